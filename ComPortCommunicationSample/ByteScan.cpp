@@ -0,0 +1,57 @@
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#define BYTESCAN_USE_SSE2
+#include <emmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+#include "ByteScan.h"
+
+#ifdef BYTESCAN_USE_SSE2
+/**
+ * 最下位の1のビット位置を得る。
+ *
+ * @param mask 0以外の値
+ * @retval ビット位置
+ */
+static inline unsigned int lowest_bit_index(uint32_t mask) noexcept {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return static_cast<unsigned int>(index);
+#else
+    return static_cast<unsigned int>(__builtin_ctz(mask));
+#endif
+}
+#endif
+
+const uint8_t* find_byte(const uint8_t* begin, const uint8_t* end, uint8_t value) noexcept {
+    const void* p = memchr(begin, value, static_cast<size_t>(end - begin));
+    return (p != nullptr) ? static_cast<const uint8_t*>(p) : end;
+}
+
+const uint8_t* find_either_byte(const uint8_t* begin, const uint8_t* end, uint8_t value1, uint8_t value2) noexcept {
+    const uint8_t* p = begin;
+#ifdef BYTESCAN_USE_SSE2
+    const __m128i pattern1 = _mm_set1_epi8(static_cast<char>(value1));
+    const __m128i pattern2 = _mm_set1_epi8(static_cast<char>(value2));
+    while ((end - p) >= 16) {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        __m128i matched = _mm_or_si128(_mm_cmpeq_epi8(block, pattern1), _mm_cmpeq_epi8(block, pattern2));
+        uint32_t mask = static_cast<uint32_t>(_mm_movemask_epi8(matched));
+        if (mask != 0) {
+            return p + lowest_bit_index(mask);
+        }
+        p += 16;
+    }
+#endif
+    for (; p < end; p++) {
+        if ((*p == value1) || (*p == value2)) {
+            break;
+        }
+    }
+    return p;
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+/**
+ * [begin, end)からvalueを探す。
+ * Cランタイムのmemchr()(ベクトル化されている)を使う。
+ *
+ * @param begin 先頭
+ * @param end 終端
+ * @param value 探すバイト
+ * @retval 見つかった位置。見つからない場合はend
+ */
+const uint8_t* find_byte(const uint8_t* begin, const uint8_t* end, uint8_t value) noexcept;
+/**
+ * [begin, end)からvalue1またはvalue2を探す。
+ * SSE2が使える環境では16バイト単位で比較する。
+ *
+ * @param begin 先頭
+ * @param end 終端
+ * @param value1 探すバイト
+ * @param value2 探すバイト
+ * @retval 最初に見つかった位置。見つからない場合はend
+ */
+const uint8_t* find_either_byte(const uint8_t* begin, const uint8_t* end, uint8_t value1, uint8_t value2) noexcept;
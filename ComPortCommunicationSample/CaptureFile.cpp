@@ -0,0 +1,284 @@
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <system_error>
+
+#ifdef _WIN32
+#include "WindowsErrorCategory.h"
+#endif
+#include "CaptureFile.h"
+
+const char CaptureFile::Magic[8] = { 'S', 'P', 'C', 'A', 'P', 'T', 'U', 'R' };
+
+/**
+ * 事前にページを確保するときの刻み[バイト]
+ */
+static const uint64_t PrefaultStride = 4096;
+
+CaptureFile::CaptureFile(const std::string& base_path, uint64_t file_size)
+    : m_base_path(base_path),
+    m_file_size((file_size > (sizeof(FileHeader) + sizeof(RecordHeader))) ? file_size : DefaultFileSize),
+    m_current(nullptr), m_spare(nullptr), m_next_index(0), m_error(0), m_is_running(false),
+    m_record_count(0), m_data_bytes(0), m_dropped_count(0), m_file_count(0) {
+}
+
+CaptureFile::~CaptureFile(void) {
+    close();
+}
+
+std::string CaptureFile::get_file_path(const std::string& base_path, uint64_t file_index) {
+    char suffix[32];
+    snprintf(suffix, sizeof(suffix), ".%04llu.cap", static_cast<unsigned long long>(file_index));
+    return base_path + suffix;
+}
+
+void CaptureFile::open(void) {
+    if (is_opened()) {
+        return;
+    }
+
+    Segment* segment;
+    int error = create_segment(0, &segment);
+    if (error != 0) {
+#ifdef _WIN32
+        throw std::system_error(error, windows_error_category());
+#else
+        throw std::system_error(error, std::generic_category());
+#endif
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_current = segment;
+        m_next_index = 1;
+        m_error = 0;
+        m_is_running = true;
+    }
+    m_thread = std::thread(&CaptureFile::manage_proc, this);
+}
+
+void CaptureFile::close(void) {
+    if (!is_opened()) {
+        return;
+    }
+    Segment* spare;
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_is_running = false;
+        if (m_current != nullptr) {
+            m_retired.push_back(m_current);
+            m_current = nullptr;
+        }
+        spare = m_spare;
+        m_spare = nullptr;
+    }
+    m_cond.notify_all();
+    m_thread.join();
+    if (spare != nullptr) {
+        close_segment(spare, true);
+    }
+}
+
+bool CaptureFile::write(uint16_t channel, Direction direction, const uint8_t* data, uint32_t length,
+    std::chrono::steady_clock::time_point timestamp) noexcept {
+    uint64_t record_length = (sizeof(RecordHeader) + static_cast<uint64_t>(length) + (RecordAlignment - 1))
+        & ~static_cast<uint64_t>(RecordAlignment - 1);
+    if ((data == nullptr) || (record_length > (m_file_size - sizeof(FileHeader)))) {
+        m_dropped_count++;
+        return false;
+    }
+
+    RecordHeader header;
+    header.timestamp_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(timestamp.time_since_epoch()).count();
+    header.length = length;
+    header.channel = channel;
+    header.direction = static_cast<uint8_t>(direction);
+    header.reserved = 0;
+
+    std::unique_lock<std::mutex> lock(m_lock);
+    Segment* segment = m_current;
+    if ((segment == nullptr) || (((*segment).offset + record_length) > (*segment).size)) { // 一杯になった？
+        // 前もって作成しておいた次のファイルに切り替え、書き終えたファイルのクローズは管理スレッドに任せる。
+        // 前回切り替えたときに次のファイルの準備が間に合わなかった場合は、準備ができていれば切り替える。
+        if (segment != nullptr) {
+            m_retired.push_back(segment);
+        }
+        segment = m_spare;
+        m_current = segment;
+        m_spare = nullptr;
+        m_cond.notify_all();
+    }
+    if (segment == nullptr) { // 次のファイルの準備が間に合わなかった？
+        lock.unlock();
+        m_dropped_count++;
+        return false;
+    }
+
+    uint8_t* p = (*segment).base + (*segment).offset;
+    memcpy(p, &header, sizeof(header));
+    memcpy(p + sizeof(header), data, length);
+    (*segment).offset += record_length;
+    // Note: 異常終了した場合でも書き込み済みの範囲が分かるよう、毎回更新する。
+    reinterpret_cast<FileHeader*>((*segment).base)->used_length = (*segment).offset;
+    lock.unlock();
+
+    m_record_count++;
+    m_data_bytes += length;
+    return true;
+}
+
+void CaptureFile::manage_proc(void) {
+    std::unique_lock<std::mutex> lock(m_lock);
+    while (true) {
+        if (!m_retired.empty()) {
+            std::vector<Segment*> retired;
+            retired.swap(m_retired);
+            lock.unlock();
+            for (Segment* segment : retired) {
+                close_segment(segment, false);
+            }
+            lock.lock();
+            continue;
+        }
+        if (!m_is_running) {
+            break;
+        }
+        if ((m_spare == nullptr) && (m_error == 0)) {
+            uint64_t file_index = m_next_index++;
+            lock.unlock();
+            Segment* segment;
+            int error = create_segment(file_index, &segment);
+            lock.lock();
+            if (error != 0) {
+                // 以降はファイルを切り替えられないため、現在のファイルが一杯になるとレコードを捨てる。
+                m_error = error;
+            }
+            else if (!m_is_running) {
+                lock.unlock();
+                close_segment(segment, true);
+                lock.lock();
+            }
+            else {
+                m_spare = segment;
+            }
+            continue;
+        }
+        m_cond.wait(lock);
+    }
+}
+
+int CaptureFile::create_segment(uint64_t file_index, Segment** psegment) {
+    std::string path = get_file_path(m_base_path, file_index);
+    uint64_t size = m_file_size;
+#ifdef _WIN32
+    HANDLE file_handle = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL,
+        CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file_handle == INVALID_HANDLE_VALUE) {
+        return static_cast<int>(GetLastError());
+    }
+    // Note: ファイルより大きいマッピングを作成すると、ファイルがそのサイズまで拡張される。
+    HANDLE mapping_handle = CreateFileMappingA(file_handle, NULL, PAGE_READWRITE,
+        static_cast<DWORD>(size >> 32), static_cast<DWORD>(size & 0xFFFFFFFF), NULL);
+    if (mapping_handle == NULL) {
+        int error = static_cast<int>(GetLastError());
+        CloseHandle(file_handle);
+        DeleteFileA(path.c_str());
+        return error;
+    }
+    void* base = MapViewOfFile(mapping_handle, FILE_MAP_WRITE, 0, 0, static_cast<SIZE_T>(size));
+    if (base == NULL) {
+        int error = static_cast<int>(GetLastError());
+        CloseHandle(mapping_handle);
+        CloseHandle(file_handle);
+        DeleteFileA(path.c_str());
+        return error;
+    }
+#else
+    int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        return errno;
+    }
+    // ディスク上の領域も確保しておく。対応していないファイルシステムでは、サイズだけ拡張する。
+    int error = posix_fallocate(fd, 0, static_cast<off_t>(size));
+    if ((error != 0) && (ftruncate(fd, static_cast<off_t>(size)) != 0)) {
+        error = errno;
+        ::close(fd);
+        unlink(path.c_str());
+        return error;
+    }
+    void* base = mmap(nullptr, static_cast<size_t>(size), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED) {
+        error = errno;
+        ::close(fd);
+        unlink(path.c_str());
+        return error;
+    }
+#endif
+
+    // 書き込み時にページフォールトで待たされないよう、全ページに触れておく。
+    volatile uint8_t* pages = static_cast<uint8_t*>(base);
+    for (uint64_t offset = 0; offset < size; offset += PrefaultStride) {
+        pages[offset] = 0;
+    }
+
+    FileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, Magic, sizeof(header.magic));
+    header.version = Version;
+    header.header_size = sizeof(FileHeader);
+    header.file_index = file_index;
+    header.system_time_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    header.steady_time_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+    header.used_length = sizeof(FileHeader);
+    memcpy(base, &header, sizeof(header));
+
+    Segment* segment = new Segment();
+#ifdef _WIN32
+    (*segment).file_handle = file_handle;
+    (*segment).mapping_handle = mapping_handle;
+#else
+    (*segment).fd = fd;
+#endif
+    (*segment).path = path;
+    (*segment).base = static_cast<uint8_t*>(base);
+    (*segment).size = size;
+    (*segment).offset = sizeof(FileHeader);
+    m_file_count++;
+    *psegment = segment;
+
+    return 0;
+}
+
+void CaptureFile::close_segment(Segment* segment, bool is_remove) {
+    uint64_t used_length = (*segment).offset;
+#ifdef _WIN32
+    UnmapViewOfFile((*segment).base);
+    CloseHandle((*segment).mapping_handle);
+    LARGE_INTEGER position;
+    position.QuadPart = static_cast<LONGLONG>(used_length);
+    if (SetFilePointerEx((*segment).file_handle, position, NULL, FILE_BEGIN)) {
+        SetEndOfFile((*segment).file_handle);
+    }
+    CloseHandle((*segment).file_handle);
+    if (is_remove) {
+        DeleteFileA((*segment).path.c_str());
+    }
+#else
+    munmap((*segment).base, static_cast<size_t>((*segment).size));
+    if (ftruncate((*segment).fd, static_cast<off_t>(used_length)) != 0) {
+        // 切り詰めに失敗しても、ファイルヘッダのused_lengthで書き込み済みの範囲は分かる。
+    }
+    ::close((*segment).fd);
+    if (is_remove) {
+        unlink((*segment).path.c_str());
+    }
+#endif
+    delete segment;
+}
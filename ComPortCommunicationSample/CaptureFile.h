@@ -0,0 +1,235 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+/**
+ * 送受信データのキャプチャファイル
+ *
+ * 送受信したデータを、タイムスタンプ・方向・チャネル番号付きのレコードとしてメモリマップしたファイルへ追記する。
+ * ファイルは作成時にfile_sizeまで確保してマップしておき、write()はマップ済みの領域へコピーするだけなので、
+ * 受信スレッドから呼び出してもファイルI/Oで待たされない。
+ * ファイルが一杯になると次のファイル(連番)に切り替える。次のファイルは管理スレッドが前もって作成しておき、
+ * 書き終えたファイルのクローズも管理スレッドで行う。
+ *
+ * ファイル名は"ベースパス.0000.cap"、"ベースパス.0001.cap"...となる。
+ * ファイルの先頭にFileHeader、続いてRecordHeaderとデータのレコードが並ぶ。
+ * レコードは8バイト境界に揃え、directionが0のレコードヘッダが終端を表す。
+ * クローズ時にはファイルサイズを書き込んだ長さに切り詰める。
+ *
+ * @note
+ * write()はどのスレッドから同時に呼び出してもよい。
+ */
+class CaptureFile
+{
+public:
+    /**
+     * データの方向
+     */
+    enum Direction {
+        DirectionRx = 1, // 受信(シリアルポート -> アプリケーション)
+        DirectionTx = 2 // 送信(アプリケーション -> シリアルポート)
+    };
+
+#pragma pack(push, 1)
+    /**
+     * ファイルヘッダ
+     */
+    struct FileHeader {
+        char magic[8]; // 識別子("SPCAPTUR")
+        uint32_t version; // フォーマットバージョン
+        uint32_t header_size; // ファイルヘッダサイズ
+        uint64_t file_index; // 連番
+        int64_t system_time_ns; // 作成時のシステム時刻(UNIXエポックからのナノ秒)
+        int64_t steady_time_ns; // 作成時のモノトニック時刻[ナノ秒] (レコードのタイムスタンプと同じ時計)
+        uint64_t used_length; // 書き込み済みの長さ(ファイルヘッダを含む)
+        uint8_t reserved[16]; // 予約
+    };
+    /**
+     * レコードヘッダ
+     */
+    struct RecordHeader {
+        int64_t timestamp_ns; // モノトニック時刻[ナノ秒] (std::chrono::steady_clock)
+        uint32_t length; // データ長
+        uint16_t channel; // チャネル番号(ポートの番号など)
+        uint8_t direction; // 方向(Direction)。0は終端。
+        uint8_t reserved; // 予約
+    };
+#pragma pack(pop)
+
+    /**
+     * ファイル識別子
+     */
+    static const char Magic[8];
+    /**
+     * フォーマットバージョン
+     */
+    static const uint32_t Version = 1;
+    /**
+     * レコードの境界[バイト]
+     */
+    static const uint32_t RecordAlignment = 8;
+    /**
+     * 1ファイルのサイズの既定値[バイト]
+     */
+    static const uint64_t DefaultFileSize = 64ull * 1024 * 1024;
+
+    /**
+     * コンストラクタ
+     *
+     * @param base_path ベースパス(".0000.cap"などを付加してファイル名にする)
+     * @param file_size 1ファイルのサイズ[バイト]
+     */
+    CaptureFile(const std::string& base_path, uint64_t file_size = DefaultFileSize);
+    /**
+     * デストラクタ
+     */
+    ~CaptureFile(void);
+
+    /**
+     * 最初のファイルを作成して、キャプチャを開始する。
+     * 失敗した場合には std::system_error を投げる。
+     */
+    void open(void);
+    /**
+     * キャプチャを終了し、ファイルをクローズする。
+     */
+    void close(void);
+    /**
+     * オープン済みかどうかを取得する。
+     *
+     * @retval true オープン済み
+     * @retval false オープンしていない
+     */
+    bool is_opened(void) const noexcept { return m_thread.joinable(); }
+
+    /**
+     * レコードを書き込む。
+     *
+     * @param channel チャネル番号
+     * @param direction 方向
+     * @param data データ
+     * @param length データ長
+     * @param timestamp タイムスタンプ
+     * @retval true 成功
+     * @retval false 失敗(オープンしていない場合、次のファイルの準備が間に合わずにレコードを捨てた場合)
+     */
+    bool write(uint16_t channel, Direction direction, const uint8_t* data, uint32_t length,
+        std::chrono::steady_clock::time_point timestamp) noexcept;
+    /**
+     * 現在時刻をタイムスタンプにしてレコードを書き込む。
+     *
+     * @param channel チャネル番号
+     * @param direction 方向
+     * @param data データ
+     * @param length データ長
+     * @retval true 成功
+     * @retval false 失敗
+     */
+    bool write(uint16_t channel, Direction direction, const uint8_t* data, uint32_t length) noexcept {
+        return write(channel, direction, data, length, std::chrono::steady_clock::now());
+    }
+
+    /**
+     * 書き込んだレコード数を得る。
+     *
+     * @retval レコード数
+     */
+    uint64_t get_record_count(void) const noexcept { return m_record_count; }
+    /**
+     * 書き込んだデータのバイト数を得る。
+     *
+     * @retval バイト数(レコードヘッダを除く)
+     */
+    uint64_t get_data_bytes(void) const noexcept { return m_data_bytes; }
+    /**
+     * 捨てたレコード数を得る。
+     *
+     * @retval レコード数
+     */
+    uint64_t get_dropped_count(void) const noexcept { return m_dropped_count; }
+    /**
+     * 作成したファイル数を得る。
+     *
+     * @retval ファイル数
+     */
+    uint64_t get_file_count(void) const noexcept { return m_file_count; }
+
+    /**
+     * キャプチャファイルのパスを得る。
+     *
+     * @param base_path ベースパス
+     * @param file_index 連番
+     * @retval パス
+     */
+    static std::string get_file_path(const std::string& base_path, uint64_t file_index);
+
+private:
+    /**
+     * マップしたファイル
+     */
+    struct Segment {
+#ifdef _WIN32
+        HANDLE file_handle; // ファイルハンドル
+        HANDLE mapping_handle; // ファイルマッピングハンドル
+#else
+        int fd; // ファイルディスクリプタ
+#endif
+        std::string path; // パス
+        uint8_t* base; // マップしたアドレス
+        uint64_t size; // ファイルサイズ
+        uint64_t offset; // 次のレコードの書き込み位置
+    };
+
+    std::string m_base_path; // ベースパス
+    uint64_t m_file_size; // 1ファイルのサイズ
+    std::mutex m_lock; // 排他ロック
+    std::condition_variable m_cond; // 管理スレッドへの通知
+    Segment* m_current; // 書き込み中のファイル
+    Segment* m_spare; // 次に使うファイル(管理スレッドが作成する)
+    std::vector<Segment*> m_retired; // 書き終えたファイル(管理スレッドがクローズする)
+    uint64_t m_next_index; // 次に作成するファイルの連番
+    int m_error; // 管理スレッドで発生したエラーのエラー番号
+    bool m_is_running; // 管理スレッドを実行中かどうか
+    std::thread m_thread; // 管理スレッド
+    std::atomic<uint64_t> m_record_count; // 書き込んだレコード数
+    std::atomic<uint64_t> m_data_bytes; // 書き込んだデータのバイト数
+    std::atomic<uint64_t> m_dropped_count; // 捨てたレコード数
+    std::atomic<uint64_t> m_file_count; // 作成したファイル数
+
+    /**
+     * 管理スレッドの処理を行う。
+     */
+    void manage_proc(void);
+    /**
+     * ファイルを作成してマップする。
+     *
+     * @param file_index 連番
+     * @param psegment 作成したファイルを格納するポインタ
+     * @retval 0 成功
+     * @retval 0以外 エラー番号(WindowsではGetLastError()、POSIXではerrnoの値)
+     */
+    int create_segment(uint64_t file_index, Segment** psegment);
+    /**
+     * ファイルを書き込んだ長さに切り詰めてクローズする。
+     *
+     * @param segment ファイル
+     * @param is_remove クローズ後にファイルを削除するかどうか(使わなかったファイルを削除する場合にtrue)
+     */
+    static void close_segment(Segment* segment, bool is_remove);
+
+    // コピーコンストラクタは使用できない。
+    CaptureFile(const CaptureFile& capture) = delete;
+    // 代入演算子は使用できない
+    CaptureFile& operator=(const CaptureFile& capture) = delete;
+};
@@ -0,0 +1,86 @@
+#include <cstring>
+#include <system_error>
+
+#include "app_error.h"
+#include "CaptureReader.h"
+
+CaptureReader::CaptureReader(const std::string& base_path)
+    : m_base_path(base_path), m_file_index(0), m_offset(0), m_used_length(0) {
+}
+
+CaptureReader::~CaptureReader(void) {
+    close();
+}
+
+void CaptureReader::open(void) {
+    close();
+    if (!open_file(0)) {
+        throw std::system_error(APP_ERROR_CAPTURE_OPEN_FAILED, app_error_category());
+    }
+}
+
+void CaptureReader::close(void) {
+    if (m_stream.is_open()) {
+        m_stream.close();
+    }
+}
+
+bool CaptureReader::read(Record* precord) {
+    while (m_stream.is_open()) {
+        if ((m_offset + sizeof(CaptureFile::RecordHeader)) <= m_used_length) {
+            CaptureFile::RecordHeader header;
+            if (!m_stream.read(reinterpret_cast<char*>(&header), sizeof(header))) {
+                throw std::system_error(APP_ERROR_INVALID_CAPTURE_FILE, app_error_category());
+            }
+            if (header.direction != 0) { // 終端ではない？
+                uint64_t record_length = (sizeof(header) + static_cast<uint64_t>(header.length) + (CaptureFile::RecordAlignment - 1))
+                    & ~static_cast<uint64_t>(CaptureFile::RecordAlignment - 1);
+                if ((m_offset + record_length) > m_used_length) {
+                    throw std::system_error(APP_ERROR_INVALID_CAPTURE_FILE, app_error_category());
+                }
+                (*precord).timestamp_ns = header.timestamp_ns;
+                (*precord).channel = header.channel;
+                (*precord).direction = static_cast<CaptureFile::Direction>(header.direction);
+                (*precord).data.resize(header.length);
+                if ((header.length > 0) && !m_stream.read(reinterpret_cast<char*>(&(*precord).data[0]), header.length)) {
+                    throw std::system_error(APP_ERROR_INVALID_CAPTURE_FILE, app_error_category());
+                }
+                // 境界合わせの詰め物を読み飛ばす。
+                m_stream.seekg(static_cast<std::streamoff>(record_length - sizeof(header) - header.length), std::ios::cur);
+                m_offset += record_length;
+                return true;
+            }
+        }
+
+        // このファイルは終わり。次の連番のファイルへ進む。
+        m_stream.close();
+        if (!open_file(m_file_index + 1)) {
+            break;
+        }
+    }
+
+    return false;
+}
+
+bool CaptureReader::open_file(uint64_t file_index) {
+    m_stream.clear();
+    m_stream.open(CaptureFile::get_file_path(m_base_path, file_index), std::ios::in | std::ios::binary);
+    if (!m_stream.is_open()) {
+        return false;
+    }
+
+    CaptureFile::FileHeader header;
+    if (!m_stream.read(reinterpret_cast<char*>(&header), sizeof(header))
+        || (memcmp(header.magic, CaptureFile::Magic, sizeof(header.magic)) != 0)
+        || (header.version != CaptureFile::Version) || (header.header_size < sizeof(header))
+        || (header.used_length < header.header_size)) {
+        m_stream.close();
+        throw std::system_error(APP_ERROR_INVALID_CAPTURE_FILE, app_error_category());
+    }
+    m_stream.seekg(static_cast<std::streamoff>(header.header_size), std::ios::beg);
+    m_file_index = file_index;
+    m_offset = header.header_size;
+    m_used_length = header.used_length;
+
+    return true;
+}
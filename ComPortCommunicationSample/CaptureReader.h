@@ -0,0 +1,89 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <fstream>
+
+#include "CaptureFile.h"
+
+/**
+ * キャプチャファイルの読み出し
+ *
+ * CaptureFileで記録した連番のファイル("ベースパス.0000.cap"から順に)を、記録順に1レコードずつ読み出す。
+ * 連番が途切れたところで終わりとする。
+ */
+class CaptureReader
+{
+public:
+    /**
+     * レコード
+     */
+    struct Record {
+        int64_t timestamp_ns; // モノトニック時刻[ナノ秒]
+        uint16_t channel; // チャネル番号
+        CaptureFile::Direction direction; // 方向
+        std::vector<uint8_t> data; // データ
+    };
+
+    /**
+     * コンストラクタ
+     *
+     * @param base_path ベースパス
+     */
+    explicit CaptureReader(const std::string& base_path);
+    /**
+     * デストラクタ
+     */
+    ~CaptureReader(void);
+
+    /**
+     * 最初のファイルをオープンする。
+     * 失敗した場合には std::system_error を投げる。
+     */
+    void open(void);
+    /**
+     * ファイルをクローズする。
+     */
+    void close(void);
+
+    /**
+     * 次のレコードを読み出す。
+     * ファイルの終わりに達すると、次の連番のファイルから読み出す。
+     * ファイルの内容が不正な場合には std::system_error を投げる。
+     *
+     * @param precord レコードを格納するポインタ
+     * @retval true 読み出した
+     * @retval false 全てのファイルの終わりに達した
+     */
+    bool read(Record* precord);
+
+    /**
+     * 読み出し中のファイルの連番を得る。
+     *
+     * @retval 連番
+     */
+    uint64_t get_file_index(void) const noexcept { return m_file_index; }
+
+private:
+    std::string m_base_path; // ベースパス
+    std::ifstream m_stream; // 読み出し中のファイル
+    uint64_t m_file_index; // 読み出し中のファイルの連番
+    uint64_t m_offset; // 読み出し中のファイルの読み出し位置
+    uint64_t m_used_length; // 読み出し中のファイルの書き込み済みの長さ
+
+    /**
+     * 連番のファイルをオープンし、ファイルヘッダを検証する。
+     *
+     * @param file_index 連番
+     * @retval true 成功
+     * @retval false ファイルが無い
+     */
+    bool open_file(uint64_t file_index);
+
+    // コピーコンストラクタは使用できない。
+    CaptureReader(const CaptureReader& reader) = delete;
+    // 代入演算子は使用できない
+    CaptureReader& operator=(const CaptureReader& reader) = delete;
+};
@@ -0,0 +1,212 @@
+#include "Crc.h"
+
+/**
+ * slicing-by-8の表
+ * values[0]は1バイト分の表、values[k]はそのバイトの後にkバイトの0が続く場合の表。
+ */
+struct CrcTable {
+    uint32_t values[8][256];
+};
+
+/**
+ * 下位widthビットを反射する(ビットの並びを逆にする)。
+ *
+ * @param value 値
+ * @param width ビット幅
+ * @retval 反射した値
+ */
+static constexpr uint32_t reflect_bits(uint32_t value, uint32_t width) {
+    uint32_t result = 0;
+    for (uint32_t i = 0; i < width; i++) {
+        if ((value & (1u << i)) != 0) {
+            result |= 1u << (width - 1 - i);
+        }
+    }
+    return result;
+}
+
+/**
+ * slicing-by-8の表を生成する。
+ * 反射しない場合は、幅が32ビットに満たないCRCも上位ビットに詰めて32ビットで計算できるようにする。
+ *
+ * @param width ビット幅
+ * @param poly 生成多項式
+ * @param is_reflected 反射するかどうか
+ * @retval 表
+ */
+static constexpr CrcTable make_table(uint32_t width, uint32_t poly, bool is_reflected) {
+    CrcTable table = {};
+    uint32_t reflected_poly = reflect_bits(poly, width);
+    uint32_t aligned_poly = poly << (32 - width);
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t crc = (is_reflected) ? i : (i << 24);
+        for (int bit = 0; bit < 8; bit++) {
+            if (is_reflected) {
+                crc = ((crc & 1) != 0) ? ((crc >> 1) ^ reflected_poly) : (crc >> 1);
+            }
+            else {
+                crc = ((crc & 0x80000000u) != 0) ? ((crc << 1) ^ aligned_poly) : (crc << 1);
+            }
+        }
+        table.values[0][i] = crc;
+    }
+    for (int k = 1; k < 8; k++) {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t prev = table.values[k - 1][i];
+            table.values[k][i] = (is_reflected) ? ((prev >> 8) ^ table.values[0][prev & 0xFF])
+                : ((prev << 8) ^ table.values[0][prev >> 24]);
+        }
+    }
+    return table;
+}
+
+/**
+ * CRCのパラメータ(Algorithmの順)
+ */
+static constexpr Crc::Parameters ParameterList[Crc::AlgorithmCount] = {
+    { "CRC-8/SMBUS", 8, 0x07, 0x00, false, 0x00, 0xF4 },
+    { "CRC-16/CCITT-FALSE", 16, 0x1021, 0xFFFF, false, 0x0000, 0x29B1 },
+    { "CRC-16/XMODEM", 16, 0x1021, 0x0000, false, 0x0000, 0x31C3 },
+    { "CRC-16/KERMIT", 16, 0x1021, 0x0000, true, 0x0000, 0x2189 },
+    { "CRC-16/MODBUS", 16, 0x8005, 0xFFFF, true, 0x0000, 0x4B37 },
+    { "CRC-32", 32, 0x04C11DB7, 0xFFFFFFFF, true, 0xFFFFFFFF, 0xCBF43926 },
+    { "CRC-32C", 32, 0x1EDC6F41, 0xFFFFFFFF, true, 0xFFFFFFFF, 0xE3069283 },
+};
+
+/**
+ * パラメータから表を生成する。
+ *
+ * @param algorithm CRCの種類
+ * @retval 表
+ */
+static constexpr CrcTable make_table(Crc::Algorithm algorithm) {
+    return make_table(ParameterList[algorithm].width, ParameterList[algorithm].poly, ParameterList[algorithm].is_reflected);
+}
+
+// Note: コンパイル時に生成させるため、表ごとにconstexpr変数にする(1つの式の評価量を抑える)。
+static constexpr CrcTable Crc8Table = make_table(Crc::AlgorithmCrc8);
+static constexpr CrcTable Crc16CcittTable = make_table(Crc::AlgorithmCrc16Ccitt);
+static constexpr CrcTable Crc16XmodemTable = make_table(Crc::AlgorithmCrc16Xmodem);
+static constexpr CrcTable Crc16KermitTable = make_table(Crc::AlgorithmCrc16Kermit);
+static constexpr CrcTable Crc16ModbusTable = make_table(Crc::AlgorithmCrc16Modbus);
+static constexpr CrcTable Crc32Table = make_table(Crc::AlgorithmCrc32);
+static constexpr CrcTable Crc32cTable = make_table(Crc::AlgorithmCrc32c);
+
+/**
+ * 表(Algorithmの順)
+ */
+static const CrcTable* const TableList[Crc::AlgorithmCount] = {
+    &Crc8Table, &Crc16CcittTable, &Crc16XmodemTable, &Crc16KermitTable, &Crc16ModbusTable, &Crc32Table, &Crc32cTable
+};
+
+static_assert(Crc16ModbusTable.values[0][1] == 0xC0C1, "CRC-16/MODBUS table is broken.");
+static_assert(Crc32Table.values[0][1] == 0x77073096, "CRC-32 table is broken.");
+
+/**
+ * リトルエンディアンの32ビット値を読み出す。
+ *
+ * @param p 読み出し元
+ * @retval 値
+ */
+static inline uint32_t load_le32(const uint8_t* p) noexcept {
+    return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8)
+        | (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+/**
+ * ビッグエンディアンの32ビット値を読み出す。
+ *
+ * @param p 読み出し元
+ * @retval 値
+ */
+static inline uint32_t load_be32(const uint8_t* p) noexcept {
+    return (static_cast<uint32_t>(p[0]) << 24) | (static_cast<uint32_t>(p[1]) << 16)
+        | (static_cast<uint32_t>(p[2]) << 8) | static_cast<uint32_t>(p[3]);
+}
+
+const Crc::Parameters& Crc::get_parameters(Algorithm algorithm) noexcept {
+    return ParameterList[algorithm];
+}
+
+uint32_t Crc::compute(Algorithm algorithm, const void* data, size_t length) noexcept {
+    Crc crc(algorithm);
+    crc.update(data, length);
+    return crc.get_value();
+}
+
+Crc::Crc(Algorithm algorithm) noexcept
+    : m_algorithm(algorithm), m_parameters(ParameterList[algorithm]), m_table((*TableList[algorithm]).values), m_register(0) {
+    reset();
+}
+
+void Crc::reset(void) noexcept {
+    if (m_parameters.is_reflected) {
+        m_register = reflect_bits(m_parameters.init, m_parameters.width);
+    }
+    else {
+        m_register = m_parameters.init << (32 - m_parameters.width);
+    }
+}
+
+void Crc::update(const void* data, size_t length) noexcept {
+    const uint8_t* p = static_cast<const uint8_t*>(data);
+    const uint32_t (*t)[256] = m_table;
+    uint32_t crc = m_register;
+    if (m_parameters.is_reflected) {
+        // 先頭のバイトが下位ビットに来るので、リトルエンディアンで読んで計算途中の値と重ねる。
+        while (length >= 8) {
+            uint32_t low = load_le32(p) ^ crc;
+            uint32_t high = load_le32(p + 4);
+            crc = t[7][low & 0xFF] ^ t[6][(low >> 8) & 0xFF] ^ t[5][(low >> 16) & 0xFF] ^ t[4][low >> 24]
+                ^ t[3][high & 0xFF] ^ t[2][(high >> 8) & 0xFF] ^ t[1][(high >> 16) & 0xFF] ^ t[0][high >> 24];
+            p += 8;
+            length -= 8;
+        }
+        while (length > 0) {
+            crc = (crc >> 8) ^ t[0][(crc ^ *p) & 0xFF];
+            p++;
+            length--;
+        }
+    }
+    else {
+        // 先頭のバイトが上位ビットに来るので、ビッグエンディアンで読んで計算途中の値と重ねる。
+        while (length >= 8) {
+            uint32_t high = load_be32(p) ^ crc;
+            uint32_t low = load_be32(p + 4);
+            crc = t[7][high >> 24] ^ t[6][(high >> 16) & 0xFF] ^ t[5][(high >> 8) & 0xFF] ^ t[4][high & 0xFF]
+                ^ t[3][low >> 24] ^ t[2][(low >> 16) & 0xFF] ^ t[1][(low >> 8) & 0xFF] ^ t[0][low & 0xFF];
+            p += 8;
+            length -= 8;
+        }
+        while (length > 0) {
+            crc = (crc << 8) ^ t[0][(crc >> 24) ^ *p];
+            p++;
+            length--;
+        }
+    }
+    m_register = crc;
+}
+
+uint32_t Crc::get_value(void) const noexcept {
+    uint32_t mask = (m_parameters.width < 32) ? ((1u << m_parameters.width) - 1) : 0xFFFFFFFFu;
+    uint32_t value = (m_parameters.is_reflected) ? m_register : (m_register >> (32 - m_parameters.width));
+    return (value ^ m_parameters.xorout) & mask;
+}
+
+void Crc::store_value(uint32_t value, uint8_t* pout) const noexcept {
+    size_t size = get_size();
+    for (size_t i = 0; i < size; i++) {
+        size_t shift = (m_parameters.is_reflected) ? i : (size - 1 - i);
+        pout[i] = static_cast<uint8_t>(value >> (shift * 8));
+    }
+}
+
+uint32_t Crc::load_value(const uint8_t* data) const noexcept {
+    size_t size = get_size();
+    uint32_t value = 0;
+    for (size_t i = 0; i < size; i++) {
+        size_t shift = (m_parameters.is_reflected) ? i : (size - 1 - i);
+        value |= static_cast<uint32_t>(data[i]) << (shift * 8);
+    }
+    return value;
+}
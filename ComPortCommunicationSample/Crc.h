@@ -0,0 +1,127 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+/**
+ * CRC計算
+ *
+ * 幅8～32ビットのCRCを、コンパイル時に生成した表を使って計算する。
+ * update()は8バイトずつ8つの表を引くslicing-by-8で処理し、8バイトに満たない端数は1バイトずつ処理する。
+ * データを分けてupdate()しても、まとめてupdate()した場合と同じ値になる。
+ *
+ * @note
+ * フレームに付けるときは、反射する(LSBファーストの)CRCはリトルエンディアン、
+ * それ以外はビッグエンディアンの順に並べるのが一般的なので、store_value()はその順で書き込む。
+ */
+class Crc
+{
+public:
+    /**
+     * CRCの種類
+     */
+    enum Algorithm {
+        AlgorithmCrc8, // CRC-8/SMBUS 多項式0x07
+        AlgorithmCrc16Ccitt, // CRC-16/CCITT-FALSE 多項式0x1021 初期値0xFFFF
+        AlgorithmCrc16Xmodem, // CRC-16/XMODEM 多項式0x1021 初期値0x0000
+        AlgorithmCrc16Kermit, // CRC-16/KERMIT 多項式0x1021 反射
+        AlgorithmCrc16Modbus, // CRC-16/MODBUS 多項式0x8005 反射 初期値0xFFFF
+        AlgorithmCrc32, // CRC-32 (IEEE 802.3, zlib) 多項式0x04C11DB7 反射
+        AlgorithmCrc32c, // CRC-32C (Castagnoli) 多項式0x1EDC6F41 反射
+        AlgorithmCount
+    };
+
+    /**
+     * CRCのパラメータ
+     */
+    struct Parameters {
+        const char* name; // 名前
+        uint32_t width; // ビット幅(8～32)
+        uint32_t poly; // 生成多項式(最上位の項を除き、反射しない表記)
+        uint32_t init; // 初期値(反射しない表記)
+        bool is_reflected; // 入力と出力を反射する(LSBファーストで計算する)かどうか
+        uint32_t xorout; // 最後にXORする値
+        uint32_t check; // "123456789"のCRC(確認用)
+    };
+
+    /**
+     * CRCのパラメータを得る。
+     *
+     * @param algorithm CRCの種類
+     * @retval パラメータ
+     */
+    static const Parameters& get_parameters(Algorithm algorithm) noexcept;
+    /**
+     * データのCRCを計算する。
+     *
+     * @param algorithm CRCの種類
+     * @param data データ
+     * @param length データのバイト数
+     * @retval CRC
+     */
+    static uint32_t compute(Algorithm algorithm, const void* data, size_t length) noexcept;
+
+    /**
+     * コンストラクタ
+     *
+     * @param algorithm CRCの種類
+     */
+    explicit Crc(Algorithm algorithm) noexcept;
+
+    /**
+     * CRCの種類を得る。
+     *
+     * @retval CRCの種類
+     */
+    Algorithm get_algorithm(void) const noexcept { return m_algorithm; }
+    /**
+     * CRCのバイト数を得る。
+     *
+     * @retval バイト数(1～4)
+     */
+    size_t get_size(void) const noexcept { return (m_parameters.width + 7) / 8; }
+
+    /**
+     * 計算途中の値を初期値に戻す。
+     */
+    void reset(void) noexcept;
+    /**
+     * データを加えて計算を進める。
+     *
+     * @param data データ
+     * @param length データのバイト数
+     */
+    void update(const void* data, size_t length) noexcept;
+    /**
+     * これまでに加えたデータのCRCを得る。
+     * 計算途中の値は変わらないので、続けてupdate()できる。
+     *
+     * @retval CRC
+     */
+    uint32_t get_value(void) const noexcept;
+    /**
+     * CRCをフレームに付ける順に書き込む。
+     *
+     * @param value CRC
+     * @param pout 書き込み先(get_size()バイト)
+     */
+    void store_value(uint32_t value, uint8_t* pout) const noexcept;
+    /**
+     * フレームに付いている順のCRCを読み出す。
+     *
+     * @param data 読み出し元(get_size()バイト)
+     * @retval CRC
+     */
+    uint32_t load_value(const uint8_t* data) const noexcept;
+
+private:
+    Algorithm m_algorithm; // CRCの種類
+    const Parameters& m_parameters; // CRCのパラメータ
+    const uint32_t (*m_table)[256]; // slicing-by-8の表(8個)
+    uint32_t m_register; // 計算途中の値(反射しない場合は上位ビットに詰める)
+
+    // コピーコンストラクタは使用できない。
+    Crc(const Crc& crc) = delete;
+    // 代入演算子は使用できない
+    Crc& operator=(const Crc& crc) = delete;
+};
@@ -0,0 +1,50 @@
+#include <cstring>
+
+#include "ByteScan.h"
+#include "CrlfNormalizer.h"
+
+const char* CrlfNormalizer::normalize(const char* data, size_t length, size_t* pout_length) {
+    const uint8_t* p = reinterpret_cast<const uint8_t*>(data);
+    const uint8_t* end = p + length;
+    if (m_is_after_cr && (p < end)) {
+        m_is_after_cr = false;
+        // 前回の末尾のCRはCR+LFとして出力済みなので、続くLFは読み飛ばす。
+        if (*p == '\n') {
+            p++;
+        }
+    }
+    const uint8_t* special = find_either_byte(p, end, '\r', '\n');
+    if (special == end) { // CR/LFを含まない？
+        (*pout_length) = static_cast<size_t>(end - p);
+        return reinterpret_cast<const char*>(p);
+    }
+
+    // Note: 全ての文字が改行でも2倍を超えない。
+    if (m_buffer.size() < (length * 2)) {
+        m_buffer.resize(length * 2);
+    }
+    char* q = m_buffer.data();
+    while (true) {
+        size_t span = static_cast<size_t>(special - p);
+        memcpy(q, p, span);
+        q += span;
+        if (special == end) {
+            break;
+        }
+        *q++ = '\r';
+        *q++ = '\n';
+        if (*special == '\r') {
+            if ((special + 1) == end) { // 末尾のCR？
+                m_is_after_cr = true;
+            }
+            else if (special[1] == '\n') { // CR+LF？
+                special++;
+            }
+        }
+        p = special + 1;
+        special = find_either_byte(p, end, '\r', '\n');
+    }
+
+    (*pout_length) = static_cast<size_t>(q - m_buffer.data());
+    return m_buffer.data();
+}
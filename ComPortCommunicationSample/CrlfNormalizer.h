@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+/**
+ * 改行コードをCR+LFに揃える変換
+ *
+ * LFのみ、CRのみの改行をCR+LFにする。
+ * 変換結果は使い回す内部バッファに書き込むので、呼び出しごとのメモリ確保は無い。
+ * CR/LFを含まないデータは、コピーせずに入力をそのまま返す。CR/LFの検索はfind_either_byte()でまとめて行う。
+ * 入力の末尾がCRで終わっている場合もすぐにCR+LFを出力し、次の入力の先頭がLFならそのLFを読み飛ばす
+ * (呼び出しをまたいだCRとLFを1つの改行として扱う)。改行の出力を次の入力まで遅らせることは無い。
+ *
+ * @note
+ * 同時に1つのスレッドからしか呼び出せない。
+ */
+class CrlfNormalizer
+{
+public:
+    /**
+     * コンストラクタ
+     */
+    CrlfNormalizer(void) : m_is_after_cr(false) { }
+
+    /**
+     * 改行コードをCR+LFに揃える。
+     *
+     * @param data 入力
+     * @param length 入力のバイト数
+     * @param pout_length 変換後のバイト数を格納する変数
+     * @retval 変換後のデータ。dataの一部か内部バッファを指し、次の呼び出しまで有効。
+     */
+    const char* normalize(const char* data, size_t length, size_t* pout_length);
+    /**
+     * 状態を初期化する。
+     */
+    void reset(void) noexcept { m_is_after_cr = false; }
+
+private:
+    std::vector<char> m_buffer; // 変換結果のバッファ
+    bool m_is_after_cr; // 直前の入力がCRで終わっていたかどうか(CR+LFとして出力済み)
+
+    // コピーコンストラクタは使用できない。
+    CrlfNormalizer(const CrlfNormalizer& normalizer) = delete;
+    // 代入演算子は使用できない
+    CrlfNormalizer& operator=(const CrlfNormalizer& normalizer) = delete;
+};
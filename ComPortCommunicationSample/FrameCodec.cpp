@@ -0,0 +1,257 @@
+#include <cstring>
+#include <algorithm>
+
+#include "ByteScan.h"
+#include "FrameCodec.h"
+
+/**
+ * COBSの区切り
+ */
+static const uint8_t CobsDelimiter = 0x00;
+/**
+ * COBSの1ブロックの最大データ長
+ */
+static const size_t CobsMaxBlockLength = 254;
+/**
+ * SLIPの特殊文字
+ */
+static const uint8_t SlipEnd = 0xC0;
+static const uint8_t SlipEsc = 0xDB;
+static const uint8_t SlipEscEnd = 0xDC;
+static const uint8_t SlipEscEsc = 0xDD;
+
+/**
+ * COBSで符号化してoutの末尾に追加する。
+ * ブロックの先頭にコードバイトの場所を確保しておき、ブロックが終わったときに書き込むので、
+ * 複数回に分けて呼び出しても続けて符号化できる。
+ *
+ * @param p データの先頭
+ * @param end データの終端
+ * @param pcode_pos 現在のブロックのコードバイトの位置(更新する)
+ * @param out 出力先
+ */
+static void encode_cobs(const uint8_t* p, const uint8_t* end, size_t* pcode_pos, std::vector<uint8_t>& out) {
+    size_t code_pos = (*pcode_pos);
+    while (p < end) {
+        const uint8_t* zero = find_byte(p, end, CobsDelimiter);
+        while (p < zero) {
+            size_t block_length = out.size() - code_pos - 1;
+            size_t length = (std::min)(static_cast<size_t>(zero - p), CobsMaxBlockLength - block_length);
+            out.insert(out.end(), p, p + length);
+            p += length;
+            if ((block_length + length) == CobsMaxBlockLength) { // ブロックが一杯？
+                out[code_pos] = 0xFF;
+                code_pos = out.size();
+                out.push_back(0);
+            }
+        }
+        if (zero < end) {
+            out[code_pos] = static_cast<uint8_t>(out.size() - code_pos);
+            code_pos = out.size();
+            out.push_back(0);
+            p = zero + 1;
+        }
+    }
+    (*pcode_pos) = code_pos;
+}
+
+/**
+ * SLIPでエスケープしてoutの末尾に追加する。
+ *
+ * @param p データの先頭
+ * @param end データの終端
+ * @param out 出力先
+ */
+static void encode_slip(const uint8_t* p, const uint8_t* end, std::vector<uint8_t>& out) {
+    while (p < end) {
+        const uint8_t* special = find_either_byte(p, end, SlipEnd, SlipEsc);
+        out.insert(out.end(), p, special);
+        if (special == end) {
+            break;
+        }
+        out.push_back(SlipEsc);
+        out.push_back((*special == SlipEnd) ? SlipEscEnd : SlipEscEsc);
+        p = special + 1;
+    }
+}
+
+FrameCodec::FrameCodec(Protocol protocol, size_t max_frame_size)
+    : m_protocol(protocol), m_max_frame_size(max_frame_size), m_is_crc_enabled(false), m_crc_algorithm(Crc::AlgorithmCrc16Ccitt),
+    m_is_started(false), m_is_discarding(false), m_block_remaining(0), m_is_zero_pending(false), m_is_escaped(false) {
+    reset_statistics();
+}
+
+void FrameCodec::feed(const uint8_t* data, size_t length) {
+    if (m_protocol == ProtocolCobs) {
+        feed_cobs(data, data + length);
+    }
+    else {
+        feed_slip(data, data + length);
+    }
+}
+
+void FrameCodec::reset(void) noexcept {
+    m_frame.clear();
+    m_is_started = false;
+    m_is_discarding = false;
+    m_block_remaining = 0;
+    m_is_zero_pending = false;
+    m_is_escaped = false;
+}
+
+void FrameCodec::reset_statistics(void) noexcept {
+    memset(&m_statistics, 0, sizeof(m_statistics));
+}
+
+void FrameCodec::feed_cobs(const uint8_t* p, const uint8_t* end) {
+    while (p < end) {
+        // 区切りの前までは0x00を含まないので、コードバイトとデータをまとめて処理できる。
+        const uint8_t* delimiter = find_byte(p, end, CobsDelimiter);
+        while (p < delimiter) {
+            if (m_block_remaining == 0) { // コードバイト？
+                if (m_is_zero_pending) {
+                    append(&CobsDelimiter, 1);
+                }
+                m_block_remaining = static_cast<uint32_t>(*p) - 1;
+                m_is_zero_pending = (*p != 0xFF);
+                m_is_started = true;
+                p++;
+            }
+            else {
+                size_t length = (std::min)(static_cast<size_t>(delimiter - p), static_cast<size_t>(m_block_remaining));
+                append(p, length);
+                m_block_remaining -= static_cast<uint32_t>(length);
+                p += length;
+            }
+        }
+        if (delimiter < end) {
+            // ブロックの途中で区切られたフレームは不正。
+            complete_frame(m_block_remaining == 0);
+            p = delimiter + 1;
+        }
+    }
+}
+
+void FrameCodec::feed_slip(const uint8_t* p, const uint8_t* end) {
+    while (p < end) {
+        if (m_is_escaped) {
+            m_is_escaped = false;
+            if (*p == SlipEscEnd) {
+                append(&SlipEnd, 1);
+            }
+            else if (*p == SlipEscEsc) {
+                append(&SlipEsc, 1);
+            }
+            else if (*p == SlipEnd) {
+                complete_frame(false);
+            }
+            else if (!m_is_discarding) { // 不正なエスケープ
+                m_statistics.error_frames++;
+                m_frame.clear();
+                m_is_discarding = true;
+            }
+            p++;
+            continue;
+        }
+
+        const uint8_t* special = find_either_byte(p, end, SlipEnd, SlipEsc);
+        if (p < special) {
+            append(p, static_cast<size_t>(special - p));
+            m_is_started = true;
+        }
+        if (special < end) {
+            if (*special == SlipEnd) {
+                complete_frame(true);
+            }
+            else {
+                m_is_escaped = true;
+                m_is_started = true;
+            }
+            special++;
+        }
+        p = special;
+    }
+}
+
+void FrameCodec::append(const uint8_t* data, size_t length) {
+    if (m_is_discarding) {
+        return;
+    }
+    if ((m_frame.size() + length) > m_max_frame_size) {
+        m_statistics.oversize_frames++;
+        m_frame.clear();
+        m_is_discarding = true;
+        return;
+    }
+    m_frame.insert(m_frame.end(), data, data + length);
+}
+
+void FrameCodec::complete_frame(bool is_valid) {
+    // Note: 捨てている途中のフレームは、捨て始めたときに数えている。
+    if (m_is_started && !m_is_discarding) {
+        size_t length = m_frame.size();
+        if (is_valid && m_is_crc_enabled) {
+            Crc crc(m_crc_algorithm);
+            if (length < crc.get_size()) {
+                m_statistics.crc_errors++;
+                is_valid = false;
+            }
+            else {
+                length -= crc.get_size();
+                crc.update(m_frame.data(), length);
+                if (crc.get_value() != crc.load_value(m_frame.data() + length)) {
+                    m_statistics.crc_errors++;
+                    is_valid = false;
+                }
+            }
+            if (!is_valid) {
+                reset();
+                return;
+            }
+        }
+        if (is_valid) {
+            m_statistics.frames++;
+            m_statistics.frame_bytes += length;
+            if (m_handler) {
+                m_handler(m_frame.data(), length);
+            }
+        }
+        else {
+            m_statistics.error_frames++;
+        }
+    }
+    reset();
+}
+
+void FrameCodec::encode(const uint8_t* data, size_t length, std::vector<uint8_t>* pout) const {
+    std::vector<uint8_t>& out = *pout;
+    uint8_t crc_bytes[4];
+    size_t crc_size = 0;
+    if (m_is_crc_enabled) {
+        Crc crc(m_crc_algorithm);
+        crc.update(data, length);
+        crc.store_value(crc.get_value(), crc_bytes);
+        crc_size = crc.get_size();
+    }
+    // Note: 最大の長さを確保しておく。続けて追加する場合も再確保が償却O(1)になるよう、倍々で拡張する。
+    size_t total_length = length + crc_size;
+    size_t max_length = (m_protocol == ProtocolCobs) ? (total_length + (total_length / CobsMaxBlockLength) + 2) : ((total_length * 2) + 2);
+    if ((out.capacity() - out.size()) < max_length) {
+        out.reserve((std::max)(out.capacity() * 2, out.size() + max_length));
+    }
+    if (m_protocol == ProtocolCobs) {
+        size_t code_pos = out.size();
+        out.push_back(0); // 最初のブロックのコードバイト
+        encode_cobs(data, data + length, &code_pos, out);
+        encode_cobs(crc_bytes, crc_bytes + crc_size, &code_pos, out);
+        out[code_pos] = static_cast<uint8_t>(out.size() - code_pos);
+        out.push_back(CobsDelimiter);
+    }
+    else {
+        // Note: 回線上のノイズを前のフレームと区切るため、先頭にも区切りを付ける(RFC 1055)。
+        out.push_back(SlipEnd);
+        encode_slip(data, data + length, out);
+        encode_slip(crc_bytes, crc_bytes + crc_size, out);
+        out.push_back(SlipEnd);
+    }
+}
@@ -0,0 +1,184 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+#include "Crc.h"
+
+/**
+ * COBS/SLIPフレームの符号化・復号
+ *
+ * 受信したバイト列をfeed()に渡すと、区切り(COBSは0x00、SLIPは0xC0)ごとに復号したフレームをハンドラに渡す。
+ * 受信データの途中で区切られていてもよい(状態は次のfeed()に引き継ぐ)。
+ * 区切りとエスケープの検索はfind_byte()/find_either_byte()でまとめて行い、区切りの間はまとめてコピーする。
+ * set_crc()でCRCを有効にすると、符号化の前にフレームの末尾へCRCを付け、復号したフレームはCRCを確認して取り除いてから渡す。
+ *
+ * @note
+ * feed()は同時に1つのスレッドからしか呼び出せない。encode()はどのスレッドから呼び出してもよい。
+ */
+class FrameCodec
+{
+public:
+    /**
+     * フレーム形式
+     */
+    enum Protocol {
+        ProtocolCobs, // COBS(Consistent Overhead Byte Stuffing) 区切りは0x00
+        ProtocolSlip // SLIP(RFC 1055) 区切りは0xC0
+    };
+
+    /**
+     * フレーム受信ハンドラ型
+     * frameはハンドラから戻るまでの間だけ有効。
+     *
+     * @param frame 復号したフレーム
+     * @param length フレームのバイト数
+     */
+    typedef std::function<void(const uint8_t* frame, size_t length)> frame_handler_t;
+
+    /**
+     * 統計
+     */
+    struct Statistics {
+        uint64_t frames; // 復号したフレーム数
+        uint64_t frame_bytes; // 復号したフレームの合計バイト数
+        uint64_t error_frames; // 形式が不正なため捨てたフレーム数
+        uint64_t oversize_frames; // 最大サイズを超えたため捨てたフレーム数
+        uint64_t crc_errors; // CRCが一致しないため捨てたフレーム数
+    };
+
+    /**
+     * 既定のフレームの最大サイズ[バイト]
+     */
+    static const size_t DefaultMaxFrameSize = 64 * 1024;
+
+    /**
+     * コンストラクタ
+     *
+     * @param protocol フレーム形式
+     * @param max_frame_size 復号後のフレームの最大サイズ[バイト](CRCを含む)
+     */
+    explicit FrameCodec(Protocol protocol, size_t max_frame_size = DefaultMaxFrameSize);
+
+    /**
+     * フレーム形式を得る。
+     *
+     * @retval フレーム形式
+     */
+    Protocol get_protocol(void) const noexcept { return m_protocol; }
+    /**
+     * フレーム受信ハンドラを設定する。
+     *
+     * @param handler ハンドラ
+     */
+    void set_handler(const frame_handler_t& handler) { m_handler = handler; }
+    /**
+     * フレームの末尾にCRCを付けるかどうかを設定する。
+     * 復号途中のフレームがある場合は、フレームの区切りで切り替えること。
+     *
+     * @param is_enabled CRCを付ける場合にはtrue
+     * @param algorithm CRCの種類
+     */
+    void set_crc(bool is_enabled, Crc::Algorithm algorithm = Crc::AlgorithmCrc16Ccitt) noexcept {
+        m_is_crc_enabled = is_enabled;
+        m_crc_algorithm = algorithm;
+    }
+    /**
+     * CRCを付けるかどうかを得る。
+     *
+     * @retval true CRCを付ける
+     * @retval false CRCを付けない
+     */
+    bool is_crc_enabled(void) const noexcept { return m_is_crc_enabled; }
+    /**
+     * CRCの種類を得る。
+     *
+     * @retval CRCの種類
+     */
+    Crc::Algorithm get_crc_algorithm(void) const noexcept { return m_crc_algorithm; }
+
+    /**
+     * 受信データを復号する。
+     * 区切りが見つかるたびにフレーム受信ハンドラを呼び出す。
+     * CRCを付ける場合は、CRCが一致したフレームだけをCRCを取り除いて渡す。
+     * 空のフレーム(連続した区切り)は無視する。
+     *
+     * @param data 受信データ
+     * @param length 受信データのバイト数
+     */
+    void feed(const uint8_t* data, size_t length);
+    /**
+     * 復号途中のフレームを捨てる。
+     */
+    void reset(void) noexcept;
+
+    /**
+     * フレームを符号化し、区切りまで含めてpoutの末尾に追加する。
+     * CRCを付ける場合は、フレームの後にCRCを続けて符号化する。
+     *
+     * @param data フレーム
+     * @param length フレームのバイト数
+     * @param pout 出力先
+     */
+    void encode(const uint8_t* data, size_t length, std::vector<uint8_t>* pout) const;
+
+    /**
+     * 統計を得る。
+     *
+     * @retval 統計
+     */
+    const Statistics& get_statistics(void) const noexcept { return m_statistics; }
+    /**
+     * 統計をクリアする。
+     */
+    void reset_statistics(void) noexcept;
+
+private:
+    Protocol m_protocol; // フレーム形式
+    size_t m_max_frame_size; // フレームの最大サイズ
+    frame_handler_t m_handler; // フレーム受信ハンドラ
+    bool m_is_crc_enabled; // CRCを付けるかどうか
+    Crc::Algorithm m_crc_algorithm; // CRCの種類
+    std::vector<uint8_t> m_frame; // 復号中のフレーム
+    bool m_is_started; // フレームの途中かどうか
+    bool m_is_discarding; // 次の区切りまで捨てるかどうか(形式不正、サイズ超過)
+    uint32_t m_block_remaining; // COBS: 現在のブロックの残りバイト数
+    bool m_is_zero_pending; // COBS: 次のブロックの前に0x00を補うかどうか
+    bool m_is_escaped; // SLIP: 直前がエスケープ(0xDB)かどうか
+    Statistics m_statistics; // 統計
+
+    /**
+     * COBSの受信データを復号する。
+     *
+     * @param p 受信データの先頭
+     * @param end 受信データの終端
+     */
+    void feed_cobs(const uint8_t* p, const uint8_t* end);
+    /**
+     * SLIPの受信データを復号する。
+     *
+     * @param p 受信データの先頭
+     * @param end 受信データの終端
+     */
+    void feed_slip(const uint8_t* p, const uint8_t* end);
+    /**
+     * 復号中のフレームに追加する。最大サイズを超える場合は次の区切りまで捨てる。
+     *
+     * @param data データ
+     * @param length バイト数
+     */
+    void append(const uint8_t* data, size_t length);
+    /**
+     * 区切りを受信したときの処理を行う。
+     *
+     * @param is_valid フレームの形式が正しいかどうか
+     */
+    void complete_frame(bool is_valid);
+
+    // コピーコンストラクタは使用できない。
+    FrameCodec(const FrameCodec& codec) = delete;
+    // 代入演算子は使用できない
+    FrameCodec& operator=(const FrameCodec& codec) = delete;
+};
@@ -0,0 +1,114 @@
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+
+#include "HexDumper.h"
+
+/**
+ * 16進数部分の幅(8バイトごとに1文字空ける)
+ */
+static const size_t HexColumnWidth = (HexDumper::BytesPerLine * 3) + 1;
+/**
+ * 行頭に付ける文字列の最大長
+ */
+static const size_t MaxPrefixLength = 32;
+/**
+ * 1行の最大長(行頭の文字列 + 16桁のオフセット + 16進数 + ASCII + 改行)
+ */
+static const size_t MaxLineLength = MaxPrefixLength + 18 + HexColumnWidth + 2 + HexDumper::BytesPerLine + 2;
+
+/**
+ * バイトを16進数2桁と表示文字に変換する表
+ */
+struct HexTable {
+    char digits[256][2]; // 16進数2桁
+    char printable[256]; // 表示文字(表示できない文字は'.')
+
+    HexTable(void) {
+        static const char HexDigits[] = "0123456789ABCDEF";
+        for (int i = 0; i < 256; i++) {
+            digits[i][0] = HexDigits[i >> 4];
+            digits[i][1] = HexDigits[i & 0x0F];
+            printable[i] = ((i >= 0x20) && (i < 0x7F)) ? static_cast<char>(i) : '.';
+        }
+    }
+};
+static const HexTable Table;
+
+HexDumper::HexDumper(size_t buffer_size)
+    : m_buffer((std::max)(buffer_size, MaxLineLength)), m_offset(0), m_base_time(std::chrono::steady_clock::now()),
+    m_is_show_offset(true), m_is_show_timestamp(false) {
+}
+
+void HexDumper::feed(const uint8_t* data, size_t length, std::chrono::steady_clock::time_point timestamp) {
+    if (length == 0) {
+        return;
+    }
+
+    // 受信時刻はfeed()ごとに1回だけ文字列にする。
+    char prefix[MaxPrefixLength];
+    size_t prefix_length = 0;
+    if (m_is_show_timestamp) {
+        double elapsed_s = std::chrono::duration<double>(timestamp - m_base_time).count();
+        int len = snprintf(prefix, sizeof(prefix), "[%12.6f] ", elapsed_s);
+        prefix_length = (len > 0) ? (std::min)(static_cast<size_t>(len), sizeof(prefix) - 1) : 0;
+    }
+
+    char* begin = m_buffer.data();
+    char* limit = begin + m_buffer.size() - MaxLineLength;
+    char* q = begin;
+    const uint8_t* p = data;
+    const uint8_t* end = data + length;
+    while (p < end) {
+        size_t count = (std::min)(static_cast<size_t>(end - p), BytesPerLine);
+        q = render_line(q, p, count, prefix, prefix_length);
+        p += count;
+        m_offset += count;
+        if ((q > limit) && (p < end)) { // 出力バッファが一杯？
+            if (m_handler) {
+                m_handler(begin, static_cast<size_t>(q - begin));
+            }
+            q = begin;
+        }
+    }
+    if (m_handler) {
+        m_handler(begin, static_cast<size_t>(q - begin));
+    }
+}
+
+void HexDumper::reset(void) noexcept {
+    m_offset = 0;
+    m_base_time = std::chrono::steady_clock::now();
+}
+
+char* HexDumper::render_line(char* q, const uint8_t* data, size_t count, const char* prefix, size_t prefix_length) const noexcept {
+    memcpy(q, prefix, prefix_length);
+    q += prefix_length;
+
+    if (m_is_show_offset) {
+        int digits = (m_offset > 0xFFFFFFFFu) ? 16 : 8;
+        for (int i = digits - 2; i >= 0; i -= 2) {
+            memcpy(q, Table.digits[(m_offset >> (i * 4)) & 0xFF], 2);
+            q += 2;
+        }
+        *q++ = ' ';
+        *q++ = ' ';
+    }
+
+    memset(q, ' ', HexColumnWidth);
+    for (size_t i = 0; i < count; i++) {
+        memcpy(q + (i * 3) + (i / 8), Table.digits[data[i]], 2);
+    }
+    q += HexColumnWidth;
+
+    *q++ = ' ';
+    *q++ = '|';
+    for (size_t i = 0; i < count; i++) {
+        q[i] = Table.printable[data[i]];
+    }
+    q += count;
+    *q++ = '|';
+    *q++ = '\n';
+
+    return q;
+}
@@ -0,0 +1,125 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <chrono>
+#include <functional>
+#include <vector>
+
+/**
+ * 受信データの16進/ASCIIダンプ表示
+ *
+ * feed()に渡した受信データを"オフセット  16進数(16バイト)  |ASCII|"の行に変換し、まとめて出力ハンドラに渡す。
+ * バイトから16進数2桁と表示文字への変換は変換表で行い、1行ずつではなく出力バッファが一杯になるまでまとめて書き込む。
+ * 表示の遅れを避けるため、受信データの末尾が16バイトに満たなくても、その行はfeed()の中で出力する
+ * (次のfeed()は新しい行から始まり、オフセットは受信データの通算の位置を示す)。
+ *
+ * @note
+ * feed()は同時に1つのスレッドからしか呼び出せない。表示設定はfeed()を呼び出していない間に変更すること。
+ */
+class HexDumper
+{
+public:
+    /**
+     * 出力ハンドラ型
+     * textはハンドラから戻るまでの間だけ有効。
+     *
+     * @param text 出力する文字列(複数行)
+     * @param length 文字列のバイト数
+     */
+    typedef std::function<void(const char* text, size_t length)> output_handler_t;
+
+    /**
+     * 1行に表示するバイト数
+     */
+    static const size_t BytesPerLine = 16;
+    /**
+     * 既定の出力バッファのサイズ[バイト]
+     */
+    static const size_t DefaultBufferSize = 64 * 1024;
+
+    /**
+     * コンストラクタ
+     *
+     * @param buffer_size 出力バッファのサイズ[バイト]。これを超える分は複数回に分けてハンドラに渡す。
+     */
+    explicit HexDumper(size_t buffer_size = DefaultBufferSize);
+
+    /**
+     * 出力ハンドラを設定する。
+     *
+     * @param handler ハンドラ
+     */
+    void set_handler(const output_handler_t& handler) { m_handler = handler; }
+    /**
+     * 行頭にオフセットを表示するかどうかを設定する。
+     *
+     * @param is_show 表示する場合にはtrue
+     */
+    void set_show_offset(bool is_show) noexcept { m_is_show_offset = is_show; }
+    /**
+     * オフセットを表示するかどうかを得る。
+     *
+     * @retval true 表示する
+     * @retval false 表示しない
+     */
+    bool is_show_offset(void) const noexcept { return m_is_show_offset; }
+    /**
+     * 行頭に受信時刻(reset()からの経過秒)を表示するかどうかを設定する。
+     *
+     * @param is_show 表示する場合にはtrue
+     */
+    void set_show_timestamp(bool is_show) noexcept { m_is_show_timestamp = is_show; }
+    /**
+     * 受信時刻を表示するかどうかを得る。
+     *
+     * @retval true 表示する
+     * @retval false 表示しない
+     */
+    bool is_show_timestamp(void) const noexcept { return m_is_show_timestamp; }
+
+    /**
+     * 受信データをダンプ表示する。
+     *
+     * @param data 受信データ
+     * @param length 受信データのバイト数
+     * @param timestamp 受信時刻
+     */
+    void feed(const uint8_t* data, size_t length, std::chrono::steady_clock::time_point timestamp);
+    /**
+     * オフセットを0に戻し、受信時刻の基準を現在時刻にする。
+     */
+    void reset(void) noexcept;
+
+    /**
+     * 次に表示するオフセット(これまでに表示したバイト数)を得る。
+     *
+     * @retval オフセット
+     */
+    uint64_t get_offset(void) const noexcept { return m_offset; }
+
+private:
+    output_handler_t m_handler; // 出力ハンドラ
+    std::vector<char> m_buffer; // 出力バッファ
+    uint64_t m_offset; // 次に表示するオフセット
+    std::chrono::steady_clock::time_point m_base_time; // 受信時刻の基準
+    bool m_is_show_offset; // オフセットを表示するかどうか
+    bool m_is_show_timestamp; // 受信時刻を表示するかどうか
+
+    /**
+     * 1行分を書き込む。
+     *
+     * @param q 書き込み先(行の最大長以上の空きがあること)
+     * @param data 行のデータ
+     * @param count 行のバイト数(1以上、BytesPerLine以下)
+     * @param prefix 行頭に付ける文字列(受信時刻)
+     * @param prefix_length 行頭に付ける文字列のバイト数
+     * @retval 書き込んだ次の位置
+     */
+    char* render_line(char* q, const uint8_t* data, size_t count, const char* prefix, size_t prefix_length) const noexcept;
+
+    // コピーコンストラクタは使用できない。
+    HexDumper(const HexDumper& dumper) = delete;
+    // 代入演算子は使用できない
+    HexDumper& operator=(const HexDumper& dumper) = delete;
+};
@@ -0,0 +1,116 @@
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#include <cstdio>
+#include <cmath>
+
+#include "LatencyHistogram.h"
+
+/**
+ * 最上位の1のビット位置を得る。
+ *
+ * @param value 値(0以外)
+ * @retval ビット位置(0～63)
+ */
+static uint32_t get_msb_index(uint64_t value) noexcept {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanReverse64(&index, value);
+    return static_cast<uint32_t>(index);
+#else
+    return 63u - static_cast<uint32_t>(__builtin_clzll(value));
+#endif
+}
+
+LatencyHistogram::LatencyHistogram(const char* name)
+    : m_name(name) {
+    reset();
+}
+
+void LatencyHistogram::record(uint64_t value) noexcept {
+    m_buckets[get_bucket_index(value)].fetch_add(1, std::memory_order_relaxed);
+    m_count.fetch_add(1, std::memory_order_relaxed);
+    m_sum.fetch_add(value, std::memory_order_relaxed);
+
+    uint64_t current = m_min.load(std::memory_order_relaxed);
+    while ((value < current) && !m_min.compare_exchange_weak(current, value, std::memory_order_relaxed)) {
+    }
+    current = m_max.load(std::memory_order_relaxed);
+    while ((value > current) && !m_max.compare_exchange_weak(current, value, std::memory_order_relaxed)) {
+    }
+}
+
+void LatencyHistogram::record(std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end) noexcept {
+    auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+    record((elapsed > 0) ? static_cast<uint64_t>(elapsed) : 0);
+}
+
+void LatencyHistogram::reset(void) noexcept {
+    for (auto& bucket : m_buckets) {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+    m_count.store(0, std::memory_order_relaxed);
+    m_sum.store(0, std::memory_order_relaxed);
+    m_min.store(UINT64_MAX, std::memory_order_relaxed);
+    m_max.store(0, std::memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::get_min(void) const noexcept {
+    return (get_count() > 0) ? m_min.load(std::memory_order_relaxed) : 0;
+}
+
+double LatencyHistogram::get_mean(void) const noexcept {
+    uint64_t count = get_count();
+    return (count > 0) ? (static_cast<double>(m_sum.load(std::memory_order_relaxed)) / count) : 0.0;
+}
+
+uint64_t LatencyHistogram::get_percentile(double percent) const noexcept {
+    uint64_t count = get_count();
+    if (count == 0) {
+        return 0;
+    }
+    uint64_t rank = static_cast<uint64_t>(std::ceil(percent / 100.0 * count));
+    if (rank == 0) {
+        rank = 1;
+    }
+    uint64_t accumulated = 0;
+    for (uint32_t i = 0; i < BucketCount; i++) {
+        accumulated += m_buckets[i].load(std::memory_order_relaxed);
+        if (accumulated >= rank) {
+            // バケットの上限値は実際の最大値を超えることがあるので、最大値で制限する。
+            uint64_t upper = get_bucket_upper_bound(i);
+            uint64_t max = get_max();
+            return (upper < max) ? upper : max;
+        }
+    }
+    return get_max();
+}
+
+std::string LatencyHistogram::format_summary(void) const {
+    char buf[256];
+    snprintf(buf, sizeof(buf),
+        "%s: count=%llu min=%.1fus p50=%.1fus p90=%.1fus p99=%.1fus p99.9=%.1fus max=%.1fus mean=%.1fus",
+        m_name, static_cast<unsigned long long>(get_count()), get_min() / 1000.0,
+        get_percentile(50.0) / 1000.0, get_percentile(90.0) / 1000.0, get_percentile(99.0) / 1000.0,
+        get_percentile(99.9) / 1000.0, get_max() / 1000.0, get_mean() / 1000.0);
+    return std::string(buf);
+}
+
+uint32_t LatencyHistogram::get_bucket_index(uint64_t value) noexcept {
+    if (value < SubBucketCount) { // 最初の区間は値そのものをバケット番号にする。
+        return static_cast<uint32_t>(value);
+    }
+    uint32_t shift = get_msb_index(value) - SubBucketBits;
+    uint32_t sub_index = static_cast<uint32_t>(value >> shift) - SubBucketCount;
+    return (shift + 1) * SubBucketCount + sub_index;
+}
+
+uint64_t LatencyHistogram::get_bucket_upper_bound(uint32_t index) noexcept {
+    if (index < SubBucketCount) {
+        return index;
+    }
+    uint32_t shift = (index / SubBucketCount) - 1;
+    uint64_t sub_index = index % SubBucketCount;
+    uint64_t lower = (SubBucketCount + sub_index) << shift;
+    return lower + ((static_cast<uint64_t>(1) << shift) - 1);
+}
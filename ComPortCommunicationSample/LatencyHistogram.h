@@ -0,0 +1,135 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+#include <chrono>
+#include <string>
+
+/**
+ * 対数バケットの遅延ヒストグラム(HDR Histogram形式)
+ *
+ * 値を2のべき乗の区間に分け、各区間をさらにSubBucketCount個に等分したバケットで数える。
+ * 相対誤差は1/SubBucketCount以下で、値の範囲によらずメモリ量が一定になる。
+ * record()はロックを取らないので、計測対象のスレッドから呼び出しても負荷は小さい。
+ *
+ * @note
+ * record()はどのスレッドから同時に呼び出してもよい。
+ * 集計(get_xxx, format_summary)は記録中に呼び出してもよいが、結果は近似値になる。
+ */
+class LatencyHistogram
+{
+public:
+    /**
+     * 1区間あたりのバケット数のビット数
+     */
+    static const uint32_t SubBucketBits = 4;
+    /**
+     * 1区間あたりのバケット数
+     */
+    static const uint32_t SubBucketCount = 1u << SubBucketBits;
+    /**
+     * バケット数
+     */
+    static const uint32_t BucketCount = (64 - SubBucketBits + 1) * SubBucketCount;
+
+    /**
+     * コンストラクタ
+     *
+     * @param name 名前
+     */
+    explicit LatencyHistogram(const char* name);
+
+    /**
+     * 名前を得る。
+     *
+     * @retval 名前
+     */
+    const char* get_name(void) const noexcept { return m_name; }
+
+    /**
+     * 値を記録する。
+     *
+     * @param value 値[ナノ秒]
+     */
+    void record(uint64_t value) noexcept;
+    /**
+     * 2つの時刻の間隔を記録する。
+     *
+     * @param start 開始時刻
+     * @param end 終了時刻(開始時刻より前の場合は0として記録する)
+     */
+    void record(std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end) noexcept;
+    /**
+     * 記録をクリアする。
+     */
+    void reset(void) noexcept;
+
+    /**
+     * 記録数を得る。
+     *
+     * @retval 記録数
+     */
+    uint64_t get_count(void) const noexcept { return m_count.load(std::memory_order_relaxed); }
+    /**
+     * 最小値を得る。
+     *
+     * @retval 最小値[ナノ秒] (記録が無い場合は0)
+     */
+    uint64_t get_min(void) const noexcept;
+    /**
+     * 最大値を得る。
+     *
+     * @retval 最大値[ナノ秒]
+     */
+    uint64_t get_max(void) const noexcept { return m_max.load(std::memory_order_relaxed); }
+    /**
+     * 平均値を得る。
+     *
+     * @retval 平均値[ナノ秒] (記録が無い場合は0)
+     */
+    double get_mean(void) const noexcept;
+    /**
+     * パーセンタイル値を得る。
+     * 該当するバケットの上限値を返す。
+     *
+     * @param percent パーセント(0～100)
+     * @retval パーセンタイル値[ナノ秒] (記録が無い場合は0)
+     */
+    uint64_t get_percentile(double percent) const noexcept;
+    /**
+     * 集計結果を1行の文字列にする。
+     * "名前: count=N min=.. p50=.. p90=.. p99=.. p99.9=.. max=.. mean=.."の形式(単位はマイクロ秒)。
+     *
+     * @retval 集計結果
+     */
+    std::string format_summary(void) const;
+
+private:
+    const char* m_name; // 名前
+    std::atomic<uint64_t> m_buckets[BucketCount]; // バケットごとの記録数
+    std::atomic<uint64_t> m_count; // 記録数
+    std::atomic<uint64_t> m_sum; // 合計値
+    std::atomic<uint64_t> m_min; // 最小値
+    std::atomic<uint64_t> m_max; // 最大値
+
+    /**
+     * 値に対応するバケット番号を得る。
+     *
+     * @param value 値
+     * @retval バケット番号
+     */
+    static uint32_t get_bucket_index(uint64_t value) noexcept;
+    /**
+     * バケットに入る値の上限を得る。
+     *
+     * @param index バケット番号
+     * @retval 上限値
+     */
+    static uint64_t get_bucket_upper_bound(uint32_t index) noexcept;
+
+    // コピーコンストラクタは使用できない。
+    LatencyHistogram(const LatencyHistogram& histogram) = delete;
+    // 代入演算子は使用できない
+    LatencyHistogram& operator=(const LatencyHistogram& histogram) = delete;
+};
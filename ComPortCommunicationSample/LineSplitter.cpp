@@ -0,0 +1,71 @@
+#include <cstring>
+
+#include "ByteScan.h"
+#include "LineSplitter.h"
+
+LineSplitter::LineSplitter(size_t max_line_length, bool is_strip_cr)
+    : m_max_line_length((max_line_length > 0) ? max_line_length : DefaultMaxLineLength), m_is_strip_cr(is_strip_cr) {
+    memset(&m_statistics, 0, sizeof(m_statistics));
+}
+
+void LineSplitter::feed(const uint8_t* data, size_t length) {
+    const uint8_t* p = data;
+    const uint8_t* end = data + length;
+    while (p < end) {
+        const uint8_t* lf = find_byte(p, end, '\n');
+        const char* line = reinterpret_cast<const char*>(p);
+        size_t line_length = static_cast<size_t>(lf - p);
+        if (lf == end) { // 改行はまだ来ていない？
+            append_pending(line, line_length);
+            break;
+        }
+
+        if (m_pending.empty()) {
+            // 受信データの中で完結している行は、そのまま渡す。
+            while (line_length > m_max_line_length) {
+                emit(line, m_max_line_length, false);
+                m_statistics.split_lines++;
+                line += m_max_line_length;
+                line_length -= m_max_line_length;
+            }
+            emit(line, line_length, true);
+        }
+        else {
+            append_pending(line, line_length);
+            emit(m_pending.data(), m_pending.size(), true);
+            m_statistics.carried_lines++;
+            m_pending.clear();
+        }
+        p = lf + 1;
+    }
+}
+
+void LineSplitter::flush(void) {
+    if (!m_pending.empty()) {
+        emit(m_pending.data(), m_pending.size(), false);
+        m_pending.clear();
+    }
+}
+
+void LineSplitter::append_pending(const char* data, size_t length) {
+    while ((m_pending.size() + length) > m_max_line_length) {
+        size_t room = m_max_line_length - m_pending.size();
+        m_pending.insert(m_pending.end(), data, data + room);
+        emit(m_pending.data(), m_pending.size(), false);
+        m_statistics.split_lines++;
+        m_pending.clear();
+        data += room;
+        length -= room;
+    }
+    m_pending.insert(m_pending.end(), data, data + length);
+}
+
+void LineSplitter::emit(const char* line, size_t length, bool is_complete) {
+    if (is_complete && m_is_strip_cr && (length > 0) && (line[length - 1] == '\r')) {
+        length--;
+    }
+    m_statistics.lines++;
+    if (m_handler) {
+        m_handler(line, length, is_complete);
+    }
+}
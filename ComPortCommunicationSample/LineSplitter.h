@@ -0,0 +1,116 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+/**
+ * 受信データの行分割
+ *
+ * 受信データをfeed()に渡すと、改行('\n')ごとに行をハンドラに渡す。
+ * 改行はfind_byte()でまとめて検索し、受信データの中で完結している行は受信データを指したまま(コピーせずに)渡す。
+ * 受信データの境界をまたぐ行だけを内部のバッファに連結してから渡す。
+ *
+ * @note
+ * feed()は同時に1つのスレッドからしか呼び出せない。
+ */
+class LineSplitter
+{
+public:
+    /**
+     * 行受信ハンドラ型
+     * lineはハンドラから戻るまでの間だけ有効。改行(と直前の'\r')は含まない。
+     *
+     * @param line 行
+     * @param length 行のバイト数
+     * @param is_complete 改行まで受信した行ならtrue、最大長で区切った行やflush()した行ならfalse
+     */
+    typedef std::function<void(const char* line, size_t length, bool is_complete)> line_handler_t;
+
+    /**
+     * 統計
+     */
+    struct Statistics {
+        uint64_t lines; // 渡した行数
+        uint64_t carried_lines; // 受信データの境界をまたいだため連結した行数
+        uint64_t split_lines; // 最大長を超えたため区切った回数
+    };
+
+    /**
+     * 既定の1行の最大長[バイト]
+     */
+    static const size_t DefaultMaxLineLength = 4096;
+
+    /**
+     * コンストラクタ
+     *
+     * @param max_line_length 1行の最大長[バイト]。これを超えると改行が無くても区切る。
+     * @param is_strip_cr 行末の'\r'を取り除くかどうか
+     */
+    explicit LineSplitter(size_t max_line_length = DefaultMaxLineLength, bool is_strip_cr = true);
+
+    /**
+     * 行受信ハンドラを設定する。
+     *
+     * @param handler ハンドラ
+     */
+    void set_handler(const line_handler_t& handler) { m_handler = handler; }
+
+    /**
+     * 受信データを行に分割する。
+     *
+     * @param data 受信データ
+     * @param length 受信データのバイト数
+     */
+    void feed(const uint8_t* data, size_t length);
+    /**
+     * 改行を受信していない行があれば、ハンドラに渡す。
+     */
+    void flush(void);
+    /**
+     * 改行を受信していない行を捨てる。
+     */
+    void reset(void) noexcept { m_pending.clear(); }
+
+    /**
+     * 改行を受信していない行のバイト数を得る。
+     *
+     * @retval バイト数
+     */
+    size_t get_pending_length(void) const noexcept { return m_pending.size(); }
+    /**
+     * 統計を得る。
+     *
+     * @retval 統計
+     */
+    const Statistics& get_statistics(void) const noexcept { return m_statistics; }
+
+private:
+    size_t m_max_line_length; // 1行の最大長
+    bool m_is_strip_cr; // 行末の'\r'を取り除くかどうか
+    line_handler_t m_handler; // 行受信ハンドラ
+    std::vector<char> m_pending; // 改行を受信していない行
+    Statistics m_statistics; // 統計
+
+    /**
+     * 改行を受信していない行に追加する。最大長に達した分はハンドラに渡す。
+     *
+     * @param data データ
+     * @param length バイト数
+     */
+    void append_pending(const char* data, size_t length);
+    /**
+     * ハンドラに行を渡す。
+     *
+     * @param line 行
+     * @param length 行のバイト数
+     * @param is_complete 改行まで受信した行かどうか
+     */
+    void emit(const char* line, size_t length, bool is_complete);
+
+    // コピーコンストラクタは使用できない。
+    LineSplitter(const LineSplitter& splitter) = delete;
+    // 代入演算子は使用できない
+    LineSplitter& operator=(const LineSplitter& splitter) = delete;
+};
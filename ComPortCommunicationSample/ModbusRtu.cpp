@@ -0,0 +1,79 @@
+#include "ModbusRtu.h"
+#include "Crc.h"
+
+uint32_t ModbusRtu::get_char_time_micros(uint32_t baudrate, uint8_t databits, bool has_parity, uint32_t stopbits) noexcept {
+    if (baudrate == 0) {
+        return 0;
+    }
+    uint32_t bits = 1 + databits + (has_parity ? 1 : 0) + stopbits;
+    return static_cast<uint32_t>((static_cast<uint64_t>(bits) * 1000000 + baudrate - 1) / baudrate);
+}
+
+uint32_t ModbusRtu::get_frame_gap_micros(uint32_t baudrate, uint8_t databits, bool has_parity, uint32_t stopbits) noexcept {
+    if ((baudrate == 0) || (baudrate > 19200)) {
+        return FixedFrameGapMicros;
+    }
+    return (get_char_time_micros(baudrate, databits, has_parity, stopbits) * 7 + 1) / 2;
+}
+
+void ModbusRtu::append_crc(std::vector<uint8_t>* pout, size_t frame_offset) {
+    Crc crc(Crc::AlgorithmCrc16Modbus);
+    crc.update((*pout).data() + frame_offset, (*pout).size() - frame_offset);
+    uint8_t value[2];
+    crc.store_value(crc.get_value(), value);
+    (*pout).insert((*pout).end(), value, value + sizeof(value));
+}
+
+bool ModbusRtu::check_crc(const uint8_t* frame, size_t length) noexcept {
+    if (length < 4) { // アドレス、ファンクションコード、CRCに満たない？
+        return false;
+    }
+    Crc crc(Crc::AlgorithmCrc16Modbus);
+    crc.update(frame, length - 2);
+    return crc.get_value() == crc.load_value(frame + length - 2);
+}
+
+size_t ModbusRtu::get_request_length(const uint8_t* data, size_t length) noexcept {
+    if (length < 2) {
+        return LengthUnknown;
+    }
+    switch (data[1]) {
+    case FunctionReadCoils:
+    case FunctionReadDiscreteInputs:
+    case FunctionReadHoldingRegisters:
+    case FunctionReadInputRegisters:
+    case FunctionWriteSingleCoil:
+    case FunctionWriteSingleRegister:
+        return 8; // アドレス、ファンクションコード、開始アドレス、数(値)、CRC
+    case FunctionWriteMultipleCoils:
+    case FunctionWriteMultipleRegisters:
+        // バイト数(7バイト目)に続けて値が並ぶ。
+        return (length >= 7) ? (9 + static_cast<size_t>(data[6])) : LengthUnknown;
+    default:
+        return LengthUnknown;
+    }
+}
+
+size_t ModbusRtu::get_response_length(const uint8_t* data, size_t length) noexcept {
+    if (length < 2) {
+        return LengthUnknown;
+    }
+    if ((data[1] & ExceptionFlag) != 0) { // 例外応答？
+        return 5; // アドレス、ファンクションコード、例外コード、CRC
+    }
+    switch (data[1]) {
+    case FunctionReadCoils:
+    case FunctionReadDiscreteInputs:
+    case FunctionReadHoldingRegisters:
+    case FunctionReadInputRegisters:
+        // バイト数(3バイト目)に続けて値が並ぶ。
+        return (length >= 3) ? (5 + static_cast<size_t>(data[2])) : LengthUnknown;
+    case FunctionWriteSingleCoil:
+    case FunctionWriteSingleRegister:
+    case FunctionWriteMultipleCoils:
+    case FunctionWriteMultipleRegisters:
+        return 8; // アドレス、ファンクションコード、開始アドレス、数(値)、CRC
+    default:
+        return LengthUnknown;
+    }
+}
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+/**
+ * Modbus RTUのフレームに関する定数と関数
+ *
+ * Modbus RTUのフレームは、スレーブアドレス、ファンクションコード、データ、CRC-16/MODBUS(リトルエンディアン)からなる。
+ * フレームの間は3.5文字分以上の無通信時間(t3.5)を空ける。19200bpsを超える場合は1750マイクロ秒に固定する。
+ * ModbusRtuMaster(マスター)とModbusSlaveSimulator(スレーブの模擬)で共用する。
+ */
+class ModbusRtu
+{
+public:
+    static const uint8_t FunctionReadCoils = 0x01; // コイル読み出し
+    static const uint8_t FunctionReadDiscreteInputs = 0x02; // 入力ステータス読み出し
+    static const uint8_t FunctionReadHoldingRegisters = 0x03; // 保持レジスタ読み出し
+    static const uint8_t FunctionReadInputRegisters = 0x04; // 入力レジスタ読み出し
+    static const uint8_t FunctionWriteSingleCoil = 0x05; // コイル1点書き込み
+    static const uint8_t FunctionWriteSingleRegister = 0x06; // 保持レジスタ1点書き込み
+    static const uint8_t FunctionWriteMultipleCoils = 0x0F; // コイル複数点書き込み
+    static const uint8_t FunctionWriteMultipleRegisters = 0x10; // 保持レジスタ複数点書き込み
+    /**
+     * 例外応答でファンクションコードに付けるビット
+     */
+    static const uint8_t ExceptionFlag = 0x80;
+
+    static const uint8_t ExceptionIllegalFunction = 0x01; // 不正なファンクションコード
+    static const uint8_t ExceptionIllegalDataAddress = 0x02; // 不正なアドレス
+    static const uint8_t ExceptionIllegalDataValue = 0x03; // 不正な値
+
+    /**
+     * ブロードキャストのスレーブアドレス(応答しない)
+     */
+    static const uint8_t BroadcastAddress = 0;
+    /**
+     * フレームの最大サイズ[バイト]
+     */
+    static const size_t MaxFrameSize = 256;
+    /**
+     * レジスタ読み出しの最大数
+     */
+    static const uint16_t MaxReadRegisters = 125;
+    /**
+     * レジスタ書き込みの最大数
+     */
+    static const uint16_t MaxWriteRegisters = 123;
+    /**
+     * コイル読み出しの最大数
+     */
+    static const uint16_t MaxReadBits = 2000;
+    /**
+     * コイル書き込みの最大数
+     */
+    static const uint16_t MaxWriteBits = 1968;
+    /**
+     * 19200bpsを超える場合のフレーム間の無通信時間[マイクロ秒]
+     */
+    static const uint32_t FixedFrameGapMicros = 1750;
+    /**
+     * フレームの長さを先頭から判断できないことを表すget_request_length(), get_response_length()の戻り値
+     */
+    static const size_t LengthUnknown = 0;
+
+    /**
+     * 1文字の送信時間[マイクロ秒]を得る。
+     * スタートビット、データビット、パリティビット、ストップビットを数える(1.5ストップビットは2ビットとして数える)。
+     *
+     * @param baudrate ボーレート
+     * @param databits データビット数
+     * @param has_parity パリティビットがあるかどうか
+     * @param stopbits ストップビット数(1または2)
+     * @retval 送信時間[マイクロ秒](切り上げ)
+     */
+    static uint32_t get_char_time_micros(uint32_t baudrate, uint8_t databits, bool has_parity, uint32_t stopbits) noexcept;
+    /**
+     * フレーム間の無通信時間(t3.5)[マイクロ秒]を得る。
+     *
+     * @param baudrate ボーレート
+     * @param databits データビット数
+     * @param has_parity パリティビットがあるかどうか
+     * @param stopbits ストップビット数(1または2)
+     * @retval 無通信時間[マイクロ秒]
+     */
+    static uint32_t get_frame_gap_micros(uint32_t baudrate, uint8_t databits, bool has_parity, uint32_t stopbits) noexcept;
+
+    /**
+     * フレームの末尾にCRCを付ける。
+     * 複数のフレームを続けて格納できるよう、frame_offsetより後ろだけをフレームとみなす。
+     *
+     * @param pout フレームの格納先(末尾にCRCを追加する)
+     * @param frame_offset フレームの先頭の位置
+     */
+    static void append_crc(std::vector<uint8_t>* pout, size_t frame_offset = 0);
+    /**
+     * フレームの末尾のCRCを確認する。
+     *
+     * @param frame フレーム(CRCを含む)
+     * @param length フレームのバイト数
+     * @retval true CRCが一致した
+     * @retval false CRCが一致しない、または短すぎる
+     */
+    static bool check_crc(const uint8_t* frame, size_t length) noexcept;
+
+    /**
+     * 要求フレームの先頭から、要求フレーム全体のバイト数(CRCを含む)を得る。
+     *
+     * @param data 受信済みの先頭部分
+     * @param length 受信済みのバイト数
+     * @retval LengthUnknown以外 要求フレームのバイト数
+     * @retval LengthUnknown 受信済みの部分では判断できない(未対応のファンクションコードを含む)
+     */
+    static size_t get_request_length(const uint8_t* data, size_t length) noexcept;
+    /**
+     * 応答フレームの先頭から、応答フレーム全体のバイト数(CRCを含む)を得る。
+     * 先頭3バイトあれば判断できる。
+     *
+     * @param data 受信済みの先頭部分
+     * @param length 受信済みのバイト数
+     * @retval LengthUnknown以外 応答フレームのバイト数
+     * @retval LengthUnknown 受信済みの部分では判断できない(未対応のファンクションコードを含む)
+     */
+    static size_t get_response_length(const uint8_t* data, size_t length) noexcept;
+};
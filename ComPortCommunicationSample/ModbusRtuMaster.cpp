@@ -0,0 +1,422 @@
+#include <algorithm>
+#include <thread>
+
+#include "ModbusRtuMaster.h"
+
+/**
+ * 16ビット値をビッグエンディアンで追加する。
+ *
+ * @param out 出力先
+ * @param value 値
+ */
+static void append_be16(std::vector<uint8_t>& out, uint16_t value) {
+    out.push_back(static_cast<uint8_t>(value >> 8));
+    out.push_back(static_cast<uint8_t>(value));
+}
+
+/**
+ * 16ビット値をビッグエンディアンで読み出す。
+ *
+ * @param p 読み出し元
+ * @retval 値
+ */
+static inline uint16_t load_be16(const uint8_t* p) noexcept {
+    return static_cast<uint16_t>((p[0] << 8) | p[1]);
+}
+
+/**
+ * ポートのストップビット数を得る(1.5ストップビットは2ビットとして数える)。
+ *
+ * @param port シリアルポート
+ * @retval ストップビット数
+ */
+static uint32_t get_stopbit_count(const SerialPort& port) noexcept {
+    return (port.get_stopbits() == SerialPort::StopBitsOne) ? 1 : 2;
+}
+
+/**
+ * ポートの設定から1文字の送信時間を得る。
+ *
+ * @param port シリアルポート
+ * @retval 送信時間[マイクロ秒]
+ */
+static uint32_t get_char_time_micros(const SerialPort& port) noexcept {
+    return ModbusRtu::get_char_time_micros(port.get_baudrate(), port.get_databits(),
+        port.get_parity() != SerialPort::ParityNone, get_stopbit_count(port));
+}
+
+/**
+ * 期限までの残り時間をミリ秒に切り上げて得る。
+ *
+ * @param deadline 期限
+ * @retval 残り時間[ミリ秒](期限を過ぎている場合は0)
+ */
+static int get_remain_millis(const std::chrono::steady_clock::time_point& deadline) {
+    auto remain = std::chrono::duration_cast<std::chrono::microseconds>(deadline - std::chrono::steady_clock::now()).count();
+    return (remain > 0) ? static_cast<int>((remain + 999) / 1000) : 0;
+}
+
+ModbusRtuMaster::ModbusRtuMaster(SerialPort& port)
+    : m_port(port), m_timeout_millis(DefaultTimeoutMillis), m_frame_detection(FrameDetectionLength),
+    m_bus_idle_time(), m_response(), m_statistics(), m_latency("modbus.transaction") {
+}
+
+bool ModbusRtuMaster::encode_request(const Request& request, std::vector<uint8_t>* pout) {
+    if (pout == nullptr) {
+        return false;
+    }
+
+    bool is_broadcast = (request.slave_id == ModbusRtu::BroadcastAddress);
+    std::vector<uint8_t>& out = *pout;
+    size_t frame_offset = out.size();
+    out.push_back(request.slave_id);
+    out.push_back(request.function);
+    append_be16(out, request.address);
+    bool is_valid = true;
+    switch (request.function) {
+    case ModbusRtu::FunctionReadCoils:
+    case ModbusRtu::FunctionReadDiscreteInputs:
+        is_valid = !is_broadcast && (request.count > 0) && (request.count <= ModbusRtu::MaxReadBits);
+        append_be16(out, request.count);
+        break;
+    case ModbusRtu::FunctionReadHoldingRegisters:
+    case ModbusRtu::FunctionReadInputRegisters:
+        is_valid = !is_broadcast && (request.count > 0) && (request.count <= ModbusRtu::MaxReadRegisters);
+        append_be16(out, request.count);
+        break;
+    case ModbusRtu::FunctionWriteSingleCoil:
+        is_valid = !request.values.empty();
+        append_be16(out, (is_valid && (request.values[0] != 0)) ? 0xFF00 : 0x0000);
+        break;
+    case ModbusRtu::FunctionWriteSingleRegister:
+        is_valid = !request.values.empty();
+        append_be16(out, is_valid ? request.values[0] : 0);
+        break;
+    case ModbusRtu::FunctionWriteMultipleCoils:
+        is_valid = (request.count > 0) && (request.count <= ModbusRtu::MaxWriteBits) && (request.values.size() == request.count);
+        if (is_valid) {
+            // コイルは先頭のアドレスから順に、各バイトの下位ビットから詰める。
+            append_be16(out, request.count);
+            out.push_back(static_cast<uint8_t>((request.count + 7) / 8));
+            for (size_t i = 0; i < request.count; i += 8) {
+                uint8_t bits = 0;
+                for (size_t bit = 0; (bit < 8) && (i + bit < request.count); bit++) {
+                    if (request.values[i + bit] != 0) {
+                        bits |= static_cast<uint8_t>(1u << bit);
+                    }
+                }
+                out.push_back(bits);
+            }
+        }
+        break;
+    case ModbusRtu::FunctionWriteMultipleRegisters:
+        is_valid = (request.count > 0) && (request.count <= ModbusRtu::MaxWriteRegisters) && (request.values.size() == request.count);
+        if (is_valid) {
+            append_be16(out, request.count);
+            out.push_back(static_cast<uint8_t>(request.count * 2));
+            for (uint16_t value : request.values) {
+                append_be16(out, value);
+            }
+        }
+        break;
+    default:
+        is_valid = false;
+        break;
+    }
+    if (!is_valid) {
+        out.resize(frame_offset);
+        return false;
+    }
+    ModbusRtu::append_crc(pout, frame_offset);
+    return true;
+}
+
+uint32_t ModbusRtuMaster::get_frame_gap_micros(void) const noexcept {
+    return ModbusRtu::get_frame_gap_micros(m_port.get_baudrate(), m_port.get_databits(),
+        m_port.get_parity() != SerialPort::ParityNone, get_stopbit_count(m_port));
+}
+
+ModbusRtuMaster::Status ModbusRtuMaster::execute(const Request& request, Result* presult) {
+    if (presult == nullptr) {
+        return StatusInvalidRequest;
+    }
+    m_frames.clear();
+    if (!encode_request(request, &m_frames)) {
+        (*presult).status = StatusInvalidRequest;
+        (*presult).exception_code = 0;
+        (*presult).values.clear();
+        (*presult).latency_micros = 0;
+        return StatusInvalidRequest;
+    }
+    return transact(request, m_frames.data(), m_frames.size(), presult);
+}
+
+size_t ModbusRtuMaster::poll(const std::vector<Request>& requests, const completion_handler_t& handler) {
+    // 要求フレームは最初にまとめて符号化しておき、応答を受信し終わったらすぐ次の要求を送信できるようにする。
+    m_frames.clear();
+    m_frame_offsets.clear();
+    for (const Request& request : requests) {
+        m_frame_offsets.push_back(m_frames.size());
+        encode_request(request, &m_frames); // 不正な要求は長さ0になる。
+    }
+    m_frame_offsets.push_back(m_frames.size());
+
+    Result result;
+    size_t succeeded = 0;
+    bool is_io_error = false;
+    for (size_t i = 0; i < requests.size(); i++) {
+        size_t offset = m_frame_offsets[i];
+        size_t length = m_frame_offsets[i + 1] - offset;
+        if (is_io_error || (length == 0)) {
+            result.status = (is_io_error) ? StatusIoError : StatusInvalidRequest;
+            result.exception_code = 0;
+            result.values.clear();
+            result.latency_micros = 0;
+        }
+        else if (transact(requests[i], &m_frames[offset], length, &result) == StatusOk) {
+            succeeded++;
+        }
+        else if (result.status == StatusIoError) {
+            is_io_error = true;
+        }
+        if (handler) {
+            handler(i, requests[i], result);
+        }
+    }
+
+    return succeeded;
+}
+
+void ModbusRtuMaster::reset_statistics(void) noexcept {
+    m_statistics = Statistics();
+    m_latency.reset();
+}
+
+ModbusRtuMaster::Status ModbusRtuMaster::transact(const Request& request, const uint8_t* frame, size_t length, Result* presult) {
+    Result& result = *presult;
+    result.exception_code = 0;
+    result.values.clear();
+    result.latency_micros = 0;
+
+    discard_input(false); // 前の応答の後に届いたデータは捨てる。
+    wait_bus_idle();
+
+    uint32_t timeout_millis = (request.timeout_millis > 0) ? request.timeout_millis : m_timeout_millis;
+    auto start = std::chrono::steady_clock::now();
+    m_statistics.requests++;
+    int sent = m_port.send(frame, static_cast<uint32_t>(length), static_cast<int>(timeout_millis));
+    if (sent != static_cast<int>(length)) {
+        m_statistics.io_errors++;
+        result.status = StatusIoError;
+        return result.status;
+    }
+    // Note: send()はドライバに渡した時点で戻ることがあるので、要求フレームが送信し終わる時刻は送信時間から見積もる。
+    auto sent_time = (std::max)(std::chrono::steady_clock::now(),
+        start + std::chrono::microseconds(static_cast<uint64_t>(get_char_time_micros(m_port)) * length));
+    if (request.slave_id == ModbusRtu::BroadcastAddress) { // ブロードキャストには応答しない。
+        m_bus_idle_time = sent_time;
+        m_statistics.responses++;
+        result.status = StatusOk;
+        return result.status;
+    }
+
+    bool is_complete;
+    m_bus_idle_time = sent_time; // 応答を受信するとreceive_response()で更新する。
+    int received = receive_response(sent_time + std::chrono::milliseconds(timeout_millis), &is_complete);
+    auto end = std::chrono::steady_clock::now();
+    if (received < 0) {
+        m_statistics.io_errors++;
+        result.status = StatusIoError;
+        return result.status;
+    }
+    if (!is_complete) {
+        m_statistics.timeouts++;
+        result.status = StatusTimeout;
+        if (received > 0) { // 途中まで受信した？
+            discard_input(true);
+        }
+        return result.status;
+    }
+
+    result.latency_micros = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(end - start).count());
+    m_latency.record(start, end);
+    result.status = decode_response(request, m_response, static_cast<size_t>(received), &result);
+    switch (result.status) {
+    case StatusOk:
+        m_statistics.responses++;
+        break;
+    case StatusException:
+        m_statistics.exceptions++;
+        break;
+    case StatusCrcError:
+        m_statistics.crc_errors++;
+        discard_input(true); // フレームの区切りを見失っている場合があるので、無通信になるまで捨てる。
+        break;
+    default:
+        m_statistics.invalid_responses++;
+        discard_input(true);
+        break;
+    }
+    return result.status;
+}
+
+int ModbusRtuMaster::receive_response(const std::chrono::steady_clock::time_point& deadline, bool* pis_complete) {
+    (*pis_complete) = false;
+    int gap_millis = get_gap_millis();
+    size_t received = 0;
+    while (received < ModbusRtu::MaxFrameSize) {
+        size_t expected = ModbusRtu::LengthUnknown;
+        if (m_frame_detection == FrameDetectionLength) {
+            expected = ModbusRtu::get_response_length(m_response, received);
+            if (expected > ModbusRtu::MaxFrameSize) { // バイト数が不正？
+                expected = ModbusRtu::LengthUnknown;
+            }
+            else if ((expected != ModbusRtu::LengthUnknown) && (received >= expected)) {
+                (*pis_complete) = true;
+                return static_cast<int>(received);
+            }
+        }
+
+        // 受信し始めてから長さが分からない場合は、t3.5の無通信をフレームの終わりとする。
+        bool is_gap_wait = (received > 0) && (expected == ModbusRtu::LengthUnknown)
+            && ((m_frame_detection == FrameDetectionGap) || (received >= 3));
+        uint32_t length_to_receive;
+        int timeout_millis;
+        if (is_gap_wait) {
+            length_to_receive = 1; // 1バイトずつ受信して、直前のバイトからの無通信時間を測る。
+            timeout_millis = gap_millis;
+        }
+        else {
+            timeout_millis = get_remain_millis(deadline);
+            if (timeout_millis == 0) {
+                return static_cast<int>(received);
+            }
+            if (expected != ModbusRtu::LengthUnknown) {
+                length_to_receive = static_cast<uint32_t>(expected - received);
+            }
+            else {
+                length_to_receive = (m_frame_detection == FrameDetectionLength) ? static_cast<uint32_t>(3 - received) : 1;
+            }
+        }
+
+        int result = m_port.receive(&m_response[received], length_to_receive, timeout_millis);
+        if (result < 0) {
+            return -1;
+        }
+        else if (result == 0) {
+            if (!m_port.is_opened()) { // close()された？
+                return -1;
+            }
+            if (is_gap_wait) { // t3.5の間受信しなかった？
+                (*pis_complete) = true;
+                return static_cast<int>(received);
+            }
+            continue;
+        }
+        received += static_cast<size_t>(result);
+        m_bus_idle_time = std::chrono::steady_clock::now(); // t3.5は最後に受信したバイトから数える。
+    }
+
+    // 最大サイズまで受信した。形式の確認はdecode_response()で行う。
+    (*pis_complete) = true;
+    return static_cast<int>(received);
+}
+
+ModbusRtuMaster::Status ModbusRtuMaster::decode_response(const Request& request, const uint8_t* frame, size_t length, Result* presult) {
+    if (!ModbusRtu::check_crc(frame, length)) {
+        return StatusCrcError;
+    }
+    if (frame[0] != request.slave_id) {
+        return StatusInvalidResponse;
+    }
+    if (frame[1] == (request.function | ModbusRtu::ExceptionFlag)) {
+        if (length != 5) {
+            return StatusInvalidResponse;
+        }
+        (*presult).exception_code = frame[2];
+        return StatusException;
+    }
+    if (frame[1] != request.function) {
+        return StatusInvalidResponse;
+    }
+
+    std::vector<uint16_t>& values = (*presult).values;
+    switch (request.function) {
+    case ModbusRtu::FunctionReadCoils:
+    case ModbusRtu::FunctionReadDiscreteInputs:
+    {
+        size_t byte_count = (request.count + 7) / 8;
+        if ((length != 5 + byte_count) || (frame[2] != byte_count)) {
+            return StatusInvalidResponse;
+        }
+        values.resize(request.count);
+        for (size_t i = 0; i < request.count; i++) {
+            values[i] = static_cast<uint16_t>((frame[3 + i / 8] >> (i % 8)) & 1);
+        }
+        return StatusOk;
+    }
+    case ModbusRtu::FunctionReadHoldingRegisters:
+    case ModbusRtu::FunctionReadInputRegisters:
+    {
+        size_t byte_count = static_cast<size_t>(request.count) * 2;
+        if ((length != 5 + byte_count) || (frame[2] != byte_count)) {
+            return StatusInvalidResponse;
+        }
+        values.resize(request.count);
+        for (size_t i = 0; i < request.count; i++) {
+            values[i] = load_be16(&frame[3 + i * 2]);
+        }
+        return StatusOk;
+    }
+    case ModbusRtu::FunctionWriteSingleCoil:
+    case ModbusRtu::FunctionWriteSingleRegister:
+    case ModbusRtu::FunctionWriteMultipleCoils:
+    case ModbusRtu::FunctionWriteMultipleRegisters:
+    {
+        // 1点書き込みは要求と同じアドレスと値、複数点書き込みはアドレスと数を返す。
+        uint16_t expected_value = request.count;
+        if (request.function == ModbusRtu::FunctionWriteSingleCoil) {
+            expected_value = (request.values[0] != 0) ? 0xFF00 : 0x0000;
+        }
+        else if (request.function == ModbusRtu::FunctionWriteSingleRegister) {
+            expected_value = request.values[0];
+        }
+        if ((length != 8) || (load_be16(&frame[2]) != request.address) || (load_be16(&frame[4]) != expected_value)) {
+            return StatusInvalidResponse;
+        }
+        return StatusOk;
+    }
+    default:
+        return StatusInvalidResponse;
+    }
+}
+
+void ModbusRtuMaster::wait_bus_idle(void) {
+    auto idle_time = m_bus_idle_time + std::chrono::microseconds(get_frame_gap_micros());
+    if (std::chrono::steady_clock::now() < idle_time) {
+        std::this_thread::sleep_until(idle_time);
+    }
+}
+
+void ModbusRtuMaster::discard_input(bool is_wait_silence) {
+    uint8_t buf[ModbusRtu::MaxFrameSize];
+    int timeout_millis = (is_wait_silence) ? get_gap_millis() : 0;
+    while (true) {
+        int result = m_port.receive(buf, sizeof(buf), timeout_millis);
+        if (result <= 0) {
+            break;
+        }
+        m_statistics.discarded_bytes += static_cast<uint64_t>(result);
+        if (!is_wait_silence && (static_cast<size_t>(result) < sizeof(buf))) { // 受信済みのデータを全て読み出した？
+            break;
+        }
+    }
+    if (is_wait_silence) {
+        // t3.5の無通信を確認済みなので、次の要求はすぐに送信してよい。
+        m_bus_idle_time = std::chrono::steady_clock::now() - std::chrono::microseconds(get_frame_gap_micros());
+    }
+}
+
+int ModbusRtuMaster::get_gap_millis(void) const noexcept {
+    return static_cast<int>((std::max)((get_frame_gap_micros() + 999) / 1000, 1u));
+}
@@ -0,0 +1,261 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <chrono>
+#include <functional>
+#include <vector>
+
+#include "SerialPort.h"
+#include "ModbusRtu.h"
+#include "LatencyHistogram.h"
+
+/**
+ * Modbus RTUのマスター
+ *
+ * オープン済みのSerialPortで要求を送信し、スレーブの応答を受信して復号する。
+ * 応答フレームの終わりは、先頭3バイトから求めた長さで判断する(FrameDetectionLength)か、
+ * 3.5文字分の無通信時間(t3.5)で判断する(FrameDetectionGap)。
+ * t3.5はポートのボーレート、データビット、パリティ、ストップビットから求める。
+ * 次の要求は、前の応答の受信完了(ブロードキャストでは送信完了)からt3.5以上空けて送信する。
+ *
+ * poll()は複数の要求(スレーブアドレスごとの読み出しなど)を続けて処理する。
+ * 要求フレームは最初にまとめて符号化しておき、応答を受信し終わったらt3.5だけ空けて次の要求を送信する。
+ * 要求ごとにタイムアウト時間を指定でき、応答しないスレーブがあっても他のスレーブの処理は続ける。
+ *
+ * @note
+ * RTUのバスは半二重で、応答を待っている間は次の要求を送信できない(同時に処理中にできる要求は1つ)。
+ * 複数のバスを並行して処理する場合は、ポートごとにModbusRtuMasterを作り、別のスレッドから呼び出すこと。
+ * 1つのModbusRtuMasterは同時に1つのスレッドからしか呼び出せない。
+ * 処理中のポートでstart_streaming()したり、PortEngineに登録したりしないこと。
+ * 受信タイムアウトはミリ秒単位なので、無通信時間の判定はt3.5をミリ秒に切り上げて行う。
+ */
+class ModbusRtuMaster
+{
+public:
+    /**
+     * 要求の処理結果
+     */
+    enum Status {
+        StatusOk, // 正常な応答を受信した(ブロードキャストでは送信した)
+        StatusException, // 例外応答を受信した
+        StatusTimeout, // タイムアウト時間内に応答を受信し終わらなかった
+        StatusCrcError, // 応答のCRCが一致しない
+        StatusInvalidResponse, // 応答の形式が不正(アドレス、ファンクションコード、長さが要求と合わない)
+        StatusInvalidRequest, // 要求が不正(未対応のファンクションコード、数が範囲外など)
+        StatusIoError // 送受信でエラーが発生した
+    };
+
+    /**
+     * 応答フレームの終わりの判断方法
+     */
+    enum FrameDetection {
+        FrameDetectionLength, // 先頭から求めた長さを受信したら終わり(長さが分からない場合はt3.5の無通信で判断する)
+        FrameDetectionGap // t3.5の無通信で終わり
+    };
+
+    /**
+     * 要求
+     */
+    struct Request {
+        uint8_t slave_id; // スレーブアドレス(0でブロードキャスト)
+        uint8_t function; // ファンクションコード(ModbusRtu::FunctionXXX)
+        uint16_t address; // 開始アドレス
+        uint16_t count; // 読み出し・書き込みの数(1点書き込みでは無視する)
+        std::vector<uint16_t> values; // 書き込む値(コイルは0以外をONとする)
+        uint32_t timeout_millis; // 応答のタイムアウト時間[ミリ秒](0でset_timeout()の値)
+
+        Request(void)
+            : slave_id(1), function(ModbusRtu::FunctionReadHoldingRegisters), address(0), count(1), timeout_millis(0) {
+        }
+        Request(uint8_t slave_id, uint8_t function, uint16_t address, uint16_t count, uint32_t timeout_millis = 0)
+            : slave_id(slave_id), function(function), address(address), count(count), timeout_millis(timeout_millis) {
+        }
+    };
+
+    /**
+     * 要求の処理結果の詳細
+     */
+    struct Result {
+        Status status; // 処理結果
+        uint8_t exception_code; // 例外コード(StatusExceptionの場合)
+        std::vector<uint16_t> values; // 読み出した値(コイル、入力ステータスは0か1)
+        uint64_t latency_micros; // 送信開始から応答の受信完了までの時間[マイクロ秒]
+    };
+
+    /**
+     * poll()の完了ハンドラ型
+     * 要求ごとに、処理が終わった順(要求の順)に呼び出す。
+     *
+     * @param index 要求の番号
+     * @param request 要求
+     * @param result 処理結果
+     */
+    typedef std::function<void(size_t index, const Request& request, const Result& result)> completion_handler_t;
+
+    /**
+     * 統計
+     */
+    struct Statistics {
+        uint64_t requests; // 送信した要求数
+        uint64_t responses; // 正常な応答数
+        uint64_t exceptions; // 例外応答数
+        uint64_t timeouts; // タイムアウト数
+        uint64_t crc_errors; // CRCが一致しない応答数
+        uint64_t invalid_responses; // 形式が不正な応答数
+        uint64_t io_errors; // 送受信エラー数
+        uint64_t discarded_bytes; // 要求の送信前や不正な応答の後に読み捨てたバイト数
+    };
+
+    /**
+     * 既定の応答のタイムアウト時間[ミリ秒]
+     */
+    static const uint32_t DefaultTimeoutMillis = 100;
+
+    /**
+     * コンストラクタ
+     *
+     * @param port シリアルポート(オープンしてから要求を処理すること)
+     */
+    explicit ModbusRtuMaster(SerialPort& port);
+
+    /**
+     * 要求フレーム(CRCを含む)を符号化してpoutの末尾に追加する。
+     *
+     * @param request 要求
+     * @param pout 出力先
+     * @retval true 成功
+     * @retval false 要求が不正
+     */
+    static bool encode_request(const Request& request, std::vector<uint8_t>* pout);
+
+    /**
+     * 既定の応答のタイムアウト時間を設定する。
+     *
+     * @param timeout_millis タイムアウト時間[ミリ秒]
+     */
+    void set_timeout(uint32_t timeout_millis) noexcept { m_timeout_millis = (timeout_millis > 0) ? timeout_millis : DefaultTimeoutMillis; }
+    /**
+     * 既定の応答のタイムアウト時間を得る。
+     *
+     * @retval タイムアウト時間[ミリ秒]
+     */
+    uint32_t get_timeout(void) const noexcept { return m_timeout_millis; }
+    /**
+     * 応答フレームの終わりの判断方法を設定する。
+     *
+     * @param detection 判断方法
+     */
+    void set_frame_detection(FrameDetection detection) noexcept { m_frame_detection = detection; }
+    /**
+     * 応答フレームの終わりの判断方法を得る。
+     *
+     * @retval 判断方法
+     */
+    FrameDetection get_frame_detection(void) const noexcept { return m_frame_detection; }
+    /**
+     * ポートの設定から求めたフレーム間の無通信時間(t3.5)を得る。
+     *
+     * @retval 無通信時間[マイクロ秒]
+     */
+    uint32_t get_frame_gap_micros(void) const noexcept;
+
+    /**
+     * 要求を1つ処理する。
+     * 要求を送信し、応答を受信して復号する(ブロードキャストでは応答を待たない)。
+     *
+     * @param request 要求
+     * @param presult 処理結果の格納先
+     * @retval 処理結果
+     */
+    Status execute(const Request& request, Result* presult);
+    /**
+     * 複数の要求を順に処理する。
+     * 要求ごとにhandlerを呼び出す。送受信エラーが発生した場合は、残りの要求をStatusIoErrorとして終了する。
+     *
+     * @param requests 要求
+     * @param handler 完了ハンドラ
+     * @retval 正常に処理できた要求の数
+     */
+    size_t poll(const std::vector<Request>& requests, const completion_handler_t& handler);
+
+    /**
+     * 統計を得る。
+     *
+     * @retval 統計
+     */
+    const Statistics& get_statistics(void) const noexcept { return m_statistics; }
+    /**
+     * 統計と応答時間ヒストグラムをクリアする。
+     */
+    void reset_statistics(void) noexcept;
+    /**
+     * 応答時間ヒストグラム(送信開始から応答の受信完了まで)を得る。
+     *
+     * @retval ヒストグラム
+     */
+    const LatencyHistogram& get_latency(void) const noexcept { return m_latency; }
+
+private:
+    SerialPort& m_port; // シリアルポート
+    uint32_t m_timeout_millis; // 既定の応答のタイムアウト時間[ミリ秒]
+    FrameDetection m_frame_detection; // 応答フレームの終わりの判断方法
+    std::chrono::steady_clock::time_point m_bus_idle_time; // 最後のフレームを送受信し終わった時刻
+    std::vector<uint8_t> m_frames; // 符号化した要求フレーム(poll()で使い回す)
+    std::vector<size_t> m_frame_offsets; // 要求フレームの位置
+    uint8_t m_response[ModbusRtu::MaxFrameSize]; // 受信した応答フレーム
+    Statistics m_statistics; // 統計
+    LatencyHistogram m_latency; // 応答時間ヒストグラム
+
+    /**
+     * 符号化済みの要求を送信し、応答を受信して復号する。
+     *
+     * @param request 要求
+     * @param frame 要求フレーム
+     * @param length 要求フレームのバイト数
+     * @param presult 処理結果の格納先
+     * @retval 処理結果
+     */
+    Status transact(const Request& request, const uint8_t* frame, size_t length, Result* presult);
+    /**
+     * 応答フレームを受信する。
+     * 受信するたびに、最後のフレームを送受信し終わった時刻を更新する。
+     *
+     * @param deadline 受信し終わる期限
+     * @param pis_complete フレームの終わりまで受信したかどうかの格納先
+     * @retval 0以上 受信したバイト数
+     * @retval -1 受信エラー
+     */
+    int receive_response(const std::chrono::steady_clock::time_point& deadline, bool* pis_complete);
+    /**
+     * 応答フレームを復号する。
+     *
+     * @param request 要求
+     * @param frame 応答フレーム
+     * @param length 応答フレームのバイト数
+     * @param presult 処理結果の格納先
+     * @retval 処理結果
+     */
+    static Status decode_response(const Request& request, const uint8_t* frame, size_t length, Result* presult);
+    /**
+     * 前のフレームからt3.5が経過するまで待つ。
+     */
+    void wait_bus_idle(void);
+    /**
+     * 受信済みのデータを読み捨てる。
+     *
+     * @param is_wait_silence t3.5の無通信を確認するまで読み捨て続ける場合にはtrue
+     */
+    void discard_input(bool is_wait_silence);
+    /**
+     * t3.5をミリ秒に切り上げた受信タイムアウト時間を得る。
+     *
+     * @retval タイムアウト時間[ミリ秒](1以上)
+     */
+    int get_gap_millis(void) const noexcept;
+
+    // コピーコンストラクタは使用できない。
+    ModbusRtuMaster(const ModbusRtuMaster& master) = delete;
+    // 代入演算子は使用できない
+    ModbusRtuMaster& operator=(const ModbusRtuMaster& master) = delete;
+};
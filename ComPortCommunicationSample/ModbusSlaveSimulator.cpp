@@ -0,0 +1,361 @@
+#ifndef _WIN32
+
+#include <poll.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <system_error>
+
+#include "ModbusRtu.h"
+#include "ModbusSlaveSimulator.h"
+
+/**
+ * 16ビット値をビッグエンディアンで読み出す。
+ *
+ * @param p 読み出し元
+ * @retval 値
+ */
+static inline uint16_t load_be16(const uint8_t* p) noexcept {
+    return static_cast<uint16_t>((p[0] << 8) | p[1]);
+}
+
+/**
+ * 16ビット値をビッグエンディアンで追加する。
+ *
+ * @param out 出力先
+ * @param value 値
+ */
+static void append_be16(std::vector<uint8_t>& out, uint16_t value) {
+    out.push_back(static_cast<uint8_t>(value >> 8));
+    out.push_back(static_cast<uint8_t>(value));
+}
+
+/**
+ * ビットの並び(1要素に1ビット)を、先頭から各バイトの下位ビットに詰めて追加する。
+ *
+ * @param out 出力先
+ * @param bits ビットの並びの先頭
+ * @param count ビット数
+ */
+static void append_bits(std::vector<uint8_t>& out, const uint8_t* bits, size_t count) {
+    for (size_t i = 0; i < count; i += 8) {
+        uint8_t value = 0;
+        for (size_t bit = 0; (bit < 8) && (i + bit < count); bit++) {
+            if (bits[i + bit] != 0) {
+                value |= static_cast<uint8_t>(1u << bit);
+            }
+        }
+        out.push_back(value);
+    }
+}
+
+ModbusSlaveSimulator::ModbusSlaveSimulator(int fd)
+    : m_fd(fd), m_stop_pipe{ -1, -1 }, m_response_delay_micros(0), m_baudrate(0),
+    m_requests(0), m_responses(0), m_errors(0) {
+}
+
+ModbusSlaveSimulator::~ModbusSlaveSimulator(void) {
+    stop();
+}
+
+bool ModbusSlaveSimulator::add_slave(uint8_t slave_id, uint32_t register_count) {
+    if ((slave_id == ModbusRtu::BroadcastAddress) || (slave_id > 247) || is_running()) {
+        return false;
+    }
+    register_count = (std::min)(register_count, 65536u);
+    auto slave = std::make_unique<Slave>();
+    (*slave).holding_registers.resize(register_count);
+    (*slave).input_registers.resize(register_count);
+    (*slave).coils.resize(register_count);
+    (*slave).discrete_inputs.resize(register_count);
+    for (uint32_t i = 0; i < register_count; i++) {
+        (*slave).holding_registers[i] = static_cast<uint16_t>(i);
+        (*slave).input_registers[i] = static_cast<uint16_t>((slave_id << 8) | (i & 0xFF));
+        (*slave).coils[i] = ((i % 3) == 0) ? 1 : 0;
+        (*slave).discrete_inputs[i] = ((i % 2) != 0) ? 1 : 0;
+    }
+    m_slaves[slave_id] = std::move(slave);
+    return true;
+}
+
+void ModbusSlaveSimulator::start(void) {
+    if (is_running()) {
+        return;
+    }
+    if (pipe(m_stop_pipe) != 0) {
+        throw std::system_error(errno, std::generic_category());
+    }
+    m_requests = 0;
+    m_responses = 0;
+    m_errors = 0;
+    m_thread = std::thread([this]() { this->serve_proc(); });
+}
+
+void ModbusSlaveSimulator::stop(void) {
+    if (!is_running()) {
+        return;
+    }
+    uint8_t c = 0;
+    if (write(m_stop_pipe[1], &c, 1) < 0) {
+        // do nothing.
+    }
+    m_thread.join();
+    for (int& fd : m_stop_pipe) {
+        ::close(fd);
+        fd = -1;
+    }
+}
+
+bool ModbusSlaveSimulator::get_holding_register(uint8_t slave_id, uint16_t address, uint16_t* pvalue) {
+    std::lock_guard<std::mutex> lock(m_lock);
+    const Slave* slave = m_slaves[slave_id].get();
+    if ((pvalue == nullptr) || (slave == nullptr) || (address >= (*slave).holding_registers.size())) {
+        return false;
+    }
+    (*pvalue) = (*slave).holding_registers[address];
+    return true;
+}
+
+void ModbusSlaveSimulator::serve_proc(void) {
+    uint32_t gap_micros = ModbusRtu::get_frame_gap_micros(m_baudrate, 8, false, 1);
+    uint32_t char_micros = ModbusRtu::get_char_time_micros(m_baudrate, 8, false, 1);
+    int gap_millis = static_cast<int>((std::max)((gap_micros + 999) / 1000, 1u));
+    uint8_t buf[ModbusRtu::MaxFrameSize];
+    size_t length = 0; // 受信済みのバイト数
+    std::vector<uint8_t> response;
+
+    // 要求フレームを1つ処理する。
+    auto handle_frame = [&](const uint8_t* frame, size_t frame_length) {
+        m_requests++;
+        if (!ModbusRtu::check_crc(frame, frame_length)) {
+            m_errors++;
+            return true;
+        }
+        process_request(frame, frame_length, &response);
+        if (response.empty()) { // 応答しない？
+            return true;
+        }
+        // 送信時間を模擬する場合は、実機のスレーブと同様に要求の後のt3.5も空ける。
+        uint64_t delay_micros = m_response_delay_micros + static_cast<uint64_t>(char_micros) * (frame_length + response.size())
+            + ((m_baudrate > 0) ? gap_micros : 0);
+        if (delay_micros > 0) {
+            std::this_thread::sleep_for(std::chrono::microseconds(delay_micros));
+        }
+        if (!write_all(response.data(), response.size())) {
+            return false;
+        }
+        m_responses++;
+        return true;
+    };
+
+    bool is_running = true;
+    while (is_running) {
+        struct pollfd fds[2];
+        fds[0].fd = m_fd;
+        fds[0].events = POLLIN;
+        fds[0].revents = 0;
+        fds[1].fd = m_stop_pipe[0];
+        fds[1].events = POLLIN;
+        fds[1].revents = 0;
+        int ready = poll(fds, 2, (length > 0) ? gap_millis : -1);
+        if (ready < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        if (fds[1].revents != 0) { // 停止要求？
+            break;
+        }
+        if (ready == 0) { // 要求の途中でt3.5の無通信になった？
+            // 長さが分からない(未対応のファンクションコードの)要求は、ここで終わりとする。
+            if ((ModbusRtu::get_request_length(buf, length) == ModbusRtu::LengthUnknown) && ModbusRtu::check_crc(buf, length)) {
+                is_running = handle_frame(buf, length);
+            }
+            else {
+                m_errors++;
+            }
+            length = 0;
+            continue;
+        }
+
+        ssize_t result = read(m_fd, buf + length, sizeof(buf) - length);
+        if (result < 0) {
+            if ((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR)) {
+                continue;
+            }
+            break;
+        }
+        length += static_cast<size_t>(result);
+
+        // 受信したデータから要求フレームを取り出す。
+        while (is_running && (length > 0)) {
+            size_t expected = ModbusRtu::get_request_length(buf, length);
+            if ((expected == ModbusRtu::LengthUnknown) || (length < expected)) {
+                break;
+            }
+            if (expected > sizeof(buf)) { // 最大サイズを超える？
+                m_errors++;
+                length = 0;
+                break;
+            }
+            is_running = handle_frame(buf, expected);
+            memmove(buf, buf + expected, length - expected);
+            length -= expected;
+        }
+        if (length == sizeof(buf)) { // 最大サイズまで受信してもフレームの終わりが分からない？
+            m_errors++;
+            length = 0;
+        }
+    }
+}
+
+void ModbusSlaveSimulator::process_request(const uint8_t* frame, size_t length, std::vector<uint8_t>* presponse) {
+    std::vector<uint8_t>& response = *presponse;
+    response.clear();
+    uint8_t slave_id = frame[0];
+    uint8_t function = frame[1];
+    uint16_t address = load_be16(&frame[2]);
+    uint16_t count = load_be16(&frame[4]); // 1点書き込みでは値
+    bool is_broadcast = (slave_id == ModbusRtu::BroadcastAddress);
+
+    std::lock_guard<std::mutex> lock(m_lock);
+    for (int id = (is_broadcast) ? 1 : slave_id; id <= ((is_broadcast) ? 247 : slave_id); id++) {
+        Slave* slave = m_slaves[id].get();
+        if (slave == nullptr) { // 登録していないスレーブアドレス宛て？
+            continue;
+        }
+        response.clear();
+        response.push_back(slave_id);
+        response.push_back(function);
+        size_t size = (*slave).holding_registers.size();
+        uint8_t exception = 0;
+        switch (function) {
+        case ModbusRtu::FunctionReadCoils:
+        case ModbusRtu::FunctionReadDiscreteInputs:
+            if ((count == 0) || (count > ModbusRtu::MaxReadBits)) {
+                exception = ModbusRtu::ExceptionIllegalDataValue;
+            }
+            else if (static_cast<size_t>(address) + count > size) {
+                exception = ModbusRtu::ExceptionIllegalDataAddress;
+            }
+            else {
+                const std::vector<uint8_t>& bits = (function == ModbusRtu::FunctionReadCoils) ? (*slave).coils : (*slave).discrete_inputs;
+                response.push_back(static_cast<uint8_t>((count + 7) / 8));
+                append_bits(response, &bits[address], count);
+            }
+            break;
+        case ModbusRtu::FunctionReadHoldingRegisters:
+        case ModbusRtu::FunctionReadInputRegisters:
+            if ((count == 0) || (count > ModbusRtu::MaxReadRegisters)) {
+                exception = ModbusRtu::ExceptionIllegalDataValue;
+            }
+            else if (static_cast<size_t>(address) + count > size) {
+                exception = ModbusRtu::ExceptionIllegalDataAddress;
+            }
+            else {
+                const std::vector<uint16_t>& registers = (function == ModbusRtu::FunctionReadHoldingRegisters)
+                    ? (*slave).holding_registers : (*slave).input_registers;
+                response.push_back(static_cast<uint8_t>(count * 2));
+                for (size_t i = 0; i < count; i++) {
+                    append_be16(response, registers[address + i]);
+                }
+            }
+            break;
+        case ModbusRtu::FunctionWriteSingleCoil:
+            if ((count != 0xFF00) && (count != 0x0000)) {
+                exception = ModbusRtu::ExceptionIllegalDataValue;
+            }
+            else if (address >= size) {
+                exception = ModbusRtu::ExceptionIllegalDataAddress;
+            }
+            else {
+                (*slave).coils[address] = (count != 0) ? 1 : 0;
+                response.insert(response.end(), &frame[2], &frame[6]);
+            }
+            break;
+        case ModbusRtu::FunctionWriteSingleRegister:
+            if (address >= size) {
+                exception = ModbusRtu::ExceptionIllegalDataAddress;
+            }
+            else {
+                (*slave).holding_registers[address] = count;
+                response.insert(response.end(), &frame[2], &frame[6]);
+            }
+            break;
+        case ModbusRtu::FunctionWriteMultipleCoils:
+            if ((count == 0) || (count > ModbusRtu::MaxWriteBits) || (frame[6] != (count + 7) / 8) || (length != 9 + static_cast<size_t>(frame[6]))) {
+                exception = ModbusRtu::ExceptionIllegalDataValue;
+            }
+            else if (static_cast<size_t>(address) + count > size) {
+                exception = ModbusRtu::ExceptionIllegalDataAddress;
+            }
+            else {
+                for (size_t i = 0; i < count; i++) {
+                    (*slave).coils[address + i] = (frame[7 + i / 8] >> (i % 8)) & 1;
+                }
+                response.insert(response.end(), &frame[2], &frame[6]);
+            }
+            break;
+        case ModbusRtu::FunctionWriteMultipleRegisters:
+            if ((count == 0) || (count > ModbusRtu::MaxWriteRegisters) || (frame[6] != count * 2) || (length != 9 + static_cast<size_t>(frame[6]))) {
+                exception = ModbusRtu::ExceptionIllegalDataValue;
+            }
+            else if (static_cast<size_t>(address) + count > size) {
+                exception = ModbusRtu::ExceptionIllegalDataAddress;
+            }
+            else {
+                for (size_t i = 0; i < count; i++) {
+                    (*slave).holding_registers[address + i] = load_be16(&frame[7 + i * 2]);
+                }
+                response.insert(response.end(), &frame[2], &frame[6]);
+            }
+            break;
+        default:
+            exception = ModbusRtu::ExceptionIllegalFunction;
+            break;
+        }
+        if (exception != 0) {
+            response.resize(1);
+            response.push_back(static_cast<uint8_t>(function | ModbusRtu::ExceptionFlag));
+            response.push_back(exception);
+        }
+        ModbusRtu::append_crc(&response);
+    }
+    if (is_broadcast) { // ブロードキャストには応答しない。
+        response.clear();
+    }
+}
+
+bool ModbusSlaveSimulator::write_all(const uint8_t* data, size_t length) {
+    size_t written = 0;
+    while (written < length) {
+        ssize_t result = write(m_fd, data + written, length - written);
+        if (result > 0) {
+            written += static_cast<size_t>(result);
+            continue;
+        }
+        else if ((result < 0) && (errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR)) {
+            return false;
+        }
+        struct pollfd fds[2];
+        fds[0].fd = m_fd;
+        fds[0].events = POLLOUT;
+        fds[0].revents = 0;
+        fds[1].fd = m_stop_pipe[0];
+        fds[1].events = POLLIN;
+        fds[1].revents = 0;
+        if ((poll(fds, 2, -1) < 0) && (errno != EINTR)) {
+            return false;
+        }
+        if (fds[1].revents != 0) { // 停止要求？
+            return false;
+        }
+    }
+    return true;
+}
+
+#endif
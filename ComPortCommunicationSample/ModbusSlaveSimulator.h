@@ -0,0 +1,169 @@
+#pragma once
+
+#ifndef _WIN32
+
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <vector>
+
+/**
+ * Modbus RTUのスレーブの模擬
+ *
+ * 疑似端末(PtyPair)のマスター側など、接続先機器側のファイルディスクリプタで要求を受信し、
+ * add_slave()で登録したスレーブアドレス宛ての要求に応答する。
+ * 要求フレームの終わりは先頭から求めた長さで判断し、途中でt3.5の無通信があった場合は捨てる。
+ * CRCが一致しない要求と、登録していないスレーブアドレス宛ての要求には応答しない(実機のスレーブと同様)。
+ * ModbusRtuMasterの動作確認や、ポーリング周期の計測に使う。
+ *
+ * レジスタとコイルの初期値は次のとおり。
+ * 保持レジスタ: アドレスと同じ値、入力レジスタ: (スレーブアドレス << 8) | (アドレスの下位8ビット)、
+ * コイル: アドレスが3の倍数ならON、入力ステータス: アドレスが奇数ならON
+ *
+ * @note
+ * POSIX専用。
+ */
+class ModbusSlaveSimulator
+{
+public:
+    /**
+     * 既定のレジスタ数(コイル、入力ステータスも同じ数)
+     */
+    static const uint32_t DefaultRegisterCount = 1024;
+
+    /**
+     * コンストラクタ
+     *
+     * @param fd 接続先機器側のファイルディスクリプタ(ノンブロッキングであること。所有権は移らない)
+     */
+    explicit ModbusSlaveSimulator(int fd);
+    /**
+     * デストラクタ
+     */
+    ~ModbusSlaveSimulator(void);
+
+    /**
+     * スレーブを登録する。start()の前に呼び出すこと。
+     *
+     * @param slave_id スレーブアドレス(1～247)
+     * @param register_count レジスタ数
+     * @retval true 成功
+     * @retval false 失敗(スレーブアドレスが範囲外、実行中の場合)
+     */
+    bool add_slave(uint8_t slave_id, uint32_t register_count = DefaultRegisterCount);
+    /**
+     * 要求を受信してから応答を送信し始めるまでの処理時間を設定する。
+     *
+     * @param delay_micros 処理時間[マイクロ秒]
+     */
+    void set_response_delay(uint32_t delay_micros) noexcept { m_response_delay_micros = delay_micros; }
+    /**
+     * 模擬するボーレートを設定する。
+     * 0以外の場合、要求と応答がそのボーレートで送信される時間と要求の後のt3.5だけ応答を遅らせ、t3.5もそのボーレートから求める。
+     * 0の場合は送信時間を模擬せず、t3.5は1750マイクロ秒とする。
+     *
+     * @param baudrate ボーレート(8ビット、パリティ無し、1ストップビットとして計算する)
+     */
+    void set_baudrate(uint32_t baudrate) noexcept { m_baudrate = baudrate; }
+
+    /**
+     * 応答を開始する。
+     * 失敗した場合には std::system_error を投げる。
+     */
+    void start(void);
+    /**
+     * 応答を停止する。
+     */
+    void stop(void);
+    /**
+     * 実行中かどうかを取得する。
+     *
+     * @retval true 実行中
+     * @retval false 停止中
+     */
+    bool is_running(void) const noexcept { return m_thread.joinable(); }
+
+    /**
+     * 保持レジスタの値を得る。
+     *
+     * @param slave_id スレーブアドレス
+     * @param address アドレス
+     * @param pvalue 値の格納先
+     * @retval true 成功
+     * @retval false スレーブアドレスを登録していない、またはアドレスが範囲外
+     */
+    bool get_holding_register(uint8_t slave_id, uint16_t address, uint16_t* pvalue);
+
+    /**
+     * 受信した要求数を得る(CRCが一致しない要求を含む)。
+     *
+     * @retval 要求数
+     */
+    uint64_t get_request_count(void) const noexcept { return m_requests; }
+    /**
+     * 送信した応答数を得る(例外応答を含む)。
+     *
+     * @retval 応答数
+     */
+    uint64_t get_response_count(void) const noexcept { return m_responses; }
+    /**
+     * CRCが一致しないか途中で途切れたため捨てた要求数を得る。
+     *
+     * @retval 要求数
+     */
+    uint64_t get_error_count(void) const noexcept { return m_errors; }
+
+private:
+    /**
+     * スレーブ
+     */
+    struct Slave {
+        std::vector<uint16_t> holding_registers; // 保持レジスタ
+        std::vector<uint16_t> input_registers; // 入力レジスタ
+        std::vector<uint8_t> coils; // コイル
+        std::vector<uint8_t> discrete_inputs; // 入力ステータス
+    };
+
+    int m_fd; // 接続先機器側のファイルディスクリプタ
+    int m_stop_pipe[2]; // 停止通知用パイプ
+    std::unique_ptr<Slave> m_slaves[256]; // スレーブ(スレーブアドレスで引く)
+    std::mutex m_lock; // レジスタとコイルのロック
+    uint32_t m_response_delay_micros; // 応答までの処理時間[マイクロ秒]
+    uint32_t m_baudrate; // 模擬するボーレート(0で模擬しない)
+    std::thread m_thread; // 応答スレッド
+    std::atomic<uint64_t> m_requests; // 受信した要求数
+    std::atomic<uint64_t> m_responses; // 送信した応答数
+    std::atomic<uint64_t> m_errors; // 捨てた要求数
+
+    /**
+     * 応答スレッドの処理を行う。
+     */
+    void serve_proc(void);
+    /**
+     * 要求を処理して応答フレームを作る。
+     *
+     * @param frame 要求フレーム(CRCを確認済み)
+     * @param length 要求フレームのバイト数
+     * @param presponse 応答フレームの格納先(応答しない場合は空にする)
+     */
+    void process_request(const uint8_t* frame, size_t length, std::vector<uint8_t>* presponse);
+    /**
+     * データを全て書き込む。
+     *
+     * @param data データ
+     * @param length バイト数
+     * @retval true 成功
+     * @retval false 失敗(停止要求を受けた場合を含む)
+     */
+    bool write_all(const uint8_t* data, size_t length);
+
+    // コピーコンストラクタは使用できない。
+    ModbusSlaveSimulator(const ModbusSlaveSimulator& simulator) = delete;
+    // 代入演算子は使用できない
+    ModbusSlaveSimulator& operator=(const ModbusSlaveSimulator& simulator) = delete;
+};
+
+#endif
@@ -0,0 +1,214 @@
+#include <cstring>
+#include <algorithm>
+
+#include "OutputBuffer.h"
+
+OutputBuffer::OutputBuffer(const writer_t& writer, size_t capacity, uint32_t flush_delay_millis)
+    : OutputBuffer(channel_writer_t([writer](uint32_t, const void* data, size_t length) { return writer(data, length); }),
+        capacity, flush_delay_millis) {
+}
+
+OutputBuffer::OutputBuffer(const channel_writer_t& writer, size_t capacity, uint32_t flush_delay_millis)
+    : m_writer(writer), m_capacity(capacity), m_flush_delay(flush_delay_millis),
+    m_queue_limit((std::max)(DefaultQueueLimit, capacity)), m_overflow_policy(OverflowBlock),
+    m_in_flight(0), m_is_urgent(false), m_flush_waiters(0), m_is_running(false) {
+    memset(&m_statistics, 0, sizeof(m_statistics));
+}
+
+OutputBuffer::~OutputBuffer(void) {
+    stop();
+}
+
+void OutputBuffer::start(void) {
+    if (m_thread.joinable()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_is_running = true;
+    }
+    m_thread = std::thread(&OutputBuffer::write_proc, this);
+}
+
+void OutputBuffer::stop(void) {
+    if (!m_thread.joinable()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_is_running = false;
+    }
+    m_cond.notify_all();
+    m_thread.join(); // Note: 書き出しスレッドはキューに残っているデータを書き出してから終了する。
+}
+
+void OutputBuffer::set_policy(size_t capacity, uint32_t flush_delay_millis) {
+    flush();
+    std::lock_guard<std::mutex> lock(m_lock);
+    m_capacity = capacity;
+    m_flush_delay = std::chrono::milliseconds(flush_delay_millis);
+    m_queue_limit = (std::max)(m_queue_limit, m_capacity);
+    m_cond.notify_all();
+}
+
+void OutputBuffer::set_overflow_policy(size_t queue_limit, OverflowPolicy policy, const writer_t& spill) {
+    std::lock_guard<std::mutex> lock(m_lock);
+    m_queue_limit = (std::max)(queue_limit, m_capacity);
+    m_overflow_policy = policy;
+    m_spill = spill;
+    m_cond.notify_all();
+}
+
+bool OutputBuffer::write(const void* data, size_t length, uint32_t channel) {
+    if (data == nullptr) {
+        return false;
+    }
+
+    std::unique_lock<std::mutex> lock(m_lock);
+    m_statistics.requests++;
+    // 書き出しスレッドを開始していないか停止した場合や、バッファリングしない場合は、
+    // スレッドが残りを書き出し終えてから直ちに書き出す。
+    auto write_after_drained = [this, &lock, data, length, channel]() {
+        m_cond.wait(lock, [this]() { return m_pending.empty() && (m_in_flight == 0); });
+        return write_through_locked(data, length, channel);
+    };
+    if (!m_is_running || (m_capacity == 0)) {
+        return write_after_drained();
+    }
+
+    // Note: 書き出し中のデータも書き出しが終わるまではキューの一部として数える。
+    //       1回の書き込みが上限を超える場合は、キューが空になれば受け付ける。
+    bool is_blocked = false;
+    while (((m_pending.size() + m_in_flight) > 0) && ((m_pending.size() + m_in_flight + length) > m_queue_limit)) { // 入りきらない？
+        OverflowPolicy policy = (channel == 0) ? m_overflow_policy : OverflowBlock; // チャンネル0以外は捨てずに待つ。
+        if (policy == OverflowDrop) {
+            m_statistics.dropped_bytes += length;
+            return false;
+        }
+        else if ((policy == OverflowSpill) && m_spill) {
+            m_statistics.spilled_bytes += length;
+            return m_spill(data, length);
+        }
+        if (!is_blocked) {
+            m_statistics.blocked++;
+            is_blocked = true;
+        }
+        m_cond.wait(lock);
+        if (!m_is_running) { // 待っている間に停止した？
+            return write_after_drained();
+        }
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    if (m_pending.empty()) {
+        m_first_buffered = now;
+        if ((m_in_flight == 0) && ((now - m_last_written) >= m_flush_delay)) {
+            // しばらく書き出していなければ(対話的な出力)、猶予時間を待たずに書き出す。
+            m_is_urgent = true;
+        }
+    }
+    const uint8_t* p = static_cast<const uint8_t*>(data);
+    m_pending.insert(m_pending.end(), p, p + length);
+    if (!m_pending_segments.empty() && (m_pending_segments.back().channel == channel)) {
+        m_pending_segments.back().length += length;
+    }
+    else {
+        m_pending_segments.push_back(Segment{ channel, length });
+    }
+    m_statistics.queue_max = (std::max)(m_statistics.queue_max, static_cast<uint64_t>(m_pending.size() + m_in_flight));
+    m_cond.notify_all();
+
+    return true;
+}
+
+bool OutputBuffer::flush(void) {
+    std::unique_lock<std::mutex> lock(m_lock);
+    // Note: 書き出しスレッドを開始していなければ、溜めているデータは無いので直ちに戻る。
+    uint64_t errors = m_statistics.errors;
+    m_flush_waiters++;
+    m_cond.notify_all();
+    m_cond.wait(lock, [this]() { return m_pending.empty() && (m_in_flight == 0); });
+    m_flush_waiters--;
+
+    return (m_statistics.errors == errors);
+}
+
+OutputBuffer::Statistics OutputBuffer::get_statistics(void) {
+    std::lock_guard<std::mutex> lock(m_lock);
+    return m_statistics;
+}
+
+void OutputBuffer::reset_statistics(void) {
+    std::lock_guard<std::mutex> lock(m_lock);
+    memset(&m_statistics, 0, sizeof(m_statistics));
+}
+
+bool OutputBuffer::write_through_locked(const void* data, size_t length, uint32_t channel) {
+    m_statistics.writes++;
+    bool retval = m_writer(channel, data, length);
+    if (retval) {
+        m_statistics.bytes += length;
+    }
+    else {
+        m_statistics.errors++;
+    }
+    m_last_written = std::chrono::steady_clock::now();
+    return retval;
+}
+
+void OutputBuffer::write_proc(void) {
+    std::unique_lock<std::mutex> lock(m_lock);
+    while (true) {
+        if (m_pending.empty()) {
+            if (!m_is_running) { // 全て書き出して停止要求を受けた？
+                break;
+            }
+            m_cond.wait(lock);
+            continue;
+        }
+        if (m_is_running && !m_is_urgent && (m_flush_waiters == 0) && (m_pending.size() < m_capacity)) {
+            // 容量に満たない場合、猶予時間が経過するまで後続のデータを待つ。
+            auto deadline = m_first_buffered + m_flush_delay;
+            if (std::chrono::steady_clock::now() < deadline) {
+                m_cond.wait_until(lock, deadline);
+                continue;
+            }
+        }
+
+        // 書き出し待ちデータを書き出し中データと入れ替え、書き出し中に次のデータを溜められるようにする。
+        m_writing.swap(m_pending);
+        m_pending.clear();
+        m_writing_segments.swap(m_pending_segments);
+        m_pending_segments.clear();
+        m_in_flight = m_writing.size();
+        m_is_urgent = false;
+        m_cond.notify_all(); // 空きができた。
+        lock.unlock();
+
+        // チャンネルが切り替わるところで区切り、溜めた順に書き出す。
+        uint64_t writes = 0;
+        uint64_t written_bytes = 0;
+        uint64_t errors = 0;
+        const uint8_t* rp = m_writing.data();
+        for (const Segment& segment : m_writing_segments) {
+            writes++;
+            if (m_writer(segment.channel, rp, segment.length)) {
+                written_bytes += segment.length;
+            }
+            else {
+                errors++;
+            }
+            rp += segment.length;
+        }
+
+        lock.lock();
+        m_statistics.writes += writes;
+        m_statistics.bytes += written_bytes;
+        m_statistics.errors += errors;
+        m_last_written = std::chrono::steady_clock::now();
+        m_writing.clear();
+        m_writing_segments.clear();
+        m_in_flight = 0;
+        m_cond.notify_all();
+    }
+}
@@ -0,0 +1,217 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+
+/**
+ * 出力バッファ
+ *
+ * write()されたデータをキューに溜め、書き出しスレッドが書き出し関数に渡す。write()は書き出しを待たないので、
+ * 書き出し先(コンソールなど)が遅くても呼び出し元(シリアルポートの受信スレッドなど)は止まらない。
+ * 書き出しスレッドは、溜まったデータが容量に達するか、最初のデータを溜めてからflush_delay_millis経過した時点で
+ * まとめて書き出す。しばらく(flush_delay_millis以上)書き出していない状態でのwrite()は猶予時間を待たずに書き出すので、
+ * キー入力のエコーバックのような対話的な出力は遅れない。連続した出力だけがまとめられる。
+ * キューが上限に達した場合の動作はOverflowPolicyで選ぶ。
+ * 複数の書き出し先(標準出力と標準エラー出力など)をチャンネル番号で区別して1つのキューに溜めることもでき、
+ * その場合もチャンネルをまたいでwrite()の順序で書き出す。
+ *
+ * @note
+ * write(), flush()はどのスレッドから呼び出してもよい。書き出しの順序はwrite()の順序と一致する。
+ * 書き出しスレッドを開始していない間と、バッファ容量が0の場合は、write()の中で直ちに書き出し関数を呼び出す。
+ */
+class OutputBuffer
+{
+public:
+    /**
+     * 書き出し関数型
+     *
+     * @param data データ
+     * @param length データのバイト数
+     * @retval true 成功
+     * @retval false 失敗
+     */
+    typedef std::function<bool(const void* data, size_t length)> writer_t;
+    /**
+     * チャンネル付き書き出し関数型
+     *
+     * @param channel write()で指定したチャンネル番号
+     * @param data データ
+     * @param length データのバイト数
+     * @retval true 成功
+     * @retval false 失敗
+     */
+    typedef std::function<bool(uint32_t channel, const void* data, size_t length)> channel_writer_t;
+
+    /**
+     * キューが上限に達したときの動作
+     */
+    enum OverflowPolicy {
+        OverflowBlock, // 空きができるまでwrite()の呼び出し元を待たせる
+        OverflowDrop, // 書き込むデータを捨てて数える
+        OverflowSpill // 書き込むデータを退避関数に渡す
+    };
+
+    /**
+     * 統計
+     */
+    struct Statistics {
+        uint64_t requests; // write()の呼び出し回数
+        uint64_t writes; // 書き出し関数の呼び出し回数
+        uint64_t bytes; // 書き出したバイト数
+        uint64_t errors; // 書き出しに失敗した回数
+        uint64_t blocked; // キューの空きを待ったwrite()の回数
+        uint64_t dropped_bytes; // キューに入りきらず捨てたバイト数
+        uint64_t spilled_bytes; // キューに入りきらず退避関数に渡したバイト数
+        uint64_t queue_max; // キューに溜まったデータ量の最大値[バイト]
+    };
+
+    /**
+     * バッファ容量の既定値[バイト]
+     */
+    static const size_t DefaultCapacity = 16 * 1024;
+    /**
+     * 溜めたデータを書き出すまでの猶予時間の既定値[ミリ秒]
+     */
+    static const uint32_t DefaultFlushDelayMillis = 10;
+    /**
+     * キューの上限の既定値[バイト]
+     */
+    static const size_t DefaultQueueLimit = 1024 * 1024;
+
+    /**
+     * コンストラクタ
+     *
+     * @param writer 書き出し関数
+     * @param capacity バッファ容量[バイト](0にするとバッファリングせず、write()の中で書き出す)
+     * @param flush_delay_millis 溜めたデータを書き出すまでの猶予時間[ミリ秒]
+     */
+    explicit OutputBuffer(const writer_t& writer, size_t capacity = DefaultCapacity,
+        uint32_t flush_delay_millis = DefaultFlushDelayMillis);
+    /**
+     * コンストラクタ
+     *
+     * @param writer チャンネル付き書き出し関数
+     * @param capacity バッファ容量[バイト](0にするとバッファリングせず、write()の中で書き出す)
+     * @param flush_delay_millis 溜めたデータを書き出すまでの猶予時間[ミリ秒]
+     */
+    explicit OutputBuffer(const channel_writer_t& writer, size_t capacity = DefaultCapacity,
+        uint32_t flush_delay_millis = DefaultFlushDelayMillis);
+    /**
+     * デストラクタ
+     */
+    ~OutputBuffer(void);
+
+    /**
+     * 書き出しスレッドを開始する。
+     * 開始するまではバッファリングせずに直ちに書き出す。
+     */
+    void start(void);
+    /**
+     * 書き出しスレッドを停止する。
+     * キューに残っているデータを書き出してから停止する。
+     */
+    void stop(void);
+
+    /**
+     * バッファリングの設定を変更する。
+     * バッファに残っているデータは書き出してから変更する。
+     *
+     * @param capacity バッファ容量[バイト](0にするとバッファリングせず、write()の中で書き出す)
+     * @param flush_delay_millis 溜めたデータを書き出すまでの猶予時間[ミリ秒]
+     */
+    void set_policy(size_t capacity, uint32_t flush_delay_millis);
+    /**
+     * キューの上限と、上限に達したときの動作を設定する。
+     * 動作はチャンネル0への書き込みにだけ適用し、他のチャンネルは捨てないように常に空きができるまで待つ。
+     *
+     * @param queue_limit キューの上限[バイト]
+     * @param policy 上限に達したときの動作
+     * @param spill 退避関数(OverflowSpillの場合のみ使用する)。ロックを保持した状態で呼び出すので、速やかに戻ること。
+     */
+    void set_overflow_policy(size_t queue_limit, OverflowPolicy policy, const writer_t& spill = writer_t());
+
+    /**
+     * データを書き込む。
+     *
+     * @param data データ
+     * @param length データのバイト数
+     * @param channel 書き出し先のチャンネル番号(書き出し関数に渡す)
+     * @retval true 成功(キューに溜めた場合、退避した場合を含む)
+     * @retval false 書き出しに失敗した、またはキューに入りきらず捨てた
+     */
+    bool write(const void* data, size_t length, uint32_t channel = 0);
+    /**
+     * キューに溜まっているデータを直ちに書き出し、書き出しが終わるまで待つ。
+     *
+     * @retval true 成功
+     * @retval false 書き出しに失敗した
+     */
+    bool flush(void);
+
+    /**
+     * 統計を得る。
+     *
+     * @retval 統計
+     */
+    Statistics get_statistics(void);
+    /**
+     * 統計をクリアする。
+     */
+    void reset_statistics(void);
+
+private:
+    /**
+     * 同じチャンネルへの連続したデータの区間
+     */
+    struct Segment {
+        uint32_t channel; // チャンネル番号
+        size_t length; // データのバイト数
+    };
+
+    channel_writer_t m_writer; // 書き出し関数
+    writer_t m_spill; // 退避関数
+    size_t m_capacity; // バッファ容量(まとめて書き出す閾値)
+    std::chrono::milliseconds m_flush_delay; // 溜めたデータを書き出すまでの猶予時間
+    size_t m_queue_limit; // キューの上限(書き出し中のデータを含む)
+    OverflowPolicy m_overflow_policy; // キューが上限に達したときの動作
+    std::mutex m_lock; // 排他ロック
+    std::condition_variable m_cond; // 状態変化通知(データ追加、書き出し完了、停止で通知する)
+    std::vector<uint8_t> m_pending; // 書き出し待ちデータ
+    std::vector<uint8_t> m_writing; // 書き出し中データ(書き出しスレッドのみアクセス)
+    std::vector<Segment> m_pending_segments; // 書き出し待ちデータのチャンネル別区間
+    std::vector<Segment> m_writing_segments; // 書き出し中データのチャンネル別区間(書き出しスレッドのみアクセス)
+    size_t m_in_flight; // 書き出し中のバイト数
+    std::chrono::steady_clock::time_point m_first_buffered; // 書き出し待ちの最初のデータを溜めた時刻
+    std::chrono::steady_clock::time_point m_last_written; // 最後に書き出した時刻
+    bool m_is_urgent; // 猶予時間を待たずに書き出すかどうか(対話的な出力、flush()要求)
+    uint32_t m_flush_waiters; // flush()で待機中のスレッド数
+    bool m_is_running; // 書き出しスレッドを実行中かどうか
+    Statistics m_statistics; // 統計
+    std::thread m_thread; // 書き出しスレッド
+
+    /**
+     * データを書き出し関数に渡す。ロックを保持した状態で呼び出すこと。
+     *
+     * @param data データ
+     * @param length データのバイト数
+     * @param channel チャンネル番号
+     * @retval true 成功
+     * @retval false 書き出しに失敗した
+     */
+    bool write_through_locked(const void* data, size_t length, uint32_t channel);
+    /**
+     * 書き出しスレッドの処理を行う。
+     */
+    void write_proc(void);
+
+    // コピーコンストラクタは使用できない。
+    OutputBuffer(const OutputBuffer& buffer) = delete;
+    // 代入演算子は使用できない
+    OutputBuffer& operator=(const OutputBuffer& buffer) = delete;
+};
@@ -0,0 +1,129 @@
+#include <cerrno>
+#include <chrono>
+#include <algorithm>
+
+#include "PortBridge.h"
+
+/**
+ * 直前に失敗した呼び出しのエラー番号を得る。
+ *
+ * @retval エラー番号(WindowsではGetLastError()、POSIXではerrnoの値)
+ */
+static int get_last_error_number(void) {
+#ifdef _WIN32
+    return static_cast<int>(GetLastError());
+#else
+    return errno;
+#endif
+}
+
+PortBridge::PortBridge(SerialPort& port_a, SerialPort& port_b, int timeout_millis)
+    : m_port_a(port_a), m_port_b(port_b), m_timeout_millis(timeout_millis),
+    m_a_to_b(port_b, "bridge.a_to_b"), m_b_to_a(port_a, "bridge.b_to_a"),
+    m_directions{ &m_a_to_b, &m_b_to_a }, m_is_failed(false), m_is_stopping(false), m_capture(nullptr) {
+}
+
+PortBridge::~PortBridge(void) {
+    stop();
+}
+
+bool PortBridge::start(uint32_t buffer_count, uint32_t buffer_size) {
+    m_is_failed = false;
+    m_is_stopping = false;
+    bool is_started = m_port_a.start_streaming([this](const uint8_t* data, uint32_t length) {
+        forward(DirectionAtoB, m_port_a, data, length);
+    }, buffer_count, buffer_size);
+    if (!is_started) {
+        return false;
+    }
+    is_started = m_port_b.start_streaming([this](const uint8_t* data, uint32_t length) {
+        forward(DirectionBtoA, m_port_b, data, length);
+    }, buffer_count, buffer_size);
+    if (!is_started) {
+        int error = get_last_error_number();
+        stop();
+#ifdef _WIN32
+        SetLastError(static_cast<DWORD>(error));
+#else
+        errno = error;
+#endif
+        return false;
+    }
+
+    return true;
+}
+
+void PortBridge::stop(void) {
+    m_is_stopping = true;
+    m_port_a.stop_streaming();
+    m_port_b.stop_streaming();
+}
+
+PortBridge::Statistics PortBridge::get_statistics(Direction direction) const noexcept {
+    const DirectionState& state = *m_directions[direction];
+    Statistics stats;
+    stats.bytes = state.bytes;
+    stats.chunks = state.chunks;
+    stats.dropped_bytes = state.dropped_bytes;
+    return stats;
+}
+
+void PortBridge::reset_statistics(void) noexcept {
+    for (DirectionState* pstate : m_directions) {
+        (*pstate).bytes = 0;
+        (*pstate).chunks = 0;
+        (*pstate).dropped_bytes = 0;
+        (*pstate).latency.reset();
+    }
+}
+
+void PortBridge::forward(Direction direction, SerialPort& src, const uint8_t* data, uint32_t length) {
+    DirectionState& state = *m_directions[direction];
+    if (data == nullptr) { // 受信エラー
+        notify_error(direction, get_last_error_number());
+        return;
+    }
+
+    if (m_capture != nullptr) {
+        (*m_capture).write(static_cast<uint16_t>(direction), CaptureFile::DirectionRx, data, length, src.get_completed_time());
+    }
+
+    // 送信が進まない場合でもstop()で抜けられるよう、StopCheckMillisごとに停止要求を確認する。
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds((m_timeout_millis > 0) ? m_timeout_millis : 0);
+    uint32_t sent = 0;
+    while (true) {
+        int wait_millis = StopCheckMillis;
+        if (m_timeout_millis >= 0) {
+            auto remain = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+            wait_millis = static_cast<int>((std::min<long long>)((std::max<long long>)(remain, 0), StopCheckMillis));
+        }
+        int result = state.dest.send(data + sent, length - sent, wait_millis);
+        if (result < 0) {
+            notify_error(direction, get_last_error_number());
+            return;
+        }
+        sent += static_cast<uint32_t>(result);
+        if ((sent >= length) || m_is_stopping || !state.dest.is_opened()) {
+            break;
+        }
+        if ((m_timeout_millis >= 0) && (std::chrono::steady_clock::now() >= deadline)) { // 送信タイムアウト？
+            break;
+        }
+    }
+
+    if (sent < length) {
+        state.dropped_bytes += length - sent;
+    }
+    if (sent > 0) {
+        state.bytes += sent;
+        state.chunks++;
+        state.latency.record(src.get_completed_time(), std::chrono::steady_clock::now());
+    }
+}
+
+void PortBridge::notify_error(Direction direction, int error) {
+    m_is_failed = true;
+    if (m_error_handler) {
+        m_error_handler(direction, error);
+    }
+}
@@ -0,0 +1,186 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+#include <atomic>
+
+#include "SerialPort.h"
+#include "LatencyHistogram.h"
+#include "CaptureFile.h"
+
+/**
+ * 2つのシリアルポート間の中継(ブリッジ)
+ *
+ * 両方のポートでストリーム受信し、受信ハンドラの中で受信バッファからそのまま対向ポートへsend()する。
+ * 中継のためのキューやコピーは行わない。
+ * 送信中も他の受信バッファで受信要求が発行済みになっているため、送信中に到着したデータも取りこぼさない。
+ * 対向ポートの送信が滞ると受信バッファが空かなくなり、受信側のドライバで溜まる(フロー制御が有効なら相手を止める)。
+ *
+ * 方向ごとに中継したバイト数と回数、受信完了から送信完了までの遅延(中継による追加遅延)を記録する。
+ * timeout_millisを指定すると、対向ポートへの送信がその時間内に完了しない場合はデータを破棄して次へ進むため、
+ * 追加遅延の上限はtimeout_millisになる。
+ *
+ * @note
+ * 中継中のポートでreceive(), start_streaming()を呼び出さないこと。
+ */
+class PortBridge
+{
+public:
+    /**
+     * 中継方向
+     */
+    enum Direction {
+        DirectionAtoB, // ポートA -> ポートB
+        DirectionBtoA, // ポートB -> ポートA
+        DirectionCount
+    };
+
+    /**
+     * 方向ごとの中継統計
+     */
+    struct Statistics {
+        uint64_t bytes; // 中継したバイト数
+        uint64_t chunks; // 中継した回数
+        uint64_t dropped_bytes; // 送信タイムアウトで破棄したバイト数
+    };
+
+    /**
+     * 中継エラーハンドラ型
+     * 受信エラーまたは送信エラーで中継が止まったときに、受信スレッドから呼び出される。
+     *
+     * @param direction エラーが発生した方向
+     * @param error エラー番号(WindowsではGetLastError()、POSIXではerrnoの値)
+     */
+    typedef std::function<void(Direction direction, int error)> error_handler_t;
+
+    /**
+     * 送信が進まない場合に停止要求を確認する間隔[ミリ秒]
+     */
+    static const int StopCheckMillis = 100;
+
+    /**
+     * コンストラクタ
+     *
+     * @param port_a ポートA(オープン済みであること)
+     * @param port_b ポートB(オープン済みであること)
+     * @param timeout_millis 対向ポートへの送信のタイムアウト時間[ミリ秒] 負数にすると永遠に待つ(データを破棄しない)。
+     */
+    PortBridge(SerialPort& port_a, SerialPort& port_b, int timeout_millis = -1);
+    /**
+     * デストラクタ
+     */
+    ~PortBridge(void);
+
+    /**
+     * 中継を開始する。
+     *
+     * @param buffer_count 1方向あたりの受信バッファ数
+     * @param buffer_size 受信バッファサイズ
+     * @retval true 成功
+     * @retval false 失敗(エラー番号はGetLastError()(POSIXではerrno)で取得できる)
+     */
+    bool start(uint32_t buffer_count = SerialPort::DefaultStreamBufferCount,
+        uint32_t buffer_size = SerialPort::DefaultStreamBufferSize);
+    /**
+     * 中継を停止する。
+     * 対向ポートへの送信が進まない状態でも、StopCheckMillis以内に受信スレッドが終了する。
+     */
+    void stop(void);
+    /**
+     * 中継中かどうかを取得する。
+     *
+     * @retval true 両方向とも中継中
+     * @retval false 停止中、またはエラーでいずれかの方向が止まった
+     */
+    bool is_running(void) const noexcept { return m_port_a.is_streaming() && m_port_b.is_streaming() && !m_is_failed; }
+
+    /**
+     * 中継エラーハンドラを設定する。
+     * start()より前に設定すること。
+     *
+     * @param handler 中継エラーハンドラ(nullptrを渡すと解除する)
+     */
+    void set_error_handler(const error_handler_t& handler) {
+        m_error_handler = handler;
+    }
+
+    /**
+     * 中継したデータを記録するキャプチャファイルを設定する。
+     * ポートAで受信したデータはチャネル0、ポートBで受信したデータはチャネル1の受信レコードとして記録する。
+     * start()より前に設定すること。
+     *
+     * @param capture キャプチャファイル(nullptrを渡すと記録しない)
+     */
+    void set_capture(CaptureFile* capture) noexcept {
+        m_capture = capture;
+    }
+
+    /**
+     * 中継統計を得る。
+     *
+     * @param direction 方向
+     * @retval 中継統計
+     */
+    Statistics get_statistics(Direction direction) const noexcept;
+    /**
+     * 中継による追加遅延(受信完了から対向ポートへの送信完了まで)のヒストグラムを得る。
+     *
+     * @param direction 方向
+     * @retval ヒストグラム
+     */
+    const LatencyHistogram& get_latency(Direction direction) const noexcept { return (*m_directions[direction]).latency; }
+    /**
+     * 中継統計と遅延ヒストグラムをクリアする。
+     */
+    void reset_statistics(void) noexcept;
+
+private:
+    /**
+     * 方向ごとの中継状態
+     */
+    struct DirectionState {
+        SerialPort& dest; // 送信先ポート
+        std::atomic<uint64_t> bytes; // 中継したバイト数
+        std::atomic<uint64_t> chunks; // 中継した回数
+        std::atomic<uint64_t> dropped_bytes; // 破棄したバイト数
+        LatencyHistogram latency; // 追加遅延
+        DirectionState(SerialPort& dest, const char* name)
+            : dest(dest), bytes(0), chunks(0), dropped_bytes(0), latency(name) {
+        }
+    };
+
+    SerialPort& m_port_a; // ポートA
+    SerialPort& m_port_b; // ポートB
+    int m_timeout_millis; // 送信タイムアウト時間
+    DirectionState m_a_to_b; // ポートA -> ポートB
+    DirectionState m_b_to_a; // ポートB -> ポートA
+    DirectionState* m_directions[DirectionCount]; // 方向ごとの中継状態
+    std::atomic<bool> m_is_failed; // エラーで中継が止まったかどうか
+    std::atomic<bool> m_is_stopping; // 停止要求中かどうか
+    error_handler_t m_error_handler; // 中継エラーハンドラ
+    CaptureFile* m_capture; // キャプチャファイル
+
+    /**
+     * 受信したデータを対向ポートへ送信する。
+     * 受信スレッドから呼び出される。
+     *
+     * @param direction 方向
+     * @param src 受信したポート
+     * @param data 受信データ(受信エラーの場合はnullptr)
+     * @param length 受信データサイズ
+     */
+    void forward(Direction direction, SerialPort& src, const uint8_t* data, uint32_t length);
+    /**
+     * エラーで中継が止まったことを通知する。
+     *
+     * @param direction 方向
+     * @param error エラー番号
+     */
+    void notify_error(Direction direction, int error);
+
+    // コピーコンストラクタは使用できない。
+    PortBridge(const PortBridge& bridge) = delete;
+    // 代入演算子は使用できない
+    PortBridge& operator=(const PortBridge& bridge) = delete;
+};
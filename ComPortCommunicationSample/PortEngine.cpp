@@ -0,0 +1,201 @@
+#ifndef _WIN32
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+#include <cerrno>
+#include <algorithm>
+#include <system_error>
+
+#ifdef _WIN32
+#include "WindowsErrorCategory.h"
+#endif
+#include "PortEngine.h"
+
+PortEngine::PortEngine(uint32_t buffer_size)
+    : m_buffer_size((buffer_size > 0) ? buffer_size : DefaultBufferSize), m_active_port_count(0) {
+#ifdef _WIN32
+    m_stop_event = CreateEventA(NULL, TRUE, FALSE, NULL);
+    if (m_stop_event == NULL) {
+        throw std::system_error(GetLastError(), windows_error_category());
+    }
+#else
+    if (pipe(m_stop_pipe) != 0) {
+        throw std::system_error(errno, std::generic_category());
+    }
+    for (int i = 0; i < 2; i++) {
+        fcntl(m_stop_pipe[i], F_SETFL, fcntl(m_stop_pipe[i], F_GETFL) | O_NONBLOCK);
+        fcntl(m_stop_pipe[i], F_SETFD, FD_CLOEXEC);
+    }
+#endif
+}
+
+PortEngine::~PortEngine(void) {
+    stop();
+#ifdef _WIN32
+    CloseHandle(m_stop_event);
+#else
+    ::close(m_stop_pipe[0]);
+    ::close(m_stop_pipe[1]);
+#endif
+}
+
+bool PortEngine::add_port(SerialPort& port, const SerialPort::receive_handler_t& handler) {
+    if (is_running()) {
+        return false;
+    }
+    m_entries.push_back(PortEntry(&port, handler));
+    return true;
+}
+
+bool PortEngine::start(uint32_t thread_count) {
+    if (m_entries.empty() || is_running()) {
+        return false;
+    }
+
+    // 停止要求をクリアする。
+#ifdef _WIN32
+    ResetEvent(m_stop_event);
+#else
+    uint8_t discard[16];
+    while (read(m_stop_pipe[0], discard, sizeof(discard)) > 0) {
+    }
+#endif
+
+    size_t port_count = m_entries.size();
+    size_t min_thread_count = (port_count + MaxPortsPerThread - 1) / MaxPortsPerThread;
+    size_t actual_thread_count = (std::min)((std::max<size_t>)(thread_count, min_thread_count), port_count);
+    m_active_port_count = static_cast<uint32_t>(port_count);
+    size_t first = 0;
+    for (size_t i = 0; i < actual_thread_count; i++) {
+        // 端数は先頭のスレッドから1つずつ割り当てる。
+        size_t count = port_count / actual_thread_count + ((i < (port_count % actual_thread_count)) ? 1 : 0);
+        m_threads.push_back(std::thread(&PortEngine::reactor_proc, this, first, count));
+        first += count;
+    }
+
+    return true;
+}
+
+void PortEngine::stop(void) {
+    if (!is_running()) {
+        return;
+    }
+#ifdef _WIN32
+    SetEvent(m_stop_event);
+#else
+    uint8_t c = 0;
+    if (write(m_stop_pipe[1], &c, 1) < 0) {
+        // パイプが満杯の場合は既に通知済みなので問題ない。
+    }
+#endif
+    for (auto& thread : m_threads) {
+        thread.join();
+    }
+    m_threads.clear();
+}
+
+void PortEngine::reactor_proc(size_t first, size_t count) {
+    std::vector<uint8_t> buf(m_buffer_size);
+    std::vector<bool> is_active(count, true);
+    std::vector<size_t> wait_indices; // 待ち合わせ対象のポート番号(先頭からfirstを引いた値)
+    wait_indices.reserve(count);
+#ifdef _WIN32
+    std::vector<HANDLE> wait_handles;
+    wait_handles.reserve(count + 1);
+#else
+    std::vector<struct pollfd> fds;
+    fds.reserve(count + 1);
+#endif
+
+    // 受信エラーが発生したポートのハンドラへ通知し、待ち合わせ対象から外す。
+    // Note: エラー番号が上書きされないよう、失敗した直後に呼び出すこと。
+    auto fail = [this, first, &is_active](size_t index) {
+        is_active[index] = false;
+        m_active_port_count--;
+        m_entries[first + index].handler(nullptr, 0);
+    };
+
+    while (true) {
+        wait_indices.clear();
+#ifdef _WIN32
+        wait_handles.clear();
+        wait_handles.push_back(m_stop_event);
+#else
+        fds.clear();
+        struct pollfd stop_fd;
+        stop_fd.fd = m_stop_pipe[0];
+        stop_fd.events = POLLIN;
+        stop_fd.revents = 0;
+        fds.push_back(stop_fd);
+#endif
+        for (size_t i = 0; i < count; i++) {
+            if (!is_active[i]) {
+                continue;
+            }
+            SerialPort& port = *(m_entries[first + i].port);
+            if (!port.request_receive_notify()) {
+                fail(i);
+                continue;
+            }
+            wait_indices.push_back(i);
+#ifdef _WIN32
+            wait_handles.push_back(port.get_receive_notify_handle());
+#else
+            struct pollfd port_fd;
+            port_fd.fd = port.get_receive_notify_handle();
+            port_fd.events = POLLIN;
+            port_fd.revents = 0;
+            fds.push_back(port_fd);
+#endif
+        }
+
+        // 停止要求はポート番号より優先して検出されるよう、先頭で待つ。
+#ifdef _WIN32
+        DWORD result = WaitForMultipleObjects(static_cast<DWORD>(wait_handles.size()), &wait_handles[0], FALSE, INFINITE);
+        if ((result == WAIT_OBJECT_0) || (result == WAIT_FAILED)) {
+            break;
+        }
+#else
+        if (poll(&fds[0], static_cast<nfds_t>(fds.size()), -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        if (fds[0].revents != 0) { // 停止要求？
+            break;
+        }
+#endif
+
+        // 通知されたポートから受信済みのデータを読み出す。
+        for (size_t i = 0; i < wait_indices.size(); i++) {
+            size_t index = wait_indices[i];
+#ifdef _WIN32
+            if (WaitForSingleObject(wait_handles[i + 1], 0) != WAIT_OBJECT_0) {
+                continue;
+            }
+#else
+            short revents = fds[i + 1].revents;
+            if (revents == 0) {
+                continue;
+            }
+#endif
+            PortEntry& entry = m_entries[first + index];
+            int length = (*entry.port).receive(&buf[0], m_buffer_size, 0);
+            if (length < 0) {
+                fail(index);
+            }
+            else if (length > 0) {
+                entry.handler(&buf[0], static_cast<uint32_t>(length));
+            }
+#ifndef _WIN32
+            else if ((revents & (POLLHUP | POLLERR | POLLNVAL)) != 0) { // ハングアップした？(疑似端末の対向がクローズされた場合など)
+                errno = EIO;
+                fail(index);
+            }
+#endif
+        }
+    }
+}
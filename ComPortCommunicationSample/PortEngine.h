@@ -0,0 +1,140 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <thread>
+#include <atomic>
+
+#include "SerialPort.h"
+
+/**
+ * 複数のシリアルポートの受信エンジン
+ *
+ * add_port()で登録したポートを、少数の受信スレッドでまとめて待ち合わせる。
+ * 各スレッドは受け持つポートの受信通知(SerialPort::request_receive_notify())を
+ * 1回の待機(WindowsではWaitForMultipleObjects()、POSIXではpoll())で待ち、
+ * 受信データがあるポートから受信済みのデータを読み出して、ポートごとの受信ハンドラへ渡す。
+ * ポート数が多くても、ポートごとに受信スレッドを起動する必要が無い。
+ *
+ * @note
+ * ポートはオープンしてからadd_port()すること。ポートの所有権は移らない。
+ * 受信中のポートでreceive(), request_receive_notify(), start_streaming()を呼び出さないこと。
+ * 送信(SerialPort::send())は別のスレッドから呼び出してよい。
+ */
+class PortEngine
+{
+public:
+    /**
+     * 1スレッドで受け持つポート数の上限
+     * (WaitForMultipleObjects()で待てるハンドル数から停止イベント分を引いた数)
+     */
+    static const uint32_t MaxPortsPerThread = 63;
+    /**
+     * 受信バッファサイズの既定値[バイト]
+     */
+    static const uint32_t DefaultBufferSize = 4096;
+
+    /**
+     * コンストラクタ
+     * 失敗した場合には std::system_error を投げる。
+     *
+     * @param buffer_size 受信バッファサイズ[バイト] (受信スレッドごとに1つ確保する)
+     */
+    explicit PortEngine(uint32_t buffer_size = DefaultBufferSize);
+    /**
+     * デストラクタ
+     */
+    ~PortEngine(void);
+
+    /**
+     * ポートを登録する。
+     * 受信データがあると、受信スレッドからhandlerを呼び出す。
+     *
+     * @param port シリアルポート(オープン済みであること)
+     * @param handler 受信ハンドラ
+     * @retval true 成功
+     * @retval false 失敗(実行中の場合)
+     * @note
+     * 受信エラーが発生すると、そのポートのhandlerをdata=nullptrで呼び出して、そのポートの受信を終了する。
+     * エラー番号はhandler内でGetLastError()(POSIXではerrno)で取得できる。
+     * 同じスレッドが受け持つ他のポートの受信は継続する。
+     */
+    bool add_port(SerialPort& port, const SerialPort::receive_handler_t& handler);
+    /**
+     * 登録したポート数を得る。
+     *
+     * @retval ポート数
+     */
+    size_t get_port_count(void) const noexcept { return m_entries.size(); }
+
+    /**
+     * 受信スレッドを開始する。
+     * ポートは受信スレッドに均等に割り当てる。
+     * 1スレッドあたりのポート数がMaxPortsPerThreadを超える場合は、thread_countより多くのスレッドを起動する。
+     *
+     * @param thread_count 受信スレッド数
+     * @retval true 成功
+     * @retval false 失敗(ポートが無い場合、既に実行中の場合)
+     */
+    bool start(uint32_t thread_count = 1);
+    /**
+     * 受信スレッドを停止する。
+     * 受信スレッドの終了を待ってから戻る。
+     */
+    void stop(void);
+    /**
+     * 実行中かどうかを取得する。
+     *
+     * @retval true 実行中
+     * @retval false 停止中
+     */
+    bool is_running(void) const noexcept { return !m_threads.empty(); }
+    /**
+     * 受信スレッド数を得る。
+     *
+     * @retval 受信スレッド数(停止中は0)
+     */
+    uint32_t get_thread_count(void) const noexcept { return static_cast<uint32_t>(m_threads.size()); }
+    /**
+     * 受信中のポート数を得る。
+     *
+     * @retval 受信中のポート数(受信エラーで終了したポートを除く)
+     */
+    uint32_t get_active_port_count(void) const noexcept { return m_active_port_count; }
+
+private:
+    /**
+     * ポートの登録情報
+     */
+    struct PortEntry {
+        SerialPort* port; // シリアルポート
+        SerialPort::receive_handler_t handler; // 受信ハンドラ
+        PortEntry(SerialPort* port, const SerialPort::receive_handler_t& handler)
+            : port(port), handler(handler) {
+        }
+    };
+
+    uint32_t m_buffer_size; // 受信バッファサイズ
+    std::vector<PortEntry> m_entries; // 登録したポート
+    std::vector<std::thread> m_threads; // 受信スレッド
+    std::atomic<uint32_t> m_active_port_count; // 受信中のポート数
+#ifdef _WIN32
+    HANDLE m_stop_event; // 停止要求イベント
+#else
+    int m_stop_pipe[2]; // 停止要求用パイプ
+#endif
+
+    /**
+     * 受信スレッドの処理を行う。
+     *
+     * @param first 受け持つ最初のポートの番号
+     * @param count 受け持つポート数
+     */
+    void reactor_proc(size_t first, size_t count);
+
+    // コピーコンストラクタは使用できない。
+    PortEngine(const PortEngine& engine) = delete;
+    // 代入演算子は使用できない
+    PortEngine& operator=(const PortEngine& engine) = delete;
+};
@@ -0,0 +1,151 @@
+#ifndef _WIN32
+
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdlib>
+#include <system_error>
+
+#include "PtyPair.h"
+
+PtyPair::PtyPair(void)
+    : m_master_fd(-1), m_slave_fd(-1), m_stop_pipe{ -1, -1 }, m_slave_name(""), m_loopback_bytes(0) {
+}
+
+PtyPair::~PtyPair(void) {
+    close();
+}
+
+void PtyPair::open(void) {
+    if (is_opened()) {
+        close();
+    }
+
+    int master_fd = posix_openpt(O_RDWR | O_NOCTTY);
+    if (master_fd < 0) {
+        throw std::system_error(errno, std::generic_category());
+    }
+    if ((grantpt(master_fd) != 0) || (unlockpt(master_fd) != 0)) {
+        int ev = errno;
+        ::close(master_fd);
+        throw std::system_error(ev, std::generic_category());
+    }
+    const char* slave_name = ptsname(master_fd);
+    if (slave_name == nullptr) {
+        int ev = errno;
+        ::close(master_fd);
+        throw std::system_error(ev, std::generic_category());
+    }
+    m_slave_name = slave_name;
+
+    // スレーブ側を開いたままにしておかないと、SerialPortがクローズしている間に
+    // マスター側の読み書きがEIOになる。
+    int slave_fd = ::open(m_slave_name.c_str(), O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+    if (slave_fd < 0) {
+        int ev = errno;
+        ::close(master_fd);
+        throw std::system_error(ev, std::generic_category());
+    }
+    // SerialPortがオープンするまでの間にエコーや改行変換が起きないよう、rawモードにしておく。
+    struct termios tio;
+    if (tcgetattr(slave_fd, &tio) == 0) {
+        cfmakeraw(&tio);
+        tcsetattr(slave_fd, TCSANOW, &tio);
+    }
+
+    fcntl(master_fd, F_SETFL, fcntl(master_fd, F_GETFL) | O_NONBLOCK);
+    fcntl(master_fd, F_SETFD, FD_CLOEXEC);
+    m_master_fd = master_fd;
+    m_slave_fd = slave_fd;
+}
+
+void PtyPair::close(void) {
+    stop_loopback();
+    if (m_slave_fd >= 0) {
+        ::close(m_slave_fd);
+        m_slave_fd = -1;
+    }
+    if (m_master_fd >= 0) {
+        ::close(m_master_fd);
+        m_master_fd = -1;
+    }
+    m_slave_name.clear();
+}
+
+void PtyPair::start_loopback(void) {
+    if (!is_opened() || is_loopback()) {
+        return;
+    }
+    if (pipe(m_stop_pipe) != 0) {
+        throw std::system_error(errno, std::generic_category());
+    }
+    m_loopback_bytes = 0;
+    m_loopback_thread = std::thread([this]() { this->loopback_thread_proc(); });
+}
+
+void PtyPair::stop_loopback(void) {
+    if (!is_loopback()) {
+        return;
+    }
+    uint8_t c = 0;
+    if (write(m_stop_pipe[1], &c, 1) < 0) {
+        // do nothing.
+    }
+    m_loopback_thread.join();
+    for (int& fd : m_stop_pipe) {
+        ::close(fd);
+        fd = -1;
+    }
+}
+
+void PtyPair::loopback_thread_proc(void) {
+    uint8_t buf[4096];
+    size_t length = 0; // 送り返していないデータ長
+    size_t offset = 0; // 送り返していないデータの先頭位置
+
+    while (true) {
+        struct pollfd fds[2];
+        fds[0].fd = m_master_fd;
+        fds[0].events = (length > 0) ? POLLOUT : POLLIN;
+        fds[0].revents = 0;
+        fds[1].fd = m_stop_pipe[0];
+        fds[1].events = POLLIN;
+        fds[1].revents = 0;
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        if (fds[1].revents != 0) { // 停止要求？
+            break;
+        }
+
+        if (length == 0) {
+            ssize_t result = read(m_master_fd, buf, sizeof(buf));
+            if (result > 0) {
+                offset = 0;
+                length = static_cast<size_t>(result);
+            }
+            else if ((result < 0) && (errno != EAGAIN) && (errno != EINTR)) {
+                break;
+            }
+        }
+        else {
+            ssize_t result = write(m_master_fd, buf + offset, length);
+            if (result > 0) {
+                offset += static_cast<size_t>(result);
+                length -= static_cast<size_t>(result);
+                m_loopback_bytes += static_cast<uint64_t>(result);
+            }
+            else if ((result < 0) && (errno != EAGAIN) && (errno != EINTR)) {
+                break;
+            }
+        }
+    }
+}
+
+#endif
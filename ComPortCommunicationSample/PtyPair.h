@@ -0,0 +1,107 @@
+#pragma once
+
+#ifndef _WIN32
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <thread>
+#include <atomic>
+
+/**
+ * 疑似端末(pty)のペア
+ *
+ * スレーブ側のデバイス名をSerialPortに渡してオープンすると、マスター側が接続先の機器として振る舞う。
+ * start_loopback()を呼ぶと、マスター側で受け取ったデータをそのまま送り返すループバックデバイスになる。
+ * シリアルポートの実機が無い環境で、SerialPortの送受信処理を動作させたり性能を計測するために使う。
+ *
+ * @note
+ * POSIX専用。
+ */
+class PtyPair
+{
+public:
+    /**
+     * コンストラクタ
+     */
+    PtyPair(void);
+    /**
+     * デストラクタ
+     */
+    ~PtyPair(void);
+
+    /**
+     * 疑似端末をオープンする。
+     * 失敗した場合には std::system_error を投げる。
+     */
+    void open(void);
+    /**
+     * 疑似端末をクローズする。
+     * ループバック動作中の場合には停止する。
+     */
+    void close(void);
+    /**
+     * オープン済みかどうかを取得する。
+     *
+     * @retval true オープン済み
+     * @retval false オープンしていない
+     */
+    bool is_opened(void) const noexcept { return m_master_fd >= 0; }
+
+    /**
+     * スレーブ側のデバイス名を得る。
+     * SerialPortのポート名として使用する。
+     *
+     * @retval デバイス名("/dev/pts/3"など)
+     */
+    const std::string& get_slave_name(void) const noexcept { return m_slave_name; }
+    /**
+     * マスター側のファイルディスクリプタを得る。
+     * ノンブロッキングモードに設定されている。
+     *
+     * @retval ファイルディスクリプタ
+     */
+    int get_master_fd(void) const noexcept { return m_master_fd; }
+
+    /**
+     * ループバック動作を開始する。
+     * マスター側で受信したデータを、受信スレッドでそのまま送り返す。
+     */
+    void start_loopback(void);
+    /**
+     * ループバック動作を停止する。
+     */
+    void stop_loopback(void);
+    /**
+     * ループバック動作中かどうかを取得する。
+     *
+     * @retval true 動作中
+     * @retval false 停止中
+     */
+    bool is_loopback(void) const noexcept { return m_loopback_thread.joinable(); }
+
+    /**
+     * ループバックで送り返したバイト数を得る。
+     *
+     * @retval バイト数
+     */
+    uint64_t get_loopback_bytes(void) const noexcept { return m_loopback_bytes; }
+
+private:
+    int m_master_fd; // マスター側のファイルディスクリプタ
+    int m_slave_fd; // スレーブ側のファイルディスクリプタ(マスター側がEIOにならないよう保持する)
+    int m_stop_pipe[2]; // ループバック停止通知用パイプ
+    std::string m_slave_name; // スレーブ側のデバイス名
+    std::thread m_loopback_thread; // ループバックスレッド
+    std::atomic<uint64_t> m_loopback_bytes; // ループバックしたバイト数
+
+    /**
+     * ループバックスレッド処理
+     */
+    void loopback_thread_proc(void);
+
+    PtyPair(const PtyPair& pty) = delete;
+    PtyPair& operator=(const PtyPair& pty) = delete;
+};
+
+#endif
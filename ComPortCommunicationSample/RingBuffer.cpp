@@ -0,0 +1,73 @@
+#include <cstring>
+#include <algorithm>
+
+#include "RingBuffer.h"
+
+/**
+ * capacity以上で最小の2のべき乗を得る。
+ *
+ * @param capacity 容量
+ * @retval 2のべき乗に切り上げた容量
+ */
+static size_t round_up_pow2(size_t capacity) {
+    size_t value = 1;
+    while (value < capacity) {
+        value <<= 1;
+    }
+    return value;
+}
+
+ByteRingBuffer::ByteRingBuffer(size_t capacity)
+    : m_buffer(round_up_pow2(capacity)), m_mask(round_up_pow2(capacity) - 1), m_head(0), m_tail(0) {
+}
+
+size_t ByteRingBuffer::push(const void* data, size_t length) {
+    const uint8_t* rp = static_cast<const uint8_t*>(data);
+    size_t written = 0;
+    while (written < length) { // 末尾で折り返す場合は2回に分けて書き込む。
+        uint8_t* span;
+        size_t span_length = get_write_span(&span);
+        if (span_length == 0) { // 満杯？
+            break;
+        }
+        size_t io_length = std::min(span_length, length - written);
+        memcpy(span, rp + written, io_length);
+        commit_write(io_length);
+        written += io_length;
+    }
+    return written;
+}
+
+size_t ByteRingBuffer::pop(void* buf, size_t bufsize) {
+    uint8_t* wp = static_cast<uint8_t*>(buf);
+    size_t read_length = 0;
+    while (read_length < bufsize) { // 末尾で折り返す場合は2回に分けて読み出す。
+        const uint8_t* span;
+        size_t span_length = get_read_span(&span);
+        if (span_length == 0) { // 空？
+            break;
+        }
+        size_t io_length = std::min(span_length, bufsize - read_length);
+        memcpy(wp + read_length, span, io_length);
+        consume(io_length);
+        read_length += io_length;
+    }
+    return read_length;
+}
+
+size_t ByteRingBuffer::get_write_span(uint8_t** pspan) noexcept {
+    size_t tail = m_tail.load(std::memory_order_relaxed);
+    size_t head = m_head.load(std::memory_order_acquire);
+    size_t free_space = capacity() - (tail - head);
+    size_t offset = tail & m_mask;
+    (*pspan) = &m_buffer[offset];
+    return std::min(free_space, capacity() - offset);
+}
+
+size_t ByteRingBuffer::get_read_span(const uint8_t** pspan) const noexcept {
+    size_t head = m_head.load(std::memory_order_relaxed);
+    size_t tail = m_tail.load(std::memory_order_acquire);
+    size_t offset = head & m_mask;
+    (*pspan) = &m_buffer[offset];
+    return std::min(tail - head, capacity() - offset);
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+#include <vector>
+
+/**
+ * 単一生産者・単一消費者(SPSC)用のロックフリーなバイトリングバッファ
+ *
+ * 書き込み(push, get_write_span, commit_write)は1つのスレッドから、
+ * 読み出し(pop, get_read_span, consume)は別の1つのスレッドからのみ呼び出すこと。
+ * size(), empty(), get_free_space()はどのスレッドから呼び出してもよい。
+ */
+class ByteRingBuffer
+{
+public:
+    /**
+     * コンストラクタ
+     *
+     * @param capacity 容量[バイト] (2のべき乗に切り上げる)
+     */
+    explicit ByteRingBuffer(size_t capacity);
+
+    /**
+     * 容量を得る。
+     *
+     * @retval 容量[バイト]
+     */
+    size_t capacity(void) const noexcept { return m_mask + 1; }
+    /**
+     * 格納されているデータ量を得る。
+     *
+     * @retval データ量[バイト]
+     */
+    size_t size(void) const noexcept {
+        return m_tail.load(std::memory_order_acquire) - m_head.load(std::memory_order_acquire);
+    }
+    /**
+     * 空かどうかを得る。
+     *
+     * @retval true 空
+     * @retval false データがある
+     */
+    bool empty(void) const noexcept { return size() == 0; }
+    /**
+     * 空き容量を得る。
+     *
+     * @retval 空き容量[バイト]
+     */
+    size_t get_free_space(void) const noexcept { return capacity() - size(); }
+
+    /**
+     * データを書き込む。
+     * 空き容量が足りない場合には書き込める分だけ書き込む。
+     *
+     * @param data データ
+     * @param length データ長
+     * @retval 書き込んだバイト数
+     */
+    size_t push(const void* data, size_t length);
+    /**
+     * データを読み出す。
+     *
+     * @param buf 読み出したデータを格納するバッファ
+     * @param bufsize バッファサイズ
+     * @retval 読み出したバイト数
+     */
+    size_t pop(void* buf, size_t bufsize);
+
+    /**
+     * 連続して書き込める領域を得る。
+     * 領域に書き込んだ後、commit_write()で書き込んだ長さを通知する。
+     *
+     * @param pspan 領域の先頭アドレスを格納する変数
+     * @retval 領域の長さ[バイト] (0の場合は満杯)
+     */
+    size_t get_write_span(uint8_t** pspan) noexcept;
+    /**
+     * get_write_span()で得た領域への書き込みを確定する。
+     *
+     * @param length 書き込んだ長さ
+     */
+    void commit_write(size_t length) noexcept {
+        m_tail.store(m_tail.load(std::memory_order_relaxed) + length, std::memory_order_release);
+    }
+
+    /**
+     * 連続して読み出せる領域を得る。
+     * 領域を読み出した後、consume()で読み出した長さを通知する。
+     *
+     * @param pspan 領域の先頭アドレスを格納する変数
+     * @retval 領域の長さ[バイト] (0の場合は空)
+     */
+    size_t get_read_span(const uint8_t** pspan) const noexcept;
+    /**
+     * get_read_span()で得た領域の読み出しを確定し、領域を解放する。
+     *
+     * @param length 読み出した長さ
+     */
+    void consume(size_t length) noexcept {
+        m_head.store(m_head.load(std::memory_order_relaxed) + length, std::memory_order_release);
+    }
+
+private:
+    std::vector<uint8_t> m_buffer; // バッファ
+    size_t m_mask; // インデックスマスク(容量 - 1)
+    alignas(64) std::atomic<size_t> m_head; // 読み出し位置(消費者のみ更新する)
+    alignas(64) std::atomic<size_t> m_tail; // 書き込み位置(生産者のみ更新する)
+
+    ByteRingBuffer(const ByteRingBuffer& buffer) = delete;
+    ByteRingBuffer& operator=(const ByteRingBuffer& buffer) = delete;
+};
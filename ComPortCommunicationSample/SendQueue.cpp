@@ -0,0 +1,242 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include "SendQueue.h"
+
+/**
+ * 直前に失敗した呼び出しのエラー番号を得る。
+ *
+ * @retval エラー番号(WindowsではGetLastError()、POSIXではerrnoの値)
+ */
+static int get_last_error_number(void) {
+#ifdef _WIN32
+    return static_cast<int>(GetLastError());
+#else
+    return errno;
+#endif
+}
+
+SendQueue::SendQueue(SerialPort& port, uint32_t capacity, uint32_t flush_threshold, uint32_t flush_delay_millis)
+    : m_port(port), m_capacity((capacity > 0) ? capacity : DefaultCapacity),
+    m_flush_threshold((std::min)(flush_threshold, m_capacity)), m_flush_delay(flush_delay_millis),
+    m_port_queue_limit(DefaultPortQueueLimit), m_in_flight(0), m_max_depth(0), m_flush_waiters(0),
+    m_is_writable_requested(false), m_port_waits(0), m_is_running(false), m_error(0) {
+    m_pending.reserve(m_capacity);
+    m_sending.reserve(m_capacity);
+}
+
+SendQueue::~SendQueue(void) {
+    stop();
+}
+
+void SendQueue::start(void) {
+    if (m_thread.joinable()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_pending.clear();
+        m_in_flight = 0;
+        m_max_depth = 0;
+        m_port_waits = 0;
+        m_error = 0;
+        m_is_running = true;
+    }
+    m_thread = std::thread(&SendQueue::send_proc, this);
+}
+
+void SendQueue::stop(void) {
+    if (!m_thread.joinable()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_is_running = false;
+    }
+    m_cond.notify_all();
+    m_thread.join();
+}
+
+void SendQueue::set_port_queue_limit(uint32_t limit) {
+    std::lock_guard<std::mutex> lock(m_lock);
+    m_port_queue_limit = limit;
+    m_cond.notify_all();
+}
+
+bool SendQueue::request_writable_notify(void) {
+    std::lock_guard<std::mutex> lock(m_lock);
+    m_is_writable_requested = !is_writable_locked();
+    return !m_is_writable_requested;
+}
+
+int SendQueue::enqueue(const uint8_t* data, uint32_t length, int timeout_millis) {
+    if (data == nullptr) {
+        return -1;
+    }
+
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds((timeout_millis > 0) ? timeout_millis : 0);
+    std::unique_lock<std::mutex> lock(m_lock);
+    uint32_t queued = 0;
+    while (queued < length) {
+        if (!m_is_running || (m_error != 0)) { // 停止中または送信エラー発生済み？
+            return (queued > 0) ? static_cast<int>(queued) : -1;
+        }
+        size_t space = get_space_locked();
+        if (space == 0) { // 空きが無い？
+            if (timeout_millis < 0) {
+                m_cond.wait(lock);
+            }
+            else if ((timeout_millis == 0) || (m_cond.wait_until(lock, deadline) == std::cv_status::timeout)) {
+                break;
+            }
+            continue;
+        }
+
+        size_t length_to_queue = (std::min<size_t>)(space, length - queued);
+        if (m_pending.empty()) {
+            m_first_enqueued = std::chrono::steady_clock::now();
+        }
+        m_pending.insert(m_pending.end(), data + queued, data + queued + length_to_queue);
+        queued += static_cast<uint32_t>(length_to_queue);
+        m_max_depth = (std::max)(m_max_depth, m_pending.size() + m_in_flight);
+        m_cond.notify_all();
+    }
+
+    return static_cast<int>(queued);
+}
+
+bool SendQueue::flush(int timeout_millis) {
+    std::unique_lock<std::mutex> lock(m_lock);
+    m_flush_waiters++;
+    m_cond.notify_all();
+    auto is_done = [this]() { return (m_pending.empty() && (m_in_flight == 0)) || (m_error != 0); };
+    if (timeout_millis < 0) {
+        m_cond.wait(lock, is_done);
+    }
+    else {
+        m_cond.wait_for(lock, std::chrono::milliseconds(timeout_millis), is_done);
+    }
+    m_flush_waiters--;
+
+    return m_pending.empty() && (m_in_flight == 0) && (m_error == 0);
+}
+
+size_t SendQueue::get_depth(void) {
+    std::lock_guard<std::mutex> lock(m_lock);
+    return m_pending.size() + m_in_flight;
+}
+
+size_t SendQueue::get_max_depth(void) {
+    std::lock_guard<std::mutex> lock(m_lock);
+    return m_max_depth;
+}
+
+int SendQueue::get_error(void) {
+    std::lock_guard<std::mutex> lock(m_lock);
+    return m_error;
+}
+
+uint64_t SendQueue::get_port_waits(void) {
+    std::lock_guard<std::mutex> lock(m_lock);
+    return m_port_waits;
+}
+
+size_t SendQueue::wait_port_writable(std::unique_lock<std::mutex>& lock) {
+    // Note: ドライバの送信キューの減少は通知されないので、上限の半分を送り出す程度の間隔で確認する。
+    //       1バイトを10ビットとして計算し、1～10ミリ秒の範囲に収める。
+    uint32_t baudrate = (std::max)(m_port.get_baudrate(), 1u);
+    uint32_t interval_millis = static_cast<uint32_t>((static_cast<uint64_t>(m_port_queue_limit / 2) * 10 * 1000) / baudrate);
+    auto interval = std::chrono::milliseconds((std::min)((std::max)(interval_millis, 1u), 10u));
+    while (m_port_queue_limit > 0) {
+        uint32_t limit = m_port_queue_limit;
+        lock.unlock();
+        if (!m_port.is_opened()) {
+            lock.lock();
+            break;
+        }
+        bool is_writable = m_port.is_writable(limit);
+        // Note: 送信キューに積むのはこのスレッドだけなので、確認した後に送信キューが増えることはない。
+        int queued = (is_writable) ? m_port.get_output_queue_length() : -1;
+        lock.lock();
+        if (is_writable && (queued >= 0) && (static_cast<uint32_t>(queued) < limit)) {
+            return limit - static_cast<uint32_t>(queued);
+        }
+        m_port_waits++;
+        m_cond.wait_for(lock, interval);
+    }
+    return SIZE_MAX;
+}
+
+void SendQueue::send_proc(void) {
+    std::unique_lock<std::mutex> lock(m_lock);
+    while (true) {
+        if (m_pending.empty()) {
+            if (!m_is_running) { // 全て送信して停止要求を受けた？
+                break;
+            }
+            m_cond.wait(lock);
+            continue;
+        }
+        if (m_is_running && (m_flush_waiters == 0) && (m_pending.size() < m_flush_threshold)) {
+            // 閾値に満たない場合、猶予時間が経過するまで後続のデータを待つ。
+            auto deadline = m_first_enqueued + m_flush_delay;
+            if (std::chrono::steady_clock::now() < deadline) {
+                m_cond.wait_until(lock, deadline);
+                continue;
+            }
+        }
+
+        // 送信待ちデータを送信中データと入れ替え、送信中に次のデータを積めるようにする。
+        // Note: 送信中のデータはsend()するまでキューの空きに含めないので、メモリ使用量は容量を超えない。
+        m_sending.swap(m_pending);
+        m_pending.clear();
+        m_in_flight = m_sending.size();
+
+        int error = 0;
+        size_t sent = 0;
+        while (sent < m_sending.size()) {
+            // ドライバの送信キューが上限を超えないように区切って送信する。
+            size_t length_to_send = (std::min)(wait_port_writable(lock), m_sending.size() - sent);
+            lock.unlock();
+            int result = m_port.send(&m_sending[sent], static_cast<uint32_t>(length_to_send), -1);
+            if (result < 0) {
+                error = get_last_error_number();
+            }
+            else if (result == 0) { // close()された？
+#ifdef _WIN32
+                error = ERROR_OPERATION_ABORTED;
+#else
+                error = ECANCELED;
+#endif
+            }
+            lock.lock();
+            if (error != 0) {
+                break;
+            }
+            sent += static_cast<size_t>(result);
+            m_in_flight -= static_cast<size_t>(result);
+            m_cond.notify_all(); // 空きができた。
+            if (take_writable_notify_locked()) {
+                lock.unlock();
+                m_writable_handler();
+                lock.lock();
+            }
+        }
+
+        m_sending.clear();
+        m_in_flight = 0;
+        if (error != 0) {
+            // 送信エラー発生後は送信待ちデータを破棄し、以降のenqueue()を失敗させる。
+            m_error = error;
+            m_pending.clear();
+            m_cond.notify_all();
+            if (take_writable_notify_locked()) {
+                lock.unlock();
+                m_writable_handler();
+            }
+            break;
+        }
+        m_cond.notify_all();
+    }
+}
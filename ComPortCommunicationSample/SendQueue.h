@@ -0,0 +1,218 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+
+#include "SerialPort.h"
+
+/**
+ * シリアルポートの非同期送信キュー
+ *
+ * enqueue()で積まれたデータを送信スレッドがまとめてSerialPort::send()する。
+ * 小さな書き込みが続く場合でも、溜まったデータがflush_threshold以上になるか、
+ * 最初のデータを積んでからflush_delay_millis経過した時点でまとめて送信するため、
+ * WriteFile()の発行回数が減る。送信中に積まれたデータは、送信完了後に続けてまとめて送信する。
+ * ドライバの送信キューが上限(port_queue_limit)に達している間やCTSで送信が止められている間は送信を控え、
+ * 1回のsend()もドライバの送信キューが上限を超えない長さに区切るので、相手が受け取れないデータはこのキューに留まる。キューの空きが容量の半分以上になるとenqueue()が
+ * ブロックしない(writable)状態とみなし、request_writable_notify()で要求した通知を送る。
+ * 呼び出し元は通知を受けてから上流(標準入力など)を読み出すことで、一定のメモリで流量を合わせられる。
+ *
+ * @note
+ * enqueue(), flush(), get_depth()はどのスレッドから呼び出してもよい。
+ * 送信が進まない状態(CTSフロー制御で停止中など)でstop()するときは、先にSerialPort::close()すること。
+ */
+class SendQueue
+{
+public:
+    /**
+     * キュー容量の既定値[バイト]
+     */
+    static const uint32_t DefaultCapacity = 64 * 1024;
+    /**
+     * まとめて送信する閾値の既定値[バイト]
+     */
+    static const uint32_t DefaultFlushThreshold = 4096;
+    /**
+     * 閾値に満たないデータを送信するまでの猶予時間の既定値[ミリ秒]
+     */
+    static const uint32_t DefaultFlushDelayMillis = 1;
+    /**
+     * ドライバの送信キューの上限の既定値[バイト]
+     */
+    static const uint32_t DefaultPortQueueLimit = 4096;
+
+    /**
+     * 書き込み可能通知ハンドラ型
+     * 送信スレッド(またはrequest_writable_notify()を呼び出したスレッド以外)から呼び出される。
+     */
+    typedef std::function<void(void)> writable_handler_t;
+
+    /**
+     * コンストラクタ
+     *
+     * @param port 送信するシリアルポート
+     * @param capacity キュー容量[バイト]
+     * @param flush_threshold まとめて送信する閾値[バイト]
+     * @param flush_delay_millis 閾値に満たないデータを送信するまでの猶予時間[ミリ秒]
+     */
+    SendQueue(SerialPort& port, uint32_t capacity = DefaultCapacity,
+        uint32_t flush_threshold = DefaultFlushThreshold, uint32_t flush_delay_millis = DefaultFlushDelayMillis);
+    /**
+     * デストラクタ
+     */
+    ~SendQueue(void);
+
+    /**
+     * 送信スレッドを開始する。
+     */
+    void start(void);
+    /**
+     * 送信スレッドを停止する。
+     * キューに残っているデータを送信してから停止する。
+     */
+    void stop(void);
+
+    /**
+     * ドライバの送信キューの上限を設定する。
+     * 送信スレッドは、ドライバの送信キューがこの値未満になるまで次の送信を待つ。
+     *
+     * @param limit ドライバの送信キューの上限[バイト](0にすると上限を設けない)
+     */
+    void set_port_queue_limit(uint32_t limit);
+    /**
+     * 書き込み可能通知ハンドラを設定する。start()の前に呼び出すこと。
+     *
+     * @param handler ハンドラ
+     */
+    void set_writable_handler(const writable_handler_t& handler) { m_writable_handler = handler; }
+    /**
+     * 書き込み可能通知を要求する。
+     * 書き込み可能でない場合は、書き込み可能になった時点で書き込み可能通知ハンドラを1回呼び出す。
+     * 通知を受けたら、データを積む前に再度呼び出して状態を確認すること。
+     *
+     * @retval true 書き込み可能(キューの空きが容量の半分以上あるか、停止中または送信エラー発生済みでenqueue()がブロックしない)
+     * @retval false 書き込み可能でない(通知を要求した)
+     */
+    bool request_writable_notify(void);
+
+    /**
+     * 送信データをキューに積む。
+     * キューに空きが無い場合は、空きができるか、timeout_millis時間経過するまで呼び出し元をブロックする。
+     *
+     * @param data 送信データ
+     * @param length 送信データサイズ
+     * @param timeout_millis タイムアウト時間[ミリ秒] 負数にすると永遠に待つ。
+     * @retval -1 送信エラーが発生している場合、または開始していない場合
+     * @retval 0以上の値 キューに積んだバイト数
+     */
+    int enqueue(const uint8_t* data, uint32_t length, int timeout_millis = -1);
+    /**
+     * キューに積まれたデータを直ちに送信し、送信完了するか、timeout_millis時間経過するまで待つ。
+     *
+     * @param timeout_millis タイムアウト時間[ミリ秒] 負数にすると永遠に待つ。
+     * @retval true 送信完了した
+     * @retval false タイムアウトした、または送信エラーが発生した
+     */
+    bool flush(int timeout_millis = -1);
+    /**
+     * キューの深さ(送信待ち+送信中のバイト数)を得る。
+     *
+     * @retval キューの深さ[バイト]
+     */
+    size_t get_depth(void);
+    /**
+     * キューの深さの最大値(start()以降)を得る。
+     *
+     * @retval キューの深さの最大値[バイト]
+     */
+    size_t get_max_depth(void);
+    /**
+     * 送信エラーのエラー番号を得る。
+     *
+     * @retval 0 エラー無し
+     * @retval 0以外 エラー番号(WindowsではGetLastError()、POSIXではerrnoの値)
+     */
+    int get_error(void);
+    /**
+     * ドライバの送信キューの空きを待った回数(start()以降)を得る。
+     *
+     * @retval 待った回数
+     */
+    uint64_t get_port_waits(void);
+
+private:
+    SerialPort& m_port; // 送信するシリアルポート
+    uint32_t m_capacity; // キュー容量
+    uint32_t m_flush_threshold; // まとめて送信する閾値
+    std::chrono::milliseconds m_flush_delay; // 閾値に満たないデータを送信するまでの猶予時間
+    uint32_t m_port_queue_limit; // ドライバの送信キューの上限(0は上限無し)
+    writable_handler_t m_writable_handler; // 書き込み可能通知ハンドラ
+    std::mutex m_lock; // 排他ロック
+    std::condition_variable m_cond; // 状態変化通知(データ追加、送信完了、停止で通知する)
+    std::vector<uint8_t> m_pending; // 送信待ちデータ
+    std::vector<uint8_t> m_sending; // 送信中データ(送信スレッドのみアクセス)
+    size_t m_in_flight; // 送信中データのうち、まだsend()していないバイト数
+    size_t m_max_depth; // キューの深さの最大値
+    std::chrono::steady_clock::time_point m_first_enqueued; // 送信待ちデータの最初のデータを積んだ時刻
+    uint32_t m_flush_waiters; // flush()で待機中のスレッド数
+    bool m_is_writable_requested; // 書き込み可能通知を要求されているかどうか
+    uint64_t m_port_waits; // ドライバの送信キューの空きを待った回数
+    bool m_is_running; // 送信スレッドを実行中かどうか
+    int m_error; // 送信エラーのエラー番号
+    std::thread m_thread; // 送信スレッド
+
+    /**
+     * キューの空きを得る。ロックを保持した状態で呼び出すこと。
+     * 送信中のデータも送信が終わるまではキューの一部として数える。
+     *
+     * @retval キューの空き[バイト]
+     */
+    size_t get_space_locked(void) const noexcept {
+        return m_capacity - m_pending.size() - m_in_flight;
+    }
+    /**
+     * 書き込み可能かどうかを得る。ロックを保持した状態で呼び出すこと。
+     *
+     * @retval true 書き込み可能
+     * @retval false 書き込み可能でない
+     */
+    bool is_writable_locked(void) const noexcept {
+        return !m_is_running || (m_error != 0) || (get_space_locked() >= (m_capacity / 2));
+    }
+    /**
+     * 書き込み可能通知を送るべきかを判定し、送る場合は要求を取り下げる。ロックを保持した状態で呼び出すこと。
+     *
+     * @retval true 書き込み可能通知ハンドラを呼び出す
+     * @retval false 呼び出さない
+     */
+    bool take_writable_notify_locked(void) noexcept {
+        if (!m_is_writable_requested || !is_writable_locked()) {
+            return false;
+        }
+        m_is_writable_requested = false;
+        return static_cast<bool>(m_writable_handler);
+    }
+    /**
+     * ドライバの送信キューに空きができるまで待ち、上限を超えずに渡せるバイト数を得る。ロックを保持した状態で呼び出すこと。
+     * ポートがクローズされた場合は待たずに戻る(続くsend()がエラーになる)。
+     *
+     * @param lock ロック
+     * @retval ドライバの送信キューに渡せるバイト数(上限無しやクローズ済みの場合はSIZE_MAX)
+     */
+    size_t wait_port_writable(std::unique_lock<std::mutex>& lock);
+    /**
+     * 送信スレッドの処理を行う。
+     */
+    void send_proc(void);
+
+    // コピーコンストラクタは使用できない。
+    SendQueue(const SendQueue& queue) = delete;
+    // 代入演算子は使用できない
+    SendQueue& operator=(const SendQueue& queue) = delete;
+};
@@ -1,12 +1,14 @@
+#ifdef _WIN32
 #include <tchar.h>
 #include <Windows.h>
 
 #include <cstdio>
+#include <vector>
 #include <system_error>
 
 #if WINVER >= _WIN32_WINNT_WIN10
 /**
- * Note: GetCommPorts()gpɂOneCore.libKvB
+ * Note: GetCommPorts()を使用するにはOneCore.libが必要。
  */
 #pragma comment(lib, "OneCore.lib")
 #endif
@@ -16,14 +18,14 @@
 
 #if WINVER < _WIN32_WINNT_WIN10
 /**
- * Y|[g݂邩ǂ擾B
+ * 該当ポートが存在するかどうかを取得する。
  *
- * @param port_name |[g
- * @retval true |[g݂B
- * @retval false |[g݂ȂB
+ * @param port_name ポート名
+ * @retval true ポートが存在する。
+ * @retval false ポートが存在しない。
  * @note
- * ͊Y|[gI[vł邩ǂŔ肵Ă̂ŁArANZXŃI[vĂꍇɂ͎sB
- * ̂߁A|[ĝfalseԂƂۂB
+ * これは該当ポートがオープンできるかどうかで判定しているので、排他アクセスでオープンされている場合には失敗する。
+ * そのため、ポートがあるのにfalseが返るという現象が発生する。
  */
 static bool is_port_exists(const char* port_name) {
     char com_device_path[256];
@@ -92,23 +94,60 @@ bool SerialPort::enumerate_ports(std::vector<std::string>* plist) {
 }
 
 SerialPort::SerialPort(const std::string& port_name)
-    : m_port_handle(INVALID_HANDLE_VALUE), m_port_name(port_name),
+    : m_port_handle(INVALID_HANDLE_VALUE),
+    m_read_event(NULL), m_write_event(NULL), m_cancel_event(NULL),
+    m_notify_event(NULL), m_notify_mask(0), m_is_notify_pending(false), m_stream_stop_event(NULL),
+    m_is_streaming(false), m_port_name(port_name),
     m_baudrate(9600), m_databits(8), m_parity(ParityNone),
     m_stopbits(StopBitsOne), m_cts_flow(CtsFlowDisable), m_rts_control(RtsControlDisable) {
-
+    reset_statistics();
+    create_events();
 }
 
 SerialPort::SerialPort(const std::string& port_name, const SerialPort& ref_port) 
-    : m_port_handle(INVALID_HANDLE_VALUE), m_port_name(port_name),
+    : m_port_handle(INVALID_HANDLE_VALUE),
+    m_read_event(NULL), m_write_event(NULL), m_cancel_event(NULL),
+    m_notify_event(NULL), m_notify_mask(0), m_is_notify_pending(false), m_stream_stop_event(NULL),
+    m_is_streaming(false), m_port_name(port_name),
     m_baudrate(ref_port.m_baudrate), m_databits(ref_port.m_databits), m_parity(ref_port.m_parity),
     m_stopbits(ref_port.m_stopbits), m_cts_flow(ref_port.m_cts_flow), m_rts_control(ref_port.m_rts_control) {
-
+    reset_statistics();
+    create_events();
 }
 
 SerialPort::~SerialPort(void) {
     if (is_opened()) {
         close();
     }
+    close_events();
+}
+
+void SerialPort::create_events(void) {
+    // Note: OVERLAPPED.hEventにはマニュアルリセットイベントを使う。
+    //       ReadFile()/WriteFile()が要求発行時に非シグナル状態へ戻す。
+    m_read_event = CreateEventA(NULL, TRUE, FALSE, NULL);
+    m_write_event = CreateEventA(NULL, TRUE, FALSE, NULL);
+    m_cancel_event = CreateEventA(NULL, TRUE, FALSE, NULL);
+    m_notify_event = CreateEventA(NULL, TRUE, FALSE, NULL);
+    m_stream_stop_event = CreateEventA(NULL, TRUE, FALSE, NULL);
+    ZeroMemory(&m_notify_req, sizeof(m_notify_req));
+    ZeroMemory(&m_saved_timeouts, sizeof(m_saved_timeouts));
+    if ((m_read_event == NULL) || (m_write_event == NULL) || (m_cancel_event == NULL) || (m_notify_event == NULL)
+        || (m_stream_stop_event == NULL)) {
+        DWORD ev = GetLastError();
+        close_events();
+        throw std::system_error(ev, windows_error_category());
+    }
+}
+
+void SerialPort::close_events(void) {
+    HANDLE* events[] = { &m_read_event, &m_write_event, &m_cancel_event, &m_notify_event, &m_stream_stop_event };
+    for (HANDLE* pevent : events) {
+        if ((*pevent) != NULL) {
+            CloseHandle(*pevent);
+            (*pevent) = NULL;
+        }
+    }
 }
 
 void SerialPort::open(void) {
@@ -124,19 +163,31 @@ void SerialPort::open(void) {
         DWORD ev = GetLastError();
         throw std::system_error(ev, windows_error_category());
     }
+    ResetEvent(m_cancel_event);
+    ResetEvent(m_notify_event);
+    SetCommMask(m_port_handle, EV_RXCHAR);
 
     apply_settings();
 }
 
 void SerialPort::close(void) {
+    stop_streaming();
     if (is_opened()) {
-        CloseHandle(m_port_handle);
+        HANDLE handle = m_port_handle;
         m_port_handle = INVALID_HANDLE_VALUE;
+        SetEvent(m_cancel_event); // wait_io()で待機中のスレッドを起こす。
+        CancelIoEx(handle, NULL);
+        if (m_is_notify_pending) { // 受信通知要求がキャンセルされるのを待つ。
+            DWORD transferred;
+            GetOverlappedResult(handle, &m_notify_req, &transferred, TRUE);
+            m_is_notify_pending = false;
+        }
+        CloseHandle(handle);
     }
 }
 
 void SerialPort::apply_settings(void) {
-    if (!is_opened()) { // I[vĂȂH
+    if (!is_opened()) { // オープンしてない？
         return;
     }
 
@@ -164,23 +215,28 @@ int SerialPort::send(const uint8_t* data, uint32_t length, int timeout_millis) {
         return 0;
     }
 
+    HANDLE handle = m_port_handle;
     OVERLAPPED write_req;
     ZeroMemory(&write_req, sizeof(write_req));
-    write_req.hEvent = NULL;
+    write_req.hEvent = m_write_event;
     DWORD transferred = 0;
-    if (WriteFile(m_port_handle, data, length, &transferred, &write_req)) {
-        return static_cast<int>(transferred);
+    int result;
+    if (WriteFile(handle, data, length, &transferred, &write_req)) {
+        result = static_cast<int>(transferred);
     }
     else {
         auto err = GetLastError();
         if (err != ERROR_IO_PENDING) {
+            count_transfer(true, -1, length, timeout_millis);
             SetLastError(err);
             return -1;
         }
         else {
-            return wait_io(&write_req, timeout_millis);
+            result = wait_io(handle, &write_req, timeout_millis);
         }
     }
+    count_transfer(true, result, length, timeout_millis);
+    return result;
 }
 
 int SerialPort::receive(uint8_t* buf, uint32_t bufsize, int timeout_millis) {
@@ -192,59 +248,281 @@ int SerialPort::receive(uint8_t* buf, uint32_t bufsize, int timeout_millis) {
         return 0;
     }
 
+    HANDLE handle = m_port_handle;
     DWORD errors;
     COMSTAT com_stat;
-    if (!ClearCommError(m_port_handle, &errors, &com_stat)) {
+    if (!ClearCommError(handle, &errors, &com_stat)) {
         // Error number was set by COM.
         return -1;
     }
     else {
-        // G[nhO
+        // エラーハンドリング
         if (errors != 0) {
             handle_errors(errors);
         }
+        count_max(CounterReceiveQueueMax, com_stat.cbInQue);
     }
 
     int io_length = (timeout_millis == 0) ? min(com_stat.cbInQue, bufsize) : bufsize;
 
     OVERLAPPED read_req;
     ZeroMemory(&read_req, sizeof(read_req));
-    read_req.hEvent = NULL;
+    read_req.hEvent = m_read_event;
     DWORD transferred = 0;
-    if (ReadFile(m_port_handle, buf, io_length, &transferred, &read_req)) {
-        return static_cast<int>(transferred);
+    int result;
+    if (ReadFile(handle, buf, io_length, &transferred, &read_req)) {
+        result = static_cast<int>(transferred);
     }
     else {
         auto err = GetLastError();
         if (err != ERROR_IO_PENDING) {
+            count_transfer(false, -1, bufsize, timeout_millis);
             SetLastError(err);
             return -1;
         }
         else {
-            return wait_io(&read_req, timeout_millis);
+            result = wait_io(handle, &read_req, timeout_millis);
         }
     }
+    count_transfer(false, result, bufsize, timeout_millis);
+    return result;
+}
+
+int SerialPort::get_output_queue_length(void) {
+    DWORD errors;
+    COMSTAT com_stat;
+    if (!ClearCommError(m_port_handle, &errors, &com_stat)) {
+        // Error number was set by COM.
+        return -1;
+    }
+    if (errors != 0) {
+        handle_errors(errors);
+    }
+    count_max(CounterSendQueueMax, com_stat.cbOutQue);
+    return static_cast<int>(com_stat.cbOutQue);
+}
+
+bool SerialPort::is_writable(uint32_t queue_limit) {
+    DWORD errors;
+    COMSTAT com_stat;
+    if (!ClearCommError(m_port_handle, &errors, &com_stat)) {
+        // Error number was set by COM.
+        return false;
+    }
+    if (errors != 0) {
+        handle_errors(errors);
+    }
+    count_max(CounterSendQueueMax, com_stat.cbOutQue);
+    return (com_stat.cbOutQue < queue_limit) && !com_stat.fCtsHold;
 }
 
-int SerialPort::wait_io(LPOVERLAPPED req, int timeout_millis) {
-    auto begin = GetTickCount64();
-    while (is_opened()) {
-        if (HasOverlappedIoCompleted(req)) {
+bool SerialPort::request_receive_notify(void) {
+    HANDLE handle = m_port_handle;
+    if (handle == INVALID_HANDLE_VALUE) {
+        SetLastError(ERROR_INVALID_HANDLE);
+        return false;
+    }
+
+    if (m_is_notify_pending) { // 前回の要求を発行中？
+        if (WaitForSingleObject(m_notify_event, 0) != WAIT_OBJECT_0) { // まだ通知されていない？
+            return true;
+        }
+        DWORD transferred;
+        GetOverlappedResult(handle, &m_notify_req, &transferred, FALSE);
+        m_is_notify_pending = false;
+    }
+
+    DWORD errors;
+    COMSTAT com_stat;
+    if (!ClearCommError(handle, &errors, &com_stat)) {
+        // Error number was set by COM.
+        return false;
+    }
+    if (errors != 0) {
+        handle_errors(errors);
+    }
+    count_max(CounterReceiveQueueMax, com_stat.cbInQue);
+    if (com_stat.cbInQue > 0) { // 既に受信データがある？
+        SetEvent(m_notify_event);
+        return true;
+    }
+
+    // Note: WaitCommEvent()の発行前にデータが到着しても、ドライバがイベントを記録しているので
+    //       直ちに完了する。
+    ResetEvent(m_notify_event);
+    ZeroMemory(&m_notify_req, sizeof(m_notify_req));
+    m_notify_req.hEvent = m_notify_event;
+    if (WaitCommEvent(handle, &m_notify_mask, &m_notify_req)) {
+        SetEvent(m_notify_event);
+    }
+    else if (GetLastError() == ERROR_IO_PENDING) {
+        m_is_notify_pending = true;
+    }
+    else {
+        // Error number was set by WaitCommEvent().
+        return false;
+    }
+    return true;
+}
+
+bool SerialPort::start_streaming(const receive_handler_t& handler, uint32_t buffer_count, uint32_t buffer_size) {
+    if (!handler || (buffer_count < 2) || (buffer_size == 0)) {
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return false;
+    }
+    if (!is_opened()) {
+        SetLastError(ERROR_INVALID_HANDLE);
+        return false;
+    }
+    if (m_stream_thread.joinable()) { // ストリーム受信中？
+        SetLastError(ERROR_BUSY);
+        return false;
+    }
+
+    // Note: ReadIntervalTimeoutとReadTotalTimeoutMultiplierをMAXDWORDにすると、
+    //       1バイトでも受信した時点で受信要求が完了する。
+    //       ReadTotalTimeoutConstantは無通信時に要求を再発行しなくて済むよう最大にしておく。
+    if (!GetCommTimeouts(m_port_handle, &m_saved_timeouts)) {
+        return false;
+    }
+    COMMTIMEOUTS timeouts = m_saved_timeouts;
+    timeouts.ReadIntervalTimeout = MAXDWORD;
+    timeouts.ReadTotalTimeoutMultiplier = MAXDWORD;
+    timeouts.ReadTotalTimeoutConstant = MAXDWORD - 1;
+    if (!SetCommTimeouts(m_port_handle, &timeouts)) {
+        return false;
+    }
+
+    ResetEvent(m_stream_stop_event);
+    m_receive_handler = handler;
+    m_is_streaming = true;
+    m_stream_thread = std::thread(&SerialPort::stream_proc, this, buffer_count, buffer_size);
+
+    return true;
+}
+
+void SerialPort::stop_streaming(void) {
+    if (!m_stream_thread.joinable()) {
+        return;
+    }
+    SetEvent(m_stream_stop_event);
+    m_stream_thread.join();
+    m_receive_handler = nullptr;
+    if (is_opened()) {
+        SetCommTimeouts(m_port_handle, &m_saved_timeouts);
+    }
+}
+
+void SerialPort::stream_proc(uint32_t buffer_count, uint32_t buffer_size) {
+    HANDLE handle = m_port_handle;
+    std::vector<uint8_t> buffers(static_cast<size_t>(buffer_count) * buffer_size);
+    std::vector<OVERLAPPED> reqs(buffer_count);
+    std::vector<bool> is_pending(buffer_count, false);
+
+    DWORD error = ERROR_SUCCESS;
+    for (uint32_t i = 0; i < buffer_count; i++) {
+        ZeroMemory(&reqs[i], sizeof(OVERLAPPED));
+        reqs[i].hEvent = CreateEventA(NULL, TRUE, FALSE, NULL);
+        if (reqs[i].hEvent == NULL) {
+            error = GetLastError();
+        }
+    }
+
+    // 全バッファで受信要求を発行する。
+    // Note: シリアルポートへの受信要求は発行順に完了する。
+    for (uint32_t i = 0; (i < buffer_count) && (error == ERROR_SUCCESS); i++) {
+        if (!ReadFile(handle, &buffers[static_cast<size_t>(i) * buffer_size], buffer_size, NULL, &reqs[i])
+            && (GetLastError() != ERROR_IO_PENDING)) {
+            error = GetLastError();
+        }
+        else {
+            is_pending[i] = true;
+        }
+    }
+
+    // 最も古い要求の完了を待ち、受信データを渡して再発行する。
+    uint32_t head = 0;
+    while (error == ERROR_SUCCESS) {
+        HANDLE wait_handles[] = { reqs[head].hEvent, m_stream_stop_event };
+        DWORD result = WaitForMultipleObjects(2, wait_handles, FALSE, INFINITE);
+        if (result == (WAIT_OBJECT_0 + 1)) { // 停止要求？
+            break;
+        }
+        else if (result != WAIT_OBJECT_0) {
+            error = GetLastError();
+            break;
+        }
+        m_completed_time = std::chrono::steady_clock::now();
+
+        DWORD transferred = 0;
+        is_pending[head] = false;
+        if (!GetOverlappedResult(handle, &reqs[head], &transferred, FALSE)) {
+            error = GetLastError();
             break;
         }
-        else if ((timeout_millis >= 0) // ^CAEgԂLH
-            && ((GetTickCount64() - begin) >= timeout_millis)) { // ^CAEgԂo߂H
-            if (!CancelIoEx(m_port_handle, req)) {
-                // Error number was set by CancelIoEx().
-                return -1;
-            }
+        DWORD errors;
+        COMSTAT com_stat;
+        if (!ClearCommError(handle, &errors, &com_stat)) {
+            error = GetLastError();
             break;
         }
-        SwitchToThread();
+        if (errors != 0) {
+            handle_errors(errors);
+        }
+        count_max(CounterReceiveQueueMax, com_stat.cbInQue);
+        count(CounterReceiveCalls);
+        uint8_t* buf = &buffers[static_cast<size_t>(head) * buffer_size];
+        if (transferred > 0) {
+            count(CounterReceivedBytes, transferred);
+            m_receive_handler(buf, transferred);
+        }
+
+        if (!ReadFile(handle, buf, buffer_size, NULL, &reqs[head])
+            && (GetLastError() != ERROR_IO_PENDING)) {
+            error = GetLastError();
+            break;
+        }
+        is_pending[head] = true;
+        head = (head + 1) % buffer_count;
+    }
+
+    // 発行済みの要求をキャンセルし、バッファが参照されなくなるまで待つ。
+    for (uint32_t i = 0; i < buffer_count; i++) {
+        if (is_pending[i]) {
+            DWORD transferred;
+            CancelIoEx(handle, &reqs[i]);
+            GetOverlappedResult(handle, &reqs[i], &transferred, TRUE);
+        }
+        if (reqs[i].hEvent != NULL) {
+            CloseHandle(reqs[i].hEvent);
+        }
+    }
+
+    m_is_streaming = false;
+    if (error != ERROR_SUCCESS) {
+        SetLastError(error);
+        m_receive_handler(nullptr, 0);
+    }
+}
+
+int SerialPort::wait_io(HANDLE handle, LPOVERLAPPED req, int timeout_millis) {
+    count(CounterWaitIo);
+    HANDLE wait_handles[] = { (*req).hEvent, m_cancel_event };
+    DWORD wait_millis = (timeout_millis >= 0) ? static_cast<DWORD>(timeout_millis) : INFINITE;
+    DWORD result = WaitForMultipleObjects(2, wait_handles, FALSE, wait_millis);
+    if (result != WAIT_OBJECT_0) { // 完了以外(タイムアウト、クローズ、待機失敗)で起床した？
+        // 要求をキャンセルし、reqが参照されなくなるまで待つ。
+        // Note: 既に完了していた場合にはCancelIoEx()はERROR_NOT_FOUNDで失敗するが、問題ない。
+        CancelIoEx(handle, req);
+        WaitForSingleObject((*req).hEvent, INFINITE);
     }
 
     DWORD transferred = 0;
-    if (!GetOverlappedResult(m_port_handle, req, &transferred, TRUE)) {
+    if (!GetOverlappedResult(handle, req, &transferred, FALSE)) {
+        if (GetLastError() == ERROR_OPERATION_ABORTED) {
+            // キャンセルされるまでに送受信できたバイト数を返す。
+            return static_cast<int>(transferred);
+        }
         // Error number was set by GetOverlappedResult().
         return -1;
     }
@@ -253,3 +531,4 @@ int SerialPort::wait_io(LPOVERLAPPED req, int timeout_millis) {
     }
 }
 
+#endif
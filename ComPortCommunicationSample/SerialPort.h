@@ -4,18 +4,43 @@
 #include <vector>
 #include <string>
 #include <functional>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#ifdef _WIN32
 #include <windows.h>
+#endif
 
 
+/**
+ * シリアルポート
+ *
+ * @note
+ * Windowsではオーバーラップ I/O、それ以外(POSIX)ではノンブロッキングモードのtermiosで実装する。
+ * POSIXではポート名にデバイスパス("/dev/ttyUSB0"など)を指定する。
+ * '/'で始まらない場合は"/dev/"以下のデバイスとして扱う。
+ * send()/receive()が失敗した場合のエラー番号は、WindowsではGetLastError()、POSIXではerrnoで取得できる。
+ */
 class SerialPort
 {
 public:
+#ifdef _WIN32
     /**
-     * VA|[gꗗ񋓂B
+     * 受信通知ハンドル型(WaitForMultipleObjects()で待つイベント)
+     */
+    typedef HANDLE notify_handle_t;
+#else
+    /**
+     * 受信通知ハンドル型(poll()でPOLLINを待つファイルディスクリプタ)
+     */
+    typedef int notify_handle_t;
+#endif
+    /**
+     * シリアルポート一覧を列挙する。
      *
-     * @param plist VA|[gꗗ擾郊Xg
-     * @retval true 
-     * @retval false s
+     * @param plist シリアルポート名一覧を取得するリスト
+     * @retval true 成功
+     * @retval false 失敗
      */
     static bool enumerate_ports(std::vector<std::string>* plist);
     /**
@@ -32,111 +57,155 @@ public:
     static const uint32_t StopBitsTwo;
 
     /**
-     * peB
+     * パリティ無し
      */
     static const uint32_t ParityNone;
     /**
-     * peB
+     * 偶数パリティ
      */
     static const uint32_t ParityEven;
     /**
-     * peB
+     * 奇数パリティ
      */
     static const uint32_t ParityOdd;
     /**
-     * CTSĎ(ڑ̏oRTSM𖳎)
+     * CTS監視無効(接続先の出すRTS信号を無視する)
      */
     static const uint32_t CtsFlowDisable;
     /**
-     * CTSĎL(ڑ̏o͂RTSM݂đM䂷)
+     * CTS監視有効(接続先の出力するRTS信号をみて送信制御する)
      */
     static const uint32_t CtsFlowEnable;
 
     /**
-     * RTS LŒ (Msŕێ)
+     * RTS L固定 (受信不可で保持)
      */
     static const uint32_t RtsControlDisable;
     /**
-     * RTS HŒ (Mŕێ)
+     * RTS H固定 (受信可で保持)
      */
     static const uint32_t RtsControlEnable;
     /**
-     * RTSML
+     * RTS信号有効
      */
     static const uint32_t RtsControlHandShake;
     /**
-     * RTSMMD(Mf[^ƂRTSLɂ)
+     * RTS信号送信優先(送信データがあるときはRTSをLにする)
      */
     static const uint32_t RtsControlToggle;
     /**
-     * BREAKoG[
+     * BREAK検出エラー
      */
     static const uint32_t ErrorBreak;
     /**
-     * t[~OG[o
+     * フレーミングエラー検出
      */
     static const uint32_t ErrorFrame;
     /**
-     * I[o[G[
+     * オーバーランエラー発生
      */
     static const uint32_t ErrorOverrRun;
     /**
-     * MI[o[t[
+     * 受信オーバーフロー
      */
     static const uint32_t ErrorReceiveOverflow;
     /**
-     * MpeBG[
+     * 受信パリティエラー
      */
     static const uint32_t ErrorReceiveParity;
 
     /**
-     * G[nh^
+     * エラーハンドラ型
      * 
-     * @param errors G[(ErrorBreak,ErrorFrame,ErrorOverRun,
-     *                      ErrorReceiveOverflow,ErrorReceiveParitŷꂩ)
+     * @param errors エラー(ErrorBreak,ErrorFrame,ErrorOverRun,
+     *                      ErrorReceiveOverflow,ErrorReceiveParityのいずれか)
      */
     typedef std::function<void(uint32_t)> error_handler_t;
 
     /**
-     * RXgN^
+     * ストリーム受信ハンドラ型
+     *
+     * @param data 受信データ。受信エラーでストリーム受信が終了した場合にはnullptr。
+     * @param length 受信データサイズ
+     * @note
+     * dataはハンドラから戻るまでの間だけ有効。
+     */
+    typedef std::function<void(const uint8_t* data, uint32_t length)> receive_handler_t;
+
+    /**
+     * ストリーム受信のバッファ数(同時に発行する受信要求数)の既定値
+     */
+    static const uint32_t DefaultStreamBufferCount = 4;
+    /**
+     * ストリーム受信のバッファサイズの既定値
+     */
+    static const uint32_t DefaultStreamBufferSize = 4096;
+
+    /**
+     * 入出力統計
+     * オープン/クローズでは初期化されない。reset_statistics()で初期化する。
+     */
+    struct Statistics {
+        uint64_t sent_bytes; // 送信バイト数
+        uint64_t send_calls; // send()の呼び出し回数
+        uint64_t send_timeouts; // send()がタイムアウトした回数
+        uint64_t received_bytes; // 受信バイト数(ストリーム受信を含む)
+        uint64_t receive_calls; // receive()の呼び出し回数(ストリーム受信では受信要求の完了回数を含む)
+        uint64_t receive_timeouts; // receive()がタイムアウトした回数
+        uint64_t wait_io_count; // I/O完了待ちの回数
+        uint64_t error_break; // ErrorBreakの検出回数
+        uint64_t error_frame; // ErrorFrameの検出回数
+        uint64_t error_overrun; // ErrorOverrRunの検出回数
+        uint64_t error_receive_overflow; // ErrorReceiveOverflowの検出回数
+        uint64_t error_receive_parity; // ErrorReceiveParityの検出回数
+        uint64_t receive_queue_max; // ドライバの受信キューにたまったデータ量の最大値(POSIXでは取得しない)
+        uint64_t send_queue_max; // ドライバの送信キューにたまったデータ量の最大値(get_output_queue_length()で観測した値)
+    };
+
+    /**
+     * コンストラクタ
      * 
-     * @param port_name VA|[g("COM1"Ȃ)
+     * @param port_name シリアルポート名("COM1", "/dev/ttyUSB0"など)
      */
     explicit SerialPort(const std::string& port_name);
 
     /**
-     * RXgN^
+     * コンストラクタ
      * 
-     * @param port_name VA|[g("COM1"Ȃ)
-     * @param ref_port ݒp|[g
+     * @param port_name シリアルポート名("COM1", "/dev/ttyUSB0"など)
+     * @param ref_port 設定を引き継ぐポート
      */
     SerialPort(const std::string& port_name, const SerialPort& ref_port);
 
     /**
-     * fXgN^
+     * デストラクタ
      */
     ~SerialPort(void);
 
     /**
-     * I[vς݂ǂ擾B
+     * オープン済みかどうかを取得する。
      *
-     * @retval true I[vς
-     * @retval false I[vĂȂ
+     * @retval true オープン済み
+     * @retval false オープンしていない
      */
+#ifdef _WIN32
     bool is_opened(void) const noexcept { return m_port_handle != INVALID_HANDLE_VALUE; }
+#else
+    bool is_opened(void) const noexcept { return m_port_fd >= 0; }
+#endif
     /**
-     * VA|[gI[v
+     * シリアルポートをオープンする
      */
     void open(void);
     /**
-     * VA|[gN[Y
+     * シリアルポートをクローズする
      */
     void close(void);
 
     /**
-     * {[[gݒ肷B
+     * ボーレートを設定する。
      * 
-     * @param baudrate {[[g[bps]
+     * @param baudrate ボーレート[bps]
      */
     void set_baudrate(uint32_t baudrate) {
         if (baudrate != m_baudrate) {
@@ -145,70 +214,70 @@ public:
         }
     }
     /**
-     * {[[g擾B
-     * @retval {[[g[bps]
+     * ボーレートを取得する。
+     * @retval ボーレート[bps]
      */
     uint32_t get_baudrate(void) const noexcept { return m_baudrate; }
     /**
-     * f[^rbgݒ肷B
+     * データビット数を設定する。
      * 
-     * @param databits f[^rbg
+     * @param databits データビット数
      */
     void set_databits(uint8_t databits) {
-        if (((databits == 7) || (databits == 8)) // f[^rbg 7or8
-            && (databits != m_databits)) { // ݒ肪ႤH
+        if (((databits == 7) || (databits == 8)) // データビットが 7or8
+            && (databits != m_databits)) { // 設定が違う？
             m_databits = databits;
             apply_settings();
         }
     }
     /**
-     * f[^rbg𓾂
+     * データビット数を得る
      * 
-     * @retval f[^rbg
+     * @retval データビット数
      */
     uint8_t get_databits(void) const noexcept { return m_databits; }
     /**
-     * peBݒB
+     * パリティ設定をする。
      * 
-     * @param parity peBݒ(ParityNone, ParityEven, ParityOdd̂ꂩ)
+     * @param parity パリティ設定(ParityNone, ParityEven, ParityOddのいずれか)
      */
     void set_parity(uint32_t parity) {
-        if (((parity == ParityNone) || (parity == ParityEven) || (parity == ParityOdd)) // parityݒl͐H
-            && (parity != m_parity)) { // ݒlႤH
+        if (((parity == ParityNone) || (parity == ParityEven) || (parity == ParityOdd)) // parity設定値は正しい？
+            && (parity != m_parity)) { // 設定値が違う？
             m_parity = parity;
             apply_settings();
         }
     }
     /**
-     * peBݒ𓾂B
+     * パリティ設定を得る。
      * 
-     * @retval peBݒ(ParityNone, ParityEven, ParityOdd̂ꂩ)
+     * @retval パリティ設定(ParityNone, ParityEven, ParityOddのいずれか)
      */
     uint32_t get_parity(void) const noexcept { return m_parity; }
 
     /**
-     *  XgbvrbgݒB
+     *  ストップビット設定をする。
      * 
-     * @param stopbits Xgbvrbgݒ(StopBitsOne, StopBitsOne5, StopBitsTwôꂩ)
+     * @param stopbits ストップビット設定(StopBitsOne, StopBitsOne5, StopBitsTwoのいずれか)
      */
     void set_stopbits(uint32_t stopbits) {
-        if (((stopbits == StopBitsOne) || (stopbits == StopBitsOne5) || (stopbits == StopBitsTwo)) // stopbitsݒ͐H
-            && (stopbits != m_stopbits)) { // ݒlႤH
+        if (((stopbits == StopBitsOne) || (stopbits == StopBitsOne5) || (stopbits == StopBitsTwo)) // stopbits設定は正しい？
+            && (stopbits != m_stopbits)) { // 設定値が違う？
             m_stopbits = stopbits;
             apply_settings();
         }
     }
     /**
-     * Xgbvrbgݒ𓾂B
+     * ストップビット設定を得る。
      * 
-     * @retval Xgbvrbgݒ(StopBitsOne, StopBitsOne5, StopBitsTwôꂩ)
+     * @retval ストップビット設定(StopBitsOne, StopBitsOne5, StopBitsTwoのいずれか)
      */
     uint32_t get_stopbits(void) const noexcept { return m_stopbits; }
 
     /**
-     * CTSݒ肷B
+     * CTS制御を設定する。
      * 
-     * @param cts_flow CTS(CtsFlowDisable, CtsFlowEnablêꂩ)
+     * @param cts_flow CTS制御(CtsFlowDisable, CtsFlowEnableのいずれか)
      */
     void set_cts_flow(uint32_t cts_flow) {
         if (((cts_flow == CtsFlowDisable) || (cts_flow == CtsFlowEnable))
@@ -218,106 +287,382 @@ public:
         }
     }
     /**
-     * CTS擾B
+     * CTS制御を取得する。
      * 
-     * @retval CTS(CtsFlowDisable, CtsFlowEnablêꂩ)
+     * @retval CTS制御(CtsFlowDisable, CtsFlowEnableのいずれか)
      */
     uint32_t get_cts_flow(void) const noexcept { return m_cts_flow; }
     /**
-     * RTSݒ肷B
+     * RTS制御を設定する。
      * 
-     * @param rts_control RTS(RtsControlDisable, RtsControlEnable, RtsControlHandShake, RtsControlToggle)̂ꂩ
+     * @param rts_control RTS制御(RtsControlDisable, RtsControlEnable, RtsControlHandShake, RtsControlToggle)のいずれか
      */
     void set_rts_control(uint32_t rts_control) {
         if (((rts_control == RtsControlDisable) || (rts_control == RtsControlEnable) 
-                || (rts_control == RtsControlHandShake) || (rts_control == RtsControlToggle)) // ݒl͐H
-            && (rts_control != m_rts_control)) { // ݒlႤ?
+                || (rts_control == RtsControlHandShake) || (rts_control == RtsControlToggle)) // 設定値は正しい？
+            && (rts_control != m_rts_control)) { // 設定値が違う?
             m_rts_control = rts_control;
             apply_settings();
         }
     }
     /**
-     * RTS擾B
+     * RTS制御を取得する。
      * 
-     * @retval RTS(RtsControlDisable, RtsControlEnable, RtsControlHandShake, RtsControlToggle)̂ꂩ
+     * @retval RTS制御(RtsControlDisable, RtsControlEnable, RtsControlHandShake, RtsControlToggle)のいずれか
      */
     uint32_t get_rts_control(void) const noexcept { return m_rts_control; }
 
     /**
-     * MB
-     * M邩Atimeout_millisԌo߂܂ŌĂяoubNB
+     * 送信する。
+     * 送信完了するか、timeout_millis時間経過するまで呼び出し元をブロックする。
      * 
-     * @param data Mf[^
-     * @param length Mf[^TCY
-     * @param timeout_millis ^CAEg[~b] ɂƉiɑ҂B
-     * @retval -1 G[ꍇ
-     * @retval 0ȏ̒l ǂݏooCg
+     * @param data 送信データ
+     * @param length 送信データサイズ
+     * @param timeout_millis タイムアウト時間[ミリ秒] 負数にすると永遠に待つ。
+     * @retval -1 エラーが発生した場合
+     * @retval 0以上の値 読み出したバイト数
+     * @note
+     * 待機中はイベント待ちでブロックするため、CPUを消費しない。
+     * send()とreceive()は別々のスレッドから同時に呼び出せるが、同じ方向の同時呼び出しはできない。
      */
     int send(const uint8_t* data, uint32_t length, int timeout_millis = -1);
     /**
-     * MB
-     * M邩Atimeout_millisԌo߂܂ŌĂяoubNB
+     * 受信する。
+     * 受信完了するか、timeout_millis時間経過するまで呼び出し元をブロックする。
      * 
-     * @param buf ǂݏof[^i[obt@
-     * @param bufsize obt@TCY
-     * @param timeout_millis ^CAEg[~b] ɂƉiɑ҂B
-     * @retval -1 G[ꍇ
-     * @retval 0ȏ̒l ǂݏooCg
+     * @param buf 読み出しデータを格納するバッファ
+     * @param bufsize バッファサイズ
+     * @param timeout_millis タイムアウト時間[ミリ秒] 負数にすると永遠に待つ。
+     * @retval -1 エラーが発生した場合
+     * @retval 0以上の値 読み出したバイト数
      */
     int receive(uint8_t* buf, uint32_t bufsize, int timeout_millis = -1);
     /**
-     * G[nhǉB
+     * ドライバの送信キューにたまっている(まだ回線に送り出していない)データ量を得る。
+     * WindowsではClearCommError()のcbOutQue、POSIXではTIOCOUTQで取得する。
+     *
+     * @retval -1 エラーが発生した場合
+     * @retval 0以上の値 送信キューのバイト数
+     */
+    int get_output_queue_length(void);
+    /**
+     * 送信を続けられる状態かどうかを得る。
+     * ドライバの送信キューがqueue_limit未満で、CTSフロー制御で送信が止められていない場合に送信できるとみなす。
+     * 送信キューを小さく保つことで、相手が受け取れない間のデータはアプリケーション側(SendQueue)に留まり、
+     * 上流(標準入力など)の読み出しを止めて流量を合わせられる。
+     *
+     * @param queue_limit ドライバの送信キューの上限[バイト]
+     * @retval true 送信できる
+     * @retval false 送信キューが上限に達しているか、CTSがオフで送信が止められている(エラーの場合を含む)
+     */
+    bool is_writable(uint32_t queue_limit);
+    /**
+     * 受信通知を要求する。
+     * 受信データが到着すると、get_receive_notify_handle()で得たハンドルが通知状態になる。
+     * 既に受信データがある場合は直ちに通知状態になる。
+     * 通知を受けてreceive()した後、次の通知を待つ前に再度呼び出すこと。
+     * 標準入力など他の入力と合わせて1つのスレッドで待ち合わせるために使う。
+     *
+     * @retval true 成功
+     * @retval false 失敗(オープンしていない場合を含む)
+     * @note
+     * POSIXではファイルディスクリプタを直接poll()するので、何もしない。
+     */
+    bool request_receive_notify(void);
+    /**
+     * 受信通知ハンドルを得る。
+     *
+     * @retval Windowsではイベントハンドル、POSIXではファイルディスクリプタ
+     */
+#ifdef _WIN32
+    notify_handle_t get_receive_notify_handle(void) const noexcept { return m_notify_event; }
+#else
+    notify_handle_t get_receive_notify_handle(void) const noexcept { return m_port_fd; }
+#endif
+    /**
+     * ストリーム受信を開始する。
+     * 受信スレッドを起動し、buffer_count個のバッファで受信要求を発行し続ける。
+     * 受信要求が完了するごとに、受信したデータを発行順にhandlerへ渡し、
+     * そのバッファで次の受信要求を発行する。
+     * handlerの処理中も他のバッファで受信要求が発行済みになっているため、
+     * 高いボーレートでもドライバの受信バッファが溢れにくい。
+     *
+     * @param handler 受信ハンドラ(受信スレッドから呼び出される)
+     * @param buffer_count バッファ数(2以上)
+     * @param buffer_size バッファサイズ
+     * @retval true 成功
+     * @retval false 失敗(オープンしていない場合、既にストリーム受信中の場合を含む)
+     * @note
+     * 受信エラーが発生するとhandlerをdata=nullptrで呼び出して終了する。
+     * エラー番号はhandler内でGetLastError()(POSIXではerrno)で取得できる。
+     * ストリーム受信中はreceive(), request_receive_notify()を呼び出さないこと。
+     * handlerからstop_streaming(), close()を呼び出さないこと。
+     * POSIXではカーネルのttyバッファが先読みするため、バッファは1つだけ使う。
+     */
+    bool start_streaming(const receive_handler_t& handler,
+        uint32_t buffer_count = DefaultStreamBufferCount, uint32_t buffer_size = DefaultStreamBufferSize);
+    /**
+     * ストリーム受信を停止する。
+     * 発行済みの受信要求をキャンセルし、受信スレッドの終了を待つ。
+     * close()からも呼び出される。
+     */
+    void stop_streaming(void);
+    /**
+     * ストリーム受信中かどうかを取得する。
+     *
+     * @retval true ストリーム受信中
+     * @retval false ストリーム受信していない(受信エラーで終了した場合を含む)
+     */
+    bool is_streaming(void) const noexcept { return m_is_streaming; }
+    /**
+     * ストリーム受信で最後に受信要求が完了した時刻を得る。
+     * 受信ハンドラ内で呼び出すと、渡されたデータの受信完了時刻になる。
+     *
+     * @retval 受信完了時刻
+     */
+    std::chrono::steady_clock::time_point get_completed_time(void) const noexcept { return m_completed_time; }
+    /**
+     * 入出力統計を得る。
+     *
+     * @retval 入出力統計
+     */
+    Statistics get_statistics(void) const noexcept {
+        Statistics stats;
+        stats.sent_bytes = get_counter(CounterSentBytes);
+        stats.send_calls = get_counter(CounterSendCalls);
+        stats.send_timeouts = get_counter(CounterSendTimeouts);
+        stats.received_bytes = get_counter(CounterReceivedBytes);
+        stats.receive_calls = get_counter(CounterReceiveCalls);
+        stats.receive_timeouts = get_counter(CounterReceiveTimeouts);
+        stats.wait_io_count = get_counter(CounterWaitIo);
+        stats.error_break = get_counter(CounterErrorBreak);
+        stats.error_frame = get_counter(CounterErrorFrame);
+        stats.error_overrun = get_counter(CounterErrorOverrun);
+        stats.error_receive_overflow = get_counter(CounterErrorReceiveOverflow);
+        stats.error_receive_parity = get_counter(CounterErrorReceiveParity);
+        stats.receive_queue_max = get_counter(CounterReceiveQueueMax);
+        stats.send_queue_max = get_counter(CounterSendQueueMax);
+        return stats;
+    }
+    /**
+     * 入出力統計を初期化する。
+     */
+    void reset_statistics(void) noexcept {
+        for (auto& counter : m_counters) {
+            counter.store(0, std::memory_order_relaxed);
+        }
+    }
+    /**
+     * エラーハンドラを設定する。
      * 
-     * @param handler ǉG[nh
+     * @param handler エラーハンドラ(nullptrを渡すと解除する)
      */
     void set_error_handler(const error_handler_t& handler) {
-        if (m_error_handler) {
-            m_error_handler = handler;
-        }
-        else {
-            m_error_handler = nullptr;
-        }
+        m_error_handler = handler;
     }
 
 private:
-    HANDLE m_port_handle; // VA|[gCX^X̃nh
-    std::string m_port_name; // VA|[g
-    uint32_t m_baudrate; // {[[g
-    uint8_t m_databits; // f[^rbg
-    uint32_t m_parity; // peB
-    uint32_t m_stopbits; // Xgbvrbg
-    uint32_t m_cts_flow; // CTSLݒ
-    uint32_t m_rts_control; // RTSݒ
-    error_handler_t m_error_handler; // G[nh
+#ifdef _WIN32
+    HANDLE m_port_handle; // シリアルポートインスタンスのハンドル
+    HANDLE m_read_event; // 受信完了通知イベント
+    HANDLE m_write_event; // 送信完了通知イベント
+    HANDLE m_cancel_event; // I/O待ち解除イベント(close()で通知)
+    HANDLE m_notify_event; // 受信通知イベント
+    OVERLAPPED m_notify_req; // 受信通知要求(WaitCommEvent)
+    DWORD m_notify_mask; // 受信通知で発生したイベント
+    bool m_is_notify_pending; // 受信通知要求を発行中かどうか
+    HANDLE m_stream_stop_event; // ストリーム受信停止イベント
+    COMMTIMEOUTS m_saved_timeouts; // ストリーム受信開始前のタイムアウト設定
+#else
+    /**
+     * 回線エラーの累積回数(TIOCGICOUNTで取得する値)
+     */
+    struct line_error_counts {
+        uint32_t brk; // BREAK検出回数
+        uint32_t frame; // フレーミングエラー回数
+        uint32_t overrun; // オーバーランエラー回数
+        uint32_t buf_overrun; // 受信バッファオーバーフロー回数
+        uint32_t parity; // パリティエラー回数
+        line_error_counts(void) : brk(0), frame(0), overrun(0), buf_overrun(0), parity(0) { }
+    };
+    int m_port_fd; // シリアルポートのファイルディスクリプタ
+    int m_cancel_pipe[2]; // I/O待ち解除用パイプ(close()で書き込む)
+    line_error_counts m_line_errors; // 前回取得した回線エラーの累積回数
+    int m_stream_stop_pipe[2]; // ストリーム受信停止用パイプ
+#endif
+    std::thread m_stream_thread; // ストリーム受信スレッド
+    std::atomic<bool> m_is_streaming; // ストリーム受信中かどうか
+    receive_handler_t m_receive_handler; // ストリーム受信ハンドラ
+    std::chrono::steady_clock::time_point m_completed_time; // ストリーム受信の受信完了時刻(受信スレッドのみ更新)
+    std::string m_port_name; // シリアルポート名
+    uint32_t m_baudrate; // ボーレート
+    uint8_t m_databits; // データビット
+    uint32_t m_parity; // パリティ
+    uint32_t m_stopbits; // ストップビット
+    uint32_t m_cts_flow; // CTS有効設定
+    uint32_t m_rts_control; // RTS制御設定
+    error_handler_t m_error_handler; // エラーハンドラ
+
+    /**
+     * 入出力統計のカウンタ番号
+     */
+    enum Counter {
+        CounterSentBytes,
+        CounterSendCalls,
+        CounterSendTimeouts,
+        CounterReceivedBytes,
+        CounterReceiveCalls,
+        CounterReceiveTimeouts,
+        CounterWaitIo,
+        CounterErrorBreak,
+        CounterErrorFrame,
+        CounterErrorOverrun,
+        CounterErrorReceiveOverflow,
+        CounterErrorReceiveParity,
+        CounterReceiveQueueMax,
+        CounterSendQueueMax,
+        CounterCount
+    };
+    std::atomic<uint64_t> m_counters[CounterCount]; // 入出力統計のカウンタ
 
     /**
-     * ݒKpB
-     * VA|[g̃CX^XI[vĂȂꍇɂ͉ȂB
+     * カウンタを加算する。
+     *
+     * @param counter カウンタ番号
+     * @param value 加算する値
+     */
+    void count(Counter counter, uint64_t value = 1) noexcept {
+        m_counters[counter].fetch_add(value, std::memory_order_relaxed);
+    }
+    /**
+     * カウンタを最大値で更新する。
+     *
+     * @param counter カウンタ番号
+     * @param value 値
+     */
+    void count_max(Counter counter, uint64_t value) noexcept {
+        uint64_t current = m_counters[counter].load(std::memory_order_relaxed);
+        while ((value > current)
+            && !m_counters[counter].compare_exchange_weak(current, value, std::memory_order_relaxed)) {
+        }
+    }
+    /**
+     * カウンタの値を得る。
+     *
+     * @param counter カウンタ番号
+     * @retval 値
+     */
+    uint64_t get_counter(Counter counter) const noexcept {
+        return m_counters[counter].load(std::memory_order_relaxed);
+    }
+    /**
+     * send()/receive()の結果をカウントする。
+     *
+     * @param is_send send()の場合はtrue、receive()の場合はfalse
+     * @param result send()/receive()の戻り値
+     * @param length 要求したバイト数
+     * @param timeout_millis タイムアウト時間[ミリ秒]
+     */
+    void count_transfer(bool is_send, int result, uint32_t length, int timeout_millis) noexcept {
+        count(is_send ? CounterSendCalls : CounterReceiveCalls);
+        if (result > 0) {
+            count(is_send ? CounterSentBytes : CounterReceivedBytes, static_cast<uint64_t>(result));
+        }
+        if ((timeout_millis > 0) && (result >= 0) && (static_cast<uint32_t>(result) < length)) {
+            count(is_send ? CounterSendTimeouts : CounterReceiveTimeouts);
+        }
+    }
+
+    /**
+     * 設定を適用する。
+     * シリアルポートのインスタンスがオープンされていない場合には何もしない。
      */
     void apply_settings(void);
     /**
-     * I/O҂B
-     * 
-     * @param req v
-     * @param timeout_millis ^CAEg[~b] ɂƉiɑ҂B
-     * @retval -1 s
-     * @retval 0ȏ̒l MoCg
+     * ストリーム受信スレッドの処理を行う。
+     *
+     * @param buffer_count バッファ数
+     * @param buffer_size バッファサイズ
+     */
+    void stream_proc(uint32_t buffer_count, uint32_t buffer_size);
+#ifdef _WIN32
+    /**
+     * I/O完了通知イベントを生成する。
      */
-    int wait_io(LPOVERLAPPED req, int timeout_millis);
+    void create_events(void);
     /**
-     * G[
+     * I/O完了通知イベントを破棄する。
+     */
+    void close_events(void);
+    /**
+     * I/O待ちをする。
+     * req->hEventが通知されるか、タイムアウトするか、close()されるまで呼び出し元をブロックする。
+     * タイムアウトした場合には要求をキャンセルし、それまでに送受信できたバイト数を返す。
      * 
-     * @param error G[
+     * @param handle 要求を発行したハンドル
+     * @param req 要求
+     * @param timeout_millis タイムアウト時間[ミリ秒] 負数にすると永遠に待つ。
+     * @retval -1 失敗
+     * @retval 0以上の値 送受信したバイト数
+     */
+    int wait_io(HANDLE handle, LPOVERLAPPED req, int timeout_millis);
+#else
+    /**
+     * I/O待ち解除用パイプとストリーム受信停止用パイプを生成する。
+     */
+    void create_cancel_pipe(void);
+    /**
+     * I/O待ち解除用パイプとストリーム受信停止用パイプを破棄する。
+     */
+    void close_cancel_pipe(void);
+    /**
+     * I/O待ちをする。
+     * fdがeventsで指定した状態になるか、タイムアウトするか、close()されるまで呼び出し元をブロックする。
+     *
+     * @param fd 待機するファイルディスクリプタ
+     * @param events 待機するイベント(POLLIN, POLLOUT)
+     * @param timeout_millis タイムアウト時間[ミリ秒] 負数にすると永遠に待つ。
+     * @retval -1 失敗(close()された場合を含む)
+     * @retval 0 タイムアウト
+     * @retval 1 I/O可能
+     */
+    int wait_io(int fd, short events, int timeout_millis);
+    /**
+     * 前回呼び出し時から発生した回線エラーを取得する。
+     *
+     * @param fd ファイルディスクリプタ
+     * @retval 発生したエラー(ErrorBreak,ErrorFrame,ErrorOverrRun,ErrorReceiveOverflow,ErrorReceiveParityの組み合わせ)
      */
-    void handle_errors(DWORD errors) const {
+    uint32_t get_line_errors(int fd);
+#endif
+    /**
+     * エラー処理する
+     * エラーごとの検出回数をカウントし、エラーハンドラを呼び出す。
+     * 
+     * @param error エラー
+     */
+    void handle_errors(uint32_t errors) {
+        static const struct {
+            uint32_t error;
+            Counter counter;
+        } ErrorCounters[] = {
+            { ErrorBreak, CounterErrorBreak }, { ErrorFrame, CounterErrorFrame },
+            { ErrorOverrRun, CounterErrorOverrun }, { ErrorReceiveOverflow, CounterErrorReceiveOverflow },
+            { ErrorReceiveParity, CounterErrorReceiveParity },
+        };
+        for (auto& entry : ErrorCounters) {
+            if ((errors & entry.error) != 0) {
+                count(entry.counter);
+            }
+        }
         if (m_error_handler) {
             m_error_handler(errors);
         }
     }
 
-    // RXgN^͎gpłȂB
+    // 代入コンストラクタは使用できない。
     SerialPort(const SerialPort& port) = delete;
-    // Zq͎gpłȂ
+    // 代入演算子は使用できない
     SerialPort& operator=(const SerialPort& port) = delete;
 };
 
@@ -0,0 +1,614 @@
+#ifndef _WIN32
+
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/ioctl.h>
+#if defined(__linux__)
+#include <linux/serial.h>
+#endif
+
+#include <cerrno>
+#include <cstring>
+#include <chrono>
+#include <algorithm>
+#include <vector>
+#include <system_error>
+
+#include "SerialPort.h"
+
+/**
+ * Note: 設定値はWindows版(DCB)と同じ値にしておく。
+ */
+const uint32_t SerialPort::StopBitsOne = 0;
+const uint32_t SerialPort::StopBitsOne5 = 1;
+const uint32_t SerialPort::StopBitsTwo = 2;
+const uint32_t SerialPort::ParityNone = 0;
+const uint32_t SerialPort::ParityEven = 2;
+const uint32_t SerialPort::ParityOdd = 1;
+const uint32_t SerialPort::CtsFlowDisable = 0;
+const uint32_t SerialPort::CtsFlowEnable = 1;
+const uint32_t SerialPort::RtsControlDisable = 0;
+const uint32_t SerialPort::RtsControlEnable = 1;
+const uint32_t SerialPort::RtsControlHandShake = 2;
+const uint32_t SerialPort::RtsControlToggle = 3;
+const uint32_t SerialPort::ErrorBreak = 0x0010;
+const uint32_t SerialPort::ErrorFrame = 0x0008;
+const uint32_t SerialPort::ErrorOverrRun = 0x0002;
+const uint32_t SerialPort::ErrorReceiveOverflow = 0x0001;
+const uint32_t SerialPort::ErrorReceiveParity = 0x0004;
+
+/**
+ * ボーレート[bps]に対応するspeed_tを得る。
+ *
+ * @param baudrate ボーレート[bps]
+ * @param pspeed speed_tを格納する変数
+ * @retval true 成功
+ * @retval false 対応しないボーレートの場合
+ */
+static bool get_speed(uint32_t baudrate, speed_t* pspeed) {
+    static const struct {
+        uint32_t baudrate;
+        speed_t speed;
+    } Entries[] = {
+        { 1200, B1200 }, { 2400, B2400 }, { 4800, B4800 }, { 9600, B9600 },
+        { 19200, B19200 }, { 38400, B38400 }, { 57600, B57600 }, { 115200, B115200 },
+        { 230400, B230400 },
+#ifdef B460800
+        { 460800, B460800 },
+#endif
+#ifdef B921600
+        { 921600, B921600 },
+#endif
+#ifdef B1000000
+        { 1000000, B1000000 },
+#endif
+#ifdef B2000000
+        { 2000000, B2000000 },
+#endif
+#ifdef B3000000
+        { 3000000, B3000000 },
+#endif
+#ifdef B4000000
+        { 4000000, B4000000 },
+#endif
+    };
+    for (auto& entry : Entries) {
+        if (entry.baudrate == baudrate) {
+            (*pspeed) = entry.speed;
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * ポート名からデバイスパスを得る。
+ *
+ * @param port_name ポート名
+ * @retval デバイスパス
+ */
+static std::string get_device_path(const std::string& port_name) {
+    if (!port_name.empty() && (port_name[0] == '/')) {
+        return port_name;
+    }
+    else {
+        return std::string("/dev/") + port_name;
+    }
+}
+
+/**
+ * 現在時刻から見た期限までの残り時間[ミリ秒]を得る。
+ *
+ * @param deadline 期限
+ * @retval 残り時間[ミリ秒] (期限を過ぎている場合は0)
+ */
+static int get_remain_millis(const std::chrono::steady_clock::time_point& deadline) {
+    auto remain = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+    return (remain > 0) ? static_cast<int>(remain) : 0;
+}
+
+bool SerialPort::enumerate_ports(std::vector<std::string>* plist) {
+    if (plist == nullptr) {
+        return false;
+    }
+
+    (*plist).clear();
+
+    DIR* dir = opendir("/dev");
+    if (dir == nullptr) {
+        return false;
+    }
+    static const char* Prefixes[] = { "ttyS", "ttyUSB", "ttyACM", "ttyAMA", "cu." };
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != nullptr) {
+        for (const char* prefix : Prefixes) {
+            if (strncmp(entry->d_name, prefix, strlen(prefix)) != 0) {
+                continue;
+            }
+            // 実在するシリアルデバイスかどうかは、オープンしてtermiosを取得できるかで判定する。
+            std::string path = std::string("/dev/") + entry->d_name;
+            int fd = ::open(path.c_str(), O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+            if (fd >= 0) {
+                struct termios tio;
+                if (tcgetattr(fd, &tio) == 0) {
+                    (*plist).push_back(path);
+                }
+                ::close(fd);
+            }
+            break;
+        }
+    }
+    closedir(dir);
+    std::sort((*plist).begin(), (*plist).end());
+
+    return true;
+}
+
+SerialPort::SerialPort(const std::string& port_name)
+    : m_port_fd(-1), m_cancel_pipe{ -1, -1 }, m_stream_stop_pipe{ -1, -1 },
+    m_is_streaming(false), m_port_name(port_name),
+    m_baudrate(9600), m_databits(8), m_parity(ParityNone),
+    m_stopbits(StopBitsOne), m_cts_flow(CtsFlowDisable), m_rts_control(RtsControlDisable) {
+    reset_statistics();
+    create_cancel_pipe();
+}
+
+SerialPort::SerialPort(const std::string& port_name, const SerialPort& ref_port)
+    : m_port_fd(-1), m_cancel_pipe{ -1, -1 }, m_stream_stop_pipe{ -1, -1 },
+    m_is_streaming(false), m_port_name(port_name),
+    m_baudrate(ref_port.m_baudrate), m_databits(ref_port.m_databits), m_parity(ref_port.m_parity),
+    m_stopbits(ref_port.m_stopbits), m_cts_flow(ref_port.m_cts_flow), m_rts_control(ref_port.m_rts_control) {
+    reset_statistics();
+    create_cancel_pipe();
+}
+
+SerialPort::~SerialPort(void) {
+    if (is_opened()) {
+        close();
+    }
+    close_cancel_pipe();
+}
+
+void SerialPort::create_cancel_pipe(void) {
+    int* pipes[] = { m_cancel_pipe, m_stream_stop_pipe };
+    for (int* p : pipes) {
+        if (pipe(p) != 0) {
+            int ev = errno;
+            p[0] = -1;
+            p[1] = -1;
+            close_cancel_pipe();
+            throw std::system_error(ev, std::generic_category());
+        }
+        for (int i = 0; i < 2; i++) {
+            fcntl(p[i], F_SETFL, fcntl(p[i], F_GETFL) | O_NONBLOCK);
+            fcntl(p[i], F_SETFD, FD_CLOEXEC);
+        }
+    }
+}
+
+void SerialPort::close_cancel_pipe(void) {
+    int* pipes[] = { m_cancel_pipe, m_stream_stop_pipe };
+    for (int* p : pipes) {
+        for (int i = 0; i < 2; i++) {
+            if (p[i] >= 0) {
+                ::close(p[i]);
+                p[i] = -1;
+            }
+        }
+    }
+}
+
+void SerialPort::open(void) {
+    if (is_opened()) {
+        close();
+    }
+
+    std::string device_path = get_device_path(m_port_name);
+    int fd = ::open(device_path.c_str(), O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0) {
+        throw std::system_error(errno, std::generic_category());
+    }
+    // Windowsと同様に排他オープンにする。
+    if (ioctl(fd, TIOCEXCL) != 0) {
+        int ev = errno;
+        ::close(fd);
+        throw std::system_error(ev, std::generic_category());
+    }
+    struct termios tio;
+    if (tcgetattr(fd, &tio) != 0) {
+        int ev = errno;
+        ::close(fd);
+        throw std::system_error(ev, std::generic_category());
+    }
+
+    // 前回close()時に書き込まれた解除要求を読み捨てる。
+    uint8_t discard[16];
+    while (read(m_cancel_pipe[0], discard, sizeof(discard)) > 0) {
+    }
+    m_line_errors = line_error_counts();
+    m_port_fd = fd;
+
+    apply_settings();
+    get_line_errors(fd); // 回線エラーの累積回数の基準値を取得する。
+}
+
+void SerialPort::close(void) {
+    stop_streaming();
+    if (is_opened()) {
+        int fd = m_port_fd;
+        m_port_fd = -1;
+        uint8_t c = 0;
+        if (write(m_cancel_pipe[1], &c, 1) < 0) { // wait_io()で待機中のスレッドを起こす。
+            // パイプが満杯の場合は既に通知済みなので問題ない。
+        }
+        ioctl(fd, TIOCNXCL);
+        ::close(fd);
+    }
+}
+
+void SerialPort::apply_settings(void) {
+    if (!is_opened()) { // オープンしてない？
+        return;
+    }
+
+    struct termios tio;
+    if (tcgetattr(m_port_fd, &tio) != 0) {
+        return;
+    }
+
+    cfmakeraw(&tio);
+    tio.c_cflag |= (CLOCAL | CREAD);
+    tio.c_cc[VMIN] = 0;
+    tio.c_cc[VTIME] = 0;
+
+    speed_t speed;
+    if (get_speed(m_baudrate, &speed)) {
+        cfsetispeed(&tio, speed);
+        cfsetospeed(&tio, speed);
+    }
+
+    tio.c_cflag &= ~CSIZE;
+    tio.c_cflag |= (m_databits == 7) ? CS7 : CS8;
+
+    tio.c_cflag &= ~(PARENB | PARODD);
+    tio.c_iflag &= ~(INPCK);
+    if (m_parity == ParityEven) {
+        tio.c_cflag |= PARENB;
+        tio.c_iflag |= INPCK;
+    }
+    else if (m_parity == ParityOdd) {
+        tio.c_cflag |= (PARENB | PARODD);
+        tio.c_iflag |= INPCK;
+    }
+
+    // Note: termiosには1.5ストップビットが無いので、2ストップビットとして扱う。
+    if (m_stopbits == StopBitsOne) {
+        tio.c_cflag &= ~CSTOPB;
+    }
+    else {
+        tio.c_cflag |= CSTOPB;
+    }
+
+    // Note: termiosではCTSフロー制御とRTSハンドシェークを個別に設定できない。
+    //       どちらかが有効ならCRTSCTSを設定する。
+#ifdef CRTSCTS
+    if ((m_cts_flow == CtsFlowEnable) || (m_rts_control == RtsControlHandShake)) {
+        tio.c_cflag |= CRTSCTS;
+    }
+    else {
+        tio.c_cflag &= ~CRTSCTS;
+    }
+#endif
+
+    tcsetattr(m_port_fd, TCSANOW, &tio);
+
+    // RTS信号線の設定。疑似端末などモデム制御線の無いデバイスでは失敗するが、無視する。
+    int rts = TIOCM_RTS;
+    if (m_rts_control == RtsControlEnable) {
+        ioctl(m_port_fd, TIOCMBIS, &rts);
+    }
+    else if (m_rts_control == RtsControlDisable) {
+        ioctl(m_port_fd, TIOCMBIC, &rts);
+    }
+#if defined(TIOCSRS485)
+    struct serial_rs485 rs485;
+    if (ioctl(m_port_fd, TIOCGRS485, &rs485) == 0) {
+        if (m_rts_control == RtsControlToggle) {
+            rs485.flags |= (SER_RS485_ENABLED | SER_RS485_RTS_ON_SEND);
+            rs485.flags &= ~SER_RS485_RTS_AFTER_SEND;
+        }
+        else {
+            rs485.flags &= ~SER_RS485_ENABLED;
+        }
+        ioctl(m_port_fd, TIOCSRS485, &rs485);
+    }
+#endif
+}
+
+int SerialPort::send(const uint8_t* data, uint32_t length, int timeout_millis) {
+    if (data == nullptr) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (length == 0) {
+        return 0;
+    }
+
+    int fd = m_port_fd;
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds((timeout_millis > 0) ? timeout_millis : 0);
+    uint32_t sent = 0;
+    while (sent < length) {
+        ssize_t result = write(fd, data + sent, length - sent);
+        if (result > 0) {
+            sent += static_cast<uint32_t>(result);
+            continue;
+        }
+        else if ((result < 0) && (errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR)) {
+            count_transfer(true, -1, length, timeout_millis);
+            return -1;
+        }
+
+        int wait_millis = (timeout_millis >= 0) ? get_remain_millis(deadline) : -1;
+        int ready = wait_io(fd, POLLOUT, wait_millis);
+        if (ready < 0) {
+            int retval = (is_opened()) ? -1 : static_cast<int>(sent);
+            count_transfer(true, retval, length, timeout_millis);
+            return retval;
+        }
+        else if (ready == 0) { // タイムアウトした？
+            break;
+        }
+    }
+
+    count_transfer(true, static_cast<int>(sent), length, timeout_millis);
+    return static_cast<int>(sent);
+}
+
+int SerialPort::receive(uint8_t* buf, uint32_t bufsize, int timeout_millis) {
+    if (buf == nullptr) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (bufsize == 0) {
+        return 0;
+    }
+
+    int fd = m_port_fd;
+    if (fd < 0) {
+        errno = EBADF;
+        return -1;
+    }
+    uint32_t errors = get_line_errors(fd);
+    if (errors != 0) {
+        handle_errors(errors);
+    }
+
+    // Note: Windows版と同様、bufsize分受信するかタイムアウトするまで待つ。
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds((timeout_millis > 0) ? timeout_millis : 0);
+    uint32_t received = 0;
+    while (received < bufsize) {
+        ssize_t result = read(fd, buf + received, bufsize - received);
+        if (result > 0) {
+            received += static_cast<uint32_t>(result);
+            continue;
+        }
+        else if ((result < 0) && (errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR)) {
+            count_transfer(false, -1, bufsize, timeout_millis);
+            return -1;
+        }
+        else if (timeout_millis == 0) { // 受信済みのデータだけ読み出す？
+            break;
+        }
+
+        int wait_millis = (timeout_millis >= 0) ? get_remain_millis(deadline) : -1;
+        int ready = wait_io(fd, POLLIN, wait_millis);
+        if (ready < 0) {
+            int retval = (is_opened()) ? -1 : static_cast<int>(received);
+            count_transfer(false, retval, bufsize, timeout_millis);
+            return retval;
+        }
+        else if (ready == 0) { // タイムアウトした？
+            break;
+        }
+    }
+
+    count_transfer(false, static_cast<int>(received), bufsize, timeout_millis);
+    return static_cast<int>(received);
+}
+
+int SerialPort::get_output_queue_length(void) {
+    int queued = 0;
+    if (ioctl(m_port_fd, TIOCOUTQ, &queued) != 0) {
+        return -1;
+    }
+    count_max(CounterSendQueueMax, static_cast<uint64_t>(queued));
+    return queued;
+}
+
+bool SerialPort::is_writable(uint32_t queue_limit) {
+    int queued = get_output_queue_length();
+    if ((queued < 0) || (static_cast<uint32_t>(queued) >= queue_limit)) {
+        return false;
+    }
+    if (m_cts_flow == CtsFlowEnable) {
+        // Note: 疑似端末などモデム制御線の無いデバイスではTIOCMGETが失敗するので、CTSはオンとみなす。
+        int status = 0;
+        if ((ioctl(m_port_fd, TIOCMGET, &status) == 0) && ((status & TIOCM_CTS) == 0)) { // CTSオフ？
+            return false;
+        }
+    }
+    return true;
+}
+
+bool SerialPort::request_receive_notify(void) {
+    if (!is_opened()) {
+        errno = EBADF;
+        return false;
+    }
+    return true;
+}
+
+bool SerialPort::start_streaming(const receive_handler_t& handler, uint32_t buffer_count, uint32_t buffer_size) {
+    if (!handler || (buffer_count < 2) || (buffer_size == 0)) {
+        errno = EINVAL;
+        return false;
+    }
+    if (!is_opened()) {
+        errno = EBADF;
+        return false;
+    }
+    if (m_stream_thread.joinable()) { // ストリーム受信中？
+        errno = EBUSY;
+        return false;
+    }
+
+    // 前回stop_streaming()時に書き込まれた停止要求を読み捨てる。
+    uint8_t discard[16];
+    while (read(m_stream_stop_pipe[0], discard, sizeof(discard)) > 0) {
+    }
+    m_receive_handler = handler;
+    m_is_streaming = true;
+    m_stream_thread = std::thread(&SerialPort::stream_proc, this, buffer_count, buffer_size);
+
+    return true;
+}
+
+void SerialPort::stop_streaming(void) {
+    if (!m_stream_thread.joinable()) {
+        return;
+    }
+    uint8_t c = 0;
+    if (write(m_stream_stop_pipe[1], &c, 1) < 0) {
+        // パイプが満杯の場合は既に通知済みなので問題ない。
+    }
+    m_stream_thread.join();
+    m_receive_handler = nullptr;
+}
+
+void SerialPort::stream_proc(uint32_t buffer_count, uint32_t buffer_size) {
+    (void)buffer_count;
+    int fd = m_port_fd;
+    std::vector<uint8_t> buf(buffer_size);
+
+    int error = 0;
+    while (error == 0) {
+        struct pollfd fds[2];
+        fds[0].fd = fd;
+        fds[0].events = POLLIN;
+        fds[0].revents = 0;
+        fds[1].fd = m_stream_stop_pipe[0];
+        fds[1].events = POLLIN;
+        fds[1].revents = 0;
+        if (poll(fds, 2, -1) < 0) {
+            if (errno != EINTR) {
+                error = errno;
+            }
+            continue;
+        }
+        if (fds[1].revents != 0) { // 停止要求？
+            break;
+        }
+        if ((fds[0].revents & (POLLERR | POLLNVAL)) != 0) {
+            error = EIO;
+            break;
+        }
+        m_completed_time = std::chrono::steady_clock::now();
+
+        uint32_t errors = get_line_errors(fd);
+        if (errors != 0) {
+            handle_errors(errors);
+        }
+        ssize_t result = read(fd, &buf[0], buffer_size);
+        count(CounterReceiveCalls);
+        if (result > 0) {
+            count(CounterReceivedBytes, static_cast<uint64_t>(result));
+            m_receive_handler(&buf[0], static_cast<uint32_t>(result));
+        }
+        else if (result == 0) { // ハングアップした？(疑似端末の対向がクローズされた場合など)
+            error = EIO;
+        }
+        else if ((errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR)) {
+            error = errno;
+        }
+    }
+
+    m_is_streaming = false;
+    if (error != 0) {
+        errno = error;
+        m_receive_handler(nullptr, 0);
+    }
+}
+
+int SerialPort::wait_io(int fd, short events, int timeout_millis) {
+    count(CounterWaitIo);
+    struct pollfd fds[2];
+    fds[0].fd = fd;
+    fds[0].events = events;
+    fds[0].revents = 0;
+    fds[1].fd = m_cancel_pipe[0];
+    fds[1].events = POLLIN;
+    fds[1].revents = 0;
+
+    int result;
+    do {
+        result = poll(fds, 2, timeout_millis);
+    } while ((result < 0) && (errno == EINTR));
+
+    if (result < 0) {
+        // Error number was set by poll().
+        return -1;
+    }
+    else if (result == 0) {
+        return 0;
+    }
+    else if (fds[1].revents != 0) { // close()された？
+        errno = EBADF;
+        return -1;
+    }
+    else if ((fds[0].revents & (POLLERR | POLLNVAL)) != 0) {
+        errno = EIO;
+        return -1;
+    }
+    else {
+        return 1;
+    }
+}
+
+uint32_t SerialPort::get_line_errors(int fd) {
+    uint32_t errors = 0;
+#if defined(TIOCGICOUNT)
+    struct serial_icounter_struct icount;
+    if (ioctl(fd, TIOCGICOUNT, &icount) == 0) {
+        line_error_counts counts;
+        counts.brk = static_cast<uint32_t>(icount.brk);
+        counts.frame = static_cast<uint32_t>(icount.frame);
+        counts.overrun = static_cast<uint32_t>(icount.overrun);
+        counts.buf_overrun = static_cast<uint32_t>(icount.buf_overrun);
+        counts.parity = static_cast<uint32_t>(icount.parity);
+        if (counts.brk != m_line_errors.brk) {
+            errors |= ErrorBreak;
+        }
+        if (counts.frame != m_line_errors.frame) {
+            errors |= ErrorFrame;
+        }
+        if (counts.overrun != m_line_errors.overrun) {
+            errors |= ErrorOverrRun;
+        }
+        if (counts.buf_overrun != m_line_errors.buf_overrun) {
+            errors |= ErrorReceiveOverflow;
+        }
+        if (counts.parity != m_line_errors.parity) {
+            errors |= ErrorReceiveParity;
+        }
+        m_line_errors = counts;
+    }
+#else
+    (void)fd;
+#endif
+    return errors;
+}
+
+#endif
@@ -0,0 +1,65 @@
+#include <chrono>
+
+#include "SessionReplayer.h"
+
+SessionReplayer::SessionReplayer(double speed)
+    : m_speed(speed), m_channel(AllChannels), m_direction(0), m_is_stopping(false),
+    m_record_count(0), m_data_bytes(0), m_lateness("replay.lateness") {
+}
+
+bool SessionReplayer::run(CaptureReader& reader, const sink_t& sink) {
+    m_is_stopping = false;
+    m_record_count = 0;
+    m_data_bytes = 0;
+    m_lateness.reset();
+
+    CaptureReader::Record record;
+    bool is_first = true;
+    int64_t first_timestamp_ns = 0;
+    auto begin = std::chrono::steady_clock::now();
+    while (reader.read(&record)) {
+        if (((m_channel != AllChannels) && (record.channel != m_channel))
+            || ((m_direction != 0) && (record.direction != m_direction))) {
+            continue;
+        }
+        if (is_first) {
+            // 最初に再生するレコードを基準にする。
+            is_first = false;
+            first_timestamp_ns = record.timestamp_ns;
+            begin = std::chrono::steady_clock::now();
+        }
+
+        if (m_speed > 0.0) {
+            auto offset = std::chrono::nanoseconds(static_cast<int64_t>((record.timestamp_ns - first_timestamp_ns) / m_speed));
+            auto scheduled = begin + std::chrono::duration_cast<std::chrono::steady_clock::duration>(offset);
+            auto now = std::chrono::steady_clock::now();
+            // Note: 予定時刻を過ぎている(遅れている、または間隔が短い)レコードはロックせずに続けて再生する。
+            if (scheduled > now) {
+                std::unique_lock<std::mutex> lock(m_lock);
+                m_cond.wait_until(lock, scheduled, [this]() { return m_is_stopping.load(); });
+                lock.unlock();
+                now = std::chrono::steady_clock::now();
+            }
+            m_lateness.record(scheduled, now);
+        }
+        if (m_is_stopping) {
+            return false;
+        }
+
+        if (!sink(record)) {
+            return false;
+        }
+        m_record_count++;
+        m_data_bytes += record.data.size();
+    }
+
+    return true;
+}
+
+void SessionReplayer::stop(void) {
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_is_stopping = true;
+    }
+    m_cond.notify_all();
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+#include "CaptureReader.h"
+#include "LatencyHistogram.h"
+
+/**
+ * キャプチャしたセッションの再生
+ *
+ * CaptureReaderから読み出したレコードを、記録時の間隔(speed倍速)または待ち時間無しでシンクへ渡す。
+ * シンクでSerialPort::send()すれば機器の代わりに送信でき、受信ハンドラへ渡せば実機から受信したのと同じように
+ * 表示やデコードの処理を動かせる。
+ * 記録時の間隔で再生する場合は、予定時刻からの遅れをヒストグラムに記録する。
+ *
+ * @note
+ * 待ち時間はOSのタイマー精度に依存する(Windowsの既定では15ms程度)。
+ */
+class SessionReplayer
+{
+public:
+    /**
+     * 再生シンク型
+     *
+     * @param record レコード
+     * @retval true 再生を続ける
+     * @retval false 再生を中止する
+     */
+    typedef std::function<bool(const CaptureReader::Record& record)> sink_t;
+
+    /**
+     * 全てのチャネルを再生することを表すチャネル指定
+     */
+    static const int AllChannels = -1;
+
+    /**
+     * コンストラクタ
+     *
+     * @param speed 再生速度(1.0で記録時と同じ間隔、2.0で2倍速。0以下にすると待たずに再生する)
+     */
+    explicit SessionReplayer(double speed = 1.0);
+
+    /**
+     * 再生するレコードを絞り込む。
+     *
+     * @param channel チャネル番号(AllChannelsで全て)
+     * @param direction 方向(0で全て)
+     */
+    void set_filter(int channel, int direction) noexcept {
+        m_channel = channel;
+        m_direction = direction;
+    }
+
+    /**
+     * 再生する。
+     * 全てのレコードを再生するか、シンクが中止するか、stop()が呼ばれるまで呼び出し元をブロックする。
+     * キャプチャファイルの内容が不正な場合には std::system_error を投げる。
+     *
+     * @param reader オープン済みのキャプチャファイル
+     * @param sink 再生シンク
+     * @retval true 全てのレコードを再生した
+     * @retval false 中止した
+     */
+    bool run(CaptureReader& reader, const sink_t& sink);
+    /**
+     * 再生を中止する。
+     * 他のスレッドから呼び出す。待機中の場合は直ちに戻る。
+     */
+    void stop(void);
+
+    /**
+     * 再生したレコード数を得る。
+     *
+     * @retval レコード数
+     */
+    uint64_t get_record_count(void) const noexcept { return m_record_count; }
+    /**
+     * 再生したデータのバイト数を得る。
+     *
+     * @retval バイト数
+     */
+    uint64_t get_data_bytes(void) const noexcept { return m_data_bytes; }
+    /**
+     * 予定時刻からの遅れのヒストグラムを得る(記録時の間隔で再生した場合のみ)。
+     *
+     * @retval ヒストグラム
+     */
+    const LatencyHistogram& get_lateness(void) const noexcept { return m_lateness; }
+
+private:
+    double m_speed; // 再生速度
+    int m_channel; // 再生するチャネル
+    int m_direction; // 再生する方向
+    std::mutex m_lock; // 待機用ロック
+    std::condition_variable m_cond; // 中止通知
+    std::atomic<bool> m_is_stopping; // 中止要求中かどうか
+    std::atomic<uint64_t> m_record_count; // 再生したレコード数
+    std::atomic<uint64_t> m_data_bytes; // 再生したデータのバイト数
+    LatencyHistogram m_lateness; // 予定時刻からの遅れ
+
+    // コピーコンストラクタは使用できない。
+    SessionReplayer(const SessionReplayer& replayer) = delete;
+    // 代入演算子は使用できない
+    SessionReplayer& operator=(const SessionReplayer& replayer) = delete;
+};
@@ -1,6 +1,6 @@
 #include <memory>
 #include <thread>
-#include <sstream>
+#include <cstring>
 #include "StandardIo.h"
 
 StandardIo& StandardIo::instance(void) {
@@ -20,18 +20,28 @@ StandardIo& StandardIo::instance(void) {
 #endif
 }
 
-bool StandardIo::Terminated = false;
+std::atomic<bool> StandardIo::Terminated(false);
 
 const DWORD StandardIo::LineInputModeFunctions =
-    ENABLE_ECHO_INPUT // ECHOobN@\(͕̃GR[obN)
-    | ENABLE_INSERT_MODE // CT[g@\(obNXy[XL[J[\ړƓ͏)
-    | ENABLE_LINE_INPUT // CPʂł̓͋@\(s܂œReadFileœǂݏo)
-    | ENABLE_QUICK_EDIT_MODE;// NCbNGfBbg@\(}EXɂ̈IƁAENbNŃRs[)
+    ENABLE_ECHO_INPUT // ECHOバック機能(入力文字のエコーバック)
+    | ENABLE_INSERT_MODE // インサート機能(バックスペースキーやカーソル移動と入力処理)
+    | ENABLE_LINE_INPUT // ライン単位での入力機能(改行まで入れるとReadFileで読み出せる)
+    | ENABLE_QUICK_EDIT_MODE;// クイックエディット機能(マウスによる領域選択と、右クリックでコピー)
 
 StandardIo::StandardIo(void)
-    : m_initialized(false), m_max_read_length(256), m_prev_input_data('\0') {
+    : m_initialized(false),
+    m_output_buffer([this](uint32_t channel, const void* data, size_t length) {
+        return write_handle((channel == ErrorChannel) ? &m_error : &m_output, data, length);
+    }),
+    m_input_data(InputBufferCapacity),
+    m_input_event(CreateEventA(NULL, TRUE, FALSE, NULL)), m_max_read_length(256), m_prev_input_data('\0'),
+    m_input_bytes(0), m_input_reads(0), m_input_buffer_max(0), m_input_stalls(0), m_output_bytes(0), m_output_requests(0), m_output_writes(0), m_output_errors(0) {
 }
 StandardIo::~StandardIo(void) {
+    m_output_buffer.stop();
+    if (m_input_event != NULL) {
+        CloseHandle(m_input_event);
+    }
 }
 
 bool StandardIo::init(void) {
@@ -45,8 +55,10 @@ bool StandardIo::init(void) {
 
     SetConsoleCtrlHandler(console_handler_proc, TRUE);
 
+    m_output_buffer.start();
+
     if (is_input_valid()) {
-        // MXbhJn
+        // 受信スレッド開始
         std::thread thread([this]() { this->receiver_thread_proc(); });
         thread.detach();
     }
@@ -62,8 +74,8 @@ bool StandardIo::init(void) {
 void StandardIo::init_std_handle(StandardIo::std_io* pstdio, DWORD handle_type) {
     auto handle = GetStdHandle(handle_type);
     if ((handle == INVALID_HANDLE_VALUE) || (handle == nullptr)) {
-        // Θb^R\[ƐڑĂȂA_CNgĂȂꍇB
-        (*pstdio).handle = INVALID_HANDLE_VALUE; // nullptrԂꍇɂINVALID_HANDLE_VALUEɒu
+        // 対話型コンソールと接続されていないか、リダイレクトされていない場合。
+        (*pstdio).handle = INVALID_HANDLE_VALUE; // nullptrが返る場合にはINVALID_HANDLE_VALUEに置き換え
         (*pstdio).is_console = false;
         (*pstdio).mode = 0;
     }
@@ -96,7 +108,7 @@ bool StandardIo::modify_console_mode(std_io* pstdio, DWORD functions, bool is_en
     else {
         new_mode = (*pstdio).mode & ~functions;
     }
-    if (new_mode == (*pstdio).mode) { // [hɕύXȂH
+    if (new_mode == (*pstdio).mode) { // モードに変更ない？
         return true;
     }
 
@@ -111,27 +123,31 @@ bool StandardIo::modify_console_mode(std_io* pstdio, DWORD functions, bool is_en
 }
 
 std::string StandardIo::read_line(void) {
-    std::ostringstream oss;
-
-    while (!is_input_EOF()) { // I[mĂȂH
-        uint8_t c;
-        if (!m_input_data.empty()) {
-            {
-                std::lock_guard<std::mutex> lock(m_input_lock);
-                c = m_input_data.front();
-                m_input_data.pop();
-            }
-            oss << c;
-            if (c == '\n') {
+    std::string line;
+    flush(); // プロンプトを表示してから入力を待つ。
+
+    while (true) {
+        const uint8_t* span;
+        size_t span_length = m_input_data.get_read_span(&span);
+        if (span_length > 0) {
+            const void* lf = memchr(span, '\n', span_length);
+            size_t length = (lf != nullptr) ? static_cast<size_t>(static_cast<const uint8_t*>(lf) - span + 1) : span_length;
+            line.append(reinterpret_cast<const char*>(span), length);
+            m_input_data.consume(length);
+            notify_input_space();
+            if (lf != nullptr) {
                 break;
             }
         }
+        else if (is_input_EOF()) { // 終端検知した？
+            break;
+        }
         else {
-            std::this_thread::yield();
+            wait_input(-1);
         }
     }
 
-    return oss.str();
+    return line;
 }
 
 bool StandardIo::read_line(char* buf, size_t bufsize, size_t* plength) {
@@ -139,24 +155,28 @@ bool StandardIo::read_line(char* buf, size_t bufsize, size_t* plength) {
         return false;
     }
 
+    flush(); // プロンプトを表示してから入力を待つ。
     size_t read_length = 0;
-    while (!is_input_EOF() // I[mĂȂH
-        && (read_length < (bufsize - 1))) { // ǂݏo bufsize - 1 H
-        uint8_t c;
-        if (!m_input_data.empty()) {
-            {
-                std::lock_guard<std::mutex> lock(m_input_lock);
-                c = m_input_data.front();
-                m_input_data.pop();
-            }
-            buf[read_length] = c;
-            read_length++;
-            if (c == '\n') {
+    while (read_length < (bufsize - 1)) { // 読み出した長さが bufsize - 1 未満？
+        const uint8_t* span;
+        size_t span_length = m_input_data.get_read_span(&span);
+        if (span_length > 0) {
+            span_length = min(span_length, bufsize - 1 - read_length);
+            const void* lf = memchr(span, '\n', span_length);
+            size_t length = (lf != nullptr) ? static_cast<size_t>(static_cast<const uint8_t*>(lf) - span + 1) : span_length;
+            memcpy(buf + read_length, span, length);
+            m_input_data.consume(length);
+            notify_input_space();
+            read_length += length;
+            if (lf != nullptr) {
                 break;
             }
         }
+        else if (is_input_EOF()) { // 終端検知した？
+            break;
+        }
         else {
-            std::this_thread::yield();
+            wait_input(-1);
         }
     }
     buf[read_length] = '\0';
@@ -177,8 +197,7 @@ bool StandardIo::read_with_timeout(void* buf, size_t bufsize, size_t* pread, int
     size_t read_length = 0;
     size_t left = bufsize;
     ULONGLONG begin = GetTickCount64();
-    while (!is_input_EOF() // I[oĂȂH
-        && (left > 0)) { // ǂݏocʂH
+    while (left > 0) { // 読み出し残量がある？
         size_t length = 0;
         retval = read(wp, left, &length);
         if (retval) {
@@ -189,11 +208,19 @@ bool StandardIo::read_with_timeout(void* buf, size_t bufsize, size_t* pread, int
         else {
             break;
         }
-
-        if ((timeout >= 0) // ^CAEgԂ0ȏH
-            && ((GetTickCount64() - begin) >= timeout)) { // oߎԂ^CAEgԈȏH
+        if ((left == 0) || is_input_EOF()) { // 読み終えた or 終端検出した？
             break;
         }
+
+        int32_t wait_millis = -1;
+        if (timeout >= 0) { // タイムアウト時間が0以上？
+            ULONGLONG elapsed = GetTickCount64() - begin;
+            if (elapsed >= static_cast<ULONGLONG>(timeout)) { // 経過時間がタイムアウト時間以上？
+                break;
+            }
+            wait_millis = static_cast<int32_t>(timeout - elapsed);
+        }
+        wait_input(wait_millis);
     }
     (*pread) = read_length;
     return retval;
@@ -204,36 +231,54 @@ bool StandardIo::read(void* buf, size_t bufsize, size_t* pread) {
         return false;
     }
 
-    uint8_t* wp = static_cast<uint8_t*>(buf);
-
-    size_t read_length = 0;
-    if (!m_input_data.empty()) {
-        std::lock_guard<std::mutex> lock(m_input_lock);
-        while ((read_length < bufsize) // ǂݏobufsizeH
-            && !m_input_data.empty()) { // f[^łȂH
-            (*wp) = m_input_data.front();
-            m_input_data.pop();
-            read_length++;
-            wp++;
-        }
+    (*pread) = m_input_data.pop(buf, bufsize);
+    if ((*pread) > 0) {
+        notify_input_space();
     }
-    (*pread) = read_length;
-    
+
     return true;
 }
 
 
-bool StandardIo::print(std_io* pstdio, const std::string& str) {
+bool StandardIo::print(const char* fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    bool retval = vprint(&m_output, fmt, args);
+    va_end(args);
+    return retval;
+}
+
+bool StandardIo::print_err(const char* fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    bool retval = vprint(&m_error, fmt, args);
+    va_end(args);
+    return retval;
+}
+
+bool StandardIo::vprint(std_io* pstdio, const char* fmt, va_list args) {
+    if (fmt == nullptr) {
+        return true;
+    }
+
+    size_t length = 0;
+    const char* str = vformat_local(&length, fmt, args);
+    if (str == nullptr) {
+        return false;
+    }
+    return print(pstdio, str, length);
+}
+
+bool StandardIo::print(std_io* pstdio, const char* str, size_t length) {
     if ((*pstdio).is_console) {
-        const std::string outstr = replace_CRLF(str);
-        const char* cstr = outstr.c_str();
-        size_t length = strlen(cstr);
-        return write(pstdio, cstr, length);
+        // 改行コードをCR+LFに揃える。呼び出しをまたいだCRとLFも1つの改行として扱う。
+        std::lock_guard<std::mutex> lock(m_print_lock);
+        size_t out_length;
+        const char* outstr = (*pstdio).normalizer.normalize(str, length, &out_length);
+        return write(pstdio, outstr, out_length);
     }
     else {
-        const char* cstr = str.c_str();
-        size_t length = strlen(cstr);
-        return write(pstdio, cstr, length);
+        return write(pstdio, str, length);
     }
 }
 
@@ -242,100 +287,198 @@ bool StandardIo::write(std_io* pstdio, const void* data, size_t length, size_t *
         return false;
     }
 
+    bool is_output = (pstdio == &m_output);
+    if (is_output) {
+        m_output_requests.fetch_add(1, std::memory_order_relaxed);
+    }
+    // Note: 標準出力と標準エラー出力は同じキューに溜めるので、もう一方の書き出しを待たずに表示順が保たれる。
+    bool retval = m_output_buffer.write(data, length, (is_output ? OutputChannel : ErrorChannel));
+    if (pwritten != nullptr) {
+        (*pwritten) = (retval) ? length : 0;
+    }
+    return retval;
+}
+
+bool StandardIo::write_handle(std_io* pstdio, const void* data, size_t length) {
     const uint8_t* rp = reinterpret_cast<const uint8_t*>(data);
     auto left = static_cast<DWORD>(length);
 
+    bool is_output = (pstdio == &m_output);
     while (left > 0) {
         DWORD transferred = 0;
+        if (is_output) {
+            m_output_writes.fetch_add(1, std::memory_order_relaxed);
+        }
         if (WriteFile((*pstdio).handle, rp, left, &transferred, nullptr)) {
             rp += transferred;
             left -= transferred;
         }
         else {
+            if (is_output) {
+                m_output_errors.fetch_add(1, std::memory_order_relaxed);
+            }
             break;
         }
     }
-    if (pwritten != nullptr) {
-        (*pwritten) = length - left;
+    if (is_output) {
+        m_output_bytes.fetch_add(length - left, std::memory_order_relaxed);
     }
     return (left == 0);
 }
 
-std::string StandardIo::replace_CRLF(const std::string& str) {
-    std::ostringstream oss;
+bool StandardIo::wait_input(int32_t timeout_millis) {
+    auto is_ready = [this]() { return !m_input_data.empty() || is_input_EOF(); };
 
-    char prev = '\0';
-    for (auto c : str) {
-        if ((c != '\n') && (prev == '\r')) { // CR݂̂H
-            oss << '\n'; // LFǉ CR+LF ɂB
-        }
-        else if ((c == '\n') && (prev != '\r')) { // LF̂݁H
-            oss << '\r'; // CRǉ CR+LF ɂB
-        }
-        oss << c;
-        prev = c;
+    std::unique_lock<std::mutex> lock(m_input_wait_lock);
+    if (timeout_millis < 0) {
+        m_input_cond.wait(lock, is_ready);
+        return true;
     }
-    if (prev == '\r') { // CR̂݁H
-        oss << '\n'; // LFǉ CR+LF ɂB
+    else {
+        return m_input_cond.wait_for(lock, std::chrono::milliseconds(timeout_millis), is_ready);
     }
-    return oss.str();
 }
 
+StandardIo::Statistics StandardIo::get_statistics(void) {
+    Statistics stats;
+    stats.input_bytes = m_input_bytes.load(std::memory_order_relaxed);
+    stats.input_reads = m_input_reads.load(std::memory_order_relaxed);
+    stats.input_buffer_max = m_input_buffer_max.load(std::memory_order_relaxed);
+    stats.input_stalls = m_input_stalls.load(std::memory_order_relaxed);
+    stats.output_bytes = m_output_bytes.load(std::memory_order_relaxed);
+    stats.output_requests = m_output_requests.load(std::memory_order_relaxed);
+    stats.output_writes = m_output_writes.load(std::memory_order_relaxed);
+    stats.output_errors = m_output_errors.load(std::memory_order_relaxed);
+    OutputBuffer::Statistics buffer_stats = m_output_buffer.get_statistics();
+    stats.output_blocked = buffer_stats.blocked;
+    stats.output_dropped_bytes = buffer_stats.dropped_bytes;
+    stats.output_spilled_bytes = buffer_stats.spilled_bytes;
+    stats.output_queue_max = buffer_stats.queue_max;
+    return stats;
+}
 
-void StandardIo::receiver_thread_proc(void) {
-    // Note : W͂LłȂꍇɂ͋NȂ̂ŁA
-    //        ReadFile()ĂяoOis_input_valid()͕svB
-    uint8_t buf[256];
-    while (!Terminated) {
-        DWORD read_len = 0;
-        if (m_input_data.size() < m_max_read_length) {
-            if (m_input.is_console) {
-                read_from_console();
-            }
-            else {
-                read_from_pipe();
-            }
+void StandardIo::reset_statistics(void) {
+    std::atomic<uint64_t>* counters[] = {
+        &m_input_bytes, &m_input_reads, &m_input_buffer_max, &m_input_stalls, &m_output_bytes, &m_output_requests, &m_output_writes, &m_output_errors
+    };
+    for (auto pcounter : counters) {
+        (*pcounter).store(0, std::memory_order_relaxed);
+    }
+    m_output_buffer.reset_statistics();
+}
+
+void StandardIo::set_output_buffering(size_t capacity, uint32_t flush_delay_millis) {
+    m_output_buffer.set_policy(capacity, flush_delay_millis);
+}
+
+void StandardIo::set_output_overflow_policy(size_t queue_limit, OutputBuffer::OverflowPolicy policy,
+    const OutputBuffer::writer_t& spill) {
+    m_output_buffer.set_overflow_policy(queue_limit, policy, spill);
+}
+
+bool StandardIo::flush(void) {
+    return m_output_buffer.flush();
+}
+
+void StandardIo::notify_input(void) {
+    // Note: 入力バッファに書き込むのは受信スレッドだけなので、最大値はほぼ受信スレッドからしか更新されない。
+    //       他のスレッドと競合しても統計値が僅かにずれるだけなので、CASは使わない。
+    uint64_t buffered = m_input_data.size();
+    if (buffered > m_input_buffer_max.load(std::memory_order_relaxed)) {
+        m_input_buffer_max.store(buffered, std::memory_order_relaxed);
+    }
+    // Note: 待機側は述語の評価をロック中に行うので、ここでロックを取ってから通知すれば
+    //       通知の取りこぼしは起きない。
+    {
+        std::lock_guard<std::mutex> lock(m_input_wait_lock);
+    }
+    m_input_cond.notify_all();
+    SetEvent(m_input_event);
+}
+
+void StandardIo::notify_input_space(void) {
+    {
+        std::lock_guard<std::mutex> lock(m_input_wait_lock);
+    }
+    m_input_space_cond.notify_all();
+}
+
+bool StandardIo::wait_input_space(void) {
+    auto has_space = [this]() { return (m_input_data.size() < m_max_read_length) || is_input_EOF(); };
+
+    std::unique_lock<std::mutex> lock(m_input_wait_lock);
+    if (!has_space()) {
+        m_input_stalls.fetch_add(1, std::memory_order_relaxed);
+        m_input_space_cond.wait(lock, has_space);
+    }
+    return !is_input_EOF();
+}
+
+bool StandardIo::request_input_notify(void) {
+    // Note: リセットしてから状態を確認するので、その間に到着したデータの通知は失われない。
+    ResetEvent(m_input_event);
+    bool is_empty = m_input_data.empty();
+    if (!is_empty || is_input_EOF()) {
+        SetEvent(m_input_event);
+    }
+    return !is_empty || !is_input_EOF();
+}
+
+void StandardIo::terminate_input(void) {
+    Terminated = true;
+    notify_input();
+    notify_input_space();
+}
 
-            size_t io_length = min(sizeof(buf), m_max_read_length - m_input_data.size());
+void StandardIo::receiver_thread_proc(void) {
+    // Note : 標準入力が有効でない場合には起動されないので、
+    //        ReadFile()呼び出し前のis_input_valid()は不要。
+    // Note: 入力バッファが読み出しバッファサイズに達したら、読み出されるまで標準入力を読まない。
+    //       パイプの場合は書き込み側がブロックするので、大きなファイルを流し込んでもメモリ使用量は一定になる。
+    while (wait_input_space()) {
+        if (m_input.is_console) {
+            read_from_console();
         }
         else {
-            std::this_thread::yield();
+            read_from_pipe();
         }
     }
 }
 void StandardIo::read_from_console(void) {
     char buf[1];
     DWORD read_len = 0;
+    m_input_reads.fetch_add(1, std::memory_order_relaxed);
     if (!ReadFile(m_input.handle, buf, 1, &read_len, nullptr)) {
         return;
     }
+    m_input_bytes.fetch_add(read_len, std::memory_order_relaxed);
 
-    if (read_len == 0) { // ǂݏo0H
-        Terminated = true;
+    if (read_len == 0) { // 読み出した長さが0？
+        terminate_input();
         return;
     }
 
     if (is_line_input_mode()) {
-        std::lock_guard<std::mutex> lock(m_input_lock);
-        m_input_data.push(buf[0]);
+        m_input_data.push(buf, 1);
+        notify_input();
     } else {
-        uint8_t write_data[4]; // o͕
+        uint8_t write_data[4]; // 出力文字列
         uint32_t write_len;
 
         uint8_t c = buf[0];
-        if ((c == '\r')) { // CR̂݁H
+        if ((c == '\r')) { // CRのみ？
             write_data[0] = '\r';
             write_data[1] = '\n';
             write_len = 2;
         }
-        else if ((c == '\n') && (m_prev_input_data != '\r')) { // LF̂݁H
+        else if ((c == '\n') && (m_prev_input_data != '\r')) { // LFのみ？
             write_data[0] = '\r';
             write_data[1] = c;
             write_len = 2;
         }
         else if (c == 0x04) {
-            // EOTm(Ctrl+D)
-            Terminated = true;
+            // EOT検知(Ctrl+D)
+            terminate_input();
             write_len = 0;
         }
         else {
@@ -343,30 +486,36 @@ void StandardIo::read_from_console(void) {
             write_len = 1;
         }
 
-        std::lock_guard<std::mutex> lock(m_input_lock);
-        for (uint32_t i = 0; i < write_len; i++) {
-            m_input_data.push(write_data[i]);
-        }
+        m_input_data.push(write_data, write_len);
     }
+    notify_input();
 
     return;
 }
 void StandardIo::read_from_pipe(void) {
-    uint8_t buf[256];
-    DWORD io_length = static_cast<DWORD>(min(sizeof(buf), m_max_read_length - m_input_data.size()));
+    // 入力バッファの書き込み領域に直接読み出す。
+    uint8_t* span;
+    size_t span_length = m_input_data.get_write_span(&span);
+    DWORD io_length = static_cast<DWORD>(min(span_length, m_max_read_length - m_input_data.size()));
     DWORD read_len = 0;
-    if (ReadFile(m_input.handle, buf, io_length, &read_len, nullptr)) {
-        std::lock_guard<std::mutex> lock(m_input_lock);
-        for (size_t i = 0; i < read_len; i++) {
-            m_input_data.push(buf[i]);
+    m_input_reads.fetch_add(1, std::memory_order_relaxed);
+    if (ReadFile(m_input.handle, span, io_length, &read_len, nullptr)) {
+        m_input_bytes.fetch_add(read_len, std::memory_order_relaxed);
+        if ((read_len == 0) && (io_length > 0)) { // 読み出した長さが0？
+            // リダイレクトされたファイルの場合、
+            // 終端に達するとReadFile()は成功して0バイトを返す。
+            terminate_input();
+            return;
         }
+        m_input_data.commit_write(read_len);
+        notify_input();
     }
     else {
         auto err = GetLastError();
         if (err == ERROR_BROKEN_PIPE) {
-            // _CNgꂽ͂̏ꍇA
-            // I[ɒB ERROR_BROKEN_PIPEԂ悤ɂȂB
-            Terminated = true;
+            // リダイレクトされた入力の場合、
+            // 終端に達すると ERROR_BROKEN_PIPEが返るようになる。
+            terminate_input();
         }
     }
 
@@ -376,8 +525,8 @@ BOOL StandardIo::console_handler_proc(DWORD event) {
     BOOL retval;
     switch (event) {
     case CTRL_BREAK_EVENT: // Ctrl-Break
-    case CTRL_CLOSE_EVENT: // R\[N[Y
-        Terminated = true;
+    case CTRL_CLOSE_EVENT: // コンソールクローズ
+        instance().terminate_input();
         retval = TRUE;
         break;
     default:
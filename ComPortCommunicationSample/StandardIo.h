@@ -5,51 +5,78 @@
 #include <cstdarg>
 #include <vector>
 #include <string>
-#include <queue>
+#include <atomic>
 #include <mutex>
+#include <condition_variable>
+#include "RingBuffer.h"
+#include "CrlfNormalizer.h"
+#include "OutputBuffer.h"
+#include "utils.h"
 
 /**
- * Wo̓bp[
+ * 標準入出力ラッパー
  * 
  * @note
- * std::cin  std::coutgǂƎvB
+ * std::cin および std::coutを使った方が良いと思う。
+ * 入力の読み出し(read_line, read_with_timeout, read)は1つのスレッドからのみ呼び出すこと。
  */
 class StandardIo
 {
 public:
+    /**
+     * 入出力統計
+     */
+    struct Statistics {
+        uint64_t input_bytes; // 標準入力から読み込んだバイト数
+        uint64_t input_reads; // 標準入力の読み込み回数
+        uint64_t input_buffer_max; // 入力バッファにたまったデータ量の最大値
+        uint64_t input_stalls; // 入力バッファが一杯で標準入力の読み込みを待った回数
+        uint64_t output_bytes; // 標準出力へ書き込んだバイト数
+        uint64_t output_requests; // 標準出力への出力要求の回数(バッファでまとめる前)
+        uint64_t output_writes; // 標準出力への書き込み回数
+        uint64_t output_errors; // 標準出力への書き込みが失敗した回数
+        uint64_t output_blocked; // 標準出力のキューの空きを待った回数
+        uint64_t output_dropped_bytes; // 標準出力のキューに入りきらず捨てたバイト数
+        uint64_t output_spilled_bytes; // 標準出力のキューに入りきらず退避したバイト数
+        uint64_t output_queue_max; // 標準出力のキューに溜まったデータ量の最大値
+    };
+
     static StandardIo& instance(void);
 
     ~StandardIo(void);
 
     /**
-     * sPʓ̓[hݒ肷B
+     * 行単位入力モードを設定する。
      * 
-     * @param is_enabled sPʓ̓[hɂꍇɂtrue, ȊOfalse.
-     * @retval true 
-     * @retval false s
+     * @param is_enabled 行単位入力モードにする場合にはtrue, それ以外はfalse.
+     * @retval true 成功
+     * @retval false 失敗
      */
     bool set_line_input_mode(bool is_enable) {
         return modify_console_mode(&m_input, LineInputModeFunctions, is_enable);
     }
 
     /**
-     * sPʓ̓[hǂ𓾂
+     * 行単位入力モードかどうかを得る
      * 
-     * @retval true sPʓ̓[h
-     * @retval false Pʓ̓[h
+     * @retval true 行単位入力モード
+     * @retval false 文字単位入力モード
      */
     bool is_line_input_mode(void) const noexcept {
         return ((m_input.mode & LineInputModeFunctions) == LineInputModeFunctions) ? true : false;
     }
 
     /**
-     * ǂݏoobt@̃TCYݒ肷B
+     * 読み出しバッファのサイズを設定する。
      * 
-     * @param length 
+     * @param length 長さ(1以上、InputBufferCapacity以下)
+     * @retval true 成功
+     * @retval false 失敗
      */
     bool set_max_read_length(uint32_t length) {
-        if (length > 0) {
+        if ((length > 0) && (length <= InputBufferCapacity)) {
             m_max_read_length = length;
+            notify_input_space(); // 広げた場合に受信スレッドが読み込みを再開できるようにする。
             return true;
         }
         else {
@@ -57,165 +84,172 @@ public:
         }
     }
     /**
-     * ǂݏoobt@̃TCY擾B
+     * 読み出しバッファのサイズを取得する。
      * 
-     * @retval obt@TCY
+     * @retval バッファサイズ
      */
     uint32_t get_max_read_length(void) const noexcept {
         return m_max_read_length;
     }
 
     /**
-     * ǂݏoobt@ɂ܂Ăf[^ʂ擾B
+     * 読み出しバッファにたまっているデータ量を取得する。
      * 
-     * @retval f[^
+     * @retval データ量
      */
     uint32_t get_read_data_length(void) const noexcept {
         return static_cast<uint32_t>(m_input_data.size());
     }
 
     /**
-     * ͂I[ǂ𔻒肷B
+     * 入力が終端したかどうかを判定する。
      * 
-     * @retval true I[Ăꍇ
-     * @retval false I[ĂȂꍇ
+     * @retval true 終端している場合
+     * @retval false 終端していない場合
      */
     bool is_input_EOF(void) const noexcept { return Terminated; }
     /**
-     * _^ւ̃LXgZq
+     * 論理型へのキャスト演算子
      * 
-     * @retval true ͂Lȏꍇ
-     * @retval false ͂ȏꍇ
+     * @retval true 入力が有効な場合
+     * @retval false 入力が無効な場合
      */
     operator bool() const noexcept {
         return is_input_valid() && !is_input_EOF();
     }
     /**
-     * ے艉Zq
+     * 否定演算子
      * 
-     * @retval true ͂ȏꍇ
-     * @retval false ͂Lȏꍇ
+     * @retval true 入力が無効な場合
+     * @retval false 入力が有効な場合
      */
     bool operator!() const noexcept {
         return !this->operator bool();
     }
 
     /**
-     * ͂LǂB
-     * R\[ɐڑĂ邩A_CNgĂꍇtrueB
-     * ǂ̎qvZXƂċNāA_CNgĂȂꍇɂfalse.
+     * 入力が有効かどうか。
+     * コンソールに接続されているか、リダイレクトされている場合にtrue。
+     * どっかの子プロセスとして起動されて、リダイレクトされていない場合にはfalse.
      * 
-     * @retval true L
-     * @retval false 
+     * @retval true 有効
+     * @retval false 無効
      */
     bool is_input_valid(void) const noexcept {
         return (m_input.handle != INVALID_HANDLE_VALUE) ? true : false;
     }
     /**
-     * Wo͂LǂB
-     * R\[ɐڑĂ邩A_CNgĂꍇtrueB
-     * ǂ̎qvZXƂċNāA_CNgĂȂꍇɂfalse.
+     * 標準出力が有効かどうか。
+     * コンソールに接続されているか、リダイレクトされている場合にtrue。
+     * どっかの子プロセスとして起動されて、リダイレクトされていない場合にはfalse.
      *
-     * @retval true L
-     * @retval false 
+     * @retval true 有効
+     * @retval false 無効
      */
     bool is_output_valid(void) const noexcept {
         return (m_output.handle != INVALID_HANDLE_VALUE) ? true : false;
     }
     /**
-     * WG[o͂LǂB
-     * R\[ɐڑĂ邩A_CNgĂꍇtrueB
-     * ǂ̎qvZXƂċNāA_CNgĂȂꍇɂfalse.
+     * 標準エラー出力が有効かどうか。
+     * コンソールに接続されているか、リダイレクトされている場合にtrue。
+     * どっかの子プロセスとして起動されて、リダイレクトされていない場合にはfalse.
      *
-     * @retval true L
-     * @retval false 
+     * @retval true 有効
+     * @retval false 無効
      */
     bool is_error_valid(void) const noexcept {
         return (m_error.handle != INVALID_HANDLE_VALUE) ? true : false;
     }
 
     /**
-     * 1sǂݏoB
-     * ͂I[Ăꍇɂ͋󕶎񂪕ԂB
-     * sR[hoOɓ͂I[ꍇɂ́Ar܂ł̕񂪕ԂB
-     * Ԃ͉sR[h܂ށB
+     * 1行読み出す。
+     * 入力が終端している場合には空文字列が返る。
+     * 改行コードを検出する前に入力が終端した場合には、途中までの文字列が返る。
+     * 返す文字列は改行コードを含む。
+     * 入力待ちの間は受信スレッドからの通知を待ってブロックするため、CPUを消費しない。
      * 
-     * @retval s
+     * @retval 行
      */
     std::string read_line(void);
     /**
-     * sR[ho邩Abufsize - 1ǂނ܂œǂݏoB
+     * 改行コードを検出するか、bufsize - 1文字読むまで読み出す。
      * 
-     * @param buf obt@(ȂƂ2oCgȏi[ł悤ȗ̈Ƃ邱)
-     * @param bufsize obt@TCY
-     * @param plength ǂݏoi[ϐ(svȏꍇɂnullptr)
-     * @retval true 
-     * @retval false s(sȃp[^nꂽꍇ)
+     * @param buf バッファ(少なくとも2バイト以上格納できるような領域とすること)
+     * @param bufsize バッファサイズ
+     * @param plength 読み出した長さを格納する変数(不要な場合にはnullptr)
+     * @retval true 成功
+     * @retval false 失敗(不正なパラメータが渡された場合)
      */
     bool read_line(char* buf, size_t bufsize, size_t* plength = nullptr);
     /**
-     * ̓obt@őbufsizeǂݏoB
-     * timeoutŎw肵Ԃҋ@B
+     * 入力バッファから最大でbufsizeだけ読み出す。
+     * timeoutで指定した時間だけ待機する。
+     * 入力の終端を検知した場合は、タイムアウトを待たずに戻る。
      * 
-     * @param buf obt@
-     * @param bufsize obt@TCY
-     * @param pread ǂݏoi[ϐ
-     * @param timeout ^CAEg[~b](ɂƉiɑ҂)
-     * @retval true 
-     * @retval false s
+     * @param buf バッファ
+     * @param bufsize バッファサイズ
+     * @param pread 読み出した長さを格納する変数
+     * @param timeout タイムアウト時間[ミリ秒](負数にすると永遠に待つ)
+     * @retval true 成功
+     * @retval false 失敗
      */
     bool read_with_timeout(void* buf, size_t bufsize, size_t* pread, int32_t timeout);
     /**
-     * ̓obt@őbufsizeǂݏoB
-     * {C^tF[X͓͑҂ȂB
+     * 入力通知を要求する。
+     * 入力データが到着するか終端を検知すると、get_input_event()で得たイベントが通知状態になる。
+     * 既に入力データがある場合は直ちに通知状態になる。
+     * 通知を受けてread()した後、次の通知を待つ前に再度呼び出すこと。
+     *
+     * @retval true 通知を待つことができる
+     * @retval false 入力が終端し、読み出すデータも無い(以降通知されない)
+     */
+    bool request_input_notify(void);
+    /**
+     * 入力通知イベントを得る。
+     * シリアルポートなど他の入力と合わせて、WaitForMultipleObjects()で待つために使う。
+     *
+     * @retval イベントハンドル
+     */
+    HANDLE get_input_event(void) const noexcept { return m_input_event; }
+    /**
+     * 入力バッファから最大でbufsizeだけ読み出す。
+     * 本インタフェースは入力待ちをしない。
      * 
-     * @param buf obt@
-     * @param bufsize obt@TCY
-     * @param pread ǂݏoi[ϐ
-     * @retval true 
-     * @retval false s
+     * @param buf バッファ
+     * @param bufsize バッファサイズ
+     * @param pread 読み出した長さを格納する変数
+     * @retval true 成功
+     * @retval false 失敗
      */
     bool read(void* buf, size_t bufsize, size_t* pread);
 
     /**
-     * wŏo͂B
+     * 文字列を書式指定で出力する。
+     * スレッドごとに使い回すバッファに生成してから書き込むので、呼び出しごとのメモリ確保は無い。
      * 
-     * @param fmt tH[}bg
-     * @param args p[^
-     * @retval true 
-     * @retval false s
-     */
-    template <typename ... Args>
-    bool print(const char* fmt, Args ... args) {
-        if (fmt != nullptr) {
-            size_t len = snprintf(nullptr, 0, fmt, args ...);
-            std::vector<char> buf(len + 1);
-            snprintf(&buf[0], len + 1, fmt, args ...);
-            std::string msg(&buf[0], &buf[0] + len);
-            return print(&m_output, msg);
-        }
-        else {
-            return true;
-        }
-    }
+     * @param fmt フォーマット
+     * @retval true 成功
+     * @retval false 失敗
+     */
+    bool print(PRINTF_FORMAT_STRING const char* fmt, ...) ATTRIBUTE_PRINTF(2, 3);
 
     /**
-     * o͂B
+     * 文字列を出力する。
      * 
-     * @param str 
-     * @retval true 
-     * @retval false s
+     * @param str 文字列
+     * @retval true 成功
+     * @retval false 失敗
      */
     bool print(const std::string& str) {
-        return print(&m_output, str);
+        return print(&m_output, str.data(), str.length());
     }
 
     /**
-     * o͂B
+     * 文字を出力する。
      * 
-     * @param c 
-     * @retval true 
-     * @retval false s
+     * @param c 文字
+     * @retval true 成功
+     * @retval false 失敗
      */
     bool print(char c) {
         char buf[1];
@@ -223,43 +257,31 @@ public:
         return write(&m_output, buf, 1);
     }
     /**
-     * wŕWG[o͂ɏo͂B
+     * 文字列を書式指定で標準エラー出力に出力する。
+     * スレッドごとに使い回すバッファに生成してから書き込むので、呼び出しごとのメモリ確保は無い。
      *
-     * @param fmt tH[}bg
-     * @param args p[^
-     * @retval true 
-     * @retval false s
-     */
-    template <typename ... Args>
-    bool print_err(const char* fmt, Args ... args) {
-        if (fmt != nullptr) {
-            size_t len = snprintf(nullptr, 0, fmt, args ...);
-            std::vector<char> buf(len + 1);
-            snprintf(&buf[0], len + 1, fmt, args ...);
-            std::string msg(&buf[0], &buf[0] + len);
-            return print(&m_error, msg);
-        }
-        else {
-            return true;
-        }
-    }
+     * @param fmt フォーマット
+     * @retval true 成功
+     * @retval false 失敗
+     */
+    bool print_err(PRINTF_FORMAT_STRING const char* fmt, ...) ATTRIBUTE_PRINTF(2, 3);
 
     /**
-     * WG[o͂ɏo͂B
+     * 文字列を標準エラー出力に出力する。
      *
-     * @param str 
-     * @retval true 
-     * @retval false s
+     * @param str 文字列
+     * @retval true 成功
+     * @retval false 失敗
      */
     bool print_err(const std::string& str) {
-        return print(&m_error, str);
+        return print(&m_error, str.data(), str.length());
     }
     /**
-     * WG[o͂ɏo͂B
+     * 文字を標準エラー出力に出力する。
      *
-     * @param c 
-     * @retval true 
-     * @retval false s
+     * @param c 文字
+     * @retval true 成功
+     * @retval false 失敗
      */
     bool print_err(char c) {
         char buf[1];
@@ -268,13 +290,13 @@ public:
     }
 
     /**
-     * f[^o͂B
+     * データを出力する。
      * 
-     * @param data f[^̃AhX
-     * @param length f[^̒
-     * @param pwritten o͂f[^󂯎ϐ(svȏꍇnullptr)
-     * @retval true 
-     * @retval false s
+     * @param data データのアドレス
+     * @param length データの長さ
+     * @param pwritten 出力したデータ長を受け取る変数(不要な場合はnullptr)
+     * @retval true 成功
+     * @retval false 失敗
      */
     bool write(const void* data, size_t length, size_t *pwritten = nullptr) {
         if ((data == nullptr)) {
@@ -286,13 +308,52 @@ public:
     }
 
     /**
-     * f[^WG[o͂ɏo͂B
+     * 標準出力と標準エラー出力のバッファリングを設定する。
+     * 溜めたデータは、容量に達するか、flush_delay_millis経過するか、flush()で書き出す。
+     * しばらく出力していない状態での出力(キー入力のエコーバックなど)は溜めずに直ちに書き出す。
+     *
+     * @param capacity バッファ容量[バイト](0にするとバッファリングせず、呼び出し元のスレッドで直ちに書き出す)
+     * @param flush_delay_millis 溜めたデータを書き出すまでの猶予時間[ミリ秒]
+     */
+    void set_output_buffering(size_t capacity, uint32_t flush_delay_millis);
+    /**
+     * 標準出力と標準エラー出力で共用するキューの上限と、上限に達したときの動作を設定する。
+     * 出力は書き出しスレッドが行うので、コンソールが遅くてもキューに空きがある間は呼び出し元を待たせない。
+     * 標準エラー出力は捨てないように、常に空きができるまで待つ。
+     *
+     * @param queue_limit キューの上限[バイト]
+     * @param policy 上限に達したときの動作
+     * @param spill 退避関数(OverflowSpillの場合のみ使用する)
+     */
+    void set_output_overflow_policy(size_t queue_limit, OutputBuffer::OverflowPolicy policy,
+        const OutputBuffer::writer_t& spill = OutputBuffer::writer_t());
+    /**
+     * 標準出力と標準エラー出力のバッファに溜まっているデータを書き出す。
+     *
+     * @retval true 成功
+     * @retval false 失敗
+     */
+    bool flush(void);
+
+    /**
+     * 入出力統計を得る。
+     *
+     * @retval 入出力統計
+     */
+    Statistics get_statistics(void);
+    /**
+     * 入出力統計を初期化する。
+     */
+    void reset_statistics(void);
+
+    /**
+     * データを標準エラー出力に出力する。
      * 
-     * @param data f[^̃AhX
-     * @param length f[^̒
-     * @param pwritten o͂f[^󂯎ϐ(svȏꍇnullptr)
-     * @retval true 
-     * @retval false s
+     * @param data データのアドレス
+     * @param length データの長さ
+     * @param pwritten 出力したデータ長を受け取る変数(不要な場合はnullptr)
+     * @retval true 成功
+     * @retval false 失敗
      */
     bool write_err(const void* data, size_t length, size_t *pwritten) {
         if (data == nullptr) {
@@ -306,102 +367,165 @@ public:
 
 private:
     struct std_io {
-        HANDLE handle; // nh
-        bool is_console; // R\[ǂ
-        DWORD mode; // R\[[h
+        HANDLE handle; // ハンドル
+        bool is_console; // コンソールかどうか
+        DWORD mode; // コンソールモード
+        CrlfNormalizer normalizer; // 改行コード変換(コンソールのみ)
         std_io(void) : handle(INVALID_HANDLE_VALUE), is_console(false), mode(0) { }
     };
-    bool m_initialized; // ǂ̃tO
-    std_io m_input; // W
-    std_io m_output; // Wo
-    std_io m_error; // WG[o
-    std::queue<uint8_t> m_input_data; // ̓f[^
-    std::mutex m_input_lock; // ̓bN
-    uint32_t m_max_read_length; // ǂݏoobt@TCY
-    char m_prev_input_data; // O͕
-    static bool Terminated; // I[m
-    static const DWORD LineInputModeFunctions; // sPʓ̓[h@\
+    bool m_initialized; // 初期化したかどうかのフラグ
+    std_io m_input; // 標準入力
+    std_io m_output; // 標準出力
+    std_io m_error; // 標準エラー出力
+    std::mutex m_print_lock; // print()のロック(改行コード変換の状態とバッファを保護する)
+    OutputBuffer m_output_buffer; // 標準出力と標準エラー出力のバッファ(書き込んだ順に書き出す)
+    ByteRingBuffer m_input_data; // 入力データ(受信スレッドが書き込み、read系メソッドが読み出す)
+    std::mutex m_input_wait_lock; // 入力待ち用ロック
+    std::condition_variable m_input_cond; // 入力通知(データ到着、終端検知で通知する)
+    std::condition_variable m_input_space_cond; // 入力バッファの空き通知(読み出し、終端検知で通知する)
+    HANDLE m_input_event; // 入力通知イベント(データ到着、終端検知で通知する)
+    uint32_t m_max_read_length; // 読み出しバッファサイズ
+    char m_prev_input_data; // 前回入力文字
+    std::atomic<uint64_t> m_input_bytes; // 標準入力から読み込んだバイト数
+    std::atomic<uint64_t> m_input_reads; // 標準入力の読み込み回数
+    std::atomic<uint64_t> m_input_buffer_max; // 入力バッファにたまったデータ量の最大値
+    std::atomic<uint64_t> m_input_stalls; // 入力バッファが一杯で標準入力の読み込みを待った回数
+    std::atomic<uint64_t> m_output_bytes; // 標準出力へ書き込んだバイト数
+    std::atomic<uint64_t> m_output_requests; // 標準出力への出力要求の回数
+    std::atomic<uint64_t> m_output_writes; // 標準出力への書き込み回数
+    std::atomic<uint64_t> m_output_errors; // 標準出力への書き込みが失敗した回数
+    static std::atomic<bool> Terminated; // 終端検知したか
+    static const DWORD LineInputModeFunctions; // 行単位入力モード機能
+    static const uint32_t InputBufferCapacity = 65536; // 入力バッファの容量
+    static const uint32_t OutputChannel = 0; // 出力バッファの標準出力チャンネル
+    static const uint32_t ErrorChannel = 1; // 出力バッファの標準エラー出力チャンネル
 
     /**
-     * RXgN^
+     * コンストラクタ
      */
     StandardIo(void);
     /**
-     * B
+     * 初期化する。
      * 
-     * @retval true 
-     * @retval false s
+     * @retval true 成功
+     * @retval false 失敗
      */
     bool init(void);
     /**
-     * ǂ
+     * 初期化したかどうか
      * 
-     * @retval true ς
-     * @retval false 
+     * @retval true 初期化済み
+     * @retval false 未初期化
      */
     bool is_initialized(void) const noexcept { return m_initialized; }
 
     /**
-     * nhB
+     * ハンドルを初期化する。
      * 
-     * @param pstdio I/OIuWFNg
-     * @param handle_type nh^Cv
+     * @param pstdio I/Oオブジェクト
+     * @param handle_type ハンドルタイプ
      */
     void init_std_handle(std_io* pstdio, DWORD handle_type);
     /**
-     * R\[[hݒ肷B
+     * コンソールモードを設定する。
      * 
-     * @param pstdio I/OIuWFNg
-     * @param functions Ώۂ̋@\
-     * @param is_enabled Lɂꍇtrue, ɂꍇfalse.
+     * @param pstdio I/Oオブジェクト
+     * @param functions 対象の機能
+     * @param is_enabled 有効にする場合はtrue, 無効にする場合はfalse.
      */
     bool modify_console_mode(std_io* pstdio, DWORD functions, bool is_enabled);
     /**
-     * o͂
+     * 出力する
+     * コンソールの場合は改行コードをCR+LFに揃える。
      * 
-     * @param pstdio I/OIuWFNg
-     * @param str o͕
-     * @retval true 
-     * @retval false s
+     * @param pstdio I/Oオブジェクト
+     * @param str 出力文字列
+     * @param length 出力文字列の長さ
+     * @retval true 成功
+     * @retval false 失敗
      */
-    bool print(std_io* pstdio, const std::string &str);
+    bool print(std_io* pstdio, const char* str, size_t length);
     /**
-     * o͂
+     * 書式指定して出力する
+     *
+     * @param pstdio I/Oオブジェクト
+     * @param fmt フォーマット
+     * @param args パラメータ
+     * @retval true 成功
+     * @retval false 失敗
+     */
+    bool vprint(std_io* pstdio, const char* fmt, va_list args);
+    /**
+     * 出力する
+     * 出力バッファに溜め、書き出しスレッドがまとめて書き込む。
+     * 標準出力と標準エラー出力の表示順を保つため、もう一方のバッファに溜まっているデータを先に書き出す。
+     * (標準エラー出力への出力は、標準出力の書き出しが終わるまで待つことになる)
      *
-     * @param pstdio I/OIuWFNg
-     * @param data Mf[^|C^
-     * @param length 
-     * @param pwritten 񂾒(svȏꍇɂnullptrn)
-     * @retval true 
-     * @retval false s
+     * @param pstdio I/Oオブジェクト
+     * @param data 送信データポインタ
+     * @param length 長さ
+     * @param pwritten 書き込んだ長さ(不要な場合にはnullptrを渡す)
+     * @retval true 成功
+     * @retval false 失敗
      */
     bool write(std_io* pstdio, const void* data, size_t length, size_t* pwritten = nullptr);
+    /**
+     * ハンドルに書き込む。出力バッファの書き出し関数。
+     *
+     * @param pstdio I/Oオブジェクト
+     * @param data 送信データポインタ
+     * @param length 長さ
+     * @retval true 成功
+     * @retval false 失敗
+     */
+    bool write_handle(std_io* pstdio, const void* data, size_t length);
 
     /**
-     * sR[hCR+LFɑ
-     * 
-     * @param str 
-     * @retval u
+     * 入力データが到着するか、終端を検知するまで待つ。
+     *
+     * @param timeout_millis タイムアウト時間[ミリ秒](負数にすると永遠に待つ)
+     * @retval true 入力データがあるか、終端を検知した
+     * @retval false タイムアウトした
+     */
+    bool wait_input(int32_t timeout_millis);
+    /**
+     * 入力待ちしているスレッドに通知する。
+     * 入力バッファにたまったデータ量の最大値も更新する。
+     */
+    void notify_input(void);
+    /**
+     * 入力バッファの空きを待っている受信スレッドに通知する。
+     */
+    void notify_input_space(void);
+    /**
+     * 入力バッファのデータ量が読み出しバッファサイズ未満になるか、終端を検知するまで待つ。
+     *
+     * @retval true 入力バッファに空きがある
+     * @retval false 終端を検知した
+     */
+    bool wait_input_space(void);
+    /**
+     * 入力の終端を設定し、入力待ちしているスレッドに通知する。
      */
-    std::string replace_CRLF(const std::string& str);
+    void terminate_input(void);
 
     /**
-     * MXbh
+     * 受信スレッド処理
      */
     void receiver_thread_proc(void);
     /**
-     * R\[͓̓ǂݏosB
+     * コンソールからの入力読み出しを行う。
      */
     void read_from_console(void);
     /**
-     * pCv͓̓ǂݏosB
+     * パイプからの入力読み出しを行う。
      */
     void read_from_pipe(void);
 
     /**
-     * R\[nh
+     * コンソールハンドラ
      * 
-     * @param event Cxg
+     * @param event イベント
      */
     static BOOL console_handler_proc(DWORD event);
 
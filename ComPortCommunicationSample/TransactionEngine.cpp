@@ -0,0 +1,410 @@
+#include <cstring>
+#include <algorithm>
+
+#include "TransactionEngine.h"
+#include "ByteScan.h"
+
+TransactionEngine::Matcher TransactionEngine::Matcher::by_length(size_t length) {
+    Matcher matcher;
+    matcher.type = TypeLength;
+    matcher.length = length;
+    matcher.max_length = length;
+    return matcher;
+}
+
+TransactionEngine::Matcher TransactionEngine::Matcher::by_terminator(const std::string& terminator, size_t max_length) {
+    Matcher matcher;
+    matcher.type = TypeTerminator;
+    matcher.length = 0;
+    matcher.terminator = terminator;
+    matcher.max_length = max_length;
+    return matcher;
+}
+
+TransactionEngine::Matcher TransactionEngine::Matcher::by_predicate(const predicate_t& predicate, size_t max_length) {
+    Matcher matcher;
+    matcher.type = TypePredicate;
+    matcher.length = 0;
+    matcher.predicate = predicate;
+    matcher.max_length = max_length;
+    return matcher;
+}
+
+TransactionEngine::TransactionEngine(SerialPort& port, uint32_t max_outstanding)
+    : m_port(port), m_max_outstanding((max_outstanding > 0) ? max_outstanding : 1), m_next_id(1),
+    m_is_stopping(false), m_is_failed(false), m_scanned(0), m_statistics(), m_latency("transaction") {
+}
+
+TransactionEngine::~TransactionEngine(void) {
+    stop();
+}
+
+bool TransactionEngine::start(uint32_t buffer_count, uint32_t buffer_size) {
+    if (m_deadline_thread.joinable()) {
+        return false;
+    }
+    m_is_stopping = false;
+    m_is_failed = false;
+    m_received.clear();
+    m_scanned = 0;
+    bool is_started = m_port.start_streaming([this](const uint8_t* data, uint32_t length) {
+        on_receive(data, length);
+    }, buffer_count, buffer_size);
+    if (!is_started) {
+        return false;
+    }
+    m_deadline_thread = std::thread(&TransactionEngine::deadline_proc, this);
+
+    return true;
+}
+
+void TransactionEngine::stop(void) {
+    if (!m_deadline_thread.joinable()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_is_stopping = true;
+    }
+    m_changed.notify_all();
+    m_port.stop_streaming();
+    m_deadline_thread.join();
+
+    std::lock_guard<std::mutex> completion_lock(m_completion_lock);
+    discard_received();
+    complete_all(StatusCanceled);
+}
+
+uint64_t TransactionEngine::submit(const uint8_t* data, size_t length, const Matcher& matcher, uint32_t timeout_millis,
+    const completion_handler_t& handler, int wait_millis) {
+    bool is_valid_matcher = (matcher.max_length > 0)
+        && ((matcher.type != Matcher::TypeLength) || (matcher.length > 0))
+        && ((matcher.type != Matcher::TypeTerminator) || !matcher.terminator.empty())
+        && ((matcher.type != Matcher::TypePredicate) || matcher.predicate);
+    if (!is_valid_matcher) {
+        return 0;
+    }
+
+    // 応答は送信順に割り当てるので、登録から送信し終わるまでの間に他の要求が割り込まないようにする。
+    std::lock_guard<std::mutex> send_lock(m_send_lock);
+    uint64_t id;
+    std::chrono::steady_clock::time_point deadline;
+    {
+        std::unique_lock<std::mutex> lock(m_lock);
+        auto is_ready = [this]() {
+            return m_is_stopping || m_is_failed || (m_transactions.size() < m_max_outstanding);
+        };
+        if (wait_millis < 0) {
+            m_changed.wait(lock, is_ready);
+        }
+        else if (!m_changed.wait_for(lock, std::chrono::milliseconds(wait_millis), is_ready)) {
+            return 0;
+        }
+        if (m_is_stopping || m_is_failed) {
+            return 0;
+        }
+
+        // 応答が送信完了より先に届いても割り当てられるよう、送信前に登録する。
+        Transaction transaction;
+        id = m_next_id++;
+        transaction.id = id;
+        transaction.matcher = matcher;
+        transaction.handler = handler;
+        transaction.start_time = std::chrono::steady_clock::now();
+        transaction.deadline = transaction.start_time + std::chrono::milliseconds(timeout_millis);
+        deadline = transaction.deadline;
+        m_transactions.push_back(std::move(transaction));
+        m_statistics.requests++;
+        m_statistics.max_outstanding = (std::max)(m_statistics.max_outstanding, static_cast<uint64_t>(m_transactions.size()));
+    }
+    m_changed.notify_all();
+
+    // 送信が進まない場合でもstop()で抜けられるよう、StopCheckMillisごとに停止要求を確認する。
+    // タイムアウト時刻を過ぎたら送信をやめる(要求はタイムアウトを判定するスレッドが完了させる)。
+    size_t sent = 0;
+    while (sent < length) {
+        uint32_t chunk = static_cast<uint32_t>((std::min)(length - sent, static_cast<size_t>(UINT32_MAX)));
+        int result = m_port.send(data + sent, chunk, StopCheckMillis);
+        if (result < 0) {
+            std::lock_guard<std::mutex> completion_lock(m_completion_lock);
+            fail();
+            break;
+        }
+        sent += static_cast<size_t>(result);
+        if ((sent < length) && (m_is_stopping || (std::chrono::steady_clock::now() >= deadline))) {
+            break;
+        }
+    }
+
+    return id;
+}
+
+TransactionEngine::Status TransactionEngine::execute(const uint8_t* data, size_t length, const Matcher& matcher,
+    uint32_t timeout_millis, std::vector<uint8_t>* presponse, uint64_t* platency_micros) {
+    std::mutex done_lock;
+    std::condition_variable done_changed;
+    bool is_done = false;
+    Status status = StatusCanceled;
+    uint64_t id = submit(data, length, matcher, timeout_millis,
+        [&done_lock, &done_changed, &is_done, &status, presponse, platency_micros](const Completion& completion) {
+        if (presponse != nullptr) {
+            if (completion.response != nullptr) {
+                (*presponse).assign(completion.response, completion.response + completion.length);
+            }
+            else {
+                (*presponse).clear();
+            }
+        }
+        if (platency_micros != nullptr) {
+            *platency_micros = completion.latency_micros;
+        }
+        {
+            std::lock_guard<std::mutex> lock(done_lock);
+            status = completion.status;
+            is_done = true;
+        }
+        done_changed.notify_all();
+    });
+    if (id == 0) {
+        return (m_is_failed) ? StatusIoError : StatusCanceled;
+    }
+
+    std::unique_lock<std::mutex> lock(done_lock);
+    done_changed.wait(lock, [&is_done]() { return is_done; });
+
+    return status;
+}
+
+bool TransactionEngine::wait_idle(int timeout_millis) {
+    std::unique_lock<std::mutex> lock(m_lock);
+    auto is_idle = [this]() { return m_transactions.empty(); };
+    if (timeout_millis < 0) {
+        m_changed.wait(lock, is_idle);
+        return true;
+    }
+    return m_changed.wait_for(lock, std::chrono::milliseconds(timeout_millis), is_idle);
+}
+
+size_t TransactionEngine::get_outstanding(void) {
+    std::lock_guard<std::mutex> lock(m_lock);
+    return m_transactions.size();
+}
+
+TransactionEngine::Statistics TransactionEngine::get_statistics(void) {
+    std::lock_guard<std::mutex> lock(m_lock);
+    return m_statistics;
+}
+
+void TransactionEngine::reset_statistics(void) {
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_statistics = Statistics();
+    }
+    m_latency.reset();
+}
+
+void TransactionEngine::on_receive(const uint8_t* data, uint32_t length) {
+    std::lock_guard<std::mutex> completion_lock(m_completion_lock);
+    if (data == nullptr) { // 受信エラー
+        fail();
+        return;
+    }
+    auto end_time = m_port.get_completed_time();
+
+    // 受信途中のデータが無ければ、受信データを指したまま(コピーせずに)判断する。
+    const uint8_t* buf = data;
+    size_t buf_length = length;
+    bool is_carried = !m_received.empty();
+    if (is_carried) {
+        m_received.insert(m_received.end(), data, data + length);
+        buf = m_received.data();
+        buf_length = m_received.size();
+    }
+
+    size_t consumed = 0;
+    size_t discarded = 0;
+    while (consumed < buf_length) {
+        size_t remain = buf_length - consumed;
+        Transaction* ptransaction = get_head();
+        if (ptransaction == nullptr) { // 応答待ちの要求が無い
+            discarded += remain;
+            consumed = buf_length;
+            break;
+        }
+        int result = match(*ptransaction, buf + consumed, remain);
+        if (result > 0) {
+            size_t response_length = (std::min)(static_cast<size_t>(result), remain);
+            m_scanned = 0;
+            complete(*ptransaction, StatusOk, buf + consumed, response_length, end_time);
+            consumed += response_length;
+        }
+        else if (result < 0) {
+            size_t skip_length = (std::min)(static_cast<size_t>(-static_cast<int64_t>(result)), remain);
+            m_scanned = 0;
+            discarded += skip_length;
+            consumed += skip_length;
+        }
+        else {
+            if (remain >= (*ptransaction).matcher.max_length) { // 最大長までに応答の終わりが無い
+                m_scanned = 0;
+                complete(*ptransaction, StatusOverflow, buf + consumed, remain, std::chrono::steady_clock::now());
+                consumed = buf_length;
+            }
+            break;
+        }
+    }
+
+    if (is_carried) {
+        m_received.erase(m_received.begin(), m_received.begin() + consumed);
+    }
+    else if (consumed < buf_length) {
+        m_received.assign(buf + consumed, buf + buf_length);
+    }
+    if (discarded > 0) {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_statistics.discarded_bytes += discarded;
+    }
+}
+
+int TransactionEngine::match(const Transaction& transaction, const uint8_t* data, size_t length) {
+    const Matcher& matcher = transaction.matcher;
+    switch (matcher.type) {
+    case Matcher::TypeLength:
+        return (length >= matcher.length) ? static_cast<int>(matcher.length) : 0;
+    case Matcher::TypeTerminator: {
+        // 終端文字列の最後のバイトをfind_byte()で探し、見つかった位置で終端文字列全体を比較する。
+        // 前回までに探し終えた位置からは探し直さない。
+        const std::string& terminator = matcher.terminator;
+        size_t terminator_length = terminator.length();
+        uint8_t last = static_cast<uint8_t>(terminator[terminator_length - 1]);
+        const uint8_t* end = data + (std::min)(length, matcher.max_length);
+        const uint8_t* p = data + (std::max)(m_scanned, terminator_length - 1);
+        if (p >= end) {
+            return 0;
+        }
+        while ((p = find_byte(p, end, last)) != end) {
+            size_t response_length = static_cast<size_t>(p - data) + 1;
+            if (memcmp(p + 1 - terminator_length, terminator.data(), terminator_length) == 0) {
+                return static_cast<int>(response_length);
+            }
+            p++;
+        }
+        m_scanned = static_cast<size_t>(end - data);
+        return 0;
+    }
+    case Matcher::TypePredicate:
+        return matcher.predicate(data, length);
+    }
+
+    return 0;
+}
+
+void TransactionEngine::deadline_proc(void) {
+    std::unique_lock<std::mutex> lock(m_lock);
+    while (!m_is_stopping) {
+        if (m_transactions.empty()) {
+            m_changed.wait(lock);
+            continue;
+        }
+        auto deadline = m_transactions.front().deadline;
+        if (std::chrono::steady_clock::now() < deadline) {
+            m_changed.wait_until(lock, deadline);
+            continue;
+        }
+
+        // 完了処理中の受信スレッドと競合しないよう、ロックを取り直してから先頭の要求を確認する。
+        lock.unlock();
+        {
+            std::lock_guard<std::mutex> completion_lock(m_completion_lock);
+            Transaction* ptransaction = get_head();
+            auto now = std::chrono::steady_clock::now();
+            if ((ptransaction != nullptr) && (now >= (*ptransaction).deadline)) {
+                discard_received();
+                complete(*ptransaction, StatusTimeout, nullptr, 0, now);
+            }
+        }
+        lock.lock();
+    }
+}
+
+TransactionEngine::Transaction* TransactionEngine::get_head(void) {
+    std::lock_guard<std::mutex> lock(m_lock);
+    // Note: 先頭の要素を取り除くのは完了処理(m_completion_lockを確保している)だけで、
+    //       std::dequeは末尾に追加しても既存の要素を移動しないので、ロックを解放した後も参照できる。
+    return (m_transactions.empty()) ? nullptr : &m_transactions.front();
+}
+
+void TransactionEngine::complete(Transaction& transaction, Status status, const uint8_t* response, size_t length,
+    std::chrono::steady_clock::time_point end_time) {
+    Completion completion;
+    completion.id = transaction.id;
+    completion.status = status;
+    completion.response = response;
+    completion.length = (response != nullptr) ? length : 0;
+    completion.latency_micros = (end_time > transaction.start_time)
+        ? static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(end_time - transaction.start_time).count())
+        : 0;
+    if (status == StatusOk) {
+        m_latency.record(transaction.start_time, end_time);
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        switch (status) {
+        case StatusOk:
+            m_statistics.responses++;
+            break;
+        case StatusTimeout:
+            m_statistics.timeouts++;
+            break;
+        case StatusOverflow:
+            m_statistics.overflows++;
+            break;
+        case StatusIoError:
+            m_statistics.io_errors++;
+            break;
+        case StatusCanceled:
+            m_statistics.canceled++;
+            break;
+        }
+    }
+
+    if (transaction.handler) {
+        transaction.handler(completion);
+    }
+
+    // 完了ハンドラから戻ってから取り除くので、wait_idle()から戻った時点で全てのハンドラが終わっている。
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_transactions.pop_front();
+    }
+    m_changed.notify_all();
+}
+
+void TransactionEngine::complete_all(Status status) {
+    Transaction* ptransaction;
+    while ((ptransaction = get_head()) != nullptr) {
+        complete(*ptransaction, status, nullptr, 0, std::chrono::steady_clock::now());
+    }
+}
+
+void TransactionEngine::fail(void) {
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_is_failed = true;
+    }
+    m_changed.notify_all();
+    discard_received();
+    complete_all(StatusIoError);
+}
+
+void TransactionEngine::discard_received(void) {
+    if (m_received.empty()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_statistics.discarded_bytes += m_received.size();
+    }
+    m_received.clear();
+    m_scanned = 0;
+}
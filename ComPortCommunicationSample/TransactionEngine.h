@@ -0,0 +1,347 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <deque>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+
+#include "SerialPort.h"
+#include "LatencyHistogram.h"
+
+/**
+ * シリアルポートの要求・応答トランザクション
+ *
+ * submit()で要求と応答の終わりの判断方法(Matcher)を渡すと、要求を送信し、
+ * 応答を受信し終わるかタイムアウトしたときに、その要求の完了ハンドラを呼び出す。
+ * 応答はストリーム受信(SerialPort::start_streaming())で受け取り、受信スレッドの中で判断するため、
+ * 送信してから受信をブロッキングで待つ("送信してから受信する"ループ)のに比べて、受信のたびのシステムコールと待ち合わせが無い。
+ *
+ * 同時に応答待ちにできる要求の数(max_outstanding)を2以上にすると、前の応答を待たずに次の要求を送信する(パイプライン)。
+ * 機器は要求を受け取った順に応答を返すものとし、受信データは応答待ちの先頭の要求から順に割り当てる。
+ * 機器が要求を受け取ってから応答し始めるまでの処理時間や、送受信のシステムコールの時間が重なるため、
+ * 要求を次々に処理する場合のスループットが上がる。
+ * 1つずつしか要求を受け付けない機器(半二重のバスなど)では1のままにすること。
+ *
+ * 要求ごとにタイムアウト時間を指定でき、送信開始からその時間内に応答の終わりまで受信できなければStatusTimeoutで完了する。
+ * タイムアウトは応答待ちの先頭の要求から順に判定する。タイムアウトした要求の受信途中のデータは読み捨てる。
+ * 送信開始から応答の受信完了までの時間を要求ごとに完了ハンドラへ渡し、ヒストグラムにも記録する。
+ *
+ * @note
+ * 処理中のポートでreceive(), start_streaming()を呼び出さないこと。
+ * submit(), execute(), wait_idle()はどのスレッドから呼び出してもよい。
+ * タイムアウトした要求の応答が後から届くと、次の要求の応答として扱われる。
+ * 応答に要求の番号などが含まれるプロトコルでは、by_predicate()で照合し、合わないデータを読み捨てること。
+ */
+class TransactionEngine
+{
+public:
+    /**
+     * 要求の処理結果
+     */
+    enum Status {
+        StatusOk, // 応答の終わりまで受信した
+        StatusTimeout, // タイムアウト時間内に応答の終わりまで受信しなかった
+        StatusOverflow, // 応答の終わりが見つからないまま最大長を超えた
+        StatusIoError, // 送受信でエラーが発生した
+        StatusCanceled // stop()で中止した
+    };
+
+    /**
+     * 応答の終わりの判断関数型
+     *
+     * @param data 受信済みのデータ(応答待ちの要求に割り当てたデータの先頭から)
+     * @param length 受信済みのバイト数
+     * @retval 正の値 応答の終わりまで受信した(応答のバイト数)
+     * @retval 0 まだ応答の終わりまで受信していない
+     * @retval 負の値 先頭の(-戻り値)バイトはこの要求の応答ではないので読み捨てる
+     */
+    typedef std::function<int(const uint8_t* data, size_t length)> predicate_t;
+
+    /**
+     * 応答の最大長の既定値[バイト]
+     */
+    static const size_t DefaultMaxResponseLength = 4096;
+
+    /**
+     * 応答の終わりの判断方法
+     */
+    struct Matcher {
+        /**
+         * 判断方法の種類
+         */
+        enum Type {
+            TypeLength, // 決まったバイト数
+            TypeTerminator, // 終端文字列(終端文字列を含めて応答とする)
+            TypePredicate // 判断関数
+        };
+
+        Type type; // 種類
+        size_t length; // 応答のバイト数(TypeLength)
+        std::string terminator; // 終端文字列(TypeTerminator)
+        predicate_t predicate; // 判断関数(TypePredicate)
+        size_t max_length; // 応答の最大長[バイト]
+
+        /**
+         * 決まったバイト数で応答の終わりを判断する。
+         *
+         * @param length 応答のバイト数(1以上)
+         * @retval 判断方法
+         */
+        static Matcher by_length(size_t length);
+        /**
+         * 終端文字列で応答の終わりを判断する。
+         *
+         * @param terminator 終端文字列("\r\n"など。空でないこと)
+         * @param max_length 応答の最大長[バイト]
+         * @retval 判断方法
+         */
+        static Matcher by_terminator(const std::string& terminator, size_t max_length = DefaultMaxResponseLength);
+        /**
+         * 判断関数で応答の終わりを判断する。
+         *
+         * @param predicate 判断関数(受信スレッドから呼び出される)
+         * @param max_length 応答の最大長[バイト]
+         * @retval 判断方法
+         */
+        static Matcher by_predicate(const predicate_t& predicate, size_t max_length = DefaultMaxResponseLength);
+    };
+
+    /**
+     * 要求の完了情報
+     */
+    struct Completion {
+        uint64_t id; // 要求の番号(submit()の戻り値)
+        Status status; // 処理結果
+        const uint8_t* response; // 応答(StatusOverflowでは受信済みのデータ、それ以外の失敗ではnullptr)
+        size_t length; // 応答のバイト数
+        uint64_t latency_micros; // 送信開始から完了までの時間[マイクロ秒]
+    };
+
+    /**
+     * 完了ハンドラ型
+     * 受信スレッド、タイムアウトを判定するスレッド、stop()を呼び出したスレッドのいずれかから、要求を送信した順に呼び出す。
+     * 同時に複数のスレッドから呼び出すことは無い。
+     *
+     * @param completion 完了情報(responseはハンドラから戻るまでの間だけ有効)
+     * @note
+     * ハンドラからsubmit(), execute(), wait_idle(), stop()を呼び出さないこと。
+     */
+    typedef std::function<void(const Completion& completion)> completion_handler_t;
+
+    /**
+     * 統計
+     */
+    struct Statistics {
+        uint64_t requests; // 送信した要求数
+        uint64_t responses; // 応答の終わりまで受信した要求数
+        uint64_t timeouts; // タイムアウトした要求数
+        uint64_t overflows; // 最大長を超えた要求数
+        uint64_t io_errors; // 送受信エラーで完了した要求数
+        uint64_t canceled; // 中止した要求数
+        uint64_t discarded_bytes; // 応答待ちの要求が無いときに受信したデータなど、読み捨てたバイト数
+        uint64_t max_outstanding; // 同時に応答待ちになった要求の最大数
+    };
+
+    /**
+     * 送信が進まない場合に停止要求を確認する間隔[ミリ秒]
+     */
+    static const int StopCheckMillis = 100;
+
+    /**
+     * コンストラクタ
+     *
+     * @param port シリアルポート(start()の前にオープンすること)
+     * @param max_outstanding 同時に応答待ちにできる要求の数(1以上)
+     */
+    explicit TransactionEngine(SerialPort& port, uint32_t max_outstanding = 1);
+    /**
+     * デストラクタ
+     */
+    ~TransactionEngine(void);
+
+    /**
+     * 処理を開始する。
+     * ストリーム受信と、タイムアウトを判定するスレッドを開始する。
+     *
+     * @param buffer_count ストリーム受信のバッファ数
+     * @param buffer_size ストリーム受信のバッファサイズ
+     * @retval true 成功
+     * @retval false 失敗(エラー番号はGetLastError()(POSIXではerrno)で取得できる)
+     */
+    bool start(uint32_t buffer_count = SerialPort::DefaultStreamBufferCount,
+        uint32_t buffer_size = SerialPort::DefaultStreamBufferSize);
+    /**
+     * 処理を停止する。
+     * 応答待ちの要求はStatusCanceledで完了させる。
+     */
+    void stop(void);
+    /**
+     * 処理中かどうかを取得する。
+     *
+     * @retval true 処理中
+     * @retval false 停止中、または送受信エラーで止まった
+     */
+    bool is_running(void) const noexcept { return m_deadline_thread.joinable() && !m_is_failed; }
+
+    /**
+     * 要求を送信する。
+     * 応答待ちの要求がmax_outstanding個ある場合は、空きができるまで待ってから送信する。
+     * 戻り値が0以外の場合は、必ずhandlerが1回呼び出される(送信エラーの場合はStatusIoErrorで完了する)。
+     *
+     * @param data 要求(submit()から戻った後は参照しない)
+     * @param length 要求のバイト数
+     * @param matcher 応答の終わりの判断方法
+     * @param timeout_millis 送信開始から応答の受信完了までのタイムアウト時間[ミリ秒]
+     * @param handler 完了ハンドラ
+     * @param wait_millis 空きができるまで待つ時間[ミリ秒] 負数にすると永遠に待つ。
+     * @retval 0以外 要求の番号
+     * @retval 0 送信しなかった(判断方法が不正、停止中、送受信エラーで止まっている、待ち時間内に空きができなかった場合)
+     */
+    uint64_t submit(const uint8_t* data, size_t length, const Matcher& matcher, uint32_t timeout_millis,
+        const completion_handler_t& handler, int wait_millis = -1);
+    /**
+     * 要求を送信し、完了するまで待つ。
+     *
+     * @param data 要求
+     * @param length 要求のバイト数
+     * @param matcher 応答の終わりの判断方法
+     * @param timeout_millis 送信開始から応答の受信完了までのタイムアウト時間[ミリ秒]
+     * @param presponse 応答の格納先(nullptrの場合は格納しない)
+     * @param platency_micros 送信開始から完了までの時間[マイクロ秒]の格納先(nullptrの場合は格納しない)
+     * @retval 処理結果(送信しなかった場合は、停止中ならStatusCanceled、送受信エラーで止まっていればStatusIoError)
+     */
+    Status execute(const uint8_t* data, size_t length, const Matcher& matcher, uint32_t timeout_millis,
+        std::vector<uint8_t>* presponse, uint64_t* platency_micros = nullptr);
+    /**
+     * 応答待ちの要求が全て完了するまで待つ。
+     *
+     * @param timeout_millis タイムアウト時間[ミリ秒] 負数にすると永遠に待つ。
+     * @retval true 全て完了した
+     * @retval false タイムアウトした
+     */
+    bool wait_idle(int timeout_millis = -1);
+
+    /**
+     * 応答待ちの要求の数を得る。
+     *
+     * @retval 要求の数
+     */
+    size_t get_outstanding(void);
+    /**
+     * 統計を得る。
+     *
+     * @retval 統計
+     */
+    Statistics get_statistics(void);
+    /**
+     * 統計と応答時間ヒストグラムをクリアする。
+     */
+    void reset_statistics(void);
+    /**
+     * 応答時間ヒストグラム(StatusOkで完了した要求の、送信開始から応答の受信完了まで)を得る。
+     *
+     * @retval ヒストグラム
+     */
+    const LatencyHistogram& get_latency(void) const noexcept { return m_latency; }
+
+private:
+    /**
+     * 応答待ちの要求
+     */
+    struct Transaction {
+        uint64_t id; // 要求の番号
+        Matcher matcher; // 応答の終わりの判断方法
+        completion_handler_t handler; // 完了ハンドラ
+        std::chrono::steady_clock::time_point start_time; // 送信開始時刻
+        std::chrono::steady_clock::time_point deadline; // タイムアウトする時刻
+    };
+
+    SerialPort& m_port; // シリアルポート
+    uint32_t m_max_outstanding; // 同時に応答待ちにできる要求の数
+    std::mutex m_lock; // 応答待ちの要求と統計のロック
+    std::condition_variable m_changed; // 応答待ちの要求の増減と停止要求の通知
+    std::deque<Transaction> m_transactions; // 応答待ちの要求(送信順。先頭の要素を取り除くのは完了処理だけ)
+    uint64_t m_next_id; // 次の要求の番号
+    std::atomic<bool> m_is_stopping; // 停止要求中かどうか
+    std::atomic<bool> m_is_failed; // 送受信エラーで止まったかどうか
+    std::mutex m_send_lock; // 送信のロック(要求の登録順と送信順を一致させる)
+    std::mutex m_completion_lock; // 完了処理と受信データのロック(完了ハンドラを送信順に1つずつ呼び出す)
+    std::vector<uint8_t> m_received; // 応答待ちの先頭の要求に割り当てた、応答の終わりまで届いていない受信データ
+    size_t m_scanned; // m_receivedのうち終端文字列を探し終えたバイト数
+    std::thread m_deadline_thread; // タイムアウトを判定するスレッド
+    Statistics m_statistics; // 統計(m_lockで保護する)
+    LatencyHistogram m_latency; // 応答時間ヒストグラム
+
+    /**
+     * 受信データを応答待ちの要求に割り当てる。
+     * 受信スレッドから呼び出される。
+     *
+     * @param data 受信データ(受信エラーの場合はnullptr)
+     * @param length 受信データサイズ
+     */
+    void on_receive(const uint8_t* data, uint32_t length);
+    /**
+     * 応答待ちの先頭の要求について、受信データのどこまでが応答かを判断する。
+     * m_completion_lockを確保して呼び出すこと。
+     *
+     * @param transaction 応答待ちの先頭の要求
+     * @param data 先頭の要求に割り当てる受信データ
+     * @param length 受信データのバイト数
+     * @retval 正の値 応答のバイト数
+     * @retval 0 まだ応答の終わりまで受信していない
+     * @retval 負の値 読み捨てるバイト数(符号を反転した値)
+     */
+    int match(const Transaction& transaction, const uint8_t* data, size_t length);
+    /**
+     * タイムアウトを判定するスレッドの処理を行う。
+     */
+    void deadline_proc(void);
+    /**
+     * 応答待ちの先頭の要求を得る。
+     *
+     * @retval 先頭の要求(無い場合はnullptr)
+     */
+    Transaction* get_head(void);
+    /**
+     * 応答待ちの先頭の要求を完了させる。
+     * 完了ハンドラを呼び出してから、応答待ちの要求から取り除く。
+     * m_completion_lockを確保して呼び出すこと。
+     *
+     * @param transaction 応答待ちの先頭の要求
+     * @param status 処理結果
+     * @param response 応答(無い場合はnullptr)
+     * @param length 応答のバイト数
+     * @param end_time 完了時刻
+     */
+    void complete(Transaction& transaction, Status status, const uint8_t* response, size_t length,
+        std::chrono::steady_clock::time_point end_time);
+    /**
+     * 応答待ちの要求を全て完了させる。
+     * m_completion_lockを確保して呼び出すこと。
+     *
+     * @param status 処理結果
+     */
+    void complete_all(Status status);
+    /**
+     * 送受信エラーで止まったことにし、応答待ちの要求を全てStatusIoErrorで完了させる。
+     * m_completion_lockを確保して呼び出すこと。
+     */
+    void fail(void);
+    /**
+     * 受信途中のデータを読み捨てる。
+     * m_completion_lockを確保して呼び出すこと。
+     */
+    void discard_received(void);
+
+    // コピーコンストラクタは使用できない。
+    TransactionEngine(const TransactionEngine& engine) = delete;
+    // 代入演算子は使用できない
+    TransactionEngine& operator=(const TransactionEngine& engine) = delete;
+};
@@ -5,25 +5,25 @@
 
 
 /**
- *  Windows̃G[`NXB
+ *  Windowsのエラーを定義するクラス。
  */
 class WindowsErrorCategory : public std::error_category
 {
 public:
     /**
-     * JeS擾
+     * カテゴリ名を取得する
      *
-     * @retval JeS
+     * @retval カテゴリ名
      */
     const char* name(void) const noexcept override {
         return "Windows system error";
     }
 
     /**
-     * G[bZ[W擾B
+     * エラーメッセージを取得する。
      *
-     * @param ev G[ԍ
-     * @retval G[bZ[W
+     * @param ev エラー番号
+     * @retval エラーメッセージ
      */
     std::string message(int ev) const override {
         return get_windows_error_message(ev);
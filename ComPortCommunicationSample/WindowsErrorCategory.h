@@ -6,9 +6,9 @@
 
 
 /**
- * Windows̃G[JeS𓾂B
+ * Windowsのエラーカテゴリを得る。
  *
- * @retval G[JeSIuWFNg
+ * @retval エラーカテゴリオブジェクト
  */
 const std::error_category& windows_error_category(void);
 
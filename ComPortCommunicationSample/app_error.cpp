@@ -3,19 +3,19 @@
 class AppErrorCategory : public std::error_category {
 public:
     /**
-     * JeS擾
+     * カテゴリ名を取得する
      *
-     * @retval JeS
+     * @retval カテゴリ名
      */
     const char* name(void) const noexcept override {
         return "Application error";
     }
 
     /**
-     * G[bZ[W擾B
+     * エラーメッセージを取得する。
      *
-     * @param ev G[ԍ
-     * @retval G[bZ[W
+     * @param ev エラー番号
+     * @retval エラーメッセージ
      */
     std::string message(int ev) const override {
         const char* msg;
@@ -26,6 +26,12 @@ public:
         case APP_ERROR_NO_SERIAL_PORTS:
             msg = "No serial ports exists.";
             break;
+        case APP_ERROR_CAPTURE_OPEN_FAILED:
+            msg = "Could not open capture file.";
+            break;
+        case APP_ERROR_INVALID_CAPTURE_FILE:
+            msg = "Invalid capture file.";
+            break;
         default:
             msg = "Unknown error.";
             break;
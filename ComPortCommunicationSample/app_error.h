@@ -3,10 +3,12 @@
 
 constexpr int APP_ERROR_SUCCESS = 0;
 constexpr int APP_ERROR_NO_SERIAL_PORTS = 1;
+constexpr int APP_ERROR_CAPTURE_OPEN_FAILED = 2;
+constexpr int APP_ERROR_INVALID_CAPTURE_FILE = 3;
 
 /**
- * AvP[ṼG[JeS𓾂B
+ * アプリケーションのエラーカテゴリを得る。
  *
- * @retval G[JeSIuWFNg
+ * @retval エラーカテゴリオブジェクト
  */
 const std::error_category& app_error_category(void);
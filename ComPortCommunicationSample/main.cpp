@@ -9,8 +9,9 @@
 #include <cstring>
 #include <string>
 #include <list>
-#include <thread>
 #include <vector>
+#include <memory>
+#include <mutex>
 #include <system_error>
 #include <stdexcept>
 
@@ -18,6 +19,17 @@
 #include "StandardIo.h"
 #include "WindowsErrorCategory.h"
 #include "SerialPort.h"
+#include "SendQueue.h"
+#include "PortEngine.h"
+#include "PortBridge.h"
+#include "CaptureFile.h"
+#include "CaptureReader.h"
+#include "SessionReplayer.h"
+#include "FrameCodec.h"
+#include "ModbusRtuMaster.h"
+#include "LineSplitter.h"
+#include "HexDumper.h"
+#include "LatencyHistogram.h"
 #include "app_error.h"
 
 
@@ -47,6 +59,68 @@ static std::unique_ptr<SerialPort> SerialPortPtr;
  */
 static bool IsAppRun;
 
+/**
+ * 通信モードから設定モードへの切り替え要求イベント
+ */
+static HANDLE ModeChangeEvent = NULL;
+
+/**
+ * 送信キューの書き込み可能通知イベント
+ */
+static HANDLE SendWritableEvent = NULL;
+
+/**
+ * 通信モードで使用する、ドライバの送信キューの上限[バイト](0で上限無し)
+ */
+static uint32_t PortQueueLimit = SendQueue::DefaultPortQueueLimit;
+
+/**
+ * 通信モードで使用した送信キューの深さの最大値
+ */
+static size_t SendQueueMaxDepth = 0;
+/**
+ * 通信モードでドライバの送信キューの空きを待った回数
+ */
+static uint64_t SendQueuePortWaits = 0;
+
+/**
+ * 受信遅延ヒストグラム(受信完了から受信ハンドラ呼び出しまで)
+ */
+static LatencyHistogram RxDispatchLatency("rx.dispatch");
+/**
+ * 受信遅延ヒストグラム(標準出力への書き出しにかかった時間)
+ */
+static LatencyHistogram RxConsoleWriteLatency("rx.console_write");
+/**
+ * 受信遅延ヒストグラム(受信完了から標準出力への書き出し完了まで)
+ */
+static LatencyHistogram RxTotalLatency("rx.total");
+
+/**
+ * 送受信データのキャプチャ(--captureオプション指定時のみ)
+ */
+static std::unique_ptr<CaptureFile> CapturePtr;
+/**
+ * 標準出力が追いつかない分の退避先(-output-overflow spill指定時のみ)
+ */
+static std::unique_ptr<CaptureFile> SpillCapturePtr;
+/**
+ * 通信モードのフレーム符号化・復号(nullptrでフレーム処理しない)
+ */
+static std::unique_ptr<FrameCodec> FrameCodecPtr;
+/**
+ * 受信データの16進ダンプ表示(nullptrで受信データをそのまま書き出す。フレーム処理する場合は使用しない)
+ */
+static std::unique_ptr<HexDumper> HexDumperPtr;
+/**
+ * 再生中のセッション(Ctrl-Cで中止するため)
+ */
+static SessionReplayer* ActiveReplayer = nullptr;
+/**
+ * ActiveReplayerのロック
+ */
+static std::mutex ReplayerLock;
+
 enum ApplicationMode {
     AppModeSetup,
     AppModeCommunication
@@ -57,12 +131,47 @@ enum ApplicationMode {
  */
 static enum ApplicationMode ApplicationMode = AppModeCommunication;
 
+/**
+ * フレーム処理しないことを表すフレーム形式
+ */
+static const uint32_t FramingNone = 0xFFFFFFFF;
+/**
+ * フレームにCRCを付けないことを表すCRCの種類
+ */
+static const uint32_t FrameCrcNone = 0xFFFFFFFF;
+
 static const StringValueList ParityValueEntries = {
     { "none", SerialPort::ParityNone },
     { "even", SerialPort::ParityEven },
     { "odd", SerialPort::ParityOdd }
 };
 
+static const StringValueList StopBitsValueEntries = {
+    { "1", SerialPort::StopBitsOne },
+    { "1.5", SerialPort::StopBitsOne5 },
+    { "2", SerialPort::StopBitsTwo }
+};
+
+/**
+ * ポート指定の形式("8N1"など)で使うパリティの文字
+ */
+static const StringValueList ParityLetterEntries = {
+    { "N", SerialPort::ParityNone },
+    { "E", SerialPort::ParityEven },
+    { "O", SerialPort::ParityOdd }
+};
+
+/**
+ * ポートごとの通信設定
+ * ポート名に":ボーレート[:形式]"を付けて指定した値を持つ。省略した値は共通の設定(--baudrateなど)と同じにする。
+ */
+struct PortSetting {
+    uint32_t baudrate; // ボーレート
+    uint32_t parity; // パリティ
+    uint32_t stopbits; // ストップビット
+    uint8_t databits; // データビット数
+};
+
 
 
 struct ApplicationSetting {
@@ -72,11 +181,29 @@ struct ApplicationSetting {
     uint8_t databits; // データビット数
     uint32_t cts_flow; // CTS フロー制御
     uint32_t rts_control; // RTS制御
-    std::string port_name; // オープンポート名(空文字列で指定無し)
+    std::vector<std::string> port_names; // オープンポート名(空で指定無し、2つ以上でモニターモード)
+    std::vector<PortSetting> port_settings; // ポートごとの通信設定(port_namesと同じ順)
+    bool print_latency; // 終了時に受信遅延ヒストグラムを表示するかどうか
+    uint32_t receive_threads; // モニターモードの受信スレッド数
+    bool is_bridge; // 2つのポートを中継するかどうか
+    int bridge_timeout_millis; // 中継の送信タイムアウト時間[ミリ秒](負数で無制限)
+    std::string capture_path; // キャプチャファイルのベースパス(空文字列でキャプチャしない)
+    uint32_t capture_file_mib; // キャプチャファイル1つのサイズ[MiB]
+    uint32_t framing; // 通信モードのフレーム形式(FramingNoneでフレーム処理しない)
+    uint32_t frame_crc; // フレームに付けるCRCの種類(FrameCrcNoneで付けない)
+    bool is_hexdump; // 受信データを16進ダンプで表示するかどうか
+    uint32_t output_buffer_kib; // 標準出力のバッファ容量[KiB](0でバッファリングしない)
+    uint32_t output_overflow; // 標準出力のキューが上限に達したときの動作(OutputBuffer::OverflowPolicy)
+    uint32_t port_queue_limit; // ドライバの送信キューの上限[バイト](0で上限無し)
+    std::vector<ModbusRtuMaster::Request> modbus_requests; // Modbus RTUでポーリングする要求(空でポーリングしない)
+    uint32_t modbus_interval_millis; // Modbus RTUのポーリング周期[ミリ秒]
     ApplicationSetting()
         : baudrate(115200), parity(SerialPort::ParityNone), stopbits(SerialPort::StopBitsOne),
         databits(8), cts_flow(SerialPort::CtsFlowDisable), rts_control(SerialPort::RtsControlEnable),
-        port_name("") {
+        print_latency(false), receive_threads(1), is_bridge(false), bridge_timeout_millis(-1),
+        capture_path(""), capture_file_mib(64), framing(FramingNone), frame_crc(FrameCrcNone), is_hexdump(false),
+        output_buffer_kib(OutputBuffer::DefaultCapacity / 1024), output_overflow(OutputBuffer::OverflowBlock),
+        port_queue_limit(SendQueue::DefaultPortQueueLimit), modbus_interval_millis(1000) {
     }
 };
 
@@ -99,19 +226,50 @@ static void parse_option_parity(ApplicationSetting* psetting, arg_t& opt_args);
 static void parse_option_stopbits(ApplicationSetting* psetting, arg_t& opt_args);
 static void parse_option_cts_flow(ApplicationSetting* psetting, arg_t& opt_args);
 static void parse_option_rts_control(ApplicationSetting* psetting, arg_t& opt_args);
+static void parse_option_latency(ApplicationSetting* psetting, arg_t& opt_args);
+static void parse_option_threads(ApplicationSetting* psetting, arg_t& opt_args);
+static void parse_option_bridge(ApplicationSetting* psetting, arg_t& opt_args);
+static void parse_option_bridge_timeout(ApplicationSetting* psetting, arg_t& opt_args);
+static void parse_option_capture(ApplicationSetting* psetting, arg_t& opt_args);
+static void parse_option_capture_size(ApplicationSetting* psetting, arg_t& opt_args);
+static void parse_option_framing(ApplicationSetting* psetting, arg_t& opt_args);
+static void parse_option_frame_crc(ApplicationSetting* psetting, arg_t& opt_args);
+static void parse_option_hexdump(ApplicationSetting* psetting, arg_t& opt_args);
+static void parse_option_output_buffer(ApplicationSetting* psetting, arg_t& opt_args);
+static void parse_option_output_overflow(ApplicationSetting* psetting, arg_t& opt_args);
+static void parse_option_port_queue(ApplicationSetting* psetting, arg_t& opt_args);
+static void parse_option_modbus_poll(ApplicationSetting* psetting, arg_t& opt_args);
+static void parse_option_modbus_interval(ApplicationSetting* psetting, arg_t& opt_args);
+static void parse_port_spec(ApplicationSetting* psetting, const std::string& spec);
 static void print_usage(void);
 static void proc_args(ApplicationSetting* psetting, int ac, char** av);
 
 static void update_command_list(void);
 static bool select_serial_port_proc(const std::vector<std::string>& port_list, int* pselected);
 static void command_proc(arg_t& args);
-static void receiver_thread_proc(void);
+static void communication_proc(void);
+static void print_frame(const uint8_t* frame, size_t length);
+static void set_hexdump(bool is_enabled, bool is_show_offset, bool is_show_timestamp);
+static void display_received(const uint8_t* data, size_t length, std::chrono::steady_clock::time_point timestamp);
+static bool send_frame_lines(SendQueue& send_queue, std::string* pline_buffer, const uint8_t* data, size_t length);
+static void apply_setting(SerialPort& port, const ApplicationSetting& setting);
+static void apply_port_setting(SerialPort& port, const ApplicationSetting& setting, size_t index);
+static void monitor_proc(const ApplicationSetting& setting);
+static void bridge_proc(const ApplicationSetting& setting);
+static void modbus_proc(const ApplicationSetting& setting);
+static void start_capture(const ApplicationSetting& setting);
+static void stop_capture(void);
 static void cmd_argv(arg_t& args);
 static void cmd_help(arg_t& args);
 static void cmd_quit(arg_t& args);
 static void cmd_open(arg_t& args);
 static void cmd_baudrate(arg_t& args);
 static void cmd_parity(arg_t& args);
+static void cmd_stats(arg_t& args);
+static void cmd_latency(arg_t& args);
+static void cmd_replay(arg_t& args);
+static void cmd_display(arg_t& args);
+static void print_latency(void);
 
 /**
  * アプリケーションのエントリポイント
@@ -134,6 +292,53 @@ int main(int ac, char** argv)
         else {
             proc_args(&setting, ac - 1, argv + 1);
         }
+        if ((setting.frame_crc != FrameCrcNone) && (setting.framing == FramingNone)) {
+            throw std::invalid_argument("Specify '--framing' option to use '--frame-crc'.");
+        }
+        stdio.set_output_buffering(setting.output_buffer_kib * 1024, OutputBuffer::DefaultFlushDelayMillis);
+        if (setting.output_overflow == OutputBuffer::OverflowSpill) {
+            if (setting.capture_path.empty()) {
+                throw std::invalid_argument("Specify '--capture' option to spill stdout.");
+            }
+        }
+        else {
+            stdio.set_output_overflow_policy(OutputBuffer::DefaultQueueLimit,
+                static_cast<OutputBuffer::OverflowPolicy>(setting.output_overflow));
+        }
+
+        ModeChangeEvent = CreateEventA(NULL, TRUE, FALSE, NULL);
+        if (ModeChangeEvent == NULL) {
+            throw std::system_error(GetLastError(), windows_error_category());
+        }
+        SendWritableEvent = CreateEventA(NULL, TRUE, FALSE, NULL);
+        if (SendWritableEvent == NULL) {
+            throw std::system_error(GetLastError(), windows_error_category());
+        }
+        PortQueueLimit = setting.port_queue_limit;
+        SetConsoleCtrlHandler(on_console_event, TRUE);
+        start_capture(setting);
+
+        if (!setting.modbus_requests.empty()) {
+            if (setting.port_names.size() != 1) {
+                throw std::invalid_argument("Specify one port for '--modbus-poll' option.");
+            }
+            modbus_proc(setting);
+            stop_capture();
+            return EXIT_SUCCESS;
+        }
+        else if (setting.is_bridge) {
+            if (setting.port_names.size() != 2) {
+                throw std::invalid_argument("Specify two ports for '--bridge' option.");
+            }
+            bridge_proc(setting);
+            stop_capture();
+            return EXIT_SUCCESS;
+        }
+        else if (setting.port_names.size() > 1) { // 複数のポートを指定した？
+            monitor_proc(setting);
+            stop_capture();
+            return EXIT_SUCCESS;
+        }
 
         std::vector<std::string> port_list;
         SerialPort::enumerate_ports(&port_list);
@@ -142,7 +347,7 @@ int main(int ac, char** argv)
             stdio.print_err("Found COM port:%s\n", s.c_str());
         }
 #endif
-        std::string selected_serial_port = setting.port_name;
+        std::string selected_serial_port = (setting.port_names.empty()) ? std::string() : setting.port_names[0];
         if (selected_serial_port.empty()) { // シリアルポート指定無し？
             if (port_list.empty()) {
                 throw std::system_error(APP_ERROR_NO_SERIAL_PORTS, app_error_category());
@@ -160,31 +365,37 @@ int main(int ac, char** argv)
             }
         }
         stdio.print("Selected serial port: %s\n", selected_serial_port.c_str());
-
-        SetConsoleCtrlHandler(on_console_event, TRUE);
+        if (setting.framing != FramingNone) {
+            FrameCodecPtr = std::make_unique<FrameCodec>(static_cast<FrameCodec::Protocol>(setting.framing));
+            (*FrameCodecPtr).set_handler(print_frame);
+            if (setting.frame_crc != FrameCrcNone) {
+                (*FrameCodecPtr).set_crc(true, static_cast<Crc::Algorithm>(setting.frame_crc));
+            }
+        }
+        if (setting.is_hexdump) {
+            set_hexdump(true, true, false);
+        }
 
         update_command_list();
 
         SerialPortPtr = std::make_unique<SerialPort>(selected_serial_port);
-
-        (*SerialPortPtr).set_baudrate(setting.baudrate);
-        (*SerialPortPtr).set_parity(setting.parity);
-        (*SerialPortPtr).set_stopbits(setting.stopbits);
-        (*SerialPortPtr).set_databits(setting.databits);
-        (*SerialPortPtr).set_cts_flow(setting.cts_flow);
-        (*SerialPortPtr).set_rts_control(setting.rts_control);
+        if (setting.port_names.empty()) {
+            apply_setting(*SerialPortPtr, setting);
+        }
+        else {
+            apply_port_setting(*SerialPortPtr, setting, 0);
+        }
         try {
             (*SerialPortPtr).open();
             ApplicationMode = AppModeCommunication;
             stdio.set_line_input_mode(false);
         }
         catch (std::exception& e) {
-            stdio.print_err(e.what());
+            stdio.print_err("%s\n", e.what());
             ApplicationMode = AppModeSetup;
             stdio.set_line_input_mode(true);
         }
 
-        std::thread thread(receiver_thread_proc);
         stdio.print_err("Press Ctrl-C to change setting mode.\n");
 
         IsAppRun = true;
@@ -203,29 +414,19 @@ int main(int ac, char** argv)
                 }
             }
             else {
-                uint8_t buf[256];
-                size_t read_len;
-                if (stdio.read(buf, sizeof(buf), &read_len)) {
-                    if (read_len > 0) {
-                        (*SerialPortPtr).send(buf, static_cast<uint32_t>(read_len));
-                    }
-                    else if (!stdio) {
-                        // Note: 受信しっぱなしを許容するため、
-                        //       入力がBREAKしても終了しない。
-                    }
-                    else {
-                        // do nothing.
-                    }
-                }
+                communication_proc();
             }
         }
         IsAppRun = false;
         (*SerialPortPtr).close();
-        thread.join();
+        if (setting.print_latency) {
+            print_latency();
+        }
     }
     catch (std::exception& ex) {
         stdio.print_err("%s\n", ex.what());
     }
+    stop_capture();
     if (SerialPortPtr != nullptr) {
         SerialPortPtr.reset();
     }
@@ -245,11 +446,13 @@ static BOOL on_console_event(DWORD event) {
     switch (event) {
     case CTRL_C_EVENT:
     {
-        if (ApplicationMode == AppModeCommunication) {
-            (*SerialPortPtr).close();
-            ApplicationMode = AppModeSetup;
-            StandardIo::instance().set_line_input_mode(true);
-            update_command_list();
+        std::lock_guard<std::mutex> lock(ReplayerLock);
+        if (ActiveReplayer != nullptr) { // 再生中？
+            (*ActiveReplayer).stop();
+        }
+        else if (ApplicationMode == AppModeCommunication) {
+            // 切り替えは通信モードの処理(communication_proc)で行う。
+            SetEvent(ModeChangeEvent);
         }
         else {
             IsAppRun = false;
@@ -279,6 +482,20 @@ static const std::vector<CommandLineOption>& get_command_line_options(void) {
         options.push_back(CommandLineOption("-stopbits", "Specify stopbits. ('1', '1.5', '2')", 1, parse_option_stopbits));
         options.push_back(CommandLineOption("-cts-flow", "Specify CTS flow control. ('enable','disable')", 1, parse_option_cts_flow));
         options.push_back(CommandLineOption("-rts-control", "Specify RTS control. ('low','high','handshake','toggle')", 1, parse_option_rts_control));
+        options.push_back(CommandLineOption("-latency", "Print receive latency histograms at exit.", 0, parse_option_latency));
+        options.push_back(CommandLineOption("-threads", "Specify receive thread count for monitor mode.", 1, parse_option_threads));
+        options.push_back(CommandLineOption("-bridge", "Relay data between two ports.", 0, parse_option_bridge));
+        options.push_back(CommandLineOption("-capture", "Capture sent/received data to 'path.NNNN.cap' files.", 1, parse_option_capture));
+        options.push_back(CommandLineOption("-capture-size", "Specify capture file size[MiB] to roll over.", 1, parse_option_capture_size));
+        options.push_back(CommandLineOption("-bridge-timeout", "Specify relay send timeout[ms]. Data not sent in time is dropped.", 1, parse_option_bridge_timeout));
+        options.push_back(CommandLineOption("-framing", "Specify frame format. ('none','cobs','slip') Frames are printed/entered as hex lines.", 1, parse_option_framing));
+        options.push_back(CommandLineOption("-frame-crc", "Specify CRC appended to each frame. ('none','crc8','crc16-ccitt','crc16-xmodem','crc16-kermit','crc16-modbus','crc32','crc32c')", 1, parse_option_frame_crc));
+        options.push_back(CommandLineOption("-hexdump", "Print received data as hex/ASCII dump with offsets.", 0, parse_option_hexdump));
+        options.push_back(CommandLineOption("-output-buffer", "Specify stdout buffer size[KiB]. ('0' writes immediately)", 1, parse_option_output_buffer));
+        options.push_back(CommandLineOption("-output-overflow", "Specify what to do when stdout can't keep up. ('block','drop','spill') 'spill' saves to '<capture path>.spill.NNNN.cap'.", 1, parse_option_output_overflow));
+        options.push_back(CommandLineOption("-port-queue", "Specify max bytes queued in the driver before sending waits. ('0' for no limit)", 1, parse_option_port_queue));
+        options.push_back(CommandLineOption("-modbus-poll", "Poll Modbus RTU slaves instead of terminal mode. ('slave:function:address:count[:timeout_ms],...' function is 1-4)", 1, parse_option_modbus_poll));
+        options.push_back(CommandLineOption("-modbus-interval", "Specify Modbus RTU polling interval[ms].", 1, parse_option_modbus_interval));
     }
 
     return options;
@@ -312,7 +529,7 @@ static void parse_option_parity(ApplicationSetting* psetting, arg_t& opt_args) {
         (*psetting).parity = parity;
     }
     else {
-        throw std::invalid_argument(format("Invalid parity : %s", opt_args[0]));
+        throw std::invalid_argument(format("Invalid parity : %s", opt_args[0].c_str()));
     }
 
 }
@@ -324,17 +541,12 @@ static void parse_option_parity(ApplicationSetting* psetting, arg_t& opt_args) {
  * @param opt_args オプションの引数
  */
 static void parse_option_stopbits(ApplicationSetting* psetting, arg_t& opt_args) {
-    const StringValueList Entries = {
-        { "1", SerialPort::StopBitsOne },
-        { "1.5", SerialPort::StopBitsOne5 },
-        { "2", SerialPort::StopBitsTwo }
-    };
     uint32_t stopbits;
-    if (parse_value(Entries, opt_args[0], &stopbits)) {
+    if (parse_value(StopBitsValueEntries, opt_args[0], &stopbits)) {
         (*psetting).stopbits = stopbits;
     }
     else {
-        throw std::invalid_argument(format("Invalid parity : %s", opt_args[0]));
+        throw std::invalid_argument(format("Invalid stop bits : %s", opt_args[0].c_str()));
     }
 }
 
@@ -354,7 +566,7 @@ static void parse_option_cts_flow(ApplicationSetting* psetting, arg_t& opt_args)
         (*psetting).cts_flow = cts_flow;
     }
     else {
-        throw std::invalid_argument(format("Invalid parity : %s", opt_args[0]));
+        throw std::invalid_argument(format("Invalid CTS flow control : %s", opt_args[0].c_str()));
     }
 }
 
@@ -376,10 +588,306 @@ static void parse_option_rts_control(ApplicationSetting* psetting, arg_t& opt_ar
         (*psetting).rts_control = rts_control;
     }
     else {
-        throw std::invalid_argument(format("Invalid parity : %s", opt_args[0]));
+        throw std::invalid_argument(format("Invalid RTS control : %s", opt_args[0].c_str()));
+    }
+}
+
+/**
+ * latencyオプションを解析する。
+ *
+ * @param psetting 設定
+ * @param opt_args オプション引数
+ */
+static void parse_option_latency(ApplicationSetting* psetting, arg_t& opt_args) {
+    (*psetting).print_latency = true;
+    return;
+}
+
+/**
+ * threadsオプションを解析する。
+ *
+ * @param psetting 設定
+ * @param opt_args オプション引数
+ */
+static void parse_option_threads(ApplicationSetting* psetting, arg_t& opt_args) {
+    uint32_t thread_count;
+    if (parse_ui32(opt_args[0], &thread_count) && (thread_count > 0)) {
+        (*psetting).receive_threads = thread_count;
+    }
+    else {
+        throw std::invalid_argument(format("Invalid thread count : %s", opt_args[0].c_str()));
+    }
+}
+
+/**
+ * bridgeオプションを解析する。
+ *
+ * @param psetting 設定
+ * @param opt_args オプション引数
+ */
+static void parse_option_bridge(ApplicationSetting* psetting, arg_t& opt_args) {
+    (*psetting).is_bridge = true;
+    return;
+}
+
+/**
+ * bridge-timeoutオプションを解析する。
+ *
+ * @param psetting 設定
+ * @param opt_args オプション引数
+ */
+static void parse_option_bridge_timeout(ApplicationSetting* psetting, arg_t& opt_args) {
+    uint32_t timeout_millis;
+    if (parse_ui32(opt_args[0], &timeout_millis) && (timeout_millis <= INT32_MAX)) {
+        (*psetting).bridge_timeout_millis = static_cast<int>(timeout_millis);
+    }
+    else {
+        throw std::invalid_argument(format("Invalid timeout : %s", opt_args[0].c_str()));
+    }
+}
+
+/**
+ * captureオプションを解析する。
+ *
+ * @param psetting 設定
+ * @param opt_args オプション引数
+ */
+static void parse_option_capture(ApplicationSetting* psetting, arg_t& opt_args) {
+    (*psetting).capture_path = opt_args[0];
+    return;
+}
+
+/**
+ * capture-sizeオプションを解析する。
+ *
+ * @param psetting 設定
+ * @param opt_args オプション引数
+ */
+static void parse_option_capture_size(ApplicationSetting* psetting, arg_t& opt_args) {
+    uint32_t size_mib;
+    if (parse_ui32(opt_args[0], &size_mib) && (size_mib > 0)) {
+        (*psetting).capture_file_mib = size_mib;
+    }
+    else {
+        throw std::invalid_argument(format("Invalid capture size : %s", opt_args[0].c_str()));
     }
 }
 
+/**
+ * framingオプションを解析する。
+ *
+ * @param psetting 設定
+ * @param opt_args オプション引数
+ */
+static void parse_option_framing(ApplicationSetting* psetting, arg_t& opt_args) {
+    const StringValueList Entries = {
+        { "none", FramingNone },
+        { "cobs", FrameCodec::ProtocolCobs },
+        { "slip", FrameCodec::ProtocolSlip }
+    };
+    uint32_t framing;
+    if (parse_value(Entries, opt_args[0], &framing)) {
+        (*psetting).framing = framing;
+    }
+    else {
+        throw std::invalid_argument(format("Invalid framing : %s", opt_args[0].c_str()));
+    }
+}
+
+/**
+ * frame-crcオプションを解析する。
+ *
+ * @param psetting 設定
+ * @param opt_args オプション引数
+ */
+static void parse_option_frame_crc(ApplicationSetting* psetting, arg_t& opt_args) {
+    const StringValueList Entries = {
+        { "none", FrameCrcNone },
+        { "crc8", Crc::AlgorithmCrc8 },
+        { "crc16-ccitt", Crc::AlgorithmCrc16Ccitt },
+        { "crc16-xmodem", Crc::AlgorithmCrc16Xmodem },
+        { "crc16-kermit", Crc::AlgorithmCrc16Kermit },
+        { "crc16-modbus", Crc::AlgorithmCrc16Modbus },
+        { "crc32", Crc::AlgorithmCrc32 },
+        { "crc32c", Crc::AlgorithmCrc32c }
+    };
+    uint32_t frame_crc;
+    if (parse_value(Entries, opt_args[0], &frame_crc)) {
+        (*psetting).frame_crc = frame_crc;
+    }
+    else {
+        throw std::invalid_argument(format("Invalid frame CRC : %s", opt_args[0].c_str()));
+    }
+}
+
+/**
+ * hexdumpオプションを解析する。
+ *
+ * @param psetting 設定
+ * @param opt_args オプションの引数
+ */
+static void parse_option_hexdump(ApplicationSetting* psetting, arg_t& opt_args) {
+    (*psetting).is_hexdump = true;
+    return;
+}
+
+/**
+ * output-bufferオプションを解析する。
+ *
+ * @param psetting 設定
+ * @param opt_args オプション引数
+ */
+static void parse_option_output_buffer(ApplicationSetting* psetting, arg_t& opt_args) {
+    uint32_t size_kib;
+    if (parse_ui32(opt_args[0], &size_kib) && (size_kib <= (64 * 1024))) {
+        (*psetting).output_buffer_kib = size_kib;
+    }
+    else {
+        throw std::invalid_argument(format("Invalid output buffer size : %s", opt_args[0].c_str()));
+    }
+}
+
+/**
+ * output-overflowオプションを解析する。
+ *
+ * @param psetting 設定
+ * @param opt_args オプション引数
+ */
+static void parse_option_output_overflow(ApplicationSetting* psetting, arg_t& opt_args) {
+    const StringValueList Entries = {
+        { "block", OutputBuffer::OverflowBlock },
+        { "drop", OutputBuffer::OverflowDrop },
+        { "spill", OutputBuffer::OverflowSpill }
+    };
+    uint32_t overflow;
+    if (parse_value(Entries, opt_args[0], &overflow)) {
+        (*psetting).output_overflow = overflow;
+    }
+    else {
+        throw std::invalid_argument(format("Invalid output overflow : %s", opt_args[0].c_str()));
+    }
+}
+
+/**
+ * port-queueオプションを解析する。
+ *
+ * @param psetting 設定
+ * @param opt_args オプション引数
+ */
+static void parse_option_port_queue(ApplicationSetting* psetting, arg_t& opt_args) {
+    uint32_t limit;
+    if (parse_ui32(opt_args[0], &limit)) {
+        (*psetting).port_queue_limit = limit;
+    }
+    else {
+        throw std::invalid_argument(format("Invalid port queue limit : %s", opt_args[0].c_str()));
+    }
+}
+
+/**
+ * modbus-pollオプションを解析する。
+ * 要求は"スレーブアドレス:ファンクションコード:開始アドレス:数[:タイムアウト時間]"をカンマで区切って並べる。
+ * ファンクションコードは読み出し(1～4)だけ指定できる。
+ *
+ * @param psetting 設定
+ * @param opt_args オプションの引数
+ */
+static void parse_option_modbus_poll(ApplicationSetting* psetting, arg_t& opt_args) {
+    const std::string& list = opt_args[0];
+    std::vector<ModbusRtuMaster::Request> requests;
+    size_t begin = 0;
+    while (begin <= list.length()) {
+        size_t end = list.find(',', begin);
+        if (end == std::string::npos) {
+            end = list.length();
+        }
+        std::string entry = list.substr(begin, end - begin);
+        begin = end + 1;
+
+        uint32_t fields[5] = { 0, 0, 0, 0, 0 }; // スレーブアドレス, ファンクションコード, 開始アドレス, 数, タイムアウト時間
+        size_t field_count = 0;
+        size_t field_begin = 0;
+        bool is_valid = true;
+        while (is_valid && (field_begin <= entry.length())) {
+            size_t field_end = entry.find(':', field_begin);
+            if (field_end == std::string::npos) {
+                field_end = entry.length();
+            }
+            is_valid = (field_count < 5) && parse_ui32(entry.substr(field_begin, field_end - field_begin), &fields[field_count]);
+            field_count++;
+            field_begin = field_end + 1;
+        }
+        is_valid = is_valid && (field_count >= 4)
+            && (fields[0] >= 1) && (fields[0] <= 247)
+            && (fields[1] >= ModbusRtu::FunctionReadCoils) && (fields[1] <= ModbusRtu::FunctionReadInputRegisters)
+            && (fields[2] <= 0xFFFF) && (fields[3] <= 0xFFFF);
+        ModbusRtuMaster::Request request(static_cast<uint8_t>(fields[0]), static_cast<uint8_t>(fields[1]),
+            static_cast<uint16_t>(fields[2]), static_cast<uint16_t>(fields[3]), fields[4]);
+        std::vector<uint8_t> frame;
+        if (!is_valid || !ModbusRtuMaster::encode_request(request, &frame)) {
+            throw std::invalid_argument(format("Invalid Modbus request : %s", entry.c_str()));
+        }
+        requests.push_back(request);
+    }
+    (*psetting).modbus_requests = requests;
+}
+
+/**
+ * modbus-intervalオプションを解析する。
+ *
+ * @param psetting 設定
+ * @param opt_args オプションの引数
+ */
+static void parse_option_modbus_interval(ApplicationSetting* psetting, arg_t& opt_args) {
+    uint32_t interval_millis;
+    if (parse_ui32(opt_args[0], &interval_millis) && (interval_millis <= INT32_MAX)) {
+        (*psetting).modbus_interval_millis = interval_millis;
+    }
+    else {
+        throw std::invalid_argument(format("Invalid interval : %s", opt_args[0].c_str()));
+    }
+}
+
+/**
+ * ポート指定("ポート名[:ボーレート[:形式]]")を解析し、ポート名とポートごとの通信設定を追加する。
+ * 形式はデータビット数(7, 8)、パリティ(N, E, O)、ストップビット(1, 1.5, 2)を続けて書く("8N1", "7E2"など)。
+ * 省略した値は共通の設定を使うので、共通の設定のオプションはポート名より前に解析しておくこと。
+ *
+ * @param psetting 設定
+ * @param spec ポート指定
+ */
+static void parse_port_spec(ApplicationSetting* psetting, const std::string& spec) {
+    PortSetting port_setting;
+    port_setting.baudrate = (*psetting).baudrate;
+    port_setting.parity = (*psetting).parity;
+    port_setting.stopbits = (*psetting).stopbits;
+    port_setting.databits = (*psetting).databits;
+
+    size_t name_end = spec.find(':');
+    std::string name = spec.substr(0, name_end);
+    bool is_valid = !name.empty();
+    if (is_valid && (name_end != std::string::npos)) { // 通信設定を指定した？
+        size_t baudrate_end = spec.find(':', name_end + 1);
+        if (baudrate_end == std::string::npos) {
+            baudrate_end = spec.length();
+        }
+        is_valid = parse_ui32(spec.substr(name_end + 1, baudrate_end - name_end - 1), &port_setting.baudrate);
+        if (is_valid && (baudrate_end < spec.length())) { // 形式を指定した？
+            std::string line_format = spec.substr(baudrate_end + 1);
+            is_valid = (line_format.length() >= 3) && ((line_format[0] == '7') || (line_format[0] == '8'))
+                && parse_value(ParityLetterEntries, line_format.substr(1, 1), &port_setting.parity)
+                && parse_value(StopBitsValueEntries, line_format.substr(2), &port_setting.stopbits);
+            port_setting.databits = static_cast<uint8_t>(line_format[0] - '0');
+        }
+    }
+    if (!is_valid) {
+        throw std::invalid_argument(format("Invalid port : %s", spec.c_str()));
+    }
+
+    (*psetting).port_names.push_back(name);
+    (*psetting).port_settings.push_back(port_setting);
+}
+
 /**
  * アプリケーションの使用方法を表示する。
  */
@@ -390,7 +898,11 @@ static void print_usage(void) {
     auto options = get_command_line_options();
     stdio.print("Usage:\n");
     stdio.print("  %s [options] [port_name$] - Run application.\n", pname.c_str());
+    stdio.print("  %s [options] port_name$ port_name$ ... - Monitor received lines of several ports.\n", pname.c_str());
+    stdio.print("  %s [options] --bridge port_name$ port_name$ - Relay data between two ports.\n", pname.c_str());
     stdio.print("  %s -help - Print this message.\n", pname.c_str());
+    stdio.print("  port_name$ may be followed by ':baudrate[:format]' to override the options for that port.\n");
+    stdio.print("  format is data bits, parity and stop bits. (e.g. '8N1', '7E2', '8O1.5')\n");
     stdio.print("Options:\n");
     for (auto& option : options) {
         stdio.print("  -%s : %s\n", option.option, option.help);
@@ -428,12 +940,12 @@ static void proc_args(ApplicationSetting* psetting, int ac, char** av) {
             i += (*pentry).arg_count;
         }
         else {
-            if ((i + 0) < ac) {
-                (*psetting).port_name = std::string(av[i + 0]);
+            // 残りの引数は全てポート指定として扱う。
+            for (int j = i; j < ac; j++) {
+                parse_port_spec(psetting, std::string(av[j]));
             }
             break;
         }
-        i++;
     }
 
     return;
@@ -447,6 +959,10 @@ static void update_command_list(void) {
     CommandEntries.push_back(CommandEntry("open", "Open serial I/O mode.", cmd_open));
     CommandEntries.push_back(CommandEntry("baudrate", "Set/Get baudrate.", cmd_baudrate));
     CommandEntries.push_back(CommandEntry("parity", "Set/Get parity", cmd_parity));
+    CommandEntries.push_back(CommandEntry("stats", "Print I/O statistics. ('stats reset' to clear)", cmd_stats));
+    CommandEntries.push_back(CommandEntry("latency", "Print receive latency histograms. ('latency reset' to clear)", cmd_latency));
+    CommandEntries.push_back(CommandEntry("display", "Set/Get received data display. (display raw|hex [offset] [time])", cmd_display));
+    CommandEntries.push_back(CommandEntry("replay", "Replay captured data. (replay path send|display [speed] [rx|tx|all])", cmd_replay));
     CommandEntries.push_back(CommandEntry("argv", "Print argv.", cmd_argv));
     CommandEntries.push_back(CommandEntry("help", "Print help messages.", cmd_help));
     CommandEntries.push_back(CommandEntry("quit", "Quit application.", cmd_quit));
@@ -528,29 +1044,489 @@ static void command_proc(arg_t &args) {
 }
 
 /**
- * 受信スレッド処理
+ * 通信モードの処理を行う。
+ * シリアルポートの受信はストリーム受信で行い、受信スレッドから標準出力へ書き出す。
+ * このスレッドでは標準入力とモード切り替え要求を待ち合わせ、標準入力のデータを送信キューに積む。
+ * 送信キューは小さな入力をまとめてシリアルポートへ送信する。
+ * モード切り替え要求を受けるか、シリアルポートでエラーが発生すると設定モードに切り替えて戻る。
  */
-static void receiver_thread_proc(void) {
+static void communication_proc(void) {
     auto& stdio = StandardIo::instance();
+    SerialPort& port = (*SerialPortPtr);
+
+    bool is_started = port.start_streaming([&stdio, &port](const uint8_t* data, uint32_t length) {
+        if (data != nullptr) {
+            // 受信完了 -> ハンドラ呼び出し -> 標準出力への書き出し完了の各区間の時間を記録する。
+            auto completed_time = port.get_completed_time();
+            auto dispatched_time = std::chrono::steady_clock::now();
+            display_received(data, length, completed_time);
+            auto written_time = std::chrono::steady_clock::now();
+            RxDispatchLatency.record(completed_time, dispatched_time);
+            RxConsoleWriteLatency.record(dispatched_time, written_time);
+            RxTotalLatency.record(completed_time, written_time);
+            if (CapturePtr != nullptr) {
+                (*CapturePtr).write(0, CaptureFile::DirectionRx, data, length, completed_time);
+            }
+        }
+        else { // 受信エラー
+            stdio.print_err("%s\n", get_windows_error_message(GetLastError()).c_str());
+            SetEvent(ModeChangeEvent);
+        }
+    });
+    if (!is_started) {
+        stdio.print_err("%s\n", get_windows_error_message(GetLastError()).c_str());
+    }
 
-    uint8_t recv_buf[256];
+    SendQueue send_queue(port);
+    send_queue.set_port_queue_limit(PortQueueLimit);
+    send_queue.set_writable_handler([]() { SetEvent(SendWritableEvent); });
+    send_queue.start();
+
+    uint8_t buf[4096];
+    std::string frame_line; // フレーム処理する場合の入力途中の行
+
+    while (IsAppRun && is_started) {
+        // Note: 受信しっぱなしを許容するため、入力が終端しても終了しない。
+        //       以降は標準入力を待ち合わせ対象から外す。
+        bool is_input_active = stdio.request_input_notify();
+        // Note: 送信キューに空きが無い間は標準入力を読まずに、空きの通知を待つ。
+        //       StandardIoの入力バッファが一杯になると標準入力の読み込みも止まるので、
+        //       相手が受け取れない間は入力元(パイプなど)まで流れが止まり、メモリ使用量は一定に保たれる。
+        ResetEvent(SendWritableEvent);
+        bool is_writable = send_queue.request_writable_notify();
+
+        HANDLE wait_handles[2];
+        DWORD wait_count = 0;
+        wait_handles[wait_count++] = ModeChangeEvent;
+        if (is_input_active) {
+            wait_handles[wait_count++] = (is_writable) ? stdio.get_input_event() : SendWritableEvent;
+        }
+        DWORD result = WaitForMultipleObjects(wait_count, wait_handles, FALSE, INFINITE);
+        if (result == WAIT_OBJECT_0) { // モード切り替え要求または受信エラー？
+            break;
+        }
+        else if (result == WAIT_FAILED) {
+            stdio.print_err("%s\n", get_windows_error_message(GetLastError()).c_str());
+            break;
+        }
 
-    while (IsAppRun) {
-        if ((*SerialPortPtr).is_opened()) {
-            int result = (*SerialPortPtr).receive(recv_buf, sizeof(recv_buf), 100);
-            if (result > 0) {
-                stdio.write(recv_buf, result);
+        // 標準入力 -> 送信キュー
+        if (!is_writable) { // 空きの通知を受けた？
+            continue;
+        }
+        size_t read_len;
+        if (stdio.read(buf, sizeof(buf), &read_len) && (read_len > 0)) {
+            if (FrameCodecPtr != nullptr) {
+                if (!send_frame_lines(send_queue, &frame_line, buf, read_len)) {
+                    break;
+                }
             }
             else {
-                std::this_thread::yield(); // 別スレッドにスイッチ。
+                if (send_queue.enqueue(buf, static_cast<uint32_t>(read_len)) < 0) {
+                    stdio.print_err("%s\n", get_windows_error_message(send_queue.get_error()).c_str());
+                    break;
+                }
+                if (CapturePtr != nullptr) {
+                    (*CapturePtr).write(0, CaptureFile::DirectionTx, buf, static_cast<uint32_t>(read_len));
+                }
             }
         }
+    }
+
+    port.close(); // ストリーム受信も停止する。
+    send_queue.stop(); // Note: 送信待ちのデータは破棄される。
+    SendQueueMaxDepth = (std::max)(SendQueueMaxDepth, send_queue.get_max_depth());
+    SendQueuePortWaits += send_queue.get_port_waits();
+    ResetEvent(ModeChangeEvent);
+    ApplicationMode = AppModeSetup;
+    stdio.set_line_input_mode(true);
+    update_command_list();
+
+    return;
+}
+
+/**
+ * 復号したフレームを"[バイト数] 16進数"の1行で標準出力へ書き出す。
+ *
+ * @param frame フレーム
+ * @param length フレームのバイト数
+ */
+static void print_frame(const uint8_t* frame, size_t length) {
+    static const char HexDigits[] = "0123456789ABCDEF";
+    std::string line = format("[%zu]", length);
+    line.reserve(line.size() + (length * 3) + 1);
+    for (size_t i = 0; i < length; i++) {
+        line.push_back(' ');
+        line.push_back(HexDigits[frame[i] >> 4]);
+        line.push_back(HexDigits[frame[i] & 0x0F]);
+    }
+    line.push_back('\n');
+    StandardIo::instance().write(line.data(), line.size());
+}
+
+/**
+ * 受信データの16進ダンプ表示を切り替える。
+ * 受信スレッドが動いていない間(設定モードや起動時)に呼び出すこと。
+ *
+ * @param is_enabled 16進ダンプで表示する場合にはtrue, そのまま書き出す場合にはfalse
+ * @param is_show_offset オフセットを表示するかどうか
+ * @param is_show_timestamp 受信時刻を表示するかどうか
+ */
+static void set_hexdump(bool is_enabled, bool is_show_offset, bool is_show_timestamp) {
+    if (!is_enabled) {
+        HexDumperPtr.reset();
+        return;
+    }
+    if (HexDumperPtr == nullptr) {
+        HexDumperPtr = std::make_unique<HexDumper>();
+        (*HexDumperPtr).set_handler([](const char* text, size_t length) {
+            StandardIo::instance().write(text, length);
+        });
+    }
+    (*HexDumperPtr).set_show_offset(is_show_offset);
+    (*HexDumperPtr).set_show_timestamp(is_show_timestamp);
+    (*HexDumperPtr).reset();
+}
+
+/**
+ * 受信データを標準出力へ書き出す。
+ * フレーミングを有効にしている場合はフレームに復号して表示し、16進ダンプ表示の場合は変換してから書き出す。
+ * 通信モードの受信とreplayコマンドの再生で共通に使う。
+ *
+ * @param data 受信データ
+ * @param length 受信データのバイト数
+ * @param timestamp 受信時刻
+ */
+static void display_received(const uint8_t* data, size_t length, std::chrono::steady_clock::time_point timestamp) {
+    if (FrameCodecPtr != nullptr) {
+        (*FrameCodecPtr).feed(data, length);
+    }
+    else if (HexDumperPtr != nullptr) {
+        (*HexDumperPtr).feed(data, length, timestamp);
+    }
+    else {
+        StandardIo::instance().write(data, length);
+    }
+}
+
+/**
+ * 標準入力のデータを行に分け、各行を16進数のフレームとして符号化して送信キューに積む。
+ * キャプチャする場合は符号化後のデータを記録する。
+ * 行の途中までのデータはpline_bufferに残し、次の呼び出しで続きとして扱う。
+ *
+ * @param send_queue 送信キュー
+ * @param pline_buffer 入力途中の行
+ * @param data 標準入力のデータ
+ * @param length データのバイト数
+ * @retval true 成功(16進数として解析できない行は無視する)
+ * @retval false 送信キューでエラーが発生した
+ */
+static bool send_frame_lines(SendQueue& send_queue, std::string* pline_buffer, const uint8_t* data, size_t length) {
+    auto& stdio = StandardIo::instance();
+    std::string& line_buffer = *pline_buffer;
+    std::vector<uint8_t> frame;
+    std::vector<uint8_t> encoded;
+    for (size_t i = 0; i < length; i++) {
+        if ((data[i] != '\r') && (data[i] != '\n')) {
+            line_buffer.push_back(static_cast<char>(data[i]));
+            continue;
+        }
+        if (!parse_hex_bytes(line_buffer, &frame)) {
+            stdio.print_err("Invalid hex bytes. [%s]\n", line_buffer.c_str());
+        }
+        else if (!frame.empty()) {
+            encoded.clear();
+            (*FrameCodecPtr).encode(frame.data(), frame.size(), &encoded);
+            if (send_queue.enqueue(encoded.data(), static_cast<uint32_t>(encoded.size())) < 0) {
+                stdio.print_err("%s\n", get_windows_error_message(send_queue.get_error()).c_str());
+                return false;
+            }
+            if (CapturePtr != nullptr) {
+                (*CapturePtr).write(0, CaptureFile::DirectionTx, encoded.data(), static_cast<uint32_t>(encoded.size()));
+            }
+        }
+        line_buffer.clear();
+    }
+
+    return true;
+}
+
+/**
+ * シリアルポートにアプリケーション設定を適用する。
+ *
+ * @param port シリアルポート
+ * @param setting 設定
+ */
+static void apply_setting(SerialPort& port, const ApplicationSetting& setting) {
+    port.set_baudrate(setting.baudrate);
+    port.set_parity(setting.parity);
+    port.set_stopbits(setting.stopbits);
+    port.set_databits(setting.databits);
+    port.set_cts_flow(setting.cts_flow);
+    port.set_rts_control(setting.rts_control);
+}
+
+/**
+ * シリアルポートにアプリケーション設定と、ポート指定で与えたポートごとの通信設定を適用する。
+ *
+ * @param port シリアルポート
+ * @param setting 設定
+ * @param index ポートの番号(port_namesでの位置)
+ */
+static void apply_port_setting(SerialPort& port, const ApplicationSetting& setting, size_t index) {
+    const PortSetting& port_setting = setting.port_settings[index];
+    apply_setting(port, setting);
+    port.set_baudrate(port_setting.baudrate);
+    port.set_parity(port_setting.parity);
+    port.set_stopbits(port_setting.stopbits);
+    port.set_databits(port_setting.databits);
+}
+
+/**
+ * モニターモードの処理を行う。
+ * 指定された全てのポートをポートごとの通信設定でオープンし、PortEngineの受信スレッドでまとめて受信する。
+ * 受信データは行単位で"ポート名: 行"の形式にして標準出力へ書き出す。
+ * Ctrl-Cが押されるか、全てのポートで受信エラーが発生すると終了する。
+ *
+ * @param setting 設定
+ */
+static void monitor_proc(const ApplicationSetting& setting) {
+    auto& stdio = StandardIo::instance();
+
+    /**
+     * ポートごとの受信先
+     */
+    struct MonitorSink {
+        std::string name; // ポート名
+        uint16_t channel; // キャプチャのチャネル番号(ポート名の指定順)
+        std::unique_ptr<SerialPort> port; // シリアルポート
+        LineSplitter splitter; // 行分割(1行の最大長を超えたら改行を受信していなくても書き出す)
+        std::string text; // 書き出す"ポート名: 行"(領域を使い回す)
+    };
+    std::mutex output_lock; // 受信スレッド間で行が混ざらないようにするロック
+
+    std::vector<std::unique_ptr<MonitorSink>> sinks;
+    for (size_t i = 0; i < setting.port_names.size(); i++) {
+        const std::string& port_name = setting.port_names[i];
+        auto sink = std::make_unique<MonitorSink>();
+        (*sink).name = port_name;
+        (*sink).channel = static_cast<uint16_t>(i);
+        (*sink).port = std::make_unique<SerialPort>(port_name);
+        apply_port_setting(*(*sink).port, setting, i);
+        try {
+            (*(*sink).port).open();
+        }
+        catch (std::exception& e) {
+            stdio.print_err("%s: %s\n", port_name.c_str(), e.what());
+            continue;
+        }
+        sinks.push_back(std::move(sink));
+    }
+    if (sinks.empty()) {
+        return;
+    }
+
+    PortEngine engine;
+    for (auto& sink : sinks) {
+        MonitorSink* psink = sink.get();
+        (*psink).splitter.set_handler([&stdio, &output_lock, psink](const char* line, size_t length, bool) {
+            std::string& text = (*psink).text;
+            text.assign((*psink).name);
+            text.append(": ");
+            text.append(line, length);
+            text.push_back('\n');
+            std::lock_guard<std::mutex> lock(output_lock);
+            stdio.write(text.data(), text.length());
+        });
+        engine.add_port(*(*psink).port, [&, psink](const uint8_t* data, uint32_t length) {
+            if (data == nullptr) { // 受信エラー
+                stdio.print_err("%s: %s\n", (*psink).name.c_str(),
+                    get_windows_error_message(GetLastError()).c_str());
+                if (engine.get_active_port_count() == 0) {
+                    SetEvent(ModeChangeEvent);
+                }
+                return;
+            }
+            if (CapturePtr != nullptr) {
+                (*CapturePtr).write((*psink).channel, CaptureFile::DirectionRx, data, length);
+            }
+            (*psink).splitter.feed(data, length);
+        });
+    }
+
+    stdio.print_err("Monitoring %u ports. Press Ctrl-C to quit.\n", static_cast<unsigned int>(sinks.size()));
+    ApplicationMode = AppModeCommunication; // Ctrl-CでModeChangeEventを通知させる。
+    engine.start(setting.receive_threads);
+    WaitForSingleObject(ModeChangeEvent, INFINITE);
+    engine.stop();
+
+    for (auto& sink : sinks) {
+        (*sink).splitter.flush();
+        (*(*sink).port).close();
+        SerialPort::Statistics stats = (*(*sink).port).get_statistics();
+        stdio.print_err("%s: received %llu bytes, %llu line errors\n", (*sink).name.c_str(),
+            static_cast<unsigned long long>(stats.received_bytes),
+            static_cast<unsigned long long>(stats.error_break + stats.error_frame + stats.error_overrun
+                + stats.error_receive_overflow + stats.error_receive_parity));
+    }
+
+    return;
+}
+
+/**
+ * ブリッジモードの処理を行う。
+ * 指定された2つのポートをポートごとの通信設定でオープンし、双方向に中継する。
+ * Ctrl-Cが押されるか、中継でエラーが発生すると終了し、方向ごとの中継統計と追加遅延を表示する。
+ *
+ * @param setting 設定
+ */
+static void bridge_proc(const ApplicationSetting& setting) {
+    auto& stdio = StandardIo::instance();
+    SerialPort port_a(setting.port_names[0]);
+    SerialPort port_b(setting.port_names[1]);
+    apply_port_setting(port_a, setting, 0);
+    apply_port_setting(port_b, setting, 1);
+    port_a.open();
+    port_b.open();
+
+    PortBridge bridge(port_a, port_b, setting.bridge_timeout_millis);
+    bridge.set_capture(CapturePtr.get());
+    bridge.set_error_handler([&stdio, &setting](PortBridge::Direction direction, int error) {
+        const std::string& src = setting.port_names[(direction == PortBridge::DirectionAtoB) ? 0 : 1];
+        stdio.print_err("%s: %s\n", src.c_str(), get_windows_error_message(error).c_str());
+        SetEvent(ModeChangeEvent);
+    });
+    if (!bridge.start()) {
+        throw std::system_error(GetLastError(), windows_error_category());
+    }
+
+    stdio.print_err("Relaying %s <-> %s. Press Ctrl-C to quit.\n",
+        setting.port_names[0].c_str(), setting.port_names[1].c_str());
+    ApplicationMode = AppModeCommunication; // Ctrl-CでModeChangeEventを通知させる。
+    WaitForSingleObject(ModeChangeEvent, INFINITE);
+    bridge.stop();
+    port_a.close();
+    port_b.close();
+
+    for (int i = 0; i < PortBridge::DirectionCount; i++) {
+        PortBridge::Direction direction = static_cast<PortBridge::Direction>(i);
+        PortBridge::Statistics stats = bridge.get_statistics(direction);
+        stdio.print("%s -> %s: %llu bytes, %llu chunks, %llu dropped\n",
+            setting.port_names[i].c_str(), setting.port_names[1 - i].c_str(),
+            static_cast<unsigned long long>(stats.bytes), static_cast<unsigned long long>(stats.chunks),
+            static_cast<unsigned long long>(stats.dropped_bytes));
+        stdio.print("%s\n", bridge.get_latency(direction).format_summary().c_str());
+    }
+
+    return;
+}
+
+/**
+ * Modbusポーリングモードの処理を行う。
+ * 指定されたポートをオープンし、-modbus-pollで指定された要求をModbusRtuMasterで周期的に処理して、
+ * 読み出した値を"slave=スレーブアドレス fc=ファンクションコード addr=開始アドレス: 値..."の形式で標準出力へ書き出す。
+ * Ctrl-Cが押されると終了し、統計と応答時間を表示する。
+ *
+ * @param setting 設定
+ */
+static void modbus_proc(const ApplicationSetting& setting) {
+    static const char* StatusNames[] = {
+        "ok", "exception", "timeout", "crc error", "invalid response", "invalid request", "I/O error"
+    };
+    auto& stdio = StandardIo::instance();
+    SerialPort port(setting.port_names[0]);
+    apply_port_setting(port, setting, 0);
+    port.open();
+
+    ModbusRtuMaster master(port);
+    std::string text; // 書き出す行(領域を使い回す)
+    auto handler = [&stdio, &text](size_t, const ModbusRtuMaster::Request& request, const ModbusRtuMaster::Result& result) {
+        text.assign(format("slave=%u fc=%u addr=%u:", static_cast<unsigned int>(request.slave_id),
+            static_cast<unsigned int>(request.function), static_cast<unsigned int>(request.address)));
+        if (result.status == ModbusRtuMaster::StatusOk) {
+            for (uint16_t value : result.values) {
+                text.append(format(" %04X", static_cast<unsigned int>(value)));
+            }
+        }
+        else if (result.status == ModbusRtuMaster::StatusException) {
+            text.append(format(" exception %u", static_cast<unsigned int>(result.exception_code)));
+        }
         else {
-            std::this_thread::yield(); // 別スレッドにスイッチ
+            text.push_back(' ');
+            text.append(StatusNames[result.status]);
+        }
+        text.push_back('\n');
+        stdio.write(text.data(), text.length());
+    };
+
+    stdio.print_err("Polling %u requests every %u ms on %s. Press Ctrl-C to quit.\n",
+        static_cast<unsigned int>(setting.modbus_requests.size()), setting.modbus_interval_millis, setting.port_names[0].c_str());
+    ApplicationMode = AppModeCommunication; // Ctrl-CでModeChangeEventを通知させる。
+    while (true) {
+        auto next_time = std::chrono::steady_clock::now() + std::chrono::milliseconds(setting.modbus_interval_millis);
+        master.poll(setting.modbus_requests, handler);
+        auto remain = std::chrono::duration_cast<std::chrono::milliseconds>(next_time - std::chrono::steady_clock::now()).count();
+        if (WaitForSingleObject(ModeChangeEvent, (remain > 0) ? static_cast<DWORD>(remain) : 0) == WAIT_OBJECT_0) {
+            break;
         }
     }
+    port.close();
+
+    const ModbusRtuMaster::Statistics& stats = master.get_statistics();
+    stdio.print("requests=%llu responses=%llu exceptions=%llu timeouts=%llu crc_errors=%llu invalid=%llu\n",
+        static_cast<unsigned long long>(stats.requests), static_cast<unsigned long long>(stats.responses),
+        static_cast<unsigned long long>(stats.exceptions), static_cast<unsigned long long>(stats.timeouts),
+        static_cast<unsigned long long>(stats.crc_errors), static_cast<unsigned long long>(stats.invalid_responses));
+    stdio.print("%s\n", master.get_latency().format_summary().c_str());
 
-    return ;
+    return;
+}
+
+/**
+ * キャプチャを開始する(--captureオプション指定時のみ)。
+ * 失敗した場合には std::system_error を投げる。
+ *
+ * @param setting 設定
+ */
+static void start_capture(const ApplicationSetting& setting) {
+    if (setting.capture_path.empty()) {
+        return;
+    }
+    CapturePtr = std::make_unique<CaptureFile>(setting.capture_path,
+        static_cast<uint64_t>(setting.capture_file_mib) * 1024 * 1024);
+    (*CapturePtr).open();
+
+    if (setting.output_overflow == OutputBuffer::OverflowSpill) {
+        // 標準出力に書き出せなかった分を別のキャプチャファイルに記録する。replay ... displayで再生できる。
+        SpillCapturePtr = std::make_unique<CaptureFile>(setting.capture_path + ".spill",
+            static_cast<uint64_t>(setting.capture_file_mib) * 1024 * 1024);
+        (*SpillCapturePtr).open();
+        StandardIo::instance().set_output_overflow_policy(OutputBuffer::DefaultQueueLimit, OutputBuffer::OverflowSpill,
+            [](const void* data, size_t length) {
+                return (*SpillCapturePtr).write(0, CaptureFile::DirectionRx, static_cast<const uint8_t*>(data), static_cast<uint32_t>(length));
+            });
+    }
+}
+
+/**
+ * キャプチャを終了し、記録したレコード数などを表示する。
+ */
+static void stop_capture(void) {
+    if (SpillCapturePtr != nullptr) {
+        StandardIo::instance().set_output_overflow_policy(OutputBuffer::DefaultQueueLimit, OutputBuffer::OverflowBlock);
+        (*SpillCapturePtr).close();
+        SpillCapturePtr.reset();
+    }
+    if (CapturePtr == nullptr) {
+        return;
+    }
+    (*CapturePtr).close();
+    StandardIo::instance().print_err("Captured %llu records (%llu bytes, %llu dropped) in %llu files.\n",
+        static_cast<unsigned long long>((*CapturePtr).get_record_count()),
+        static_cast<unsigned long long>((*CapturePtr).get_data_bytes()),
+        static_cast<unsigned long long>((*CapturePtr).get_dropped_count()),
+        static_cast<unsigned long long>((*CapturePtr).get_file_count()));
+    CapturePtr.reset();
 }
 
 
@@ -612,8 +1588,8 @@ static void cmd_open(arg_t& args) {
         ApplicationMode = AppModeCommunication;
         stdio.set_line_input_mode(false);
     }
-    catch (std::exception e) {
-        stdio.print_err(e.what());
+    catch (const std::exception& e) {
+        stdio.print_err("%s\n", e.what());
     }
 }
 
@@ -630,7 +1606,7 @@ static void cmd_baudrate(arg_t& args) {
             (*SerialPortPtr).set_baudrate(baudrate);
         }
         else {
-            stdio.print_err("Invalid baudrate %s\n", args[1]);
+            stdio.print_err("Invalid baudrate %s\n", args[1].c_str());
         }
     }
     else {
@@ -653,7 +1629,7 @@ static void cmd_parity(arg_t& args) {
             (*SerialPortPtr).set_parity(parity);
         }
         else {
-            stdio.print_err("Invalid parity value. %s\n", args[1]);
+            stdio.print_err("Invalid parity value. %s\n", args[1].c_str());
         }
     }
     else {
@@ -663,3 +1639,265 @@ static void cmd_parity(arg_t& args) {
         }
     }
 }
+
+/**
+ * stats コマンドを処理する。
+ *
+ * @param args 引数
+ */
+static void cmd_stats(arg_t& args) {
+    auto& stdio = StandardIo::instance();
+    if (args.size() >= 2) {
+        if (args[1] == "reset") {
+            (*SerialPortPtr).reset_statistics();
+            stdio.reset_statistics();
+            SendQueueMaxDepth = 0;
+            SendQueuePortWaits = 0;
+            if (FrameCodecPtr != nullptr) {
+                (*FrameCodecPtr).reset_statistics();
+            }
+        }
+        else {
+            stdio.print_err("Invalid argument. %s\n", args[1].c_str());
+        }
+        return;
+    }
+
+    SerialPort::Statistics port_stats = (*SerialPortPtr).get_statistics();
+    StandardIo::Statistics stdio_stats = stdio.get_statistics();
+    const struct {
+        const char* name;
+        uint64_t value;
+    } Entries[] = {
+        { "serial.sent_bytes", port_stats.sent_bytes },
+        { "serial.send_calls", port_stats.send_calls },
+        { "serial.send_timeouts", port_stats.send_timeouts },
+        { "serial.received_bytes", port_stats.received_bytes },
+        { "serial.receive_calls", port_stats.receive_calls },
+        { "serial.receive_timeouts", port_stats.receive_timeouts },
+        { "serial.wait_io", port_stats.wait_io_count },
+        { "serial.error_break", port_stats.error_break },
+        { "serial.error_frame", port_stats.error_frame },
+        { "serial.error_overrun", port_stats.error_overrun },
+        { "serial.error_rx_overflow", port_stats.error_receive_overflow },
+        { "serial.error_rx_parity", port_stats.error_receive_parity },
+        { "serial.rx_queue_max", port_stats.receive_queue_max },
+        { "serial.tx_queue_max", port_stats.send_queue_max },
+        { "send_queue.depth_max", SendQueueMaxDepth },
+        { "send_queue.port_waits", SendQueuePortWaits },
+        { "stdin.bytes", stdio_stats.input_bytes },
+        { "stdin.reads", stdio_stats.input_reads },
+        { "stdin.buffer_max", stdio_stats.input_buffer_max },
+        { "stdin.stalls", stdio_stats.input_stalls },
+        { "stdout.bytes", stdio_stats.output_bytes },
+        { "stdout.requests", stdio_stats.output_requests },
+        { "stdout.writes", stdio_stats.output_writes },
+        { "stdout.errors", stdio_stats.output_errors },
+        { "stdout.blocked", stdio_stats.output_blocked },
+        { "stdout.dropped_bytes", stdio_stats.output_dropped_bytes },
+        { "stdout.spilled_bytes", stdio_stats.output_spilled_bytes },
+        { "stdout.queue_max", stdio_stats.output_queue_max },
+    };
+    for (auto& entry : Entries) {
+        stdio.print("%-24s %llu\n", entry.name, static_cast<unsigned long long>(entry.value));
+    }
+    if (FrameCodecPtr != nullptr) {
+        const FrameCodec::Statistics& frame_stats = (*FrameCodecPtr).get_statistics();
+        stdio.print("%-24s %llu\n", "frame.frames", static_cast<unsigned long long>(frame_stats.frames));
+        stdio.print("%-24s %llu\n", "frame.bytes", static_cast<unsigned long long>(frame_stats.frame_bytes));
+        stdio.print("%-24s %llu\n", "frame.errors", static_cast<unsigned long long>(frame_stats.error_frames));
+        stdio.print("%-24s %llu\n", "frame.oversize", static_cast<unsigned long long>(frame_stats.oversize_frames));
+        stdio.print("%-24s %llu\n", "frame.crc_errors", static_cast<unsigned long long>(frame_stats.crc_errors));
+    }
+
+    return;
+}
+
+/**
+ * latency コマンドを処理する。
+ *
+ * @param args 引数
+ */
+static void cmd_latency(arg_t& args) {
+    auto& stdio = StandardIo::instance();
+    if (args.size() >= 2) {
+        if (args[1] == "reset") {
+            RxDispatchLatency.reset();
+            RxConsoleWriteLatency.reset();
+            RxTotalLatency.reset();
+        }
+        else {
+            stdio.print_err("Invalid argument. %s\n", args[1].c_str());
+        }
+        return;
+    }
+
+    print_latency();
+
+    return;
+}
+
+/**
+ * 受信遅延ヒストグラムの集計結果を表示する。
+ */
+static void print_latency(void) {
+    auto& stdio = StandardIo::instance();
+    stdio.print("%s\n", RxDispatchLatency.format_summary().c_str());
+    stdio.print("%s\n", RxConsoleWriteLatency.format_summary().c_str());
+    stdio.print("%s\n", RxTotalLatency.format_summary().c_str());
+
+    return;
+}
+
+/**
+ * display コマンドを処理する。
+ * rawは受信データをそのまま書き出し、hexは16進/ASCIIダンプで表示する。
+ * hexの後にoffset, timeを指定すると、行頭にオフセット、受信時刻を表示する。
+ * 引数が無い場合は現在の設定を表示する。
+ * フレーム処理する場合はフレームごとの16進表示になり、この設定は使用しない。
+ *
+ * @param args 引数
+ */
+static void cmd_display(arg_t& args) {
+    auto& stdio = StandardIo::instance();
+    if (args.size() < 2) {
+        if (HexDumperPtr == nullptr) {
+            stdio.print("raw\n");
+        }
+        else {
+            stdio.print("hex%s%s\n", (*HexDumperPtr).is_show_offset() ? " offset" : "",
+                (*HexDumperPtr).is_show_timestamp() ? " time" : "");
+        }
+        return;
+    }
+
+    if (args[1] == "raw") {
+        set_hexdump(false, false, false);
+    }
+    else if (args[1] == "hex") {
+        bool is_show_offset = false;
+        bool is_show_timestamp = false;
+        for (size_t i = 2; i < args.size(); i++) {
+            if (args[i] == "offset") {
+                is_show_offset = true;
+            }
+            else if (args[i] == "time") {
+                is_show_timestamp = true;
+            }
+            else {
+                stdio.print_err("Invalid argument. %s\n", args[i].c_str());
+                return;
+            }
+        }
+        set_hexdump(true, is_show_offset, is_show_timestamp);
+    }
+    else {
+        stdio.print_err("Invalid argument. %s\n", args[1].c_str());
+    }
+
+    return;
+}
+
+/**
+ * replay コマンドを処理する。
+ * -captureで記録したファイルを再生する。
+ * sendはシリアルポートから送信し、displayは受信データと同じように標準出力へ書き出す。
+ * 速度は1で記録時と同じ間隔、0で待たずに再生する。
+ * 方向の既定値はsendでは送信データ(tx)、displayでは受信データ(rx)。
+ *
+ * @param args 引数
+ */
+static void cmd_replay(arg_t& args) {
+    auto& stdio = StandardIo::instance();
+    if (args.size() < 3) {
+        stdio.print_err("Usage: replay path send|display [speed] [rx|tx|all]\n");
+        return;
+    }
+    bool is_send;
+    if (args[2] == "send") {
+        is_send = true;
+    }
+    else if (args[2] == "display") {
+        is_send = false;
+    }
+    else {
+        stdio.print_err("Invalid argument. %s\n", args[2].c_str());
+        return;
+    }
+    double speed = 1.0;
+    if (args.size() >= 4) {
+        char* endp;
+        speed = strtod(args[3].c_str(), &endp);
+        if ((endp == args[3].c_str()) || (*endp != '\0') || (speed < 0.0)) {
+            stdio.print_err("Invalid speed. %s\n", args[3].c_str());
+            return;
+        }
+    }
+    int direction = (is_send) ? CaptureFile::DirectionTx : CaptureFile::DirectionRx;
+    if (args.size() >= 5) {
+        if (args[4] == "rx") {
+            direction = CaptureFile::DirectionRx;
+        }
+        else if (args[4] == "tx") {
+            direction = CaptureFile::DirectionTx;
+        }
+        else if (args[4] == "all") {
+            direction = 0;
+        }
+        else {
+            stdio.print_err("Invalid direction. %s\n", args[4].c_str());
+            return;
+        }
+    }
+
+    SerialPort& port = (*SerialPortPtr);
+    SessionReplayer replayer(speed);
+    replayer.set_filter(SessionReplayer::AllChannels, direction);
+    try {
+        CaptureReader reader(args[1]);
+        reader.open();
+        if (is_send) {
+            port.open();
+        }
+        {
+            std::lock_guard<std::mutex> lock(ReplayerLock);
+            ActiveReplayer = &replayer;
+        }
+        bool is_completed = replayer.run(reader, [is_send, &stdio, &port](const CaptureReader::Record& record) {
+            if (record.data.empty()) {
+                return true;
+            }
+            if (is_send) {
+                if (port.send(&record.data[0], static_cast<uint32_t>(record.data.size())) < 0) {
+                    stdio.print_err("%s\n", get_windows_error_message(GetLastError()).c_str());
+                    return false;
+                }
+            }
+            else {
+                display_received(&record.data[0], record.data.size(), std::chrono::steady_clock::now());
+            }
+            return true;
+        });
+        if (!is_completed) {
+            stdio.print_err("Replay stopped.\n");
+        }
+    }
+    catch (std::exception& e) {
+        stdio.print_err("%s\n", e.what());
+    }
+    {
+        std::lock_guard<std::mutex> lock(ReplayerLock);
+        ActiveReplayer = nullptr;
+    }
+    if (is_send) {
+        port.close();
+    }
+
+    stdio.print("replay.records           %llu\n", static_cast<unsigned long long>(replayer.get_record_count()));
+    stdio.print("replay.bytes             %llu\n", static_cast<unsigned long long>(replayer.get_data_bytes()));
+    if (speed > 0.0) {
+        stdio.print("%s\n", replayer.get_lateness().format_summary().c_str());
+    }
+
+    return;
+}
@@ -1,5 +1,10 @@
+#ifdef _WIN32
 #include <Windows.h>
 #include <shlwapi.h>
+#else
+#include <unistd.h>
+#include <climits>
+#endif
 
 #include <cstdlib>
 #include <cstring>
@@ -8,7 +13,9 @@
 
 #include "utils.h"
 
+#ifdef _WIN32
 #pragma comment(lib, "Shlwapi.lib")
+#endif
 
 
 bool parse_ui32(const std::string& str, uint32_t* pvalue) {
@@ -40,6 +47,38 @@ bool parse_i32(const char* str, int32_t* pvalue) {
     }
 }
 
+bool parse_hex_bytes(const std::string& str, std::vector<uint8_t>* pbytes) {
+    std::vector<uint8_t>& bytes = *pbytes;
+    bytes.clear();
+    int high = -1; // 上位4ビット(-1で未読)
+    for (char c : str) {
+        int value;
+        if ((c >= '0') && (c <= '9')) {
+            value = c - '0';
+        }
+        else if ((c >= 'a') && (c <= 'f')) {
+            value = c - 'a' + 10;
+        }
+        else if ((c >= 'A') && (c <= 'F')) {
+            value = c - 'A' + 10;
+        }
+        else if ((c == ' ') || (c == '\t') || (c == '\r') || (c == '\n')) {
+            continue;
+        }
+        else {
+            return false;
+        }
+        if (high < 0) {
+            high = value;
+        }
+        else {
+            bytes.push_back(static_cast<uint8_t>((high << 4) | value));
+            high = -1;
+        }
+    }
+
+    return (high < 0);
+}
 
 std::string strtrim(const std::string& str, const std::string& delim) {
     std::string::size_type begin_pos = str.find_first_not_of(delim);
@@ -77,18 +116,18 @@ void make_argv(char* str, argchar_t* pargv, const char* delim) {
 
     char* p = str;
     while ((p != nullptr) && (*p != '\0')) {
-        while ((p != nullptr) && (*p != '\0')  // p͖łȂH
-            && (strchr(delim, *p) != nullptr)) { // p̓f~^H
+        while ((p != nullptr) && (*p != '\0')  // pは末尾でない？
+            && (strchr(delim, *p) != nullptr)) { // pはデリミタ？
             p++;
         }
         if (*p == '\0') {
             break;
         }
         char* begin = p;
-        if ((*begin == '\'') // VONH[e[VH
-            || (*begin == '"')) { // _uNH[e[VH
+        if ((*begin == '\'') // シングルクォーテーション？
+            || (*begin == '"')) { // ダブルクォーテーション？
             char c = *begin;
-            char* end = strchr(begin + 1, c); // ̃VO/_uNH[e[VT
+            char* end = strchr(begin + 1, c); // 次のシングル/ダブルクォーテーションを探す
             if (end != nullptr) {
                 *begin = '\0';
                 begin++;
@@ -101,8 +140,8 @@ void make_argv(char* str, argchar_t* pargv, const char* delim) {
             }
         }
         else {
-            while ((p != nullptr) && (*p != '\0') // I[łȂH
-                && (strchr(delim, *p) == nullptr)) { // f~^ɕsvH
+            while ((p != nullptr) && (*p != '\0') // 終端でない？
+                && (strchr(delim, *p) == nullptr)) { // デリミタに不一致？
                 p++;
             }
             (*pargv).push_back(begin);
@@ -163,6 +202,7 @@ void make_argv(const std::string& str, arg_t* pargv, const std::string& delim) {
 }
 
 std::string get_process_filename(void) {
+#ifdef _WIN32
     char path[MAX_PATH];
     DWORD size = GetModuleFileNameA(nullptr, path, sizeof(path));
     path[sizeof(path) - 1] = '\0';
@@ -170,7 +210,50 @@ std::string get_process_filename(void) {
     std::string filename(PathFindFileNameA(path));
 
     return filename;
+#else
+    char path[PATH_MAX];
+    ssize_t size = readlink("/proc/self/exe", path, sizeof(path) - 1);
+    if (size < 0) {
+        return std::string("");
+    }
+    path[size] = '\0';
+
+    const char* filename = strrchr(path, '/');
+    return std::string((filename != nullptr) ? (filename + 1) : path);
+#endif
+}
+const char* vformat_local(size_t* pout_length, const char* fmt, va_list args) {
+    thread_local std::vector<char> buffer(256);
+
+    va_list args_copy;
+    va_copy(args_copy, args);
+    int len = vsnprintf(buffer.data(), buffer.size(), fmt, args_copy);
+    va_end(args_copy);
+    if (len < 0) {
+        return nullptr;
+    }
+    if (static_cast<size_t>(len) >= buffer.size()) { // 入りきらなかった？
+        buffer.resize(static_cast<size_t>(len) + 1);
+        vsnprintf(buffer.data(), buffer.size(), fmt, args);
+    }
+
+    (*pout_length) = static_cast<size_t>(len);
+    return buffer.data();
 }
+
+std::string format(const char* fmt, ...) {
+    if (fmt == nullptr) {
+        return std::string("");
+    }
+
+    va_list args;
+    va_start(args, fmt);
+    size_t len = 0;
+    const char* str = vformat_local(&len, fmt, args);
+    va_end(args);
+    return (str != nullptr) ? std::string(str, len) : std::string("");
+}
+
 bool parse_value(const StringValueList& list, const std::string& str, uint32_t* pvalue)
 {
     return parse_value(list, str.c_str(), pvalue);
@@ -181,7 +264,7 @@ bool parse_value(const StringValueList& list, const char* str, uint32_t* pvalue)
         return false;
     }
 
-    auto it = find_if(list.begin(), list.end(), [str](const StringValueEntry& entry) { return strcmp(str, entry.name); });
+    auto it = find_if(list.begin(), list.end(), [str](const StringValueEntry& entry) { return strcmp(str, entry.name) == 0; });
     if (it == list.end()) {
         return false;
     }
@@ -194,6 +277,7 @@ StringValueList::const_iterator find_value(const StringValueList& list, uint32_t
     return std::find_if(list.begin(), list.end(), [value](const StringValueEntry& entry) { return entry.value == value; });
 }
 
+#ifdef _WIN32
 const std::string get_windows_error_message(int error_code) {
     LPSTR lpMsgBuf;
     if (FormatMessageA(FORMAT_MESSAGE_ALLOCATE_BUFFER | FORMAT_MESSAGE_FROM_SYSTEM | FORMAT_MESSAGE_IGNORE_INSERTS,
@@ -207,4 +291,5 @@ const std::string get_windows_error_message(int error_code) {
         LocalFree(lpMsgBuf);
         return error_message;
     }
-}
\ No newline at end of file
+}
+#endif
@@ -7,153 +7,189 @@
 #include <string>
 
 /**
- * str͂ĕ32bit𓾂B
+ * strを解析して符号無し32bit整数を得る。
  * 
- * @param str 
- * @param pvalue i[ϐ
- * @retval true 
- * @retval false s
+ * @param str 文字列
+ * @param pvalue 符号無し整数を格納する変数
+ * @retval true 成功
+ * @retval false 失敗
  */
 bool parse_ui32(const std::string& str, uint32_t* pvalue);
 /**
- * str͂ĕ32bit𓾂B
+ * strを解析して符号無し32bit整数を得る。
  *
- * @param str 
- * @param pvalue i[ϐ
- * @retval true 
- * @retval false s
+ * @param str 文字列
+ * @param pvalue 符号無し整数を格納する変数
+ * @retval true 成功
+ * @retval false 失敗
  */
 bool parse_ui32(const char* str, uint32_t* pvalue);
 /**
- * str͂ĕ32bit𓾂B
+ * strを解析して符号あり32bit整数を得る。
  *
- * @param str 
- * @param pvalue 萮i[ϐ
- * @retval true 
- * @retval false s
+ * @param str 文字列
+ * @param pvalue 符号あり整数を格納する変数
+ * @retval true 成功
+ * @retval false 失敗
  */
 bool parse_i32(const std::string& str, int32_t* pvalue);
 /**
- * str͂ĕ32bit𓾂B
+ * strを解析して符号あり32bit整数を得る。
  *
- * @param str 
- * @param pvalue 萮i[ϐ
- * @retval true 
- * @retval false s
+ * @param str 文字列
+ * @param pvalue 符号あり整数を格納する変数
+ * @retval true 成功
+ * @retval false 失敗
  */
 bool parse_i32(const char* str, int32_t* pvalue);
+/**
+ * 16進数のバイト列("01 ab 2C"や"01ab2c")を解析する。
+ * 空白(スペース、タブ、改行)は読み飛ばす。
+ *
+ * @param str 文字列
+ * @param pbytes バイト列を格納する変数
+ * @retval true 成功
+ * @retval false 失敗(16進数以外の文字を含む、または桁数が奇数)
+ */
+bool parse_hex_bytes(const std::string& str, std::vector<uint8_t>* pbytes);
 
 /**
- *  str̐擪ƖɂdelimɊ܂܂镶ĕԂB
+ *  strの先頭と末尾にあるdelimに含まれる文字を除いて返す。
  *
- * @param str 
- * @param delim f~^
- * @retval delimꂽB
+ * @param str 文字列
+ * @param delim デリミタ
+ * @retval delimが除かれた文字列。
  */
 std::string strtrim(const std::string& str, const std::string &delim = std::string(" \t\r\n"));
 /**
- *  str̐擪ƖɂdelimɊ܂܂镶ĕԂB
+ *  strの先頭と末尾にあるdelimに含まれる文字を除いて返す。
  *
- * @param str 
- * @param delim f~^
- * @retval delimꂽB
+ * @param str 文字列
+ * @param delim デリミタ
+ * @retval delimが除かれた文字列。
  */
 char* strtrim(char* str, const char* delim = " \t\r\n");
 
 typedef std::vector<char*> argchar_t;
 /**
- * strg[NB
+ * strをトークン分割する。
  *
- * @param str 
- * @param pargv g[Ni[郊Xg
- * @param delim f~^
+ * @param str 文字列
+ * @param pargv 分割したトークンを格納するリスト
+ * @param delim デリミタ
  */
 void make_argv(char* str, argchar_t* pargv, const char *delim = " \t\r\n");
 
 typedef std::vector<std::string> arg_t;
 /**
- * strg[NB
+ * strをトークン分割する。
  *
- * @param str 
- * @param pargv g[Ni[z
- * @param delim Ɏgp؂蕶̏W
+ * @param str 文字列
+ * @param pargv 分割したトークンを格納する配列
+ * @param delim 分割に使用する区切り文字の集合
  */
 void make_argv(const std::string& str, arg_t* pargv, const std::string &delim = std::string(" \t\r\n"));
 
 /**
- * vZX̃t@C𓾂B
+ * プロセスのファイル名を得る。
  *
- * Note: [fBNg(pXMAX_PATH𒴂P[X)ł́A삵ȂB
+ * Note: 深いディレクトリ(パス文字列がMAX_PATHを超えるケース)では、正しく動作しない。
  *
- * @retval vZX̃t@CB
+ * @retval プロセスのファイル名。
  */
 std::string get_process_filename(void);
 
 
 /**
- * w肵ĕ𐶐B
- * C++11pB
+ * printf形式の書式指定を検査する関数属性。
+ * GCC/Clangでは、可変引数の型が書式と一致しない場合にコンパイル時に警告する。
+ * fmt_indexとargs_indexは1から数える(メンバ関数ではthisが1番目)。
+ */
+#if defined(__GNUC__)
+#define ATTRIBUTE_PRINTF(fmt_index, args_index) __attribute__((format(printf, fmt_index, args_index)))
+#else
+#define ATTRIBUTE_PRINTF(fmt_index, args_index)
+#endif
+
+/**
+ * printf形式の書式であることを示すSAL注釈。
+ * MSVCではコード分析(/analyze)で可変引数の型を検査する。
+ */
+#if defined(_MSC_VER)
+#include <sal.h>
+#define PRINTF_FORMAT_STRING _Printf_format_string_
+#else
+#define PRINTF_FORMAT_STRING
+#endif
+
+/**
+ * 書式指定した文字列を、スレッドごとに使い回すバッファに生成する。
+ * 通常はvsnprintfを1回呼ぶだけで、バッファより長い文字列を初めて生成したときだけバッファを拡張する。
+ *
+ * @param pout_length 生成した文字列の長さ(終端を含まない)を格納する変数
+ * @param fmt フォーマット
+ * @param args パラメータ
+ * @retval 生成した文字列。同じスレッドで次に呼び出すまで有効。書式が不正な場合はnullptr。
+ */
+const char* vformat_local(size_t* pout_length, const char* fmt, va_list args);
+
+/**
+ * 書式指定して文字列を生成する。
+ * vformat_local()で生成してからstd::stringにするので、メモリ確保はstd::stringの1回だけ。
  * 
- * https://pyopyopyo.hatenablog.com/entry/2019/02/08/102456 QlɂĂB
- * Note: C++11pB C++20 łstd::format()̂łgׂB
- */
-template <typename ... Args>
-std::string format(const char* fmt, Args ... args)
-{
-    if (fmt != nullptr) {
-        size_t len = snprintf(nullptr, 0, fmt, args ...);
-        std::vector<char> buf(len + 1);
-        snprintf(&buf[0], len + 1, fmt, args ...);
-        return std::string(&buf[0], &buf[0] + len);
-    }
-    else {
-        return std::string("");
-    }
-}
+ * https://pyopyopyo.hatenablog.com/entry/2019/02/08/102456 を参考にさせていただいた。
+ * Note: C++11用。 C++20 ではstd::format()があるのでそちらを使うべき。
+ *
+ * @param fmt フォーマット
+ * @retval 生成した文字列
+ */
+std::string format(PRINTF_FORMAT_STRING const char* fmt, ...) ATTRIBUTE_PRINTF(1, 2);
 
 /**
- *   32bit yAɂlGgB
- * O(gp)ƂI/F͕ƂāAvOł͐lň߂̕ϊe[upGgB
+ * 文字列 と 32bit符号無し整数 をペアにした値エントリ。
+ * 外部(使用者)とのI/Fは文字列として、プログラム内部では数値で扱うための変換テーブル用エントリ。
  */
 struct StringValueEntry {
-    const char* name; // lɑΉ镶
-    uint32_t value; // l
+    const char* name; // 値に対応する文字列
+    uint32_t value; // 値
 };
 typedef std::vector<StringValueEntry> StringValueList;
 
 /**
- * listɑ΂āAstrvGgAvlԂB
+ * listに対して、strが一致するエントリを検索し、一致した値を返す。
  *
- * @param list Xg
- * @param str 
- * @param pvalue li[ϐ
- * @retval true ꍇ
- * @retval false Ȃꍇ
+ * @param list リスト
+ * @param str 文字列
+ * @param pvalue 値を格納する変数
+ * @retval true 見つかった場合
+ * @retval false 見つからない場合
  */
 bool parse_value(const StringValueList& list, const std::string& str, uint32_t* pvalue);
 /**
- * listɑ΂āAstrvGgAvlԂB
+ * listに対して、strが一致するエントリを検索し、一致した値を返す。
  *
- * @param list Xg
- * @param str 
- * @param pvalue li[ϐ
- * @retval true ꍇ
- * @retval false Ȃꍇ
+ * @param list リスト
+ * @param str 文字列
+ * @param pvalue 値を格納する変数
+ * @retval true 見つかった場合
+ * @retval false 見つからない場合
  */
 bool parse_value(const StringValueList& list, const char* str, uint32_t* pvalue);
 /**
- * listɑ΂āAvaluevGgAvlԂB
+ * listに対して、valueが一致するエントリを検索し、一致した値を返す。
  * 
- * @param list Xg
- * @param value l
- * @retval Ce[^B ꍇ͗LȃCe[^BȂꍇɂlist.end()ԂB
+ * @param list リスト
+ * @param value 値
+ * @retval イテレータ。 見つかった場合は有効なイテレータ。見つからない場合にはlist.end()を返す。
  */
 StringValueList::const_iterator find_value(const StringValueList& list, uint32_t value);
 
+#ifdef _WIN32
 /**
- * Windows̃G[bZ[W𓾂B
+ * Windowsのエラーメッセージを得る。
  *
- * @param error_code G[R[h
- * @retval G[bZ[W
+ * @param error_code エラーコード
+ * @retval エラーメッセージ
  */
 const std::string get_windows_error_message(int error_code);
+#endif
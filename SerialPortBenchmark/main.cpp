@@ -0,0 +1,2967 @@
+﻿// SerialPortBenchmark.cpp : SerialPort の性能を計測するベンチマーク。
+//
+// Linuxでは次のようにビルドすると、疑似端末(pty)のループバックで計測できる。
+//   $ cd SerialPortBenchmark
+//   $ SRC=../ComPortCommunicationSample
+//   $ g++ -std=c++17 -O2 -pthread -I$SRC main.cpp $SRC/SerialPortPosix.cpp $SRC/SendQueue.cpp $SRC/PortEngine.cpp $SRC/PortBridge.cpp $SRC/LatencyHistogram.cpp $SRC/CaptureFile.cpp $SRC/CaptureReader.cpp $SRC/SessionReplayer.cpp $SRC/FrameCodec.cpp $SRC/Crc.cpp $SRC/ModbusRtu.cpp $SRC/ModbusRtuMaster.cpp $SRC/ModbusSlaveSimulator.cpp $SRC/TransactionEngine.cpp $SRC/LineSplitter.cpp $SRC/CrlfNormalizer.cpp $SRC/HexDumper.cpp $SRC/OutputBuffer.cpp $SRC/ByteScan.cpp $SRC/app_error.cpp $SRC/PtyPair.cpp $SRC/utils.cpp -o SerialPortBenchmark
+//   $ ./SerialPortBenchmark loopback pty
+//
+// 結果は"ベンチマーク名: key=value ..."の形式で標準出力に出力する。
+// 先頭に-jsonオプションを指定すると、1レコード1行のJSON(JSON Lines)で出力する。
+//   $ ./SerialPortBenchmark -json suite pty > result.jsonl
+//
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <sys/resource.h>
+#endif
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <ctime>
+#include <chrono>
+#include <algorithm>
+#include <string>
+#include <sstream>
+#include <vector>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <SerialPort.h>
+#include <SendQueue.h>
+#include <PortEngine.h>
+#include <PortBridge.h>
+#include <CaptureFile.h>
+#include <CaptureReader.h>
+#include <SessionReplayer.h>
+#include <FrameCodec.h>
+#include <Crc.h>
+#include <ModbusRtuMaster.h>
+#include <TransactionEngine.h>
+#include <LineSplitter.h>
+#include <CrlfNormalizer.h>
+#include <HexDumper.h>
+#include <OutputBuffer.h>
+#include <utils.h>
+#ifndef _WIN32
+#include <poll.h>
+#include <unistd.h>
+#include <PtyPair.h>
+#include <ModbusSlaveSimulator.h>
+#endif
+
+struct BenchmarkEntry {
+    const char* name; // ベンチマーク名
+    const char* usage; // 引数の説明
+    int (*proc)(const arg_t& args); // 処理
+};
+
+/**
+ * 結果の出力形式
+ */
+enum ResultFormat {
+    ResultFormatText, // "ベンチマーク名: key=value ..."
+    ResultFormatJson // JSON Lines
+};
+
+/**
+ * 計測結果の1レコード
+ * add_xxx()で項目を追加し、print()で出力形式に従って標準出力へ出力する。
+ */
+class ResultRecord {
+public:
+    /**
+     * コンストラクタ
+     *
+     * @param benchmark ベンチマーク名
+     */
+    explicit ResultRecord(const char* benchmark) : m_benchmark(benchmark) { }
+    /**
+     * 文字列の項目を追加する。
+     *
+     * @param key 項目名
+     * @param value 値
+     * @retval このレコード
+     */
+    ResultRecord& add_string(const char* key, const std::string& value) {
+        m_fields.push_back(Field(key, value, true));
+        return *this;
+    }
+    /**
+     * 整数の項目を追加する。
+     *
+     * @param key 項目名
+     * @param value 値
+     * @retval このレコード
+     */
+    ResultRecord& add_integer(const char* key, int64_t value) {
+        m_fields.push_back(Field(key, format("%lld", static_cast<long long>(value)), false));
+        return *this;
+    }
+    /**
+     * 実数の項目を追加する。
+     *
+     * @param key 項目名
+     * @param value 値
+     * @param precision 小数点以下の桁数
+     * @retval このレコード
+     */
+    ResultRecord& add_real(const char* key, double value, int precision = 3) {
+        m_fields.push_back(Field(key, format("%.*f", precision, std::isfinite(value) ? value : 0.0), false));
+        return *this;
+    }
+    /**
+     * 出力する。
+     */
+    void print(void) const;
+
+private:
+    struct Field {
+        std::string key; // 項目名
+        std::string value; // 値(文字列化したもの)
+        bool is_string; // 文字列項目かどうか
+        Field(const char* k, const std::string& v, bool s) : key(k), value(v), is_string(s) { }
+    };
+    std::string m_benchmark; // ベンチマーク名
+    std::vector<Field> m_fields; // 項目
+};
+
+/**
+ * 結果の出力形式
+ */
+static ResultFormat OutputFormat = ResultFormatText;
+
+static int bench_idle(const arg_t& args);
+static int bench_loopback(const arg_t& args);
+static int bench_stream(const arg_t& args);
+static int bench_send_queue(const arg_t& args);
+static int bench_capture(const arg_t& args);
+static int bench_replay(const arg_t& args);
+static int bench_framing(const arg_t& args);
+static int bench_crc(const arg_t& args);
+static int bench_lines(const arg_t& args);
+static int bench_crlf(const arg_t& args);
+static int bench_format(const arg_t& args);
+static int bench_hexdump(const arg_t& args);
+static int bench_output(const arg_t& args);
+static int bench_output_stall(const arg_t& args);
+#ifndef _WIN32
+static int bench_engine(const arg_t& args);
+static int bench_bridge(const arg_t& args);
+static int bench_backpressure(const arg_t& args);
+static int bench_modbus(const arg_t& args);
+static int bench_transaction(const arg_t& args);
+#endif
+#ifdef _WIN32
+static int bench_app(const arg_t& args);
+static double get_process_cpu_seconds(HANDLE process);
+#endif
+static double get_process_cpu_seconds(void);
+static int bench_suite(const arg_t& args);
+static void print_usage(const char* pname);
+static std::string escape_json(const std::string& s);
+static double get_percentile(const std::vector<double>& sorted_values, double percent);
+
+static const std::vector<BenchmarkEntry> BenchmarkEntries = {
+    { "idle", "port_name [seconds] [timeout_millis] - Measure CPU usage while waiting for idle line.", bench_idle },
+    { "loopback", "port_name|pty [total_bytes] [chunk_size] - Measure send/receive throughput over loopback.", bench_loopback },
+    { "suite", "port_name|pty [total_bytes] [rtt_count] [baudrate] - Measure throughput for several chunk sizes and timeouts, and round-trip latency.", bench_suite },
+    { "stream", "port_name|pty [total_bytes] [buffer_count] [buffer_size] [baudrate] - Measure streaming receive throughput and line errors over loopback.", bench_stream },
+    { "sendqueue", "port_name|pty [total_bytes] [chunk_size] - Compare direct send() of small chunks with SendQueue over loopback.", bench_send_queue },
+    { "capture", "base_path [thread_count] [total_bytes] [chunk_size] [rate_kib_s] [file_size] - Measure CaptureFile write throughput, latency and dropped records from several threads.", bench_capture },
+    { "replay", "base_path [record_count] [interval_us] [chunk_size] - Measure SessionReplayer throughput at max speed and timing error at 1x/10x speed.", bench_replay },
+    { "framing", "[total_bytes] [frame_size] - Measure COBS/SLIP encode/decode throughput of FrameCodec against a byte-at-a-time decoder.", bench_framing },
+    { "crc", "[total_bytes] [chunk_size] - Measure CRC-8/16/32 throughput of slicing-by-8 against one-table bytewise and bitwise computation.", bench_crc },
+    { "lines", "[total_bytes] [line_length] [chunk_size] - Measure LineSplitter throughput against appending one byte at a time.", bench_lines },
+    { "crlf", "[total_bytes] [chunk_size] - Measure CrlfNormalizer throughput against the former per-character ostringstream conversion.", bench_crlf },
+    { "format", "[iterations] - Measure printf-style formatting through the thread-local buffer against the former two-pass snprintf into a vector.", bench_format },
+    { "hexdump", "[total_bytes] [chunk_size] - Measure HexDumper throughput against formatting each byte with snprintf(\"%02X \").", bench_hexdump },
+    { "output", "[total_bytes] [chunk_size] - Measure OutputBuffer write calls and throughput against writing every chunk, and the delay of sparse (interactive) writes.", bench_output },
+    { "output_stall", "[stall_ms] - Measure how long a fixed-rate producer is held up by a stalled console with each OutputBuffer overflow policy.", bench_output_stall },
+#ifndef _WIN32
+    { "engine", "pty_count [total_bytes] [thread_count] - Compare receiving from many ptys with PortEngine and with a streaming thread per port.", bench_engine },
+    { "bridge", "[total_bytes] [timeout_millis] - Measure bidirectional throughput and added latency of PortBridge between two ptys.", bench_bridge },
+    { "backpressure", "[total_bytes] [rate_kib_s] - Send to a pty read at a limited rate, comparing blocking enqueue with waiting for SendQueue writable notifications.", bench_backpressure },
+    { "modbus", "[slave_count] [cycles] [register_count] [baudrate] - Measure Modbus RTU polling cycle time against simulated slaves on a pty, ending responses by length or by t3.5 gap.", bench_modbus },
+    { "transaction", "[count] [delay_us] [baudrate] - Compare send-then-receive loops with TransactionEngine at several outstanding request counts against a simulated line-protocol device on a pty.", bench_transaction },
+#endif
+#ifdef _WIN32
+    { "app", "app_path app_port peer_port [count] [idle_seconds] - Measure keystroke-to-wire latency and idle CPU usage of the application.", bench_app },
+#endif
+};
+
+int main(int ac, char** av)
+{
+    int name_index = 1;
+    if ((ac > name_index) && (strcmp(av[name_index], "-json") == 0)) {
+        OutputFormat = ResultFormatJson;
+        name_index++;
+    }
+    if (ac <= name_index) {
+        print_usage(av[0]);
+        return EXIT_FAILURE;
+    }
+
+    const char* name = av[name_index];
+    auto it = std::find_if(BenchmarkEntries.begin(), BenchmarkEntries.end(),
+        [name](const BenchmarkEntry& entry) { return strcmp(name, entry.name) == 0; });
+    if (it == BenchmarkEntries.end()) {
+        print_usage(av[0]);
+        return EXIT_FAILURE;
+    }
+
+    arg_t args;
+    for (int i = name_index + 1; i < ac; i++) {
+        args.push_back(std::string(av[i]));
+    }
+    try {
+        return (*it).proc(args);
+    }
+    catch (std::exception& e) {
+        fprintf(stderr, "%s\n", e.what());
+        return EXIT_FAILURE;
+    }
+}
+
+/**
+ * 使用方法を表示する。
+ *
+ * @param pname プログラム名
+ */
+static void print_usage(const char* pname) {
+    fprintf(stderr, "Usage:\n");
+    for (auto& entry : BenchmarkEntries) {
+        fprintf(stderr, "  %s [-json] %s %s\n", pname, entry.name, entry.usage);
+    }
+}
+
+void ResultRecord::print(void) const {
+    std::string line;
+    if (OutputFormat == ResultFormatJson) {
+        line = format("{\"benchmark\":\"%s\",\"time\":%lld", escape_json(m_benchmark).c_str(),
+            static_cast<long long>(time(nullptr)));
+        for (const Field& field : m_fields) {
+            if (field.is_string) {
+                line += format(",\"%s\":\"%s\"", escape_json(field.key).c_str(), escape_json(field.value).c_str());
+            }
+            else {
+                line += format(",\"%s\":%s", escape_json(field.key).c_str(), field.value.c_str());
+            }
+        }
+        line += "}";
+    }
+    else {
+        line = m_benchmark + ":";
+        for (const Field& field : m_fields) {
+            line += " " + field.key + "=" + field.value;
+        }
+    }
+    printf("%s\n", line.c_str());
+    fflush(stdout);
+}
+
+/**
+ * JSONの文字列として出力できるようにエスケープする。
+ *
+ * @param s 文字列
+ * @retval エスケープした文字列
+ */
+static std::string escape_json(const std::string& s) {
+    std::string escaped;
+    for (char c : s) {
+        if ((c == '"') || (c == '\\')) {
+            escaped += '\\';
+            escaped += c;
+        }
+        else if (static_cast<unsigned char>(c) < 0x20) {
+            escaped += format("\\u%04x", static_cast<unsigned int>(c));
+        }
+        else {
+            escaped += c;
+        }
+    }
+    return escaped;
+}
+
+/**
+ * 昇順に整列済みの値からパーセンタイル値を得る(最近傍順位法)。
+ *
+ * @param sorted_values 昇順に整列済みの値
+ * @param percent パーセント(0より大きく100以下)
+ * @retval パーセンタイル値 (値が無い場合は0)
+ */
+static double get_percentile(const std::vector<double>& sorted_values, double percent) {
+    if (sorted_values.empty()) {
+        return 0.0;
+    }
+    size_t rank = static_cast<size_t>(std::ceil(percent / 100.0 * sorted_values.size()));
+    return sorted_values[(rank > 0) ? (std::min)(rank - 1, sorted_values.size() - 1) : 0];
+}
+
+/**
+ * プロセスが消費したCPU時間(ユーザー+カーネル)を得る。
+ *
+ * @retval CPU時間[秒]
+ */
+static double get_process_cpu_seconds(void) {
+#ifdef _WIN32
+    return get_process_cpu_seconds(GetCurrentProcess());
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0.0;
+    }
+    return static_cast<double>(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec)
+        + static_cast<double>(usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1000000.0;
+#endif
+}
+
+#ifdef _WIN32
+/**
+ * 指定プロセスが消費したCPU時間(ユーザー+カーネル)を得る。
+ *
+ * @param process プロセスハンドル
+ * @retval CPU時間[秒]
+ */
+static double get_process_cpu_seconds(HANDLE process) {
+    FILETIME creation_time, exit_time, kernel_time, user_time;
+    if (!GetProcessTimes(process, &creation_time, &exit_time, &kernel_time, &user_time)) {
+        return 0.0;
+    }
+    ULARGE_INTEGER kernel, user;
+    kernel.LowPart = kernel_time.dwLowDateTime;
+    kernel.HighPart = kernel_time.dwHighDateTime;
+    user.LowPart = user_time.dwLowDateTime;
+    user.HighPart = user_time.dwHighDateTime;
+    return static_cast<double>(kernel.QuadPart + user.QuadPart) / 10000000.0; // 100ns単位
+}
+#endif
+
+/**
+ * 無通信状態でreceive()を繰り返し、待機中のCPU使用率を計測する。
+ *
+ * @param args 引数 (ポート名, 計測時間[秒], receive()のタイムアウト[ミリ秒])
+ * @retval EXIT_SUCCESS 成功
+ * @retval EXIT_FAILURE 失敗
+ */
+static int bench_idle(const arg_t& args) {
+    if (args.size() < 1) {
+        fprintf(stderr, "Too few arguments.\n");
+        return EXIT_FAILURE;
+    }
+    uint32_t seconds = 10;
+    if ((args.size() >= 2) && !parse_ui32(args[1], &seconds)) {
+        fprintf(stderr, "Invalid seconds. [%s]\n", args[1].c_str());
+        return EXIT_FAILURE;
+    }
+    int32_t timeout_millis = 100;
+    if ((args.size() >= 3) && !parse_i32(args[2], &timeout_millis)) {
+        fprintf(stderr, "Invalid timeout. [%s]\n", args[2].c_str());
+        return EXIT_FAILURE;
+    }
+
+    SerialPort port(args[0]);
+    port.open();
+
+    uint8_t buf[256];
+    uint64_t call_count = 0;
+    uint64_t received = 0;
+    double cpu_begin = get_process_cpu_seconds();
+    auto begin = std::chrono::steady_clock::now();
+    auto end = begin + std::chrono::seconds(seconds);
+    while (std::chrono::steady_clock::now() < end) {
+        int result = port.receive(buf, sizeof(buf), timeout_millis);
+        if (result > 0) {
+            received += static_cast<uint64_t>(result);
+        }
+        call_count++;
+    }
+    double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    double cpu = get_process_cpu_seconds() - cpu_begin;
+    port.close();
+
+    ResultRecord("idle")
+        .add_string("port", args[0])
+        .add_integer("timeout_ms", timeout_millis)
+        .add_real("wall_s", wall)
+        .add_real("cpu_s", cpu)
+        .add_real("cpu_percent", (wall > 0.0) ? (cpu * 100.0 / wall) : 0.0, 2)
+        .add_integer("calls", static_cast<int64_t>(call_count))
+        .add_integer("bytes", static_cast<int64_t>(received))
+        .print();
+
+    return EXIT_SUCCESS;
+}
+
+/**
+ * ループバック計測の結果
+ */
+struct LoopbackResult {
+    uint64_t sent; // 送信したバイト数
+    uint64_t received; // 受信したバイト数
+    uint64_t mismatch; // 受信データの不一致数
+    uint64_t receive_calls; // receive()の呼び出し回数
+    uint64_t receive_timeouts; // receive()がタイムアウトした回数(SerialPortの入出力統計)
+    uint64_t wait_io_count; // I/O完了待ちの回数(SerialPortの入出力統計)
+    double wall; // 経過時間[秒]
+    double cpu; // プロセスのCPU時間[秒]
+    LoopbackResult(void)
+        : sent(0), received(0), mismatch(0), receive_calls(0), receive_timeouts(0), wait_io_count(0), wall(0.0), cpu(0.0) { }
+};
+
+/**
+ * ループバック接続したポートでchunk_sizeずつ送受信し、結果を得る。
+ * 受信は別スレッドからreceive(chunk_size, timeout_millis)を繰り返して行う。
+ * 1秒間受信が進まなかったら打ち切る。
+ *
+ * @param port オープン済みのポート
+ * @param total_bytes 総送信バイト数
+ * @param chunk_size 1回の送受信サイズ
+ * @param timeout_millis receive()のタイムアウト[ミリ秒]
+ * @retval 計測結果
+ */
+static LoopbackResult measure_loopback(SerialPort& port, uint32_t total_bytes, uint32_t chunk_size, int timeout_millis) {
+    std::vector<uint8_t> tx_data(chunk_size);
+    for (uint32_t i = 0; i < chunk_size; i++) {
+        tx_data[i] = static_cast<uint8_t>(i);
+    }
+    LoopbackResult result;
+    SerialPort::Statistics stats_begin = port.get_statistics();
+    std::thread receiver([&port, &result, total_bytes, chunk_size, timeout_millis]() {
+        std::vector<uint8_t> rx_buf(chunk_size);
+        auto last_progress = std::chrono::steady_clock::now();
+        while (result.received < total_bytes) {
+            uint32_t left = static_cast<uint32_t>(std::min<uint64_t>(chunk_size, total_bytes - result.received));
+            int length = port.receive(&rx_buf[0], left, timeout_millis);
+            result.receive_calls++;
+            if (length < 0) {
+                break;
+            }
+            else if (length == 0) {
+                if ((std::chrono::steady_clock::now() - last_progress) > std::chrono::seconds(1)) {
+                    break;
+                }
+                continue;
+            }
+            for (int i = 0; i < length; i++) {
+                if (rx_buf[i] != static_cast<uint8_t>((result.received + i) % chunk_size)) {
+                    result.mismatch++;
+                }
+            }
+            result.received += static_cast<uint64_t>(length);
+            last_progress = std::chrono::steady_clock::now();
+        }
+    });
+
+    double cpu_begin = get_process_cpu_seconds();
+    auto begin = std::chrono::steady_clock::now();
+    while (result.sent < total_bytes) {
+        uint32_t length = static_cast<uint32_t>(std::min<uint64_t>(chunk_size, total_bytes - result.sent));
+        int sent = port.send(&tx_data[0], length, 1000);
+        if (sent <= 0) {
+            break;
+        }
+        result.sent += static_cast<uint64_t>(sent);
+    }
+    receiver.join();
+    result.wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    result.cpu = get_process_cpu_seconds() - cpu_begin;
+    SerialPort::Statistics stats_end = port.get_statistics();
+    result.receive_timeouts = stats_end.receive_timeouts - stats_begin.receive_timeouts;
+    result.wait_io_count = stats_end.wait_io_count - stats_begin.wait_io_count;
+
+    return result;
+}
+
+/**
+ * ループバック計測の結果をレコードに追加する。
+ *
+ * @param record レコード
+ * @param result 計測結果
+ * @retval レコード
+ */
+static ResultRecord& add_loopback_result(ResultRecord& record, const LoopbackResult& result) {
+    double mib = result.received / (1024.0 * 1024.0);
+    return record
+        .add_integer("sent", static_cast<int64_t>(result.sent))
+        .add_integer("received", static_cast<int64_t>(result.received))
+        .add_integer("mismatch", static_cast<int64_t>(result.mismatch))
+        .add_integer("receive_calls", static_cast<int64_t>(result.receive_calls))
+        .add_integer("receive_timeouts", static_cast<int64_t>(result.receive_timeouts))
+        .add_integer("wait_io", static_cast<int64_t>(result.wait_io_count))
+        .add_real("wall_s", result.wall)
+        .add_real("throughput_kib_s", (result.wall > 0.0) ? (result.received / 1024.0 / result.wall) : 0.0, 1)
+        .add_real("cpu_s", result.cpu)
+        .add_real("cpu_ms_per_mib", (mib > 0.0) ? (result.cpu * 1000.0 / mib) : 0.0, 2);
+}
+
+/**
+ * ループバック接続したポートで送受信し、スループットを計測する。
+ * ポート名に"pty"を指定すると、疑似端末のループバックデバイスを使用する(POSIXのみ)。
+ *
+ * @param args 引数 (ポート名, 総送信バイト数, 1回の送信サイズ)
+ * @retval EXIT_SUCCESS 成功
+ * @retval EXIT_FAILURE 失敗
+ */
+static int bench_loopback(const arg_t& args) {
+    if (args.size() < 1) {
+        fprintf(stderr, "Too few arguments.\n");
+        return EXIT_FAILURE;
+    }
+    uint32_t total_bytes = 1024 * 1024;
+    if ((args.size() >= 2) && !parse_ui32(args[1], &total_bytes)) {
+        fprintf(stderr, "Invalid total bytes. [%s]\n", args[1].c_str());
+        return EXIT_FAILURE;
+    }
+    uint32_t chunk_size = 256;
+    if ((args.size() >= 3) && (!parse_ui32(args[2], &chunk_size) || (chunk_size == 0))) {
+        fprintf(stderr, "Invalid chunk size. [%s]\n", args[2].c_str());
+        return EXIT_FAILURE;
+    }
+
+    std::string port_name = args[0];
+#ifndef _WIN32
+    PtyPair pty;
+    if (port_name == "pty") {
+        pty.open();
+        pty.start_loopback();
+        port_name = pty.get_slave_name();
+    }
+#endif
+    SerialPort port(port_name);
+    port.set_baudrate(115200);
+    port.open();
+
+    LoopbackResult result = measure_loopback(port, total_bytes, chunk_size, 1000);
+    port.close();
+
+    ResultRecord record("loopback");
+    record.add_string("port", args[0]).add_integer("chunk", chunk_size);
+    add_loopback_result(record, result).print();
+
+    return ((result.received == total_bytes) && (result.mismatch == 0)) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/**
+ * 計測スイートを実行する。
+ * ループバック接続したポートで、送受信サイズとreceive()のタイムアウトの組み合わせごとにスループットと
+ * 1MiBあたりのCPU時間を計測し、続いて1バイトの往復遅延を繰り返し計測してパーセンタイル値を求める。
+ * ポート名に"pty"を指定すると、疑似端末のループバックデバイスを使用する(POSIXのみ)。
+ * 疑似端末の場合、CPU時間には折り返しスレッドの分も含まれる。
+ *
+ * @param args 引数 (ポート名, 組み合わせごとの総送信バイト数, 往復遅延の計測回数, ボーレート)
+ * @retval EXIT_SUCCESS 成功
+ * @retval EXIT_FAILURE 失敗
+ */
+static int bench_suite(const arg_t& args) {
+    if (args.size() < 1) {
+        fprintf(stderr, "Too few arguments.\n");
+        return EXIT_FAILURE;
+    }
+    uint32_t total_bytes = 256 * 1024;
+    if ((args.size() >= 2) && !parse_ui32(args[1], &total_bytes)) {
+        fprintf(stderr, "Invalid total bytes. [%s]\n", args[1].c_str());
+        return EXIT_FAILURE;
+    }
+    uint32_t rtt_count = 1000;
+    if ((args.size() >= 3) && (!parse_ui32(args[2], &rtt_count) || (rtt_count == 0))) {
+        fprintf(stderr, "Invalid round-trip count. [%s]\n", args[2].c_str());
+        return EXIT_FAILURE;
+    }
+    uint32_t baudrate = 115200;
+    if ((args.size() >= 4) && !parse_ui32(args[3], &baudrate)) {
+        fprintf(stderr, "Invalid baudrate. [%s]\n", args[3].c_str());
+        return EXIT_FAILURE;
+    }
+
+    std::string port_name = args[0];
+#ifndef _WIN32
+    PtyPair pty;
+    if (port_name == "pty") {
+        pty.open();
+        pty.start_loopback();
+        port_name = pty.get_slave_name();
+    }
+#endif
+    SerialPort port(port_name);
+    port.set_baudrate(baudrate);
+    port.open();
+
+    static const uint32_t ChunkSizes[] = { 1, 16, 256, 4096 };
+    static const int TimeoutMillis[] = { 0, 10, 100 };
+    bool is_succeeded = true;
+    for (uint32_t chunk_size : ChunkSizes) {
+        for (int timeout_millis : TimeoutMillis) {
+            LoopbackResult result = measure_loopback(port, total_bytes, chunk_size, timeout_millis);
+            ResultRecord record("suite.throughput");
+            record.add_string("port", args[0])
+                .add_integer("baudrate", baudrate)
+                .add_integer("chunk", chunk_size)
+                .add_integer("timeout_ms", timeout_millis);
+            add_loopback_result(record, result).print();
+            if ((result.received != total_bytes) || (result.mismatch != 0)) {
+                is_succeeded = false;
+            }
+        }
+    }
+
+    // 往復遅延
+    std::vector<double> latencies;
+    latencies.reserve(rtt_count);
+    double cpu_begin = get_process_cpu_seconds();
+    for (uint32_t i = 0; i < rtt_count; i++) {
+        uint8_t tx = static_cast<uint8_t>(i);
+        uint8_t rx;
+        auto begin = std::chrono::steady_clock::now();
+        if ((port.send(&tx, 1, 1000) != 1) || (port.receive(&rx, 1, 1000) != 1) || (rx != tx)) {
+            break;
+        }
+        latencies.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - begin).count());
+    }
+    double cpu = get_process_cpu_seconds() - cpu_begin;
+    port.close();
+
+    std::sort(latencies.begin(), latencies.end());
+    double sum = 0.0;
+    for (double latency : latencies) {
+        sum += latency;
+    }
+    ResultRecord("suite.rtt")
+        .add_string("port", args[0])
+        .add_integer("baudrate", baudrate)
+        .add_integer("count", static_cast<int64_t>(latencies.size()))
+        .add_real("min_us", latencies.empty() ? 0.0 : latencies.front(), 1)
+        .add_real("avg_us", latencies.empty() ? 0.0 : (sum / latencies.size()), 1)
+        .add_real("p50_us", get_percentile(latencies, 50.0), 1)
+        .add_real("p90_us", get_percentile(latencies, 90.0), 1)
+        .add_real("p99_us", get_percentile(latencies, 99.0), 1)
+        .add_real("p999_us", get_percentile(latencies, 99.9), 1)
+        .add_real("max_us", latencies.empty() ? 0.0 : latencies.back(), 1)
+        .add_real("cpu_us_per_rtt", latencies.empty() ? 0.0 : (cpu * 1000000.0 / latencies.size()), 1)
+        .print();
+    if (latencies.size() != rtt_count) {
+        is_succeeded = false;
+    }
+
+    return (is_succeeded) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/**
+ * ループバック接続したポートで送信し、ストリーム受信でのスループットと回線エラーの発生回数を計測する。
+ * ポート名に"pty"を指定すると、疑似端末のループバックデバイスを使用する(POSIXのみ)。
+ *
+ * @param args 引数 (ポート名, 総送信バイト数, バッファ数, バッファサイズ, ボーレート)
+ * @retval EXIT_SUCCESS 成功
+ * @retval EXIT_FAILURE 失敗
+ */
+static int bench_stream(const arg_t& args) {
+    if (args.size() < 1) {
+        fprintf(stderr, "Too few arguments.\n");
+        return EXIT_FAILURE;
+    }
+    uint32_t total_bytes = 1024 * 1024;
+    if ((args.size() >= 2) && !parse_ui32(args[1], &total_bytes)) {
+        fprintf(stderr, "Invalid total bytes. [%s]\n", args[1].c_str());
+        return EXIT_FAILURE;
+    }
+    uint32_t buffer_count = SerialPort::DefaultStreamBufferCount;
+    if ((args.size() >= 3) && (!parse_ui32(args[2], &buffer_count) || (buffer_count < 2))) {
+        fprintf(stderr, "Invalid buffer count. [%s]\n", args[2].c_str());
+        return EXIT_FAILURE;
+    }
+    uint32_t buffer_size = SerialPort::DefaultStreamBufferSize;
+    if ((args.size() >= 4) && (!parse_ui32(args[3], &buffer_size) || (buffer_size == 0))) {
+        fprintf(stderr, "Invalid buffer size. [%s]\n", args[3].c_str());
+        return EXIT_FAILURE;
+    }
+    uint32_t baudrate = 921600;
+    if ((args.size() >= 5) && !parse_ui32(args[4], &baudrate)) {
+        fprintf(stderr, "Invalid baudrate. [%s]\n", args[4].c_str());
+        return EXIT_FAILURE;
+    }
+
+    std::string port_name = args[0];
+#ifndef _WIN32
+    PtyPair pty;
+    if (port_name == "pty") {
+        pty.open();
+        pty.start_loopback();
+        port_name = pty.get_slave_name();
+    }
+#endif
+    SerialPort port(port_name);
+    port.set_baudrate(baudrate);
+    std::atomic<uint32_t> error_count(0);
+    port.set_error_handler([&error_count](uint32_t errors) {
+        (void)errors;
+        error_count++;
+    });
+    port.open();
+
+    std::mutex lock;
+    std::condition_variable cond;
+    uint64_t received = 0;
+    uint64_t mismatch = 0;
+    bool is_finished = false;
+    bool is_started = port.start_streaming([&](const uint8_t* data, uint32_t length) {
+        std::lock_guard<std::mutex> guard(lock);
+        if (data != nullptr) {
+            for (uint32_t i = 0; i < length; i++) {
+                if (data[i] != static_cast<uint8_t>((received + i) & 0xFF)) {
+                    mismatch++;
+                }
+            }
+            received += length;
+        }
+        if ((data == nullptr) || (received >= total_bytes)) {
+            is_finished = true;
+            cond.notify_all();
+        }
+    }, buffer_count, buffer_size);
+    if (!is_started) {
+        fprintf(stderr, "Could not start streaming.\n");
+        return EXIT_FAILURE;
+    }
+
+    std::vector<uint8_t> tx_data(4096);
+    for (size_t i = 0; i < tx_data.size(); i++) {
+        tx_data[i] = static_cast<uint8_t>(i & 0xFF);
+    }
+    double cpu_begin = get_process_cpu_seconds();
+    auto begin = std::chrono::steady_clock::now();
+    uint64_t sent = 0;
+    while (sent < total_bytes) {
+        uint32_t length = static_cast<uint32_t>(std::min<uint64_t>(tx_data.size(), total_bytes - sent));
+        int result = port.send(&tx_data[0], length, 1000);
+        if (result <= 0) {
+            break;
+        }
+        sent += static_cast<uint64_t>(result);
+    }
+    {
+        // 1秒間受信が進まなかったら打ち切る。
+        std::unique_lock<std::mutex> guard(lock);
+        uint64_t last_received = received;
+        while (!is_finished) {
+            if (!cond.wait_for(guard, std::chrono::seconds(1), [&is_finished]() { return is_finished; })
+                && (received == last_received)) {
+                break;
+            }
+            last_received = received;
+        }
+    }
+    double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    double cpu = get_process_cpu_seconds() - cpu_begin;
+    port.close();
+
+    ResultRecord("stream")
+        .add_string("port", args[0])
+        .add_integer("baudrate", baudrate)
+        .add_integer("buffer_count", buffer_count)
+        .add_integer("buffer_size", buffer_size)
+        .add_integer("sent", static_cast<int64_t>(sent))
+        .add_integer("received", static_cast<int64_t>(received))
+        .add_integer("mismatch", static_cast<int64_t>(mismatch))
+        .add_integer("line_errors", error_count)
+        .add_real("wall_s", wall)
+        .add_real("throughput_kib_s", (wall > 0.0) ? (received / 1024.0 / wall) : 0.0, 1)
+        .add_real("cpu_s", cpu)
+        .print();
+
+    return ((received == total_bytes) && (mismatch == 0)) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/**
+ * ループバック接続したポートへ小さなデータを繰り返し送信し、
+ * send()を直接呼び出した場合とSendQueueを使用した場合のスループットを比較する。
+ * 受信はストリーム受信で行う。
+ * ポート名に"pty"を指定すると、疑似端末のループバックデバイスを使用する(POSIXのみ)。
+ *
+ * @param args 引数 (ポート名, 総送信バイト数, 1回の送信サイズ)
+ * @retval EXIT_SUCCESS 成功
+ * @retval EXIT_FAILURE 失敗
+ */
+static int bench_send_queue(const arg_t& args) {
+    if (args.size() < 1) {
+        fprintf(stderr, "Too few arguments.\n");
+        return EXIT_FAILURE;
+    }
+    uint32_t total_bytes = 256 * 1024;
+    if ((args.size() >= 2) && !parse_ui32(args[1], &total_bytes)) {
+        fprintf(stderr, "Invalid total bytes. [%s]\n", args[1].c_str());
+        return EXIT_FAILURE;
+    }
+    uint32_t chunk_size = 16;
+    if ((args.size() >= 3) && (!parse_ui32(args[2], &chunk_size) || (chunk_size == 0))) {
+        fprintf(stderr, "Invalid chunk size. [%s]\n", args[2].c_str());
+        return EXIT_FAILURE;
+    }
+
+    std::string port_name = args[0];
+#ifndef _WIN32
+    PtyPair pty;
+    if (port_name == "pty") {
+        pty.open();
+        pty.start_loopback();
+        port_name = pty.get_slave_name();
+    }
+#endif
+    SerialPort port(port_name);
+    port.set_baudrate(115200);
+    port.open();
+
+    std::atomic<uint64_t> received(0);
+    if (!port.start_streaming([&received](const uint8_t* data, uint32_t length) {
+            if (data != nullptr) {
+                received += length;
+            }
+        })) {
+        fprintf(stderr, "Could not start streaming.\n");
+        return EXIT_FAILURE;
+    }
+
+    std::vector<uint8_t> tx_data(chunk_size, 'a');
+    bool is_succeeded = true;
+    for (int use_queue = 0; use_queue <= 1; use_queue++) {
+        SendQueue send_queue(port);
+        send_queue.start();
+        uint64_t received_begin = received;
+        double cpu_begin = get_process_cpu_seconds();
+        auto begin = std::chrono::steady_clock::now();
+        uint64_t sent = 0;
+        while (sent < total_bytes) {
+            uint32_t length = static_cast<uint32_t>(std::min<uint64_t>(chunk_size, total_bytes - sent));
+            int result = (use_queue != 0) ? send_queue.enqueue(&tx_data[0], length, 1000) : port.send(&tx_data[0], length, 1000);
+            if (result <= 0) {
+                break;
+            }
+            sent += static_cast<uint64_t>(result);
+        }
+        send_queue.flush(1000);
+        send_queue.stop();
+        // 送信した分を受信し終えるまで待つ。1秒間受信が進まなかったら打ち切る。
+        uint64_t last_received = received;
+        auto last_progress = std::chrono::steady_clock::now();
+        while ((received - received_begin) < sent) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            if (received != last_received) {
+                last_received = received;
+                last_progress = std::chrono::steady_clock::now();
+            }
+            else if ((std::chrono::steady_clock::now() - last_progress) > std::chrono::seconds(1)) {
+                break;
+            }
+        }
+        double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+        double cpu = get_process_cpu_seconds() - cpu_begin;
+        uint64_t pass_received = received - received_begin;
+
+        ResultRecord("sendqueue")
+            .add_string("port", args[0])
+            .add_string("mode", (use_queue != 0) ? "queue" : "direct")
+            .add_integer("chunk", chunk_size)
+            .add_integer("sent", static_cast<int64_t>(sent))
+            .add_integer("received", static_cast<int64_t>(pass_received))
+            .add_real("wall_s", wall)
+            .add_real("throughput_kib_s", (wall > 0.0) ? (pass_received / 1024.0 / wall) : 0.0, 1)
+            .add_real("cpu_s", cpu)
+            .print();
+        if ((sent != total_bytes) || (pass_received != sent)) {
+            is_succeeded = false;
+        }
+    }
+    port.close();
+
+    return (is_succeeded) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/**
+ * 複数のスレッドから同時にCaptureFileへ書き込み、スループットと1回の書き込みにかかる時間、捨てたレコード数を計測する。
+ * 受信スレッドが複数のポートのデータを記録する状況を模擬する。作成したファイルは計測後に削除する。
+ * 書き込み速度を指定すると、各スレッドはその速度になるよう書き込みの間隔をあける(0で無制限)。
+ * 無制限の場合、次のファイルの作成が間に合わずにレコードを捨てることがある。
+ *
+ * @param args 引数 (ベースパス, スレッド数, 1スレッドあたりの総書き込みバイト数, 1回の書き込みサイズ,
+ *                   1スレッドあたりの書き込み速度[KiB/s], 1ファイルのサイズ)
+ * @retval EXIT_SUCCESS 成功
+ * @retval EXIT_FAILURE 失敗
+ */
+static int bench_capture(const arg_t& args) {
+    if (args.size() < 1) {
+        fprintf(stderr, "Too few arguments.\n");
+        return EXIT_FAILURE;
+    }
+    uint32_t thread_count = 4;
+    if ((args.size() >= 2) && (!parse_ui32(args[1], &thread_count) || (thread_count == 0))) {
+        fprintf(stderr, "Invalid thread count. [%s]\n", args[1].c_str());
+        return EXIT_FAILURE;
+    }
+    uint32_t total_bytes = 64 * 1024 * 1024;
+    if ((args.size() >= 3) && !parse_ui32(args[2], &total_bytes)) {
+        fprintf(stderr, "Invalid total bytes. [%s]\n", args[2].c_str());
+        return EXIT_FAILURE;
+    }
+    uint32_t chunk_size = 4096;
+    if ((args.size() >= 4) && (!parse_ui32(args[3], &chunk_size) || (chunk_size == 0))) {
+        fprintf(stderr, "Invalid chunk size. [%s]\n", args[3].c_str());
+        return EXIT_FAILURE;
+    }
+    uint32_t rate_kib_s = 0;
+    if ((args.size() >= 5) && !parse_ui32(args[4], &rate_kib_s)) {
+        fprintf(stderr, "Invalid rate. [%s]\n", args[4].c_str());
+        return EXIT_FAILURE;
+    }
+    uint32_t file_size = 16 * 1024 * 1024;
+    if ((args.size() >= 6) && !parse_ui32(args[5], &file_size)) {
+        fprintf(stderr, "Invalid file size. [%s]\n", args[5].c_str());
+        return EXIT_FAILURE;
+    }
+
+    CaptureFile capture(args[0], file_size);
+    capture.open();
+    LatencyHistogram latency("capture.write");
+    std::vector<uint8_t> data(chunk_size);
+    for (size_t i = 0; i < data.size(); i++) {
+        data[i] = static_cast<uint8_t>(i & 0xFF);
+    }
+
+    double cpu_begin = get_process_cpu_seconds();
+    auto begin = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (uint32_t i = 0; i < thread_count; i++) {
+        threads.push_back(std::thread([&, i]() {
+            for (uint64_t written = 0; written < total_bytes; written += chunk_size) {
+                if (rate_kib_s > 0) {
+                    std::this_thread::sleep_until(begin + std::chrono::microseconds(written * 1000000 / (rate_kib_s * 1024ull)));
+                }
+                uint32_t length = static_cast<uint32_t>((std::min<uint64_t>)(chunk_size, total_bytes - written));
+                auto write_begin = std::chrono::steady_clock::now();
+                capture.write(static_cast<uint16_t>(i), CaptureFile::DirectionRx, &data[0], length, write_begin);
+                latency.record(write_begin, std::chrono::steady_clock::now());
+            }
+        }));
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    capture.close();
+    double cpu = get_process_cpu_seconds() - cpu_begin;
+
+    uint64_t file_count = capture.get_file_count();
+    for (uint64_t i = 0; i < file_count; i++) {
+        remove(CaptureFile::get_file_path(args[0], i).c_str());
+    }
+
+    ResultRecord("capture")
+        .add_integer("threads", thread_count)
+        .add_integer("chunk_size", chunk_size)
+        .add_integer("file_size", file_size)
+        .add_integer("rate_kib_s", rate_kib_s)
+        .add_integer("records", static_cast<int64_t>(capture.get_record_count()))
+        .add_integer("bytes", static_cast<int64_t>(capture.get_data_bytes()))
+        .add_integer("dropped", static_cast<int64_t>(capture.get_dropped_count()))
+        .add_integer("files", static_cast<int64_t>(file_count))
+        .add_real("wall_s", wall)
+        .add_real("throughput_mib_s", (wall > 0.0) ? (capture.get_data_bytes() / 1024.0 / 1024.0 / wall) : 0.0, 1)
+        .add_real("write_p50_us", latency.get_percentile(50.0) / 1000.0, 2)
+        .add_real("write_p99_us", latency.get_percentile(99.0) / 1000.0, 2)
+        .add_real("write_max_us", latency.get_max() / 1000.0, 1)
+        .add_real("cpu_s", cpu)
+        .print();
+
+    return EXIT_SUCCESS;
+}
+
+/**
+ * 一定間隔のタイムスタンプを付けたキャプチャファイルを作成し、SessionReplayerで再生する。
+ * 記録時の間隔(1倍速)と10倍速では予定時刻からの遅れを、待たずに再生した場合はスループットを計測する。
+ * 再生したデータは内容を検証する。
+ *
+ * @param args 引数 (ベースパス, レコード数, レコードの間隔[マイクロ秒], 1レコードのサイズ)
+ * @retval EXIT_SUCCESS 成功
+ * @retval EXIT_FAILURE 失敗
+ */
+static int bench_replay(const arg_t& args) {
+    if (args.size() < 1) {
+        fprintf(stderr, "Too few arguments.\n");
+        return EXIT_FAILURE;
+    }
+    uint32_t record_count = 2000;
+    if ((args.size() >= 2) && (!parse_ui32(args[1], &record_count) || (record_count == 0))) {
+        fprintf(stderr, "Invalid record count. [%s]\n", args[1].c_str());
+        return EXIT_FAILURE;
+    }
+    uint32_t interval_us = 1000;
+    if ((args.size() >= 3) && !parse_ui32(args[2], &interval_us)) {
+        fprintf(stderr, "Invalid interval. [%s]\n", args[2].c_str());
+        return EXIT_FAILURE;
+    }
+    uint32_t chunk_size = 64;
+    if ((args.size() >= 4) && (!parse_ui32(args[3], &chunk_size) || (chunk_size == 0))) {
+        fprintf(stderr, "Invalid chunk size. [%s]\n", args[3].c_str());
+        return EXIT_FAILURE;
+    }
+
+    uint64_t file_count;
+    {
+        CaptureFile capture(args[0], 4 * 1024 * 1024);
+        capture.open();
+        std::vector<uint8_t> data(chunk_size);
+        auto base = std::chrono::steady_clock::now();
+        for (uint32_t i = 0; i < record_count; i++) {
+            for (uint32_t j = 0; j < chunk_size; j++) {
+                data[j] = static_cast<uint8_t>((i + j) & 0xFF);
+            }
+            // 次のファイルの準備が間に合うよう、一杯になる前に少し待つ。
+            while (!capture.write(0, CaptureFile::DirectionRx, &data[0], chunk_size,
+                base + std::chrono::microseconds(static_cast<uint64_t>(i) * interval_us))) {
+                if (capture.get_dropped_count() > record_count) {
+                    fprintf(stderr, "Could not write capture file.\n");
+                    return EXIT_FAILURE;
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        }
+        capture.close();
+        file_count = capture.get_file_count();
+    }
+
+    int retval = EXIT_SUCCESS;
+    const double Speeds[] = { 1.0, 10.0, 0.0 };
+    for (double speed : Speeds) {
+        CaptureReader reader(args[0]);
+        reader.open();
+        SessionReplayer replayer(speed);
+        uint64_t mismatches = 0;
+        uint32_t index = 0;
+        double cpu_begin = get_process_cpu_seconds();
+        auto begin = std::chrono::steady_clock::now();
+        replayer.run(reader, [&](const CaptureReader::Record& record) {
+            for (size_t j = 0; j < record.data.size(); j++) {
+                if (record.data[j] != static_cast<uint8_t>((index + j) & 0xFF)) {
+                    mismatches++;
+                    break;
+                }
+            }
+            index++;
+            return true;
+        });
+        double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+        double cpu = get_process_cpu_seconds() - cpu_begin;
+        if ((mismatches > 0) || (replayer.get_record_count() != record_count)) {
+            retval = EXIT_FAILURE;
+        }
+
+        const LatencyHistogram& lateness = replayer.get_lateness();
+        ResultRecord("replay")
+            .add_real("speed", speed, 1)
+            .add_integer("chunk_size", chunk_size)
+            .add_integer("interval_us", interval_us)
+            .add_integer("files", static_cast<int64_t>(file_count))
+            .add_integer("records", static_cast<int64_t>(replayer.get_record_count()))
+            .add_integer("mismatches", static_cast<int64_t>(mismatches))
+            .add_real("wall_s", wall)
+            .add_real("records_per_s", (wall > 0.0) ? (replayer.get_record_count() / wall) : 0.0, 0)
+            .add_real("throughput_mib_s", (wall > 0.0) ? (replayer.get_data_bytes() / 1024.0 / 1024.0 / wall) : 0.0, 1)
+            .add_real("late_p50_us", lateness.get_percentile(50.0) / 1000.0, 1)
+            .add_real("late_p99_us", lateness.get_percentile(99.0) / 1000.0, 1)
+            .add_real("late_max_us", lateness.get_max() / 1000.0, 1)
+            .add_real("cpu_s", cpu)
+            .print();
+    }
+
+    for (uint64_t i = 0; i < file_count; i++) {
+        remove(CaptureFile::get_file_path(args[0], i).c_str());
+    }
+
+    return retval;
+}
+
+/**
+ * 1バイトずつ状態遷移してCOBS/SLIPを復号する(比較用)
+ */
+struct BytewiseDecoder {
+    FrameCodec::Protocol protocol; // フレーム形式
+    std::vector<uint8_t> frame; // 復号中のフレーム
+    uint32_t block_remaining; // COBS: 現在のブロックの残りバイト数
+    bool is_zero_pending; // COBS: 次のブロックの前に0x00を補うかどうか
+    bool is_escaped; // SLIP: 直前がエスケープかどうか
+    uint64_t frame_count; // 復号したフレーム数
+    uint64_t frame_bytes; // 復号したフレームの合計バイト数
+
+    explicit BytewiseDecoder(FrameCodec::Protocol p)
+        : protocol(p), block_remaining(0), is_zero_pending(false), is_escaped(false), frame_count(0), frame_bytes(0) { }
+
+    void feed(const uint8_t* data, size_t length) {
+        for (size_t i = 0; i < length; i++) {
+            uint8_t c = data[i];
+            if (protocol == FrameCodec::ProtocolCobs) {
+                if (c == 0x00) {
+                    complete();
+                }
+                else if (block_remaining == 0) {
+                    if (is_zero_pending) {
+                        frame.push_back(0x00);
+                    }
+                    block_remaining = c - 1u;
+                    is_zero_pending = (c != 0xFF);
+                }
+                else {
+                    frame.push_back(c);
+                    block_remaining--;
+                }
+            }
+            else {
+                if (is_escaped) {
+                    frame.push_back((c == 0xDC) ? 0xC0 : 0xDB);
+                    is_escaped = false;
+                }
+                else if (c == 0xC0) {
+                    complete();
+                }
+                else if (c == 0xDB) {
+                    is_escaped = true;
+                }
+                else {
+                    frame.push_back(c);
+                }
+            }
+        }
+    }
+
+    void complete(void) {
+        if (!frame.empty()) {
+            frame_count++;
+            frame_bytes += frame.size();
+        }
+        frame.clear();
+        block_remaining = 0;
+        is_zero_pending = false;
+    }
+};
+
+/**
+ * 乱数のフレームをCOBS/SLIPで符号化・復号するスループットを計測する。
+ * 復号はFrameCodec(区切りをまとめて検索する)と、1バイトずつ状態遷移する復号とを比較する。
+ * 受信データは4096バイトずつ渡す。
+ *
+ * @param args 引数 (総バイト数, 1フレームのバイト数)
+ * @retval EXIT_SUCCESS 成功
+ * @retval EXIT_FAILURE 失敗
+ */
+static int bench_framing(const arg_t& args) {
+    uint32_t total_bytes = 64 * 1024 * 1024;
+    if ((args.size() >= 1) && (!parse_ui32(args[0], &total_bytes) || (total_bytes == 0))) {
+        fprintf(stderr, "Invalid total bytes. [%s]\n", args[0].c_str());
+        return EXIT_FAILURE;
+    }
+    uint32_t frame_size = 256;
+    if ((args.size() >= 2) && (!parse_ui32(args[1], &frame_size) || (frame_size == 0))) {
+        fprintf(stderr, "Invalid frame size. [%s]\n", args[1].c_str());
+        return EXIT_FAILURE;
+    }
+    const size_t ChunkSize = 4096;
+
+    std::vector<uint8_t> frame(frame_size);
+    uint32_t seed = 12345;
+    for (size_t i = 0; i < frame.size(); i++) {
+        seed = seed * 1103515245 + 12345;
+        frame[i] = static_cast<uint8_t>(seed >> 16);
+    }
+    uint32_t frame_count = (std::max)(total_bytes / frame_size, 1u);
+
+    int retval = EXIT_SUCCESS;
+    const FrameCodec::Protocol Protocols[] = { FrameCodec::ProtocolCobs, FrameCodec::ProtocolSlip };
+    for (FrameCodec::Protocol protocol : Protocols) {
+        FrameCodec codec(protocol);
+        std::vector<uint8_t> encoded;
+        auto begin = std::chrono::steady_clock::now();
+        for (uint32_t i = 0; i < frame_count; i++) {
+            codec.encode(&frame[0], frame.size(), &encoded);
+        }
+        double encode_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+        uint64_t mismatches = 0;
+        codec.set_handler([&frame, &mismatches](const uint8_t* data, size_t length) {
+            if ((length != frame.size()) || (memcmp(data, &frame[0], length) != 0)) {
+                mismatches++;
+            }
+        });
+        begin = std::chrono::steady_clock::now();
+        for (size_t offset = 0; offset < encoded.size(); offset += ChunkSize) {
+            codec.feed(&encoded[offset], (std::min)(ChunkSize, encoded.size() - offset));
+        }
+        double decode_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+        BytewiseDecoder bytewise(protocol);
+        begin = std::chrono::steady_clock::now();
+        for (size_t offset = 0; offset < encoded.size(); offset += ChunkSize) {
+            bytewise.feed(&encoded[offset], (std::min)(ChunkSize, encoded.size() - offset));
+        }
+        double bytewise_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+        const FrameCodec::Statistics& stats = codec.get_statistics();
+        if ((mismatches > 0) || (stats.frames != frame_count) || (bytewise.frame_count != frame_count)
+            || (bytewise.frame_bytes != stats.frame_bytes)) {
+            retval = EXIT_FAILURE;
+        }
+        double wire_mib = encoded.size() / 1024.0 / 1024.0;
+        ResultRecord("framing")
+            .add_string("protocol", (protocol == FrameCodec::ProtocolCobs) ? "cobs" : "slip")
+            .add_integer("frame_size", frame_size)
+            .add_integer("frames", static_cast<int64_t>(stats.frames))
+            .add_integer("mismatches", static_cast<int64_t>(mismatches))
+            .add_integer("wire_bytes", static_cast<int64_t>(encoded.size()))
+            .add_real("encode_mib_s", (encode_s > 0.0) ? (wire_mib / encode_s) : 0.0, 1)
+            .add_real("decode_mib_s", (decode_s > 0.0) ? (wire_mib / decode_s) : 0.0, 1)
+            .add_real("bytewise_mib_s", (bytewise_s > 0.0) ? (wire_mib / bytewise_s) : 0.0, 1)
+            .print();
+    }
+
+    return retval;
+}
+
+/**
+ * 1ビットずつ計算するCRC(比較用)
+ *
+ * @param params CRCのパラメータ
+ * @param data データ
+ * @param length データのバイト数
+ * @retval CRC
+ */
+static uint32_t crc_bitwise(const Crc::Parameters& params, const uint8_t* data, size_t length) {
+    uint64_t top = 1ull << (params.width - 1);
+    uint64_t mask = (1ull << params.width) - 1;
+    uint64_t crc = params.init;
+    for (size_t i = 0; i < length; i++) {
+        uint32_t value = data[i];
+        if (params.is_reflected) {
+            uint32_t reflected = 0;
+            for (int bit = 0; bit < 8; bit++) {
+                reflected |= ((value >> bit) & 1u) << (7 - bit);
+            }
+            value = reflected;
+        }
+        crc ^= static_cast<uint64_t>(value) << (params.width - 8);
+        for (int bit = 0; bit < 8; bit++) {
+            crc = ((crc & top) != 0) ? ((crc << 1) ^ params.poly) : (crc << 1);
+        }
+        crc &= mask;
+    }
+    if (params.is_reflected) {
+        uint64_t reflected = 0;
+        for (uint32_t bit = 0; bit < params.width; bit++) {
+            reflected |= ((crc >> bit) & 1u) << (params.width - 1 - bit);
+        }
+        crc = reflected;
+    }
+    return static_cast<uint32_t>((crc ^ params.xorout) & mask);
+}
+
+/**
+ * 1バイトごとに1つの表を引いてCRCを計算する(比較用)
+ * 表は実行時に生成する。反射しない場合は上位ビットに詰めて32ビットで計算する。
+ */
+struct BytewiseCrc {
+    const Crc::Parameters& params; // CRCのパラメータ
+    uint32_t table[256]; // 表
+    uint32_t crc; // 計算途中の値
+
+    explicit BytewiseCrc(const Crc::Parameters& p) : params(p), table(), crc(0) {
+        uint32_t poly = 0;
+        if (params.is_reflected) {
+            for (uint32_t bit = 0; bit < params.width; bit++) {
+                poly |= ((params.poly >> bit) & 1u) << (params.width - 1 - bit);
+            }
+        }
+        else {
+            poly = params.poly << (32 - params.width);
+        }
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t value = (params.is_reflected) ? i : (i << 24);
+            for (int bit = 0; bit < 8; bit++) {
+                if (params.is_reflected) {
+                    value = ((value & 1) != 0) ? ((value >> 1) ^ poly) : (value >> 1);
+                }
+                else {
+                    value = ((value & 0x80000000u) != 0) ? ((value << 1) ^ poly) : (value << 1);
+                }
+            }
+            table[i] = value;
+        }
+        reset();
+    }
+
+    void reset(void) {
+        if (params.is_reflected) {
+            crc = 0;
+            for (uint32_t bit = 0; bit < params.width; bit++) {
+                crc |= ((params.init >> bit) & 1u) << (params.width - 1 - bit);
+            }
+        }
+        else {
+            crc = params.init << (32 - params.width);
+        }
+    }
+
+    void update(const uint8_t* data, size_t length) {
+        if (params.is_reflected) {
+            for (size_t i = 0; i < length; i++) {
+                crc = (crc >> 8) ^ table[(crc ^ data[i]) & 0xFF];
+            }
+        }
+        else {
+            for (size_t i = 0; i < length; i++) {
+                crc = (crc << 8) ^ table[(crc >> 24) ^ data[i]];
+            }
+        }
+    }
+
+    uint32_t get_value(void) const {
+        uint32_t mask = (params.width < 32) ? ((1u << params.width) - 1) : 0xFFFFFFFFu;
+        uint32_t value = (params.is_reflected) ? crc : (crc >> (32 - params.width));
+        return (value ^ params.xorout) & mask;
+    }
+};
+
+/**
+ * CRCのスループットを、Crc(slicing-by-8)、1バイトごとに1つの表を引く計算、1ビットずつの計算で比較する。
+ * データはchunk_sizeずつ渡す。1ビットずつの計算は遅いので、総バイト数の1/16だけ計算する。
+ * 全ての種類について確認用の値("123456789"のCRC)と、3つの計算の結果が一致することも確認する。
+ *
+ * @param args 引数 (総バイト数, 1回に渡すバイト数)
+ * @retval EXIT_SUCCESS 成功
+ * @retval EXIT_FAILURE 失敗
+ */
+static int bench_crc(const arg_t& args) {
+    uint32_t total_bytes = 64 * 1024 * 1024;
+    if ((args.size() >= 1) && (!parse_ui32(args[0], &total_bytes) || (total_bytes == 0))) {
+        fprintf(stderr, "Invalid total bytes. [%s]\n", args[0].c_str());
+        return EXIT_FAILURE;
+    }
+    uint32_t chunk_size = 4096;
+    if ((args.size() >= 2) && (!parse_ui32(args[1], &chunk_size) || (chunk_size == 0))) {
+        fprintf(stderr, "Invalid chunk size. [%s]\n", args[1].c_str());
+        return EXIT_FAILURE;
+    }
+
+    std::vector<uint8_t> data(total_bytes);
+    uint32_t seed = 12345;
+    for (size_t i = 0; i < data.size(); i++) {
+        seed = seed * 1103515245 + 12345;
+        data[i] = static_cast<uint8_t>(seed >> 16);
+    }
+    size_t bitwise_bytes = (std::max<size_t>)(data.size() / 16, 1);
+    const char* CheckData = "123456789";
+
+    int retval = EXIT_SUCCESS;
+    for (int i = 0; i < Crc::AlgorithmCount; i++) {
+        Crc::Algorithm algorithm = static_cast<Crc::Algorithm>(i);
+        const Crc::Parameters& params = Crc::get_parameters(algorithm);
+        bool is_check_ok = (Crc::compute(algorithm, CheckData, strlen(CheckData)) == params.check);
+
+        Crc crc(algorithm);
+        auto begin = std::chrono::steady_clock::now();
+        for (size_t offset = 0; offset < data.size(); offset += chunk_size) {
+            crc.update(&data[offset], (std::min<size_t>)(chunk_size, data.size() - offset));
+        }
+        uint32_t value = crc.get_value();
+        double sliced_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+        BytewiseCrc bytewise(params);
+        begin = std::chrono::steady_clock::now();
+        for (size_t offset = 0; offset < data.size(); offset += chunk_size) {
+            bytewise.update(&data[offset], (std::min<size_t>)(chunk_size, data.size() - offset));
+        }
+        uint32_t bytewise_value = bytewise.get_value();
+        double bytewise_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+        begin = std::chrono::steady_clock::now();
+        uint32_t bitwise_value = crc_bitwise(params, &data[0], bitwise_bytes);
+        double bitwise_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+        bool is_match = (value == bytewise_value) && (bitwise_value == Crc::compute(algorithm, &data[0], bitwise_bytes));
+        if (!is_check_ok || !is_match) {
+            retval = EXIT_FAILURE;
+        }
+
+        double mib = data.size() / 1024.0 / 1024.0;
+        double bitwise_mib = bitwise_bytes / 1024.0 / 1024.0;
+        ResultRecord("crc")
+            .add_string("algorithm", params.name)
+            .add_integer("chunk_size", chunk_size)
+            .add_string("check", is_check_ok ? "ok" : "ng")
+            .add_string("match", is_match ? "ok" : "ng")
+            .add_real("sliced_mib_s", (sliced_s > 0.0) ? (mib / sliced_s) : 0.0, 1)
+            .add_real("bytewise_mib_s", (bytewise_s > 0.0) ? (mib / bytewise_s) : 0.0, 1)
+            .add_real("bitwise_mib_s", (bitwise_s > 0.0) ? (bitwise_mib / bitwise_s) : 0.0, 1)
+            .print();
+    }
+
+    return retval;
+}
+
+/**
+ * CRLF区切りのテキストをLineSplitterで行に分割するスループットを、1バイトずつ行バッファに追加する方法と比較する。
+ * 行の長さはline_lengthを中心にばらつかせ、受信データはchunk_sizeずつ渡す。
+ *
+ * @param args 引数 (総バイト数, 平均の行の長さ, 1回に渡すバイト数)
+ * @retval EXIT_SUCCESS 成功
+ * @retval EXIT_FAILURE 失敗
+ */
+static int bench_lines(const arg_t& args) {
+    uint32_t total_bytes = 64 * 1024 * 1024;
+    if ((args.size() >= 1) && (!parse_ui32(args[0], &total_bytes) || (total_bytes == 0))) {
+        fprintf(stderr, "Invalid total bytes. [%s]\n", args[0].c_str());
+        return EXIT_FAILURE;
+    }
+    uint32_t line_length = 80;
+    if ((args.size() >= 2) && (!parse_ui32(args[1], &line_length) || (line_length < 2))) {
+        fprintf(stderr, "Invalid line length. [%s]\n", args[1].c_str());
+        return EXIT_FAILURE;
+    }
+    uint32_t chunk_size = 4096;
+    if ((args.size() >= 3) && (!parse_ui32(args[2], &chunk_size) || (chunk_size == 0))) {
+        fprintf(stderr, "Invalid chunk size. [%s]\n", args[2].c_str());
+        return EXIT_FAILURE;
+    }
+
+    std::vector<uint8_t> text;
+    text.reserve(total_bytes + line_length * 2);
+    uint64_t expected_lines = 0;
+    uint64_t expected_bytes = 0;
+    uint32_t seed = 12345;
+    while (text.size() < total_bytes) {
+        seed = seed * 1103515245 + 12345;
+        uint32_t length = (line_length / 2) + ((seed >> 16) % line_length);
+        for (uint32_t i = 0; i < length; i++) {
+            text.push_back(static_cast<uint8_t>(' ' + ((i + seed) % 95)));
+        }
+        text.push_back('\r');
+        text.push_back('\n');
+        expected_lines++;
+        expected_bytes += length;
+    }
+
+    // 1行の最大長は十分大きくして、区切りが発生しないようにする。
+    LineSplitter splitter(line_length * 4);
+    uint64_t lines = 0;
+    uint64_t line_bytes = 0;
+    splitter.set_handler([&lines, &line_bytes](const char*, size_t length, bool) {
+        lines++;
+        line_bytes += length;
+    });
+    auto begin = std::chrono::steady_clock::now();
+    for (size_t offset = 0; offset < text.size(); offset += chunk_size) {
+        splitter.feed(&text[offset], (std::min)(static_cast<size_t>(chunk_size), text.size() - offset));
+    }
+    double splitter_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+    uint64_t bytewise_lines = 0;
+    uint64_t bytewise_bytes = 0;
+    std::string line;
+    begin = std::chrono::steady_clock::now();
+    for (size_t offset = 0; offset < text.size(); offset += chunk_size) {
+        size_t end = (std::min)(offset + chunk_size, text.size());
+        for (size_t i = offset; i < end; i++) {
+            char c = static_cast<char>(text[i]);
+            if (c == '\n') {
+                bytewise_lines++;
+                bytewise_bytes += line.length();
+                line.clear();
+            }
+            else if (c != '\r') {
+                line += c;
+            }
+        }
+    }
+    double bytewise_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+    const LineSplitter::Statistics& stats = splitter.get_statistics();
+    double mib = text.size() / 1024.0 / 1024.0;
+    ResultRecord("lines")
+        .add_integer("line_length", line_length)
+        .add_integer("chunk_size", chunk_size)
+        .add_integer("lines", static_cast<int64_t>(lines))
+        .add_integer("carried_lines", static_cast<int64_t>(stats.carried_lines))
+        .add_real("splitter_mib_s", (splitter_s > 0.0) ? (mib / splitter_s) : 0.0, 1)
+        .add_real("bytewise_mib_s", (bytewise_s > 0.0) ? (mib / bytewise_s) : 0.0, 1)
+        .print();
+
+    bool is_matched = (lines == expected_lines) && (line_bytes == expected_bytes)
+        && (bytewise_lines == expected_lines) && (bytewise_bytes == expected_bytes);
+    return is_matched ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/**
+ * 以前のStandardIo::replace_CRLF()と同じ方法で改行コードをCR+LFに揃える(比較用)。
+ *
+ * @param str 文字列
+ * @retval 置換した文字列
+ */
+static std::string replace_CRLF_ostringstream(const std::string& str) {
+    std::ostringstream oss;
+
+    char prev = '\0';
+    for (auto c : str) {
+        if ((c != '\n') && (prev == '\r')) {
+            oss << '\n';
+        }
+        else if ((c == '\n') && (prev != '\r')) {
+            oss << '\r';
+        }
+        oss << c;
+        prev = c;
+    }
+    if (prev == '\r') {
+        oss << '\n';
+    }
+    return oss.str();
+}
+
+/**
+ * 改行コードをCR+LFに揃えるスループットを、CrlfNormalizerと以前のostringstreamによる変換とで比較する。
+ * 入力は改行無し、LF区切り、CR+LF区切りの3種類で、chunk_sizeずつ変換する。
+ * CrlfNormalizerの結果は、全体を一度に以前の方法で変換した結果と一致することを検証する。
+ *
+ * @param args 引数 (総バイト数, 1回に変換するバイト数)
+ * @retval EXIT_SUCCESS 成功
+ * @retval EXIT_FAILURE 失敗
+ */
+static int bench_crlf(const arg_t& args) {
+    uint32_t total_bytes = 16 * 1024 * 1024;
+    if ((args.size() >= 1) && (!parse_ui32(args[0], &total_bytes) || (total_bytes == 0))) {
+        fprintf(stderr, "Invalid total bytes. [%s]\n", args[0].c_str());
+        return EXIT_FAILURE;
+    }
+    uint32_t chunk_size = 256;
+    if ((args.size() >= 2) && (!parse_ui32(args[1], &chunk_size) || (chunk_size == 0))) {
+        fprintf(stderr, "Invalid chunk size. [%s]\n", args[1].c_str());
+        return EXIT_FAILURE;
+    }
+
+    const struct {
+        const char* name;
+        const char* newline;
+    } Inputs[] = {
+        { "none", "" },
+        { "lf", "\n" },
+        { "crlf", "\r\n" },
+    };
+    int retval = EXIT_SUCCESS;
+    for (auto& input : Inputs) {
+        std::string text;
+        text.reserve(total_bytes + 80);
+        while (text.size() < total_bytes) {
+            for (int i = 0; i < 72; i++) {
+                text.push_back(static_cast<char>(' ' + ((text.size() + i) % 95)));
+            }
+            text.append(input.newline);
+        }
+
+        CrlfNormalizer normalizer;
+        std::string normalized;
+        normalized.reserve(text.size() * 2);
+        auto begin = std::chrono::steady_clock::now();
+        for (size_t offset = 0; offset < text.size(); offset += chunk_size) {
+            size_t length;
+            const char* out = normalizer.normalize(&text[offset], (std::min)(static_cast<size_t>(chunk_size), text.size() - offset), &length);
+            normalized.append(out, length);
+        }
+        double normalizer_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+        uint64_t ostringstream_bytes = 0;
+        begin = std::chrono::steady_clock::now();
+        for (size_t offset = 0; offset < text.size(); offset += chunk_size) {
+            std::string chunk(text, offset, chunk_size);
+            const std::string out = replace_CRLF_ostringstream(chunk);
+            ostringstream_bytes += strlen(out.c_str());
+        }
+        double ostringstream_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+        bool is_matched = (normalized == replace_CRLF_ostringstream(text));
+        if (!is_matched) {
+            retval = EXIT_FAILURE;
+        }
+        double mib = text.size() / 1024.0 / 1024.0;
+        ResultRecord("crlf")
+            .add_string("input", input.name)
+            .add_integer("chunk_size", chunk_size)
+            .add_integer("bytes", static_cast<int64_t>(text.size()))
+            .add_integer("output_bytes", static_cast<int64_t>(normalized.size()))
+            .add_string("matched", is_matched ? "yes" : "no")
+            .add_real("normalizer_mib_s", (normalizer_s > 0.0) ? (mib / normalizer_s) : 0.0, 1)
+            .add_real("ostringstream_mib_s", (ostringstream_s > 0.0) ? (mib / ostringstream_s) : 0.0, 1)
+            .print();
+    }
+
+    return retval;
+}
+
+/**
+ * 以前のformat()と同じ方法で書式指定して文字列を生成する(比較用)。
+ * snprintfで長さを求め、vectorに生成してからstd::stringにコピーする。
+ *
+ * @param fmt フォーマット
+ * @param args パラメータ
+ * @retval 生成した文字列
+ */
+template <typename ... Args>
+static std::string format_two_pass(const char* fmt, Args ... args) {
+    size_t len = snprintf(nullptr, 0, fmt, args ...);
+    std::vector<char> buf(len + 1);
+    snprintf(&buf[0], len + 1, fmt, args ...);
+    return std::string(&buf[0], &buf[0] + len);
+}
+
+/**
+ * vformat_local()を可変引数で呼び出す(比較用)。
+ *
+ * @param pout_length 生成した文字列の長さを格納する変数
+ * @param fmt フォーマット
+ * @retval 生成した文字列
+ */
+static const char* format_local(size_t* pout_length, const char* fmt, ...) ATTRIBUTE_PRINTF(2, 3);
+static const char* format_local(size_t* pout_length, const char* fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    const char* str = vformat_local(pout_length, fmt, args);
+    va_end(args);
+    return str;
+}
+
+/**
+ * 受信スレッドの状態表示と同程度の書式指定を繰り返し、1回あたりの時間を比較する。
+ * 以前の2回snprintfしてvectorとstd::stringを確保する方法、format()、vformat_local()の3通りを測る。
+ *
+ * @param args 引数 (繰り返し回数)
+ * @retval EXIT_SUCCESS 成功
+ * @retval EXIT_FAILURE 失敗
+ */
+static int bench_format(const arg_t& args) {
+    uint32_t iterations = 1000000;
+    if ((args.size() >= 1) && (!parse_ui32(args[0], &iterations) || (iterations == 0))) {
+        fprintf(stderr, "Invalid iterations. [%s]\n", args[0].c_str());
+        return EXIT_FAILURE;
+    }
+
+    const char* Format = "[%s] received %u bytes (total %llu bytes, %u errors)\n";
+    const char* Name = "COM3";
+    uint64_t checksum[3] = { 0, 0, 0 };
+    double elapsed_s[3];
+
+    auto begin = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < iterations; i++) {
+        std::string str = format_two_pass(Format, Name, i & 0xFFF, static_cast<unsigned long long>(i) * 4096, i & 0x7);
+        checksum[0] += str.size();
+    }
+    elapsed_s[0] = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+    begin = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < iterations; i++) {
+        std::string str = format(Format, Name, i & 0xFFF, static_cast<unsigned long long>(i) * 4096, i & 0x7);
+        checksum[1] += str.size();
+    }
+    elapsed_s[1] = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+    begin = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < iterations; i++) {
+        size_t length = 0;
+        format_local(&length, Format, Name, i & 0xFFF, static_cast<unsigned long long>(i) * 4096, i & 0x7);
+        checksum[2] += length;
+    }
+    elapsed_s[2] = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+    bool is_matched = (checksum[0] == checksum[1]) && (checksum[0] == checksum[2]);
+    ResultRecord("format")
+        .add_integer("iterations", iterations)
+        .add_string("matched", is_matched ? "yes" : "no")
+        .add_real("two_pass_ns", elapsed_s[0] * 1e9 / iterations, 1)
+        .add_real("format_ns", elapsed_s[1] * 1e9 / iterations, 1)
+        .add_real("local_ns", elapsed_s[2] * 1e9 / iterations, 1)
+        .print();
+
+    return is_matched ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/**
+ * 以前の方法(1バイトずつsnprintf)でHexDumperと同じ形式の16進/ASCIIダンプを生成する(比較用)。
+ *
+ * @param data データ
+ * @param length データのバイト数
+ * @param offset データの先頭のオフセット
+ * @param ptext 生成した文字列を追加する変数
+ */
+static void hexdump_snprintf(const uint8_t* data, size_t length, size_t offset, std::string* ptext) {
+    std::string& text = *ptext;
+    for (size_t line = 0; line < length; line += HexDumper::BytesPerLine) {
+        size_t count = (std::min)(HexDumper::BytesPerLine, length - line);
+        char buf[16];
+        snprintf(buf, sizeof(buf), "%08X  ", static_cast<unsigned int>(offset + line));
+        text += buf;
+        for (size_t i = 0; i < HexDumper::BytesPerLine; i++) {
+            if (i < count) {
+                snprintf(buf, sizeof(buf), "%02X ", data[line + i]);
+                text += buf;
+            }
+            else {
+                text += "   ";
+            }
+            if (i == 7) {
+                text += " ";
+            }
+        }
+        text += " |";
+        for (size_t i = 0; i < count; i++) {
+            uint8_t c = data[line + i];
+            text += ((c >= 0x20) && (c < 0x7F)) ? static_cast<char>(c) : '.';
+        }
+        text += "|\n";
+    }
+}
+
+/**
+ * 16進/ASCIIダンプのスループットを、HexDumperと1バイトずつsnprintfで書式指定する方法とで比較する。
+ * 出力は書き出さずにバイト数だけを数える。
+ * 計測とは別に、先頭の64KiBで両者の出力が一致することを検証する。
+ *
+ * @param args 引数 (総バイト数, 1回にダンプするバイト数)
+ * @retval EXIT_SUCCESS 成功
+ * @retval EXIT_FAILURE 失敗
+ */
+static int bench_hexdump(const arg_t& args) {
+    uint32_t total_bytes = 16 * 1024 * 1024;
+    if ((args.size() >= 1) && (!parse_ui32(args[0], &total_bytes) || (total_bytes == 0))) {
+        fprintf(stderr, "Invalid total bytes. [%s]\n", args[0].c_str());
+        return EXIT_FAILURE;
+    }
+    uint32_t chunk_size = 4096;
+    if ((args.size() >= 2) && (!parse_ui32(args[1], &chunk_size) || (chunk_size == 0))) {
+        fprintf(stderr, "Invalid chunk size. [%s]\n", args[1].c_str());
+        return EXIT_FAILURE;
+    }
+
+    std::vector<uint8_t> data(total_bytes);
+    uint32_t seed = 12345;
+    for (auto& b : data) {
+        seed = (seed * 1103515245u) + 12345u;
+        b = static_cast<uint8_t>(seed >> 16);
+    }
+    auto now = std::chrono::steady_clock::now();
+
+    // 出力の検証
+    size_t verify_bytes = (std::min)(data.size(), static_cast<size_t>(64 * 1024));
+    std::string expected;
+    std::string actual;
+    HexDumper verifier;
+    verifier.set_handler([&actual](const char* text, size_t length) { actual.append(text, length); });
+    for (size_t offset = 0; offset < verify_bytes; offset += chunk_size) {
+        size_t length = (std::min)(static_cast<size_t>(chunk_size), verify_bytes - offset);
+        verifier.feed(&data[offset], length, now);
+        hexdump_snprintf(&data[offset], length, offset, &expected);
+    }
+    bool is_matched = (actual == expected);
+
+    // HexDumper
+    HexDumper dumper;
+    uint64_t dumper_bytes = 0;
+    dumper.set_handler([&dumper_bytes](const char*, size_t length) { dumper_bytes += length; });
+    auto begin = std::chrono::steady_clock::now();
+    for (size_t offset = 0; offset < data.size(); offset += chunk_size) {
+        dumper.feed(&data[offset], (std::min)(static_cast<size_t>(chunk_size), data.size() - offset), now);
+    }
+    double dumper_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+    // 1バイトずつsnprintf
+    uint64_t snprintf_bytes = 0;
+    std::string text;
+    begin = std::chrono::steady_clock::now();
+    for (size_t offset = 0; offset < data.size(); offset += chunk_size) {
+        text.clear();
+        hexdump_snprintf(&data[offset], (std::min)(static_cast<size_t>(chunk_size), data.size() - offset), offset, &text);
+        snprintf_bytes += text.size();
+    }
+    double snprintf_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+    is_matched = is_matched && (dumper_bytes == snprintf_bytes);
+    double mib = data.size() / 1024.0 / 1024.0;
+    ResultRecord("hexdump")
+        .add_integer("bytes", total_bytes)
+        .add_integer("chunk_size", chunk_size)
+        .add_integer("output_bytes", static_cast<int64_t>(dumper_bytes))
+        .add_string("matched", is_matched ? "yes" : "no")
+        .add_real("dumper_mib_s", (dumper_s > 0.0) ? (mib / dumper_s) : 0.0, 1)
+        .add_real("snprintf_mib_s", (snprintf_s > 0.0) ? (mib / snprintf_s) : 0.0, 1)
+        .print();
+
+    return is_matched ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/**
+ * OutputBufferの効果を計測する。
+ * 書き出し先はバッファリングしないFILE*で開いたヌルデバイスとし、fwrite()1回がwrite()1回になるようにする。
+ * 連続出力: chunk_sizeずつtotal_bytesを書き込み、バッファリングしない場合とする場合とで書き出し回数とスループットを比較する。
+ * 対話的出力: 猶予時間より長い間隔で1バイトずつ書き込み、write()から書き出しまでの遅延の最大値を計測する。
+ *
+ * @param args 引数 (総バイト数, 1回に書き込むバイト数)
+ * @retval EXIT_SUCCESS 成功
+ * @retval EXIT_FAILURE 失敗
+ */
+static int bench_output(const arg_t& args) {
+    uint32_t total_bytes = 64 * 1024 * 1024;
+    if ((args.size() >= 1) && (!parse_ui32(args[0], &total_bytes) || (total_bytes == 0))) {
+        fprintf(stderr, "Invalid total bytes. [%s]\n", args[0].c_str());
+        return EXIT_FAILURE;
+    }
+    uint32_t chunk_size = 64;
+    if ((args.size() >= 2) && (!parse_ui32(args[1], &chunk_size) || (chunk_size == 0))) {
+        fprintf(stderr, "Invalid chunk size. [%s]\n", args[1].c_str());
+        return EXIT_FAILURE;
+    }
+
+#ifdef _WIN32
+    FILE* null_device = fopen("NUL", "wb");
+#else
+    FILE* null_device = fopen("/dev/null", "wb");
+#endif
+    if (null_device == nullptr) {
+        fprintf(stderr, "Could not open null device.\n");
+        return EXIT_FAILURE;
+    }
+    setvbuf(null_device, nullptr, _IONBF, 0);
+
+    std::atomic<int64_t> written_ns(0); // 最後に書き出した時刻(フラッシュスレッドからも書き込む)
+    auto writer = [null_device, &written_ns](const void* data, size_t length) {
+        written_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+        return fwrite(data, 1, length, null_device) == length;
+    };
+    std::vector<uint8_t> chunk(chunk_size, 'x');
+
+    // 連続出力
+    const struct {
+        const char* name;
+        size_t capacity;
+    } Policies[] = {
+        { "unbuffered", 0 },
+        { "buffered", OutputBuffer::DefaultCapacity },
+    };
+    for (auto& policy : Policies) {
+        OutputBuffer buffer(writer, policy.capacity);
+        buffer.start();
+        auto begin = std::chrono::steady_clock::now();
+        for (uint32_t written = 0; written < total_bytes; written += chunk_size) {
+            buffer.write(chunk.data(), chunk.size());
+        }
+        buffer.stop();
+        double elapsed_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+        OutputBuffer::Statistics stats = buffer.get_statistics();
+        ResultRecord("output")
+            .add_string("mode", "stream")
+            .add_string("policy", policy.name)
+            .add_integer("chunk_size", chunk_size)
+            .add_integer("requests", static_cast<int64_t>(stats.requests))
+            .add_integer("writes", static_cast<int64_t>(stats.writes))
+            .add_integer("bytes", static_cast<int64_t>(stats.bytes))
+            .add_real("mib_s", (elapsed_s > 0.0) ? (stats.bytes / 1024.0 / 1024.0 / elapsed_s) : 0.0, 1)
+            .print();
+    }
+
+    // 対話的出力
+    const uint32_t Interval = OutputBuffer::DefaultFlushDelayMillis * 2;
+    const int Count = 25;
+    OutputBuffer buffer(writer);
+    buffer.start();
+    double max_delay_us = 0.0;
+    for (int i = 0; i < Count; i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(Interval));
+        int64_t requested_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+        buffer.write("k", 1);
+        // 溜めた場合はフラッシュスレッドが猶予時間後に書き出すので、間隔の分だけ待ってから遅延を求める。
+        std::this_thread::sleep_for(std::chrono::milliseconds(Interval));
+        double delay_us = (written_ns - requested_ns) / 1000.0;
+        max_delay_us = (std::max)(max_delay_us, delay_us);
+    }
+    buffer.stop();
+    OutputBuffer::Statistics stats = buffer.get_statistics();
+    ResultRecord("output")
+        .add_string("mode", "interactive")
+        .add_integer("interval_ms", Interval)
+        .add_integer("requests", static_cast<int64_t>(stats.requests))
+        .add_integer("writes", static_cast<int64_t>(stats.writes))
+        .add_real("max_delay_us", max_delay_us, 1)
+        .print();
+
+    fclose(null_device);
+    return EXIT_SUCCESS;
+}
+
+/**
+ * 書き出し先(コンソール)が一時停止したときに、書き込む側(シリアルポートの受信スレッドに相当)が止められる時間を計測する。
+ * 書き出し関数は最初の呼び出しでstall_ms停止し、以降は直ちに戻る。
+ * 書き込む側は1msごとに1KiBをstall_msの2倍の時間書き込み、write()にかかった時間の最大値を求める。
+ * 書き出しスレッドを使わない同期書き出しと、キューの上限を256KiBにしたblock/drop/spillの各動作とを比較する。
+ *
+ * @param args 引数 (停止時間[ミリ秒])
+ * @retval EXIT_SUCCESS 成功
+ * @retval EXIT_FAILURE 失敗
+ */
+static int bench_output_stall(const arg_t& args) {
+    uint32_t stall_ms = 500;
+    if ((args.size() >= 1) && (!parse_ui32(args[0], &stall_ms) || (stall_ms == 0))) {
+        fprintf(stderr, "Invalid stall time. [%s]\n", args[0].c_str());
+        return EXIT_FAILURE;
+    }
+
+    const struct {
+        const char* name;
+        bool is_async;
+        OutputBuffer::OverflowPolicy policy;
+    } Policies[] = {
+        { "sync", false, OutputBuffer::OverflowBlock },
+        { "block", true, OutputBuffer::OverflowBlock },
+        { "drop", true, OutputBuffer::OverflowDrop },
+        { "spill", true, OutputBuffer::OverflowSpill },
+    };
+    const size_t QueueLimit = 256 * 1024;
+    const size_t ChunkSize = 1024;
+    std::vector<uint8_t> chunk(ChunkSize, 'x');
+    for (auto& policy : Policies) {
+        std::atomic<bool> is_stalled(false);
+        OutputBuffer buffer([stall_ms, &is_stalled](const void*, size_t) {
+            if (!is_stalled.exchange(true)) { // 最初の書き出し？
+                std::this_thread::sleep_for(std::chrono::milliseconds(stall_ms));
+            }
+            return true;
+        });
+        std::atomic<uint64_t> spilled(0);
+        buffer.set_overflow_policy(QueueLimit, policy.policy, [&spilled](const void*, size_t length) {
+            spilled += length;
+            return true;
+        });
+        if (policy.is_async) {
+            buffer.start();
+        }
+
+        double max_write_ms = 0.0;
+        auto begin = std::chrono::steady_clock::now();
+        auto next = begin;
+        for (uint32_t i = 0; i < (stall_ms * 2); i++) {
+            std::this_thread::sleep_until(next);
+            next += std::chrono::milliseconds(1);
+            auto write_begin = std::chrono::steady_clock::now();
+            buffer.write(chunk.data(), chunk.size());
+            double write_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - write_begin).count();
+            max_write_ms = (std::max)(max_write_ms, write_ms);
+        }
+        double producer_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+        buffer.stop();
+
+        OutputBuffer::Statistics stats = buffer.get_statistics();
+        ResultRecord("output_stall")
+            .add_string("policy", policy.name)
+            .add_integer("stall_ms", stall_ms)
+            .add_integer("requests", static_cast<int64_t>(stats.requests))
+            .add_integer("writes", static_cast<int64_t>(stats.writes))
+            .add_integer("written_bytes", static_cast<int64_t>(stats.bytes))
+            .add_integer("dropped_bytes", static_cast<int64_t>(stats.dropped_bytes))
+            .add_integer("spilled_bytes", static_cast<int64_t>(spilled.load()))
+            .add_integer("blocked", static_cast<int64_t>(stats.blocked))
+            .add_integer("queue_max", static_cast<int64_t>(stats.queue_max))
+            .add_real("max_write_ms", max_write_ms, 3)
+            .add_real("producer_s", producer_s, 3)
+            .print();
+    }
+
+    return EXIT_SUCCESS;
+}
+
+#ifndef _WIN32
+/**
+ * 読み出し速度を制限した疑似端末へSendQueueで送信し、送り手の待ち方による違いを計測する。
+ * blockingは従来の通信モードと同様にenqueue()の中で空きを待ち、notifyは書き込み可能通知を受けてからenqueue()する。
+ * いずれも送信キューの深さ(送信待ち+送信中)は容量の2倍で頭打ちになり、データを失わないことを確認する。
+ * notifyではenqueue()がブロックしないので、待っている間も他のイベント(モード切り替えなど)に応答できる。
+ *
+ * @param args 引数 (総送信バイト数, 読み出し速度[KiB/s])
+ * @retval EXIT_SUCCESS 成功
+ * @retval EXIT_FAILURE 失敗
+ */
+static int bench_backpressure(const arg_t& args) {
+    uint32_t total_bytes = 1024 * 1024;
+    if ((args.size() >= 1) && (!parse_ui32(args[0], &total_bytes) || (total_bytes == 0))) {
+        fprintf(stderr, "Invalid total bytes. [%s]\n", args[0].c_str());
+        return EXIT_FAILURE;
+    }
+    uint32_t rate_kib_s = 1024;
+    if ((args.size() >= 2) && (!parse_ui32(args[1], &rate_kib_s) || (rate_kib_s == 0))) {
+        fprintf(stderr, "Invalid rate. [%s]\n", args[1].c_str());
+        return EXIT_FAILURE;
+    }
+
+    const uint32_t ChunkSize = 4096;
+    std::vector<uint8_t> tx_data(total_bytes);
+    for (uint32_t i = 0; i < total_bytes; i++) {
+        tx_data[i] = static_cast<uint8_t>(i % 251);
+    }
+
+    bool is_succeeded = true;
+    const char* modes[] = { "blocking", "notify" };
+    for (const char* mode : modes) {
+        bool is_notify = (strcmp(mode, "notify") == 0);
+        PtyPair pty;
+        pty.open();
+        SerialPort port(pty.get_slave_name());
+        port.set_baudrate(921600);
+        port.open();
+
+        // 読み出し側: 1ミリ秒ごとに速度に見合う分だけ読み出し、内容を確認する。
+        std::atomic<uint64_t> received(0);
+        std::atomic<uint64_t> mismatches(0);
+        std::atomic<bool> is_reading(true);
+        std::thread reader([&]() {
+            std::vector<uint8_t> buf(64 * 1024);
+            size_t bytes_per_tick = (std::max)(static_cast<size_t>(rate_kib_s) * 1024 / 1000, static_cast<size_t>(1));
+            auto next = std::chrono::steady_clock::now();
+            uint64_t position = 0;
+            while (is_reading && (position < total_bytes)) {
+                std::this_thread::sleep_until(next);
+                next += std::chrono::milliseconds(1);
+                ssize_t result = read(pty.get_master_fd(), buf.data(), (std::min)(bytes_per_tick, buf.size()));
+                if (result <= 0) {
+                    continue;
+                }
+                for (ssize_t i = 0; i < result; i++) {
+                    if (buf[i] != static_cast<uint8_t>((position + i) % 251)) {
+                        mismatches++;
+                    }
+                }
+                position += static_cast<uint64_t>(result);
+                received = position;
+            }
+        });
+
+        SendQueue send_queue(port);
+        std::mutex notify_lock;
+        std::condition_variable notify_cond;
+        bool is_notified = false;
+        send_queue.set_writable_handler([&]() {
+            std::lock_guard<std::mutex> lock(notify_lock);
+            is_notified = true;
+            notify_cond.notify_all();
+        });
+        send_queue.start();
+
+        double max_enqueue_ms = 0.0;
+        double max_wait_ms = 0.0;
+        uint64_t notify_waits = 0;
+        uint64_t sent = 0;
+        auto begin = std::chrono::steady_clock::now();
+        while (sent < total_bytes) {
+            if (is_notify) {
+                auto wait_begin = std::chrono::steady_clock::now();
+                std::unique_lock<std::mutex> lock(notify_lock);
+                is_notified = false;
+                lock.unlock();
+                if (!send_queue.request_writable_notify()) {
+                    // Note: 実際の通信モードでは、ここでモード切り替えイベントなども合わせて待つ。
+                    lock.lock();
+                    notify_cond.wait(lock, [&]() { return is_notified; });
+                    lock.unlock();
+                    notify_waits++;
+                    double wait_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - wait_begin).count();
+                    max_wait_ms = (std::max)(max_wait_ms, wait_ms);
+                    continue;
+                }
+            }
+            uint32_t length = static_cast<uint32_t>((std::min<uint64_t>)(ChunkSize, total_bytes - sent));
+            auto enqueue_begin = std::chrono::steady_clock::now();
+            int result = send_queue.enqueue(&tx_data[sent], length);
+            double enqueue_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - enqueue_begin).count();
+            max_enqueue_ms = (std::max)(max_enqueue_ms, enqueue_ms);
+            if (result <= 0) {
+                break;
+            }
+            sent += static_cast<uint64_t>(result);
+        }
+        send_queue.flush();
+        // 送信した分を読み出し終えるまで待つ。
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+        while ((received < sent) && (std::chrono::steady_clock::now() < deadline)) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+        is_reading = false;
+        reader.join();
+        send_queue.stop();
+        SerialPort::Statistics port_stats = port.get_statistics();
+        port.close();
+
+        ResultRecord("backpressure")
+            .add_string("mode", mode)
+            .add_integer("rate_kib_s", rate_kib_s)
+            .add_integer("sent", static_cast<int64_t>(sent))
+            .add_integer("received", static_cast<int64_t>(received.load()))
+            .add_integer("mismatches", static_cast<int64_t>(mismatches.load()))
+            .add_integer("queue_depth_max", static_cast<int64_t>(send_queue.get_max_depth()))
+            .add_integer("queue_capacity", SendQueue::DefaultCapacity)
+            .add_integer("port_sends", static_cast<int64_t>(port_stats.send_calls))
+            .add_integer("port_queue_limit", SendQueue::DefaultPortQueueLimit)
+            .add_integer("notify_waits", static_cast<int64_t>(notify_waits))
+            .add_real("max_wait_ms", max_wait_ms, 3)
+            .add_real("max_enqueue_ms", max_enqueue_ms, 3)
+            .add_real("throughput_kib_s", (wall > 0.0) ? (received / 1024.0 / wall) : 0.0, 1)
+            .print();
+        if ((sent != total_bytes) || (received != sent) || (mismatches != 0)
+            || (send_queue.get_max_depth() > SendQueue::DefaultCapacity)
+            || ((port_stats.send_calls * SendQueue::DefaultPortQueueLimit) < sent)) { // 1回のsend()は送信キューの上限まで
+            is_succeeded = false;
+        }
+    }
+
+    return (is_succeeded) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/**
+ * 複数の疑似端末のマスター側から同時に送信し、スレーブ側を開いたポートで受信するスループットとCPU時間を、
+ * PortEngineで受信した場合と、ポートごとにストリーム受信した場合とで比較する。
+ * 送信データは0x00～0xFFの繰り返しで、受信側で内容を検証する。
+ *
+ * @param args 引数 (疑似端末の数, 1ポートあたりの総送信バイト数, PortEngineの受信スレッド数)
+ * @retval EXIT_SUCCESS 成功
+ * @retval EXIT_FAILURE 失敗
+ */
+static int bench_engine(const arg_t& args) {
+    if (args.size() < 1) {
+        fprintf(stderr, "Too few arguments.\n");
+        return EXIT_FAILURE;
+    }
+    uint32_t port_count;
+    if (!parse_ui32(args[0], &port_count) || (port_count == 0)) {
+        fprintf(stderr, "Invalid pty count. [%s]\n", args[0].c_str());
+        return EXIT_FAILURE;
+    }
+    uint32_t total_bytes = 256 * 1024;
+    if ((args.size() >= 2) && !parse_ui32(args[1], &total_bytes)) {
+        fprintf(stderr, "Invalid total bytes. [%s]\n", args[1].c_str());
+        return EXIT_FAILURE;
+    }
+    uint32_t thread_count = 1;
+    if ((args.size() >= 3) && (!parse_ui32(args[2], &thread_count) || (thread_count == 0))) {
+        fprintf(stderr, "Invalid thread count. [%s]\n", args[2].c_str());
+        return EXIT_FAILURE;
+    }
+
+    std::vector<uint8_t> tx_data(4096);
+    for (size_t i = 0; i < tx_data.size(); i++) {
+        tx_data[i] = static_cast<uint8_t>(i & 0xFF);
+    }
+
+    bool is_succeeded = true;
+    const char* modes[] = { "engine", "threads" };
+    for (const char* mode : modes) {
+        bool is_engine = (strcmp(mode, "engine") == 0);
+        std::vector<std::unique_ptr<PtyPair>> ptys;
+        std::vector<std::unique_ptr<SerialPort>> ports;
+        for (uint32_t i = 0; i < port_count; i++) {
+            ptys.push_back(std::make_unique<PtyPair>());
+            (*ptys.back()).open();
+            ports.push_back(std::make_unique<SerialPort>((*ptys.back()).get_slave_name()));
+            (*ports.back()).set_baudrate(921600);
+            (*ports.back()).open();
+        }
+
+        // 受信ハンドラはポートごとに1つのスレッドから呼び出されるので、ポートごとの状態は排他不要。
+        std::vector<uint64_t> received(port_count, 0);
+        std::atomic<uint64_t> total_received(0);
+        std::atomic<uint64_t> mismatch(0);
+        auto make_handler = [&](uint32_t index) {
+            return [&, index](const uint8_t* data, uint32_t length) {
+                if (data == nullptr) {
+                    return;
+                }
+                for (uint32_t i = 0; i < length; i++) {
+                    if (data[i] != static_cast<uint8_t>((received[index] + i) & 0xFF)) {
+                        mismatch++;
+                    }
+                }
+                received[index] += length;
+                total_received += length;
+            };
+        };
+
+        PortEngine engine;
+        if (is_engine) {
+            for (uint32_t i = 0; i < port_count; i++) {
+                engine.add_port(*ports[i], make_handler(i));
+            }
+            engine.start(thread_count);
+        }
+        else {
+            for (uint32_t i = 0; i < port_count; i++) {
+                (*ports[i]).start_streaming(make_handler(i));
+            }
+        }
+
+        double cpu_begin = get_process_cpu_seconds();
+        auto begin = std::chrono::steady_clock::now();
+
+        // 全ポートのマスター側へ順番に書き込む。
+        std::vector<uint64_t> sent(port_count, 0);
+        uint64_t expected = static_cast<uint64_t>(total_bytes) * port_count;
+        uint64_t total_sent = 0;
+        while (total_sent < expected) {
+            std::vector<struct pollfd> fds;
+            for (uint32_t i = 0; i < port_count; i++) {
+                if (sent[i] < total_bytes) {
+                    struct pollfd fd;
+                    fd.fd = (*ptys[i]).get_master_fd();
+                    fd.events = POLLOUT;
+                    fd.revents = 0;
+                    fds.push_back(fd);
+                }
+            }
+            if (poll(&fds[0], static_cast<nfds_t>(fds.size()), 1000) <= 0) {
+                break;
+            }
+            for (uint32_t i = 0, j = 0; i < port_count; i++) {
+                if (sent[i] >= total_bytes) {
+                    continue;
+                }
+                if ((fds[j++].revents & POLLOUT) == 0) {
+                    continue;
+                }
+                size_t offset = static_cast<size_t>(sent[i] % tx_data.size());
+                size_t length = (std::min<uint64_t>)(tx_data.size() - offset, total_bytes - sent[i]);
+                ssize_t result = write((*ptys[i]).get_master_fd(), &tx_data[offset], length);
+                if (result > 0) {
+                    sent[i] += static_cast<uint64_t>(result);
+                    total_sent += static_cast<uint64_t>(result);
+                }
+            }
+        }
+
+        // 1秒間受信が進まなかったら打ち切る。
+        uint64_t last_received = total_received;
+        auto last_progress = std::chrono::steady_clock::now();
+        while (total_received < total_sent) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            if (total_received != last_received) {
+                last_received = total_received;
+                last_progress = std::chrono::steady_clock::now();
+            }
+            else if ((std::chrono::steady_clock::now() - last_progress) >= std::chrono::seconds(1)) {
+                break;
+            }
+        }
+        double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+        double cpu = get_process_cpu_seconds() - cpu_begin;
+        uint32_t receive_threads = (is_engine) ? engine.get_thread_count() : port_count;
+        engine.stop();
+        for (auto& port : ports) {
+            (*port).close();
+        }
+
+        ResultRecord("engine")
+            .add_string("mode", mode)
+            .add_integer("ports", port_count)
+            .add_integer("receive_threads", receive_threads)
+            .add_integer("sent", static_cast<int64_t>(total_sent))
+            .add_integer("received", static_cast<int64_t>(total_received))
+            .add_integer("mismatch", static_cast<int64_t>(mismatch))
+            .add_real("wall_s", wall)
+            .add_real("throughput_kib_s", (wall > 0.0) ? (total_received / 1024.0 / wall) : 0.0, 1)
+            .add_real("cpu_s", cpu)
+            .print();
+        if ((total_received != expected) || (mismatch != 0)) {
+            is_succeeded = false;
+        }
+    }
+
+    return (is_succeeded) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/**
+ * 2つの疑似端末のスレーブ側を開いたポートをPortBridgeで中継し、
+ * 両方のマスター側から同時に送信して、対向のマスター側で受信するスループットと中継による追加遅延を計測する。
+ * 送信データは0x00～0xFFの繰り返しで、受信側で内容を検証する。
+ *
+ * @param args 引数 (1方向あたりの総送信バイト数, 中継の送信タイムアウト[ミリ秒])
+ * @retval EXIT_SUCCESS 成功
+ * @retval EXIT_FAILURE 失敗
+ */
+static int bench_bridge(const arg_t& args) {
+    uint32_t total_bytes = 1024 * 1024;
+    if ((args.size() >= 1) && !parse_ui32(args[0], &total_bytes)) {
+        fprintf(stderr, "Invalid total bytes. [%s]\n", args[0].c_str());
+        return EXIT_FAILURE;
+    }
+    int timeout_millis = -1;
+    uint32_t value;
+    if (args.size() >= 2) {
+        if (!parse_ui32(args[1], &value)) {
+            fprintf(stderr, "Invalid timeout. [%s]\n", args[1].c_str());
+            return EXIT_FAILURE;
+        }
+        timeout_millis = static_cast<int>(value);
+    }
+
+    PtyPair ptys[2];
+    std::unique_ptr<SerialPort> ports[2];
+    for (int i = 0; i < 2; i++) {
+        ptys[i].open();
+        ports[i] = std::make_unique<SerialPort>(ptys[i].get_slave_name());
+        (*ports[i]).set_baudrate(921600);
+        (*ports[i]).open();
+    }
+    PortBridge bridge(*ports[0], *ports[1], timeout_millis);
+    if (!bridge.start()) {
+        fprintf(stderr, "Could not start bridge.\n");
+        return EXIT_FAILURE;
+    }
+
+    std::vector<uint8_t> tx_data(4096);
+    for (size_t i = 0; i < tx_data.size(); i++) {
+        tx_data[i] = static_cast<uint8_t>(i & 0xFF);
+    }
+    std::vector<uint8_t> rx_data(4096);
+
+    // マスター側iから送信したデータは、対向のマスター側(1 - i)で受信する。
+    uint64_t sent[2] = { 0, 0 };
+    uint64_t received[2] = { 0, 0 };
+    uint64_t mismatch = 0;
+    double cpu_begin = get_process_cpu_seconds();
+    auto begin = std::chrono::steady_clock::now();
+    while ((received[0] < total_bytes) || (received[1] < total_bytes)) {
+        struct pollfd fds[2];
+        for (int i = 0; i < 2; i++) {
+            fds[i].fd = ptys[i].get_master_fd();
+            fds[i].events = static_cast<short>(POLLIN | ((sent[i] < total_bytes) ? POLLOUT : 0));
+            fds[i].revents = 0;
+        }
+        if (poll(fds, 2, 1000) <= 0) { // 1秒間進まなかったら打ち切る。
+            break;
+        }
+        for (int i = 0; i < 2; i++) {
+            if ((fds[i].revents & POLLOUT) != 0) {
+                size_t offset = static_cast<size_t>(sent[i] % tx_data.size());
+                size_t length = (std::min<uint64_t>)(tx_data.size() - offset, total_bytes - sent[i]);
+                ssize_t result = write(fds[i].fd, &tx_data[offset], length);
+                if (result > 0) {
+                    sent[i] += static_cast<uint64_t>(result);
+                }
+            }
+            if ((fds[i].revents & POLLIN) != 0) {
+                ssize_t result = read(fds[i].fd, &rx_data[0], rx_data.size());
+                uint64_t& count = received[1 - i];
+                for (ssize_t j = 0; j < result; j++) {
+                    if (rx_data[j] != static_cast<uint8_t>((count + j) & 0xFF)) {
+                        mismatch++;
+                    }
+                }
+                if (result > 0) {
+                    count += static_cast<uint64_t>(result);
+                }
+            }
+        }
+    }
+    double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    double cpu = get_process_cpu_seconds() - cpu_begin;
+    bridge.stop();
+
+    bool is_succeeded = (mismatch == 0);
+    const char* names[] = { "a_to_b", "b_to_a" };
+    for (int i = 0; i < 2; i++) {
+        PortBridge::Direction direction = static_cast<PortBridge::Direction>(i);
+        PortBridge::Statistics stats = bridge.get_statistics(direction);
+        const LatencyHistogram& latency = bridge.get_latency(direction);
+        ResultRecord("bridge")
+            .add_string("direction", names[i])
+            .add_integer("timeout_ms", timeout_millis)
+            .add_integer("sent", static_cast<int64_t>(sent[i]))
+            .add_integer("received", static_cast<int64_t>(received[i]))
+            .add_integer("mismatch", static_cast<int64_t>(mismatch))
+            .add_integer("forwarded", static_cast<int64_t>(stats.bytes))
+            .add_integer("chunks", static_cast<int64_t>(stats.chunks))
+            .add_integer("dropped", static_cast<int64_t>(stats.dropped_bytes))
+            .add_real("wall_s", wall)
+            .add_real("throughput_kib_s", (wall > 0.0) ? (received[i] / 1024.0 / wall) : 0.0, 1)
+            .add_real("latency_p50_us", latency.get_percentile(50.0) / 1000.0, 1)
+            .add_real("latency_p99_us", latency.get_percentile(99.0) / 1000.0, 1)
+            .add_real("latency_max_us", latency.get_max() / 1000.0, 1)
+            .add_real("cpu_s", cpu)
+            .print();
+        if (received[i] != total_bytes) {
+            is_succeeded = false;
+        }
+    }
+    for (auto& port : ports) {
+        (*port).close();
+    }
+
+    return (is_succeeded) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/**
+ * 疑似端末のModbusSlaveSimulatorに登録したスレーブを、ModbusRtuMasterのpoll()で繰り返しポーリングし、1周期の時間を計測する。
+ * 各スレーブの保持レジスタをregister_count個ずつ読み出す。シミュレータは要求と応答をbaudrateで送信する時間だけ応答を遅らせる。
+ * 応答の終わりを長さで判断する場合とt3.5の無通信で判断する場合を比較し、
+ * さらに応答しないスレーブアドレスを1つ加えた場合(タイムアウト5ミリ秒)も計測する。
+ * 計測の前に、書き込み、ブロードキャスト、例外応答が正しく処理できることを確認する。
+ *
+ * @param args 引数 (スレーブ数, 周期数, 読み出すレジスタ数, ボーレート)
+ * @retval EXIT_SUCCESS 成功
+ * @retval EXIT_FAILURE 失敗
+ */
+static int bench_modbus(const arg_t& args) {
+    uint32_t slave_count = 8;
+    if ((args.size() >= 1) && (!parse_ui32(args[0], &slave_count) || (slave_count == 0) || (slave_count > 246))) {
+        fprintf(stderr, "Invalid slave count. [%s]\n", args[0].c_str());
+        return EXIT_FAILURE;
+    }
+    uint32_t cycles = 100;
+    if ((args.size() >= 2) && (!parse_ui32(args[1], &cycles) || (cycles == 0))) {
+        fprintf(stderr, "Invalid cycles. [%s]\n", args[1].c_str());
+        return EXIT_FAILURE;
+    }
+    uint32_t register_count = 10;
+    if ((args.size() >= 3) && (!parse_ui32(args[2], &register_count) || (register_count == 0) || (register_count > ModbusRtu::MaxReadRegisters))) {
+        fprintf(stderr, "Invalid register count. [%s]\n", args[2].c_str());
+        return EXIT_FAILURE;
+    }
+    uint32_t baudrate = 115200;
+    if ((args.size() >= 4) && (!parse_ui32(args[3], &baudrate) || (baudrate == 0))) {
+        fprintf(stderr, "Invalid baudrate. [%s]\n", args[3].c_str());
+        return EXIT_FAILURE;
+    }
+    const uint16_t ScratchAddress = 200; // 書き込みの確認に使うアドレス(読み出す範囲とは重ならない)
+
+    PtyPair pty;
+    pty.open();
+    ModbusSlaveSimulator simulator(pty.get_master_fd());
+    for (uint32_t id = 1; id <= slave_count; id++) {
+        simulator.add_slave(static_cast<uint8_t>(id), 256);
+    }
+    simulator.set_baudrate(baudrate);
+    simulator.start();
+    SerialPort port(pty.get_slave_name());
+    port.set_baudrate(baudrate);
+    port.open();
+    ModbusRtuMaster master(port);
+    // 低いボーレートでも応答を送信し終わるまで待てるよう、応答の送信時間をタイムアウト時間に加える。
+    uint32_t char_micros = ModbusRtu::get_char_time_micros(baudrate, 8, false, 1);
+    uint32_t gap_micros = master.get_frame_gap_micros();
+    master.set_timeout(ModbusRtuMaster::DefaultTimeoutMillis + (char_micros * (5 + register_count * 2) + gap_micros) / 1000);
+
+    // 書き込み、ブロードキャスト、例外応答を確認する。
+    bool is_verified = true;
+    ModbusRtuMaster::Result result;
+    ModbusRtuMaster::Request write_request(1, ModbusRtu::FunctionWriteMultipleRegisters, ScratchAddress, 3);
+    write_request.values = { 0x1234, 0x5678, 0x9ABC };
+    uint16_t value = 0;
+    if ((master.execute(write_request, &result) != ModbusRtuMaster::StatusOk)
+        || !simulator.get_holding_register(1, ScratchAddress + 1, &value) || (value != 0x5678)) {
+        fprintf(stderr, "Write multiple registers failed. (status=%d)\n", static_cast<int>(result.status));
+        is_verified = false;
+    }
+    ModbusRtuMaster::Request broadcast_request(ModbusRtu::BroadcastAddress, ModbusRtu::FunctionWriteSingleRegister, ScratchAddress, 1);
+    broadcast_request.values = { 0xBEEF };
+    master.execute(broadcast_request, &result);
+    ModbusRtuMaster::Request read_request(static_cast<uint8_t>(slave_count), ModbusRtu::FunctionReadHoldingRegisters, ScratchAddress, 1);
+    if ((master.execute(read_request, &result) != ModbusRtuMaster::StatusOk) || (result.values.size() != 1) || (result.values[0] != 0xBEEF)) {
+        fprintf(stderr, "Broadcast write failed. (status=%d)\n", static_cast<int>(result.status));
+        is_verified = false;
+    }
+    ModbusRtuMaster::Request illegal_request(1, ModbusRtu::FunctionReadHoldingRegisters, 250, 10);
+    if ((master.execute(illegal_request, &result) != ModbusRtuMaster::StatusException)
+        || (result.exception_code != ModbusRtu::ExceptionIllegalDataAddress)) {
+        fprintf(stderr, "Exception response was not detected. (status=%d)\n", static_cast<int>(result.status));
+        is_verified = false;
+    }
+
+    /**
+     * 計測条件
+     */
+    struct ModbusCase {
+        const char* name; // 名前
+        ModbusRtuMaster::FrameDetection detection; // 応答フレームの終わりの判断方法
+        bool has_absent_slave; // 応答しないスレーブアドレスを加えるかどうか
+    };
+    const ModbusCase Cases[] = {
+        { "length", ModbusRtuMaster::FrameDetectionLength, false },
+        { "gap", ModbusRtuMaster::FrameDetectionGap, false },
+        { "length_absent", ModbusRtuMaster::FrameDetectionLength, true },
+    };
+    const uint32_t AbsentTimeoutMillis = 5;
+
+    // 要求と応答の送信時間とt3.5だけからなる、1周期の理論上の最短時間
+    double wire_ms = slave_count * (static_cast<double>(char_micros) * (8 + 5 + register_count * 2) + gap_micros * 2.0) / 1000.0;
+
+    int retval = (is_verified) ? EXIT_SUCCESS : EXIT_FAILURE;
+    for (const ModbusCase& test_case : Cases) {
+        std::vector<ModbusRtuMaster::Request> requests;
+        for (uint32_t id = 1; id <= slave_count; id++) {
+            requests.push_back(ModbusRtuMaster::Request(static_cast<uint8_t>(id), ModbusRtu::FunctionReadHoldingRegisters,
+                0, static_cast<uint16_t>(register_count)));
+        }
+        if (test_case.has_absent_slave) {
+            requests.push_back(ModbusRtuMaster::Request(static_cast<uint8_t>(slave_count + 1), ModbusRtu::FunctionReadHoldingRegisters,
+                0, static_cast<uint16_t>(register_count), AbsentTimeoutMillis));
+        }
+        master.set_frame_detection(test_case.detection);
+        master.reset_statistics();
+
+        uint64_t mismatches = 0;
+        auto handler = [&mismatches](size_t, const ModbusRtuMaster::Request& request, const ModbusRtuMaster::Result& result) {
+            if (result.status != ModbusRtuMaster::StatusOk) {
+                return;
+            }
+            for (size_t i = 0; i < result.values.size(); i++) {
+                if (result.values[i] != request.address + i) {
+                    mismatches++;
+                }
+            }
+        };
+        std::vector<double> cycle_times;
+        auto begin = std::chrono::steady_clock::now();
+        for (uint32_t i = 0; i < cycles; i++) {
+            auto cycle_begin = std::chrono::steady_clock::now();
+            master.poll(requests, handler);
+            cycle_times.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - cycle_begin).count());
+        }
+        double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+        std::sort(cycle_times.begin(), cycle_times.end());
+
+        const ModbusRtuMaster::Statistics& stats = master.get_statistics();
+        uint64_t errors = stats.exceptions + stats.crc_errors + stats.invalid_responses + stats.io_errors;
+        uint64_t expected_timeouts = (test_case.has_absent_slave) ? cycles : 0;
+        if ((stats.responses != static_cast<uint64_t>(slave_count) * cycles) || (stats.timeouts != expected_timeouts)
+            || (errors > 0) || (mismatches > 0)) {
+            retval = EXIT_FAILURE;
+        }
+        const LatencyHistogram& latency = master.get_latency();
+        ResultRecord("modbus")
+            .add_string("detection", test_case.name)
+            .add_integer("slaves", slave_count)
+            .add_integer("registers", register_count)
+            .add_integer("baudrate", baudrate)
+            .add_integer("cycles", cycles)
+            .add_integer("responses", static_cast<int64_t>(stats.responses))
+            .add_integer("timeouts", static_cast<int64_t>(stats.timeouts))
+            .add_integer("errors", static_cast<int64_t>(errors))
+            .add_integer("mismatches", static_cast<int64_t>(mismatches))
+            .add_real("wire_ms", wire_ms, 2)
+            .add_real("cycle_mean_ms", wall * 1000.0 / cycles, 2)
+            .add_real("cycle_p50_ms", get_percentile(cycle_times, 50.0), 2)
+            .add_real("cycle_p99_ms", get_percentile(cycle_times, 99.0), 2)
+            .add_real("request_p50_us", latency.get_percentile(50.0) / 1000.0, 1)
+            .add_real("request_p99_us", latency.get_percentile(99.0) / 1000.0, 1)
+            .add_real("polls_per_s", (wall > 0.0) ? (stats.responses / wall) : 0.0, 1)
+            .print();
+    }
+    port.close();
+    simulator.stop();
+
+    return retval;
+}
+
+/**
+ * 要求・応答トランザクションの処理速度を、送信してから受信するループとTransactionEngineで比較する。
+ * 疑似端末のマスター側で、"Q連番\n"の要求を受け取った順にdelay_us掛けて処理し、"A連番\r\n"を返す機器を模擬する。
+ * 要求と応答をbaudrateで送信する時間も模擬する(全二重なので、応答の送信中にも次の要求が届く)。baudrateが0の場合は模擬しない。
+ * TransactionEngineは同時に応答待ちにできる要求の数を変えて計測する。
+ *
+ * @param args 引数 (要求数, 機器の処理時間[マイクロ秒], ボーレート)
+ * @retval EXIT_SUCCESS 成功
+ * @retval EXIT_FAILURE 失敗
+ */
+static int bench_transaction(const arg_t& args) {
+    uint32_t count = 2000;
+    if ((args.size() >= 1) && (!parse_ui32(args[0], &count) || (count == 0) || (count > 99999999))) {
+        fprintf(stderr, "Invalid count. [%s]\n", args[0].c_str());
+        return EXIT_FAILURE;
+    }
+    uint32_t delay_micros = 100;
+    if ((args.size() >= 2) && !parse_ui32(args[1], &delay_micros)) {
+        fprintf(stderr, "Invalid delay. [%s]\n", args[1].c_str());
+        return EXIT_FAILURE;
+    }
+    uint32_t baudrate = 115200;
+    if ((args.size() >= 3) && !parse_ui32(args[2], &baudrate)) {
+        fprintf(stderr, "Invalid baudrate. [%s]\n", args[2].c_str());
+        return EXIT_FAILURE;
+    }
+    const size_t RequestLength = 10; // "Q" + 8桁 + "\n"
+    const size_t ResponseLength = 11; // "A" + 8桁 + "\r\n"
+    const uint32_t TimeoutMillis = 1000;
+    const uint32_t SilentTimeoutMillis = 20;
+
+    PtyPair pty;
+    pty.open();
+    int device_fd = pty.get_master_fd();
+
+    // 機器側: 受信スレッドで要求を1行ずつ取り出し、届いた時刻を付けて処理スレッドへ渡す。
+    // 処理スレッドは届いた順に処理して応答する。"S"で始まる要求には応答しない。
+    auto request_wire = std::chrono::microseconds((baudrate > 0) ? (RequestLength * 10 * 1000000ULL / baudrate) : 0);
+    auto response_wire = std::chrono::microseconds((baudrate > 0) ? (ResponseLength * 10 * 1000000ULL / baudrate) : 0);
+    std::mutex device_lock;
+    std::condition_variable device_changed;
+    std::deque<std::pair<std::string, std::chrono::steady_clock::time_point>> device_requests; // 要求と届いた時刻
+    std::atomic<bool> is_device_running(true);
+    std::thread device_receiver([&]() {
+        std::vector<uint8_t> buf(4096);
+        std::string pending;
+        auto arrival_time = std::chrono::steady_clock::now(); // 最後の要求を受信し終わった時刻
+        while (is_device_running) {
+            struct pollfd fds;
+            fds.fd = device_fd;
+            fds.events = POLLIN;
+            fds.revents = 0;
+            if (poll(&fds, 1, 100) <= 0) {
+                continue;
+            }
+            ssize_t result = read(device_fd, buf.data(), buf.size());
+            if (result <= 0) {
+                continue;
+            }
+            auto read_time = std::chrono::steady_clock::now();
+            pending.append(reinterpret_cast<const char*>(buf.data()), static_cast<size_t>(result));
+            size_t begin = 0;
+            size_t end;
+            while ((end = pending.find('\n', begin)) != std::string::npos) {
+                // 続けて届いた要求は回線上で順に並ぶので、前の要求を受信し終わってから送信時間だけ後に届く。
+                arrival_time = (std::max)(arrival_time, read_time) + request_wire;
+                {
+                    std::lock_guard<std::mutex> lock(device_lock);
+                    device_requests.push_back(std::make_pair(pending.substr(begin, end - begin), arrival_time));
+                }
+                device_changed.notify_one();
+                begin = end + 1;
+            }
+            pending.erase(0, begin);
+        }
+        device_changed.notify_one();
+    });
+    std::thread device_processor([&]() {
+        while (true) {
+            std::unique_lock<std::mutex> lock(device_lock);
+            device_changed.wait(lock, [&]() { return !is_device_running || !device_requests.empty(); });
+            if (device_requests.empty()) {
+                break;
+            }
+            std::string line = device_requests.front().first;
+            auto arrival_time = device_requests.front().second;
+            device_requests.pop_front();
+            lock.unlock();
+            if (line.empty() || (line[0] == 'S')) {
+                continue;
+            }
+            auto ready = (std::max)(arrival_time, std::chrono::steady_clock::now())
+                + std::chrono::microseconds(delay_micros) + response_wire;
+            std::this_thread::sleep_until(ready);
+            std::string response = "A" + line.substr(1) + "\r\n";
+            size_t written = 0;
+            while (is_device_running && (written < response.length())) {
+                ssize_t n = write(device_fd, response.data() + written, response.length() - written);
+                if (n > 0) {
+                    written += static_cast<size_t>(n);
+                }
+                else {
+                    std::this_thread::sleep_for(std::chrono::microseconds(100));
+                }
+            }
+        }
+    });
+
+    SerialPort port(pty.get_slave_name());
+    port.set_baudrate((baudrate > 0) ? baudrate : 921600);
+    port.open();
+    auto make_request = [](uint32_t seq, char* request, size_t size) {
+        snprintf(request, size, "Q%08u\n", seq);
+    };
+    auto is_expected = [](uint32_t seq, const uint8_t* response, size_t length) {
+        char expected[32];
+        snprintf(expected, sizeof(expected), "A%08u\r\n", seq);
+        return (length == ResponseLength) && (memcmp(response, expected, ResponseLength) == 0);
+    };
+
+    int retval = EXIT_SUCCESS;
+    double baseline_per_s = 0.0;
+
+    // 送信してから、応答のバイト数を受信し終わるまで待つループ
+    {
+        std::vector<double> latencies;
+        latencies.reserve(count);
+        uint64_t errors = 0;
+        char request[32];
+        uint8_t response[ResponseLength];
+        auto begin = std::chrono::steady_clock::now();
+        for (uint32_t seq = 0; seq < count; seq++) {
+            make_request(seq, request, sizeof(request));
+            auto start = std::chrono::steady_clock::now();
+            if (port.send(reinterpret_cast<const uint8_t*>(request), RequestLength, TimeoutMillis) != static_cast<int>(RequestLength)) {
+                errors++;
+                continue;
+            }
+            // Windowsのreceive()は受信済みのデータだけで戻るので、応答のバイト数に達するまで繰り返す。
+            size_t received = 0;
+            auto deadline = start + std::chrono::milliseconds(TimeoutMillis);
+            while (received < ResponseLength) {
+                auto remain = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+                if (remain <= 0) {
+                    break;
+                }
+                int result = port.receive(response + received, static_cast<uint32_t>(ResponseLength - received), static_cast<int>(remain));
+                if (result < 0) {
+                    break;
+                }
+                received += static_cast<size_t>(result);
+            }
+            latencies.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count());
+            if (!is_expected(seq, response, received)) {
+                errors++;
+            }
+        }
+        double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+        std::sort(latencies.begin(), latencies.end());
+        baseline_per_s = (wall > 0.0) ? (count / wall) : 0.0;
+        if (errors > 0) {
+            retval = EXIT_FAILURE;
+        }
+        ResultRecord("transaction")
+            .add_string("mode", "send_receive")
+            .add_integer("outstanding", 1)
+            .add_integer("count", count)
+            .add_integer("delay_us", delay_micros)
+            .add_integer("baudrate", baudrate)
+            .add_integer("errors", static_cast<int64_t>(errors))
+            .add_real("transactions_per_s", baseline_per_s, 1)
+            .add_real("speedup", 1.0, 2)
+            .add_real("latency_p50_us", get_percentile(latencies, 50.0), 1)
+            .add_real("latency_p99_us", get_percentile(latencies, 99.0), 1)
+            .print();
+    }
+
+    // 判断関数、決まったバイト数、タイムアウトの動作を確認する。
+    {
+        TransactionEngine engine(port);
+        engine.start();
+        char request[32];
+        std::vector<uint8_t> response;
+        uint64_t latency_micros = 0;
+        make_request(1, request, sizeof(request));
+        auto predicate = [&is_expected](const uint8_t* data, size_t length) {
+            if (length < ResponseLength) {
+                return 0;
+            }
+            return is_expected(1, data, ResponseLength) ? static_cast<int>(ResponseLength) : -static_cast<int>(ResponseLength);
+        };
+        if ((engine.execute(reinterpret_cast<const uint8_t*>(request), RequestLength,
+                TransactionEngine::Matcher::by_predicate(predicate), TimeoutMillis, &response) != TransactionEngine::StatusOk)
+            || !is_expected(1, response.data(), response.size())) {
+            fprintf(stderr, "Predicate matcher failed.\n");
+            retval = EXIT_FAILURE;
+        }
+        make_request(2, request, sizeof(request));
+        if ((engine.execute(reinterpret_cast<const uint8_t*>(request), RequestLength,
+                TransactionEngine::Matcher::by_length(ResponseLength), TimeoutMillis, &response) != TransactionEngine::StatusOk)
+            || !is_expected(2, response.data(), response.size())) {
+            fprintf(stderr, "Length matcher failed.\n");
+            retval = EXIT_FAILURE;
+        }
+        const char silent_request[] = "S\n";
+        if ((engine.execute(reinterpret_cast<const uint8_t*>(silent_request), strlen(silent_request),
+                TransactionEngine::Matcher::by_terminator("\r\n"), SilentTimeoutMillis, &response, &latency_micros) != TransactionEngine::StatusTimeout)
+            || (latency_micros < SilentTimeoutMillis * 1000)) {
+            fprintf(stderr, "Timeout was not detected. (latency=%llu us)\n", static_cast<unsigned long long>(latency_micros));
+            retval = EXIT_FAILURE;
+        }
+        engine.stop();
+    }
+
+    // TransactionEngineで、同時に応答待ちにできる要求の数を変えて処理する。
+    const uint32_t OutstandingCounts[] = { 1, 2, 4, 16 };
+    for (uint32_t outstanding : OutstandingCounts) {
+        TransactionEngine engine(port, outstanding);
+        if (!engine.start()) {
+            fprintf(stderr, "TransactionEngine::start() failed.\n");
+            retval = EXIT_FAILURE;
+            break;
+        }
+        TransactionEngine::Matcher matcher = TransactionEngine::Matcher::by_terminator("\r\n", 64);
+        std::atomic<uint64_t> errors(0);
+        char request[32];
+        auto begin = std::chrono::steady_clock::now();
+        for (uint32_t seq = 0; seq < count; seq++) {
+            make_request(seq, request, sizeof(request));
+            uint64_t id = engine.submit(reinterpret_cast<const uint8_t*>(request), RequestLength, matcher, TimeoutMillis,
+                [seq, &errors, &is_expected](const TransactionEngine::Completion& completion) {
+                if ((completion.status != TransactionEngine::StatusOk) || !is_expected(seq, completion.response, completion.length)) {
+                    errors++;
+                }
+            });
+            if (id == 0) {
+                errors++;
+            }
+        }
+        engine.wait_idle();
+        double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+        TransactionEngine::Statistics stats = engine.get_statistics();
+        engine.stop();
+        if ((errors > 0) || (stats.responses != count)) {
+            retval = EXIT_FAILURE;
+        }
+        double per_s = (wall > 0.0) ? (count / wall) : 0.0;
+        const LatencyHistogram& latency = engine.get_latency();
+        ResultRecord("transaction")
+            .add_string("mode", "engine")
+            .add_integer("outstanding", outstanding)
+            .add_integer("count", count)
+            .add_integer("delay_us", delay_micros)
+            .add_integer("baudrate", baudrate)
+            .add_integer("errors", static_cast<int64_t>(errors.load()))
+            .add_real("transactions_per_s", per_s, 1)
+            .add_real("speedup", (baseline_per_s > 0.0) ? (per_s / baseline_per_s) : 0.0, 2)
+            .add_real("latency_p50_us", latency.get_percentile(50.0) / 1000.0, 1)
+            .add_real("latency_p99_us", latency.get_percentile(99.0) / 1000.0, 1)
+            .add_integer("max_outstanding", static_cast<int64_t>(stats.max_outstanding))
+            .print();
+    }
+
+    port.close();
+    is_device_running = false;
+    device_receiver.join();
+    device_processor.join();
+
+    return retval;
+}
+#endif
+
+#ifdef _WIN32
+/**
+ * アプリケーション(ComPortCommunicationSample)を子プロセスとして起動し、
+ * 標準入力に書き込んでから対向ポートで受信するまでの遅延と、
+ * 無通信時のアプリケーションのCPU使用率を計測する。
+ * app_portとpeer_portはヌルモデムケーブルや仮想COMポートペアで接続しておくこと。
+ *
+ * @param args 引数 (アプリケーションのパス, アプリケーションが使うポート, 対向ポート, 計測回数, 無通信計測時間[秒])
+ * @retval EXIT_SUCCESS 成功
+ * @retval EXIT_FAILURE 失敗
+ */
+static int bench_app(const arg_t& args) {
+    if (args.size() < 3) {
+        fprintf(stderr, "Too few arguments.\n");
+        return EXIT_FAILURE;
+    }
+    uint32_t count = 1000;
+    if ((args.size() >= 4) && (!parse_ui32(args[3], &count) || (count == 0))) {
+        fprintf(stderr, "Invalid count. [%s]\n", args[3].c_str());
+        return EXIT_FAILURE;
+    }
+    uint32_t idle_seconds = 10;
+    if ((args.size() >= 5) && !parse_ui32(args[4], &idle_seconds)) {
+        fprintf(stderr, "Invalid idle seconds. [%s]\n", args[4].c_str());
+        return EXIT_FAILURE;
+    }
+
+    SerialPort peer(args[2]);
+    peer.set_baudrate(115200);
+    peer.open();
+
+    SECURITY_ATTRIBUTES sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.nLength = sizeof(sa);
+    sa.bInheritHandle = TRUE;
+    HANDLE stdin_read, stdin_write;
+    if (!CreatePipe(&stdin_read, &stdin_write, &sa, 0)) {
+        fprintf(stderr, "%s\n", get_windows_error_message(GetLastError()).c_str());
+        return EXIT_FAILURE;
+    }
+    SetHandleInformation(stdin_write, HANDLE_FLAG_INHERIT, 0);
+    HANDLE null_output = CreateFileA("NUL", GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, &sa, OPEN_EXISTING, 0, NULL);
+
+    STARTUPINFOA si;
+    memset(&si, 0, sizeof(si));
+    si.cb = sizeof(si);
+    si.dwFlags = STARTF_USESTDHANDLES;
+    si.hStdInput = stdin_read;
+    si.hStdOutput = null_output;
+    si.hStdError = null_output;
+    PROCESS_INFORMATION pi;
+    std::string command_line = format("\"%s\" %s", args[0].c_str(), args[1].c_str());
+    std::vector<char> command_line_buf(command_line.begin(), command_line.end());
+    command_line_buf.push_back('\0');
+    BOOL is_created = CreateProcessA(NULL, &command_line_buf[0], NULL, NULL, TRUE, 0, NULL, NULL, &si, &pi);
+    DWORD create_error = GetLastError();
+    CloseHandle(stdin_read);
+    CloseHandle(null_output);
+    if (!is_created) {
+        CloseHandle(stdin_write);
+        fprintf(stderr, "%s\n", get_windows_error_message(create_error).c_str());
+        return EXIT_FAILURE;
+    }
+
+    // アプリケーションがポートをオープンし、通信モードに入るのを待つ。
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+
+    std::vector<double> latencies;
+    latencies.reserve(count);
+    for (uint32_t i = 0; i < count; i++) {
+        uint8_t tx = static_cast<uint8_t>('0' + (i % 10));
+        DWORD written;
+        auto begin = std::chrono::steady_clock::now();
+        if (!WriteFile(stdin_write, &tx, 1, &written, NULL)) {
+            break;
+        }
+        uint8_t rx;
+        int result = peer.receive(&rx, 1, 1000);
+        if (result <= 0) { // 1秒間受信できなかったら打ち切る。
+            break;
+        }
+        latencies.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - begin).count());
+    }
+
+    double cpu_begin = get_process_cpu_seconds(pi.hProcess);
+    auto idle_begin = std::chrono::steady_clock::now();
+    std::this_thread::sleep_for(std::chrono::seconds(idle_seconds));
+    double idle_wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - idle_begin).count();
+    double idle_cpu = get_process_cpu_seconds(pi.hProcess) - cpu_begin;
+
+    CloseHandle(stdin_write);
+    TerminateProcess(pi.hProcess, 0);
+    WaitForSingleObject(pi.hProcess, INFINITE);
+    CloseHandle(pi.hThread);
+    CloseHandle(pi.hProcess);
+    peer.close();
+
+    if (latencies.empty()) {
+        fprintf(stderr, "No data received from %s.\n", args[2].c_str());
+        return EXIT_FAILURE;
+    }
+    std::sort(latencies.begin(), latencies.end());
+    double sum = 0.0;
+    for (double latency : latencies) {
+        sum += latency;
+    }
+    ResultRecord("app")
+        .add_string("port", args[1])
+        .add_string("peer", args[2])
+        .add_integer("count", count)
+        .add_integer("received", static_cast<int64_t>(latencies.size()))
+        .add_real("min_us", latencies.front(), 1)
+        .add_real("avg_us", sum / latencies.size(), 1)
+        .add_real("p50_us", get_percentile(latencies, 50.0), 1)
+        .add_real("p99_us", get_percentile(latencies, 99.0), 1)
+        .add_real("max_us", latencies.back(), 1)
+        .add_real("idle_wall_s", idle_wall)
+        .add_real("idle_cpu_s", idle_cpu)
+        .add_real("idle_cpu_percent", (idle_wall > 0.0) ? (idle_cpu * 100.0 / idle_wall) : 0.0, 2)
+        .print();
+
+    return (latencies.size() == count) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+#endif